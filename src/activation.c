@@ -0,0 +1,190 @@
+#include "config.h"
+
+#ifndef _WIN32
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "activation.h"
+#include "addr.h"
+#include "error.h"
+
+/*
+ * Defs
+ */
+
+// Far more than the two we use; anything past this is a bad environment.
+#define HSK_ACTIVATION_MAX_FDS 64
+
+/*
+ * Helpers
+ */
+
+static void
+hsk_activation_log(const char *fmt, ...) {
+  printf("activation: ");
+
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static bool
+hsk_activation_read_int(const char *str, long *value) {
+  if (!str || *str == '\0')
+    return false;
+
+  char *end;
+
+  errno = 0;
+
+  long n = strtol(str, &end, 10);
+
+  if (errno != 0 || *end != '\0' || n < 0)
+    return false;
+
+  *value = n;
+
+  return true;
+}
+
+// Whether the i-th socket in the colon-separated list has this name.
+static bool
+hsk_activation_name(const char *names, int i, const char *name) {
+  if (!names)
+    return false;
+
+  const char *s = names;
+
+  while (i > 0) {
+    s = strchr(s, ':');
+
+    if (!s)
+      return false;
+
+    s += 1;
+    i -= 1;
+  }
+
+  size_t len = strcspn(s, ":");
+
+  return strlen(name) == len && memcmp(s, name, len) == 0;
+}
+
+/*
+ * Activation
+ */
+
+int
+hsk_activation_listen_fds(int *ns_fd, int *rs_fd) {
+  if (!ns_fd || !rs_fd)
+    return HSK_EBADARGS;
+
+  *ns_fd = -1;
+  *rs_fd = -1;
+
+  long pid;
+  long count;
+
+  // Not for us: maybe meant for a parent that started us.
+  if (!hsk_activation_read_int(getenv("LISTEN_PID"), &pid)
+      || pid != (long)getpid()) {
+    return HSK_SUCCESS;
+  }
+
+  const char *names = getenv("LISTEN_FDNAMES");
+  int rc = HSK_SUCCESS;
+
+  if (!hsk_activation_read_int(getenv("LISTEN_FDS"), &count)
+      || count > HSK_ACTIVATION_MAX_FDS) {
+    hsk_activation_log("invalid LISTEN_FDS\n");
+    rc = HSK_EFAILURE;
+    goto done;
+  }
+
+  int i;
+
+  for (i = 0; i < count; i++) {
+    int fd = HSK_ACTIVATION_FD_START + i;
+
+    if (hsk_activation_name(names, i, "ns") && *ns_fd == -1)
+      *ns_fd = fd;
+    else if (hsk_activation_name(names, i, "rs") && *rs_fd == -1)
+      *rs_fd = fd;
+  }
+
+  if (*ns_fd == -1 && *rs_fd == -1) {
+    if (count > 0)
+      *ns_fd = HSK_ACTIVATION_FD_START;
+
+    if (count > 1)
+      *rs_fd = HSK_ACTIVATION_FD_START + 1;
+  }
+
+  for (i = 0; i < count; i++) {
+    int fd = HSK_ACTIVATION_FD_START + i;
+
+    if (fd != *ns_fd && fd != *rs_fd)
+      hsk_activation_log("ignoring socket on fd %d\n", fd);
+  }
+
+done:
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  unsetenv("LISTEN_FDNAMES");
+
+  return rc;
+}
+
+int
+hsk_activation_check(int fd, struct sockaddr *addr) {
+  if (fd < 0 || !addr)
+    return HSK_EBADARGS;
+
+  int type;
+  socklen_t len = sizeof(type);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0) {
+    hsk_activation_log("fd %d is not a socket: %s\n", fd, strerror(errno));
+    return HSK_EFAILURE;
+  }
+
+  if (type != SOCK_DGRAM) {
+    hsk_activation_log("fd %d is not a UDP socket\n", fd);
+    return HSK_EFAILURE;
+  }
+
+  struct sockaddr_storage ss;
+  socklen_t ss_len = sizeof(ss);
+
+  memset(&ss, 0, sizeof(ss));
+
+  if (getsockname(fd, (struct sockaddr *)&ss, &ss_len) != 0
+      || (ss.ss_family != AF_INET && ss.ss_family != AF_INET6)) {
+    hsk_activation_log("fd %d is not an IP socket\n", fd);
+    return HSK_EFAILURE;
+  }
+
+  if (!hsk_sa_copy(addr, (struct sockaddr *)&ss))
+    return HSK_EFAILURE;
+
+  int flags = fcntl(fd, F_GETFD);
+
+  if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)
+    return HSK_EFAILURE;
+
+  return HSK_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _HSK_ACTIVATION_H
+#define _HSK_ACTIVATION_H
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/*
+ * Defs
+ */
+
+// First fd passed by a service manager (after stdin, stdout and stderr).
+#define HSK_ACTIVATION_FD_START 3
+
+/*
+ * Activation
+ */
+
+// Sockets passed in by a service manager using the systemd protocol
+// (LISTEN_PID, LISTEN_FDS and optionally LISTEN_FDNAMES). Sockets named "ns"
+// and "rs" go to those nameservers; if none are named, the first is the ns
+// and the second the rs. Missing ones are set to -1. The variables are unset
+// so they are not passed on.
+int
+hsk_activation_listen_fds(int *ns_fd, int *rs_fd);
+
+// Check that the fd is a bound UDP socket and get its address. The fd is
+// marked close-on-exec.
+int
+hsk_activation_check(int fd, struct sockaddr *addr);
+
+#endif
+#endif
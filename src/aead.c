@@ -14,6 +14,10 @@
 #include "poly1305.h"
 #include "sha256.h"
 
+// Encrypt and authenticate in chunks, so each one is still in
+// L1 when poly1305 reads it back.
+#define HSK_AEAD_CHUNK 512
+
 void
 hsk_aead_init(hsk_aead_t *aead) {
   memset(&aead->chacha, 0, sizeof(hsk_chacha20_ctx));
@@ -51,6 +55,48 @@ hsk_aead_setup(hsk_aead_t *aead, const uint8_t *key, const uint8_t *iv) {
   aead->has_cipher = false;
 }
 
+void
+hsk_aead_key_init(hsk_aead_key_t *key, const uint8_t *raw) {
+  assert(key && raw);
+
+  hsk_chacha20_ctx ctx;
+  hsk_chacha20_keysetup(&ctx, raw, 32);
+
+  memcpy(key->schedule, ctx.schedule, sizeof(key->schedule));
+  memset(&ctx, 0, sizeof(hsk_chacha20_ctx));
+}
+
+void
+hsk_aead_setup_key(
+  hsk_aead_t *aead,
+  const hsk_aead_key_t *key,
+  const uint8_t *iv
+) {
+  assert(key && iv);
+
+  hsk_chacha20_ctx *ctx = &aead->chacha;
+
+  memcpy(ctx->schedule, key->schedule, sizeof(key->schedule));
+  hsk_chacha20_ivsetup(ctx, iv, 12);
+  ctx->available = 0;
+
+  // Block zero: the first half is the poly1305 key, the
+  // second half is thrown away.
+  uint32_t block[16];
+  hsk_chacha20_block(ctx, block);
+
+  memcpy(aead->poly_key, block, 32);
+  memset(block, 0, sizeof(block));
+
+  hsk_poly1305_init(&aead->poly, aead->poly_key);
+
+  assert(hsk_chacha20_counter_get(ctx) == 1);
+
+  aead->aad_len = 0;
+  aead->cipher_len = 0;
+  aead->has_cipher = false;
+}
+
 void
 hsk_aead_aad(hsk_aead_t *aead, const uint8_t *aad, size_t len) {
   assert(!aead->has_cipher);
@@ -68,11 +114,19 @@ hsk_aead_encrypt(
   if (!aead->has_cipher)
     hsk_aead_pad16(aead, aead->aad_len);
 
-  hsk_chacha20_encrypt(&aead->chacha, in, out, len);
-  hsk_poly1305_update(&aead->poly, out, len);
-
   aead->cipher_len += len;
   aead->has_cipher = true;
+
+  while (len > 0) {
+    size_t size = len < HSK_AEAD_CHUNK ? len : HSK_AEAD_CHUNK;
+
+    hsk_chacha20_encrypt(&aead->chacha, in, out, size);
+    hsk_poly1305_update(&aead->poly, out, size);
+
+    in += size;
+    out += size;
+    len -= size;
+  }
 }
 
 void
@@ -88,8 +142,16 @@ hsk_aead_decrypt(
   aead->cipher_len += len;
   aead->has_cipher = true;
 
-  hsk_poly1305_update(&aead->poly, in, len);
-  hsk_chacha20_encrypt(&aead->chacha, in, out, len);
+  while (len > 0) {
+    size_t size = len < HSK_AEAD_CHUNK ? len : HSK_AEAD_CHUNK;
+
+    hsk_poly1305_update(&aead->poly, in, size);
+    hsk_chacha20_encrypt(&aead->chacha, in, out, size);
+
+    in += size;
+    out += size;
+    len -= size;
+  }
 }
 
 void
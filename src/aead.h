@@ -10,6 +10,11 @@
 #include "chacha20.h"
 #include "poly1305.h"
 
+// ChaCha20 key words, expanded once and reused for every nonce.
+typedef struct hsk_aead_key_s {
+  uint32_t schedule[12];
+} hsk_aead_key_t;
+
 typedef struct hsk_aead_s {
   hsk_chacha20_ctx chacha;
   hsk_poly1305_ctx poly;
@@ -25,6 +30,17 @@ hsk_aead_init(hsk_aead_t *aead);
 void
 hsk_aead_setup(hsk_aead_t *aead, const uint8_t *key, const uint8_t *iv);
 
+void
+hsk_aead_key_init(hsk_aead_key_t *key, const uint8_t *raw);
+
+// Same as hsk_aead_setup(), without loading the key again.
+void
+hsk_aead_setup_key(
+  hsk_aead_t *aead,
+  const hsk_aead_key_t *key,
+  const uint8_t *iv
+);
+
 void
 hsk_aead_aad(hsk_aead_t *aead, const uint8_t *aad, size_t len);
 
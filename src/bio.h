@@ -415,6 +415,8 @@ static inline size_t
 write_bytes(uint8_t **data, const uint8_t *bytes, size_t size) {
   if (data == NULL || *data == NULL)
     return size;
+  if (size == 0)
+    return 0;
   memcpy(*data, bytes, size);
   *data += size;
   return size;
@@ -422,7 +424,7 @@ write_bytes(uint8_t **data, const uint8_t *bytes, size_t size) {
 
 static inline bool
 read_varint(uint8_t **data, size_t *data_len, uint64_t *value) {
-  if (data_len == 0)
+  if (*data_len == 0)
     return false;
 
   uint8_t prefix = (*data)[0];
@@ -491,7 +493,7 @@ read_varsize(uint8_t **data, size_t *data_len, size_t *value) {
   return true;
 }
 
-static inline bool
+static inline size_t
 size_varint(uint64_t value) {
   if (value < 0xfd)
     return 1;
@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
@@ -227,9 +228,231 @@ hsk_blake2b_compress(
     ctx->h[i] = ctx->h[i] ^ v[i] ^ v[i + 8];
 }
 
+void
+hsk_blake2b_256_block(void *out, const void *in, size_t inlen) {
+  uint8_t block[HSK_BLAKE2B_BLOCKBYTES];
+  uint8_t *o = (uint8_t *)out;
+  uint64_t m[16];
+  uint64_t v[16];
+  size_t i;
+
+  assert(inlen <= HSK_BLAKE2B_BLOCKBYTES);
+
+  memcpy(block, in, inlen);
+  memset(block + inlen, 0, HSK_BLAKE2B_BLOCKBYTES - inlen);
+
+  for (i = 0; i < 16; i++)
+    m[i] = load64(block + i * sizeof(m[i]));
+
+  // digest_length=32, fanout=1, depth=1
+  for (i = 0; i < 8; i++)
+    v[i] = hsk_blake2b_IV[i];
+
+  v[0] ^= 0x01010020ULL;
+
+  v[8] = hsk_blake2b_IV[0];
+  v[9] = hsk_blake2b_IV[1];
+  v[10] = hsk_blake2b_IV[2];
+  v[11] = hsk_blake2b_IV[3];
+  v[12] = hsk_blake2b_IV[4] ^ (uint64_t)inlen;
+  v[13] = hsk_blake2b_IV[5];
+  v[14] = ~hsk_blake2b_IV[6];
+  v[15] = hsk_blake2b_IV[7];
+
+  ROUND(0);
+  ROUND(1);
+  ROUND(2);
+  ROUND(3);
+  ROUND(4);
+  ROUND(5);
+  ROUND(6);
+  ROUND(7);
+  ROUND(8);
+  ROUND(9);
+  ROUND(10);
+  ROUND(11);
+
+  for (i = 0; i < 4; i++) {
+    uint64_t h = hsk_blake2b_IV[i] ^ (i == 0 ? 0x01010020ULL : 0);
+    store64(o + i * 8, h ^ v[i] ^ v[i + 8]);
+  }
+}
+
 #undef G
 #undef ROUND
 
+#if defined(__GNUC__)
+
+/*
+ * 4-lane single block BLAKE2b-256
+ */
+
+typedef uint64_t hsk_blake2b_u64x4 __attribute__((vector_size(32)));
+
+#define ROTR4(x, c) (((x) >> (c)) | ((x) << (64 - (c))))
+
+#define G4(r, i, a, b, c, d)                    \
+  do {                                          \
+    a = a + b + m[hsk_blake2b_sigma[r][2*i+0]]; \
+    d = ROTR4(d ^ a, 32);                       \
+    c = c + d;                                  \
+    b = ROTR4(b ^ c, 24);                       \
+    a = a + b + m[hsk_blake2b_sigma[r][2*i+1]]; \
+    d = ROTR4(d ^ a, 16);                       \
+    c = c + d;                                  \
+    b = ROTR4(b ^ c, 63);                       \
+  } while (0)
+
+#define ROUND4(r)                       \
+  do {                                  \
+    G4(r, 0, v[0], v[4], v[8], v[12]);  \
+    G4(r, 1, v[1], v[5], v[9], v[13]);  \
+    G4(r, 2, v[2], v[6], v[10], v[14]); \
+    G4(r, 3, v[3], v[7], v[11], v[15]); \
+    G4(r, 4, v[0], v[5], v[10], v[15]); \
+    G4(r, 5, v[1], v[6], v[11], v[12]); \
+    G4(r, 6, v[2], v[7], v[8], v[13]);  \
+    G4(r, 7, v[3], v[4], v[9], v[14]);  \
+  } while (0)
+
+// Compiled once for the baseline target and once for AVX2. Vectors never
+// cross a call boundary, so both copies share the same ABI.
+static inline __attribute__((always_inline)) void
+hsk_blake2b_256_x4_impl(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+) {
+  uint8_t block[4][HSK_BLAKE2B_BLOCKBYTES];
+  hsk_blake2b_u64x4 m[16];
+  hsk_blake2b_u64x4 v[16];
+  size_t i, j;
+
+  for (j = 0; j < 4; j++) {
+    assert(inlen[j] <= HSK_BLAKE2B_BLOCKBYTES);
+    memcpy(block[j], in[j], inlen[j]);
+    memset(block[j] + inlen[j], 0, HSK_BLAKE2B_BLOCKBYTES - inlen[j]);
+  }
+
+  for (i = 0; i < 16; i++) {
+    hsk_blake2b_u64x4 w = {
+      load64(block[0] + i * 8),
+      load64(block[1] + i * 8),
+      load64(block[2] + i * 8),
+      load64(block[3] + i * 8)
+    };
+    m[i] = w;
+  }
+
+  for (i = 0; i < 8; i++) {
+    uint64_t h = hsk_blake2b_IV[i] ^ (i == 0 ? 0x01010020ULL : 0);
+    hsk_blake2b_u64x4 x = { h, h, h, h };
+    hsk_blake2b_u64x4 y = {
+      hsk_blake2b_IV[i],
+      hsk_blake2b_IV[i],
+      hsk_blake2b_IV[i],
+      hsk_blake2b_IV[i]
+    };
+    v[i] = x;
+    v[i + 8] = y;
+  }
+
+  {
+    hsk_blake2b_u64x4 t = {
+      (uint64_t)inlen[0],
+      (uint64_t)inlen[1],
+      (uint64_t)inlen[2],
+      (uint64_t)inlen[3]
+    };
+    v[12] ^= t;
+    v[14] = ~v[14];
+  }
+
+  ROUND4(0);
+  ROUND4(1);
+  ROUND4(2);
+  ROUND4(3);
+  ROUND4(4);
+  ROUND4(5);
+  ROUND4(6);
+  ROUND4(7);
+  ROUND4(8);
+  ROUND4(9);
+  ROUND4(10);
+  ROUND4(11);
+
+  for (i = 0; i < 4; i++) {
+    uint64_t h = hsk_blake2b_IV[i] ^ (i == 0 ? 0x01010020ULL : 0);
+    hsk_blake2b_u64x4 x = v[i] ^ v[i + 8];
+
+    for (j = 0; j < 4; j++)
+      store64(out[j] + i * 8, h ^ x[j]);
+  }
+}
+
+#undef G4
+#undef ROUND4
+#undef ROTR4
+
+static void
+hsk_blake2b_256_x4_generic(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+) {
+  hsk_blake2b_256_x4_impl(out, in, inlen);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HSK_BLAKE2B_AVX2
+
+__attribute__((target("avx2"))) static void
+hsk_blake2b_256_x4_avx2(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+) {
+  hsk_blake2b_256_x4_impl(out, in, inlen);
+}
+#endif
+
+void
+hsk_blake2b_256_block_x4(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+) {
+#ifdef HSK_BLAKE2B_AVX2
+  static int has_avx2 = -1;
+
+  if (has_avx2 == -1)
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+  if (has_avx2) {
+    hsk_blake2b_256_x4_avx2(out, in, inlen);
+    return;
+  }
+#endif
+
+  hsk_blake2b_256_x4_generic(out, in, inlen);
+}
+
+#else
+
+void
+hsk_blake2b_256_block_x4(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+) {
+  size_t i;
+
+  for (i = 0; i < 4; i++)
+    hsk_blake2b_256_block(out[i], in[i], inlen[i]);
+}
+
+#endif
+
 int
 hsk_blake2b_update(hsk_blake2b_ctx *ctx, const void *pin, size_t inlen) {
   const unsigned char * in = (const unsigned char *)pin;
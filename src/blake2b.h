@@ -91,4 +91,17 @@ int hsk_blake2b(
   size_t keylen
 );
 
+// BLAKE2b-256 of a message that fits in a single block (inlen <= 128).
+// Skips the streaming state entirely: one compression with the parameter
+// block folded into the IV.
+void hsk_blake2b_256_block(void *out, const void *in, size_t inlen);
+
+// Four independent single block BLAKE2b-256 hashes, computed in parallel
+// lanes. Uses AVX2 when the CPU supports it.
+void hsk_blake2b_256_block_x4(
+  uint8_t *out[4],
+  const uint8_t *in[4],
+  const size_t inlen[4]
+);
+
 #endif
@@ -21,6 +21,7 @@
 #include "ec.h"
 #include "error.h"
 #include "hash.h"
+#include "random.h"
 #include "sha256.h"
 #include "utils.h"
 
@@ -31,6 +32,8 @@ static const char brontide_protocol_name[] =
 // We use "hns" instead of "lightning".
 static const char brontide_prologue[] = "hns";
 
+static const char brontide_ticket_label[] = "hns-resume";
+
 #define BRONTIDE_ROTATION_INTERVAL 1000
 #define BRONTIDE_VERSION 0
 
@@ -42,6 +45,9 @@ static const char brontide_prologue[] = "hns";
 #define BRONTIDE_ACT_TWO_SIZE 80
 #define BRONTIDE_ACT_THREE_SIZE 65
 
+// Sent in place of act one, so a responder reads the same amount either way.
+#define BRONTIDE_RESUME_SIZE BRONTIDE_ACT_ONE_SIZE
+
 #define BRONTIDE_ACT_NONE 0
 #define BRONTIDE_ACT_ONE 1
 #define BRONTIDE_ACT_TWO 2
@@ -59,6 +65,7 @@ hsk_cs_init(hsk_cs_t *cs) {
   cs->nonce = 0;
   memset(cs->iv, 0, 12);
   memset(cs->secret_key, 0, 32);
+  memset(&cs->key, 0, sizeof(hsk_aead_key_t));
   memset(cs->salt, 0, 32);
   memset(cs->tag, 0, 16);
   hsk_aead_init(&cs->cipher);
@@ -73,6 +80,7 @@ hsk_cs_update(hsk_cs_t *cs) {
 void
 hsk_cs_init_key(hsk_cs_t *cs, const uint8_t *key) {
   memcpy(cs->secret_key, key, 32);
+  hsk_aead_key_init(&cs->key, key);
   cs->nonce = 0;
   hsk_cs_update(cs);
 }
@@ -85,18 +93,27 @@ hsk_cs_init_saltkey(hsk_cs_t *cs, const uint8_t *salt, const uint8_t *key) {
 
 void
 hsk_cs_rotate_key(hsk_cs_t *cs) {
-  uint8_t *info = NULL;
-  uint8_t *old_key = cs->secret_key;
-  uint8_t h1[32];
-  uint8_t h2[32];
+  // HKDF(secret=key, salt=salt, info=""), with the expand
+  // step unrolled for an empty info so every buffer is fixed
+  // size, and the new salt written in place.
+  uint8_t prk[32];
+  uint8_t buf[33];
+  uint8_t next_key[32];
 
-  hsk_hash_hkdf(old_key, 32, cs->salt, 32, info, 0, h1, h2);
+  hsk_hash_sha256_hmac(cs->secret_key, 32, cs->salt, 32, prk);
 
-  memcpy(cs->salt, h1, 32);
+  buf[0] = 0x01;
+  hsk_hash_sha256_hmac(buf, 1, prk, 32, cs->salt);
 
-  uint8_t *next_key = &h2[0];
+  memcpy(buf, cs->salt, 32);
+  buf[32] = 0x02;
+  hsk_hash_sha256_hmac(buf, 33, prk, 32, next_key);
 
   hsk_cs_init_key(cs, next_key);
+
+  memset(prk, 0, sizeof(prk));
+  memset(buf, 0, sizeof(buf));
+  memset(next_key, 0, sizeof(next_key));
 }
 
 void
@@ -107,7 +124,7 @@ hsk_cs_encrypt(
   uint8_t *out,
   size_t len
 ) {
-  hsk_aead_setup(&cs->cipher, cs->secret_key, cs->iv);
+  hsk_aead_setup_key(&cs->cipher, &cs->key, cs->iv);
 
   if (ad)
     hsk_aead_aad(&cs->cipher, ad, 32);
@@ -130,7 +147,7 @@ hsk_cs_decrypt(
   uint8_t *out,
   size_t len
 ) {
-  hsk_aead_setup(&cs->cipher, cs->secret_key, cs->iv);
+  hsk_aead_setup_key(&cs->cipher, &cs->key, cs->iv);
 
   if (ad)
     hsk_aead_aad(&cs->cipher, ad, 32);
@@ -178,6 +195,12 @@ hsk_brontide_init(hsk_brontide_t *b, const hsk_ec_t *ec) {
   hsk_cs_init(&b->send_cipher);
   hsk_cs_init(&b->recv_cipher);
 
+  // Resumption
+  b->resume = false;
+  memset(&b->ticket, 0, sizeof(hsk_brontide_ticket_t));
+  b->ticket_cb = NULL;
+  b->ticket_arg = NULL;
+
   // Net
   b->connect_cb = NULL;
   b->connect_arg = NULL;
@@ -199,6 +222,8 @@ hsk_brontide_uninit(hsk_brontide_t *b) {
 
   hsk_brontide_destroy(b);
 
+  memset(&b->ticket, 0, sizeof(hsk_brontide_ticket_t));
+
   if (b->msg) {
     free(b->msg);
     b->msg = NULL;
@@ -511,6 +536,125 @@ hsk_brontide_split(hsk_brontide_t *b) {
   }
 }
 
+/*
+ * Resumption
+ *
+ * The resume act replaces act one when the initiator holds a ticket from a
+ * previous session with the same peer:
+ *
+ *   id (32) || nonce (32) || tag (16)
+ *
+ * Both the ticket secret and a fresh nonce are mixed into the chaining key,
+ * and the tag (an encryption of nothing, keyed by the result) authenticates
+ * the transcript, which already commits to the responder's static key. No
+ * ECDH is done by either side and the initiator can send its first message
+ * right behind the resume act instead of waiting for act two.
+ *
+ * Unlike the full handshake, resumed sessions are not forward secret with
+ * respect to the ticket, which is why tickets are short-lived and consumed
+ * on use. A responder that doesn't know the ID treats the act as act one,
+ * which fails its tag check, so an initiator only resumes with peers that
+ * agreed to keep a ticket.
+ */
+
+void
+hsk_brontide_gen_resume(hsk_brontide_t *b, uint8_t *act) {
+  assert(b->resume);
+
+  uint8_t nonce[32];
+  assert(hsk_randombytes(nonce, 32));
+
+  hsk_brontide_mix_hash(b, b->ticket.id, 32);
+  hsk_brontide_mix_hash(b, nonce, 32);
+  hsk_brontide_mix_key(b, b->ticket.secret);
+  hsk_brontide_mix_key(b, nonce);
+
+  hsk_brontide_encrypt(b, NULL, NULL, 0);
+
+  memcpy(&act[0], b->ticket.id, 32);
+  memcpy(&act[32], nonce, 32);
+  memcpy(&act[64], b->cs.tag, 16);
+
+  hsk_brontide_split(b);
+}
+
+bool
+hsk_brontide_recv_resume(
+  hsk_brontide_t *b,
+  const uint8_t *act,
+  const hsk_brontide_ticket_t *ticket
+) {
+  const uint8_t *id = &act[0];
+  const uint8_t *nonce = &act[32];
+  const uint8_t *p = &act[64];
+
+  if (memcmp(id, ticket->id, 32) != 0)
+    return false;
+
+  hsk_brontide_mix_hash(b, id, 32);
+  hsk_brontide_mix_hash(b, nonce, 32);
+  hsk_brontide_mix_key(b, ticket->secret);
+  hsk_brontide_mix_key(b, nonce);
+
+  hsk_brontide_decrypt(b, NULL, NULL, 0, p);
+
+  if (!hsk_cs_verify(&b->cs, p))
+    return false;
+
+  memcpy(b->remote_static, ticket->remote_static, 33);
+
+  b->resume = true;
+
+  hsk_brontide_split(b);
+
+  return true;
+}
+
+void
+hsk_brontide_set_ticket(
+  hsk_brontide_t *b,
+  const hsk_brontide_ticket_t *ticket
+) {
+  assert(b && ticket);
+  assert(b->initiator);
+  assert(memcmp(ticket->remote_static, b->remote_static, 33) == 0);
+
+  memcpy(&b->ticket, ticket, sizeof(hsk_brontide_ticket_t));
+  b->resume = true;
+}
+
+bool
+hsk_brontide_get_ticket(
+  const hsk_brontide_t *b,
+  hsk_brontide_ticket_t *ticket
+) {
+  assert(b && ticket);
+
+  if (b->state != BRONTIDE_ACT_DONE)
+    return false;
+
+  hsk_hash_hkdf(
+    b->chaining_key,
+    32,
+    (const uint8_t *)brontide_ticket_label,
+    sizeof(brontide_ticket_label) - 1,
+    NULL,
+    0,
+    ticket->id,
+    ticket->secret
+  );
+
+  memcpy(ticket->remote_static, b->remote_static, 33);
+  ticket->time = hsk_now();
+
+  return true;
+}
+
+bool
+hsk_brontide_is_resumed(const hsk_brontide_t *b) {
+  return b->resume && b->state == BRONTIDE_ACT_DONE;
+}
+
 int
 hsk_brontide_accept(hsk_brontide_t *b, const uint8_t *our_key) {
   hsk_brontide_init_brontide(b, false, our_key, NULL);
@@ -533,7 +677,24 @@ hsk_brontide_on_connect(hsk_brontide_t *b) {
 
   assert(b->write_cb);
 
-  if (b->initiator) {
+  if (b->initiator && b->resume) {
+    uint8_t act[BRONTIDE_RESUME_SIZE];
+
+    hsk_brontide_gen_resume(b, act);
+
+    int r = b->write_cb(b->write_arg, act, BRONTIDE_RESUME_SIZE, false);
+
+    // The ticket is spent either way.
+    memset(&b->ticket, 0, sizeof(hsk_brontide_ticket_t));
+
+    if (r != HSK_SUCCESS) {
+      hsk_brontide_destroy(b);
+      return r;
+    }
+
+    b->state = BRONTIDE_ACT_DONE;
+    size = BRONTIDE_HEADER_SIZE;
+  } else if (b->initiator) {
     b->state = BRONTIDE_ACT_TWO;
 
     uint8_t act1[BRONTIDE_ACT_ONE_SIZE];
@@ -564,42 +725,63 @@ hsk_brontide_on_connect(hsk_brontide_t *b) {
   b->msg_pos = 0;
   b->msg_len = size;
 
+  if (b->state == BRONTIDE_ACT_DONE)
+    b->connect_cb(b->connect_arg);
+
   return HSK_SUCCESS;
 }
 
-int
-hsk_brontide_write(hsk_brontide_t *b, uint8_t *data, size_t data_len) {
-  assert(b->write_cb);
-
-  int r = HSK_SUCCESS;
+size_t
+hsk_brontide_frame_size(size_t data_len) {
+  return BRONTIDE_HEADER_SIZE + data_len + BRONTIDE_MAC_SIZE;
+}
 
-  if (b->state != BRONTIDE_ACT_DONE)
-    goto done;
+void
+hsk_brontide_seal(
+  hsk_brontide_t *b,
+  const uint8_t *data,
+  size_t data_len,
+  uint8_t *out
+) {
+  assert(b->state == BRONTIDE_ACT_DONE);
 
   uint8_t len[4];
 
   set_u32(&len[0], (uint32_t)data_len);
 
-  hsk_cs_encrypt(&b->send_cipher, NULL, len, len, 4);
+  hsk_cs_encrypt(&b->send_cipher, NULL, len, &out[0], 4);
+  memcpy(&out[4], b->send_cipher.tag, 16);
 
-  r = b->write_cb(b->write_arg, len, 4, false);
-
-  if (r != 0)
-    goto done;
+  hsk_cs_encrypt(&b->send_cipher, NULL, data, &out[20], data_len);
+  memcpy(&out[20 + data_len], b->send_cipher.tag, 16);
+}
 
-  r = b->write_cb(b->write_arg, b->send_cipher.tag, 16, false);
+int
+hsk_brontide_write(hsk_brontide_t *b, uint8_t *data, size_t data_len) {
+  assert(b->write_cb);
 
-  if (r != 0)
-    goto done;
+  int r = HSK_SUCCESS;
 
-  hsk_cs_encrypt(&b->send_cipher, NULL, data, data, data_len);
+  if (b->state != BRONTIDE_ACT_DONE) {
+    free(data);
+    return r;
+  }
 
-  r = b->write_cb(b->write_arg, data, data_len, true);
+  // One buffer and one write per frame.
+  size_t frame_len = hsk_brontide_frame_size(data_len);
+  uint8_t *frame = malloc(frame_len);
 
-  if (r != 0)
+  if (!frame) {
+    free(data);
+    r = HSK_ENOMEM;
     goto done;
+  }
+
+  hsk_brontide_seal(b, data, data_len, frame);
+
+  free(data);
 
-  r = b->write_cb(b->write_arg, b->send_cipher.tag, 16, false);
+  r = b->write_cb(b->write_arg, frame, frame_len, true);
 
 done:
   if (r != HSK_SUCCESS)
@@ -702,6 +884,23 @@ hsk_brontide_parse(
       case BRONTIDE_ACT_ONE: {
         assert(data_len == BRONTIDE_ACT_ONE_SIZE);
 
+        hsk_brontide_ticket_t ticket;
+
+        if (b->ticket_cb && b->ticket_cb(b->ticket_arg, data, &ticket)) {
+          bool ok = hsk_brontide_recv_resume(b, data, &ticket);
+
+          memset(&ticket, 0, sizeof(hsk_brontide_ticket_t));
+
+          if (!ok)
+            return HSK_EACTONE;
+
+          b->state = BRONTIDE_ACT_DONE;
+          b->connect_cb(b->connect_arg);
+
+          *msg_len = BRONTIDE_HEADER_SIZE;
+          return HSK_SUCCESS;
+        }
+
         if (!hsk_brontide_recv_act_one(b, data))
           return HSK_EACTONE;
 
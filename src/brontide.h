@@ -15,11 +15,27 @@ typedef struct hsk_cs_s {
   uint32_t nonce;
   uint8_t iv[12];
   uint8_t secret_key[32];
+  hsk_aead_key_t key;
   uint8_t salt[32];
   uint8_t tag[16];
   hsk_aead_t cipher;
 } hsk_cs_t;
 
+// How long a resumption ticket may be used after the session it was
+// derived from was established.
+#define HSK_BRONTIDE_TICKET_LIFETIME (10 * 60)
+
+// Resumption ticket. Both ends of a session derive the same ticket from the
+// final chaining key, so nothing extra goes over the wire to issue one. It
+// is only kept if both peers advertised HSK_SERVICE_RESUME, and it is good
+// for a single reconnect: the resumed session yields the next ticket.
+typedef struct hsk_brontide_ticket_s {
+  uint8_t id[32];
+  uint8_t secret[32];
+  uint8_t remote_static[33];
+  int64_t time;
+} hsk_brontide_ticket_t;
+
 typedef void (*hsk_brontide_connect_cb)(
   const void *arg
 );
@@ -37,6 +53,13 @@ typedef void (*hsk_brontide_read_cb)(
   size_t data_len
 );
 
+// Look up (and forget) the ticket with the given ID when accepting.
+typedef bool (*hsk_brontide_ticket_cb)(
+  const void *arg,
+  const uint8_t *id,
+  hsk_brontide_ticket_t *ticket
+);
+
 typedef struct hsk_brontide_s {
   // Cipher state
   hsk_cs_t cs;
@@ -58,6 +81,12 @@ typedef struct hsk_brontide_s {
   hsk_cs_t send_cipher;
   hsk_cs_t recv_cipher;
 
+  // Resumption
+  bool resume;
+  hsk_brontide_ticket_t ticket;
+  hsk_brontide_ticket_cb ticket_cb;
+  void *ticket_arg;
+
   // Net
   hsk_brontide_connect_cb connect_cb;
   void *connect_arg;
@@ -186,6 +215,35 @@ hsk_brontide_recv_act_three(hsk_brontide_t *b, const uint8_t *act3);
 void
 hsk_brontide_split(hsk_brontide_t *b);
 
+void
+hsk_brontide_gen_resume(hsk_brontide_t *b, uint8_t *act);
+
+bool
+hsk_brontide_recv_resume(
+  hsk_brontide_t *b,
+  const uint8_t *act,
+  const hsk_brontide_ticket_t *ticket
+);
+
+// Resume from `ticket` instead of running the handshake on the next
+// hsk_brontide_on_connect(). Initiator only.
+void
+hsk_brontide_set_ticket(
+  hsk_brontide_t *b,
+  const hsk_brontide_ticket_t *ticket
+);
+
+// Derive the ticket for the next reconnect. Only valid once the handshake
+// (or resumption) has completed.
+bool
+hsk_brontide_get_ticket(
+  const hsk_brontide_t *b,
+  hsk_brontide_ticket_t *ticket
+);
+
+bool
+hsk_brontide_is_resumed(const hsk_brontide_t *b);
+
 int
 hsk_brontide_accept(hsk_brontide_t *b, const uint8_t *our_key);
 
@@ -199,6 +257,21 @@ hsk_brontide_connect(
 int
 hsk_brontide_on_connect(hsk_brontide_t *b);
 
+// Size of a sealed frame carrying `data_len` bytes.
+size_t
+hsk_brontide_frame_size(size_t data_len);
+
+// Encrypt a message into a complete frame (length, tag, body, tag). `out`
+// must have room for hsk_brontide_frame_size(data_len) bytes.
+void
+hsk_brontide_seal(
+  hsk_brontide_t *b,
+  const uint8_t *data,
+  size_t data_len,
+  uint8_t *out
+);
+
+// Takes ownership of `data`.
 int
 hsk_brontide_write(hsk_brontide_t *b, uint8_t *data, size_t data_len);
 
@@ -7,6 +7,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include "bio.h"
 #include "cache.h"
 #include "dns.h"
 #include "error.h"
@@ -22,6 +23,8 @@ hsk_cache_init(hsk_cache_t *c) {
     hsk_cache_key_hash,
     hsk_cache_key_equal,
     (hsk_map_free_func)hsk_cache_item_free);
+  c->limit = HSK_CACHE_LIMIT;
+  c->ttl = HSK_CACHE_TTL;
 }
 
 void
@@ -45,6 +48,19 @@ hsk_cache_free(hsk_cache_t *c) {
   free(c);
 }
 
+bool
+hsk_cache_set_limits(hsk_cache_t *c, size_t limit, int64_t ttl) {
+  assert(c);
+
+  if (limit == 0 || ttl <= 0)
+    return false;
+
+  c->limit = limit;
+  c->ttl = ttl;
+
+  return true;
+}
+
 static void
 hsk_cache_log(const hsk_cache_t *c, const char *fmt, ...) {
   assert(c);
@@ -62,37 +78,28 @@ hsk_cache_prune(hsk_cache_t *c) {
   hsk_map_clear(&c->map);
 }
 
-bool
-hsk_cache_insert_data(
+static bool
+hsk_cache_insert_key(
   hsk_cache_t *c,
-  const char *name,
-  uint16_t type,
+  const hsk_cache_key_t *ck,
   uint8_t *wire,
   size_t wire_len
 ) {
-  assert(c);
-
-  hsk_cache_key_t ck;
-  hsk_cache_key_init(&ck);
-
-  if (!hsk_cache_key_set(&ck, name, type))
-    return false;
-
-  hsk_cache_item_t *cache = hsk_map_get(&c->map, &ck);
+  hsk_cache_item_t *cache = hsk_map_get(&c->map, ck);
 
   if (cache) {
-    if (hsk_now() < cache->time + 6 * 60 * 60) {
+    if (hsk_now() < cache->time + c->ttl) {
       free(wire);
       return true;
     }
 
-    hsk_map_del(&c->map, &ck);
+    hsk_map_del(&c->map, ck);
     hsk_cache_item_free(cache);
 
     cache = NULL;
   }
 
-  if (c->map.size >= HSK_CACHE_LIMIT)
+  if (c->map.size >= c->limit)
     hsk_cache_prune(c);
 
   hsk_cache_item_t *item = hsk_cache_item_alloc();
@@ -100,7 +107,7 @@ hsk_cache_insert_data(
   if (!item)
     return false;
 
-  memcpy(&item->key, &ck, sizeof(hsk_cache_key_t));
+  memcpy(&item->key, ck, sizeof(hsk_cache_key_t));
 
   item->msg = wire;
   item->msg_len = wire_len;
@@ -116,6 +123,190 @@ hsk_cache_insert_data(
   return true;
 }
 
+static size_t
+hsk_cache_item_write(const hsk_cache_item_t *item, uint8_t **data) {
+  const hsk_cache_key_t *ck = &item->key;
+  size_t size = 0;
+  size += write_u8(data, ck->name_len);
+  size += write_bytes(data, ck->name, ck->name_len);
+  size += write_u16(data, ck->type);
+  size += write_u8(data, ck->ref ? 1 : 0);
+  size += write_i64(data, item->time);
+  size += write_u32(data, item->msg_len);
+  size += write_bytes(data, item->msg, item->msg_len);
+  return size;
+}
+
+bool
+hsk_cache_encode(const hsk_cache_t *c, uint8_t **data, size_t *data_len) {
+  assert(c && data && data_len);
+
+  const hsk_map_t *map = &c->map;
+  int64_t now = hsk_now();
+  uint32_t count = 0;
+  size_t size = 5;
+  hsk_map_iter_t i;
+
+  for (i = hsk_map_begin(map); i != hsk_map_end(map); i++) {
+    if (!hsk_map_exists(map, i))
+      continue;
+
+    const hsk_cache_item_t *item = hsk_map_value(map, i);
+
+    if (now >= item->time + c->ttl)
+      continue;
+
+    size += hsk_cache_item_write(item, NULL);
+    count += 1;
+  }
+
+  uint8_t *buf = malloc(size);
+
+  if (!buf)
+    return false;
+
+  uint8_t *p = buf;
+
+  // Version, for whoever reads this.
+  write_u8(&p, 0);
+  write_u32(&p, count);
+
+  for (i = hsk_map_begin(map); i != hsk_map_end(map); i++) {
+    if (!hsk_map_exists(map, i))
+      continue;
+
+    const hsk_cache_item_t *item = hsk_map_value(map, i);
+
+    if (now >= item->time + c->ttl)
+      continue;
+
+    hsk_cache_item_write(item, &p);
+  }
+
+  assert(p == buf + size);
+
+  *data = buf;
+  *data_len = size;
+
+  return true;
+}
+
+bool
+hsk_cache_decode(hsk_cache_t *c, const uint8_t *data, size_t data_len) {
+  assert(c && data);
+
+  uint8_t *p = (uint8_t *)data;
+  size_t left = data_len;
+  uint8_t version;
+  uint32_t count;
+
+  if (!read_u8(&p, &left, &version) || version != 0)
+    return false;
+
+  if (!read_u32(&p, &left, &count))
+    return false;
+
+  uint32_t n;
+  for (n = 0; n < count; n++) {
+    hsk_cache_key_t ck;
+    hsk_cache_key_init(&ck);
+
+    uint8_t name_len, ref;
+    int64_t time;
+    uint32_t msg_len;
+
+    if (!read_u8(&p, &left, &name_len) || name_len > HSK_DNS_MAX_NAME)
+      return false;
+
+    if (!read_bytes(&p, &left, ck.name, name_len))
+      return false;
+
+    ck.name_len = name_len;
+
+    if (!read_u16(&p, &left, &ck.type))
+      return false;
+
+    if (!read_u8(&p, &left, &ref) || !read_i64(&p, &left, &time))
+      return false;
+
+    ck.ref = ref != 0;
+
+    if (!read_u32(&p, &left, &msg_len) || msg_len > left)
+      return false;
+
+    if (c->map.size >= c->limit)
+      break;
+
+    // Keep anything we already have.
+    if (hsk_map_has(&c->map, &ck)) {
+      p += msg_len;
+      left -= msg_len;
+      continue;
+    }
+
+    hsk_cache_item_t *item = hsk_cache_item_alloc();
+
+    if (!item)
+      return false;
+
+    item->key = ck;
+    item->msg = malloc(msg_len ? msg_len : 1);
+    item->msg_len = msg_len;
+    item->time = time;
+
+    if (!item->msg) {
+      hsk_cache_item_free(item);
+      return false;
+    }
+
+    read_bytes(&p, &left, item->msg, msg_len);
+
+    if (!hsk_map_set(&c->map, &item->key, item)) {
+      hsk_cache_item_free(item);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool
+hsk_cache_insert_data(
+  hsk_cache_t *c,
+  const char *name,
+  uint16_t type,
+  uint8_t *wire,
+  size_t wire_len
+) {
+  assert(c);
+
+  hsk_cache_key_t ck;
+  hsk_cache_key_init(&ck);
+
+  if (!hsk_cache_key_set(&ck, name, type))
+    return false;
+
+  return hsk_cache_insert_key(c, &ck, wire, wire_len);
+}
+
+bool
+hsk_cache_insert_wire(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  uint8_t *wire,
+  size_t wire_len
+) {
+  assert(c && req);
+
+  hsk_cache_key_t ck;
+  hsk_cache_key_init(&ck);
+
+  if (!hsk_cache_key_set_name(&ck, &req->qname, req->type))
+    return false;
+
+  return hsk_cache_insert_key(c, &ck, wire, wire_len);
+}
+
 bool
 hsk_cache_insert(
   hsk_cache_t *c,
@@ -130,7 +321,7 @@ hsk_cache_insert(
     return false;
   }
 
-  if (!hsk_cache_insert_data(c, req->name, req->type, wire, wire_len)) {
+  if (!hsk_cache_insert_wire(c, req, wire, wire_len)) {
     hsk_cache_log(c, "could not insert cache\n");
     free(wire);
     return false;
@@ -139,6 +330,22 @@ hsk_cache_insert(
   return true;
 }
 
+static hsk_cache_item_t *
+hsk_cache_get_key(hsk_cache_t *c, const hsk_cache_key_t *ck) {
+  hsk_cache_item_t *cache = hsk_map_get(&c->map, ck);
+
+  if (!cache)
+    return NULL;
+
+  if (hsk_now() >= cache->time + c->ttl) {
+    hsk_map_del(&c->map, ck);
+    hsk_cache_item_free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
 bool
 hsk_cache_get_data(
   hsk_cache_t *c,
@@ -155,35 +362,40 @@ hsk_cache_get_data(
   if (!hsk_cache_key_set(&ck, name, type))
     return false;
 
-  hsk_cache_item_t *cache = hsk_map_get(&c->map, &ck);
+  hsk_cache_item_t *cache = hsk_cache_get_key(c, &ck);
 
   if (!cache)
     return false;
 
-  if (hsk_now() >= cache->time + 6 * 60 * 60) {
-    hsk_map_del(&c->map, &ck);
-    hsk_cache_item_free(cache);
-    return false;
-  }
-
   *wire = cache->msg;
   *wire_len = cache->msg_len;
 
   return true;
 }
 
+static hsk_cache_item_t *
+hsk_cache_lookup(hsk_cache_t *c, const hsk_dns_req_t *req) {
+  hsk_cache_key_t ck;
+  hsk_cache_key_init(&ck);
+
+  if (!hsk_cache_key_set_name(&ck, &req->qname, req->type))
+    return NULL;
+
+  return hsk_cache_get_key(c, &ck);
+}
+
 hsk_dns_msg_t *
 hsk_cache_get(hsk_cache_t *c, const hsk_dns_req_t *req) {
-  uint8_t *data;
-  size_t data_len;
   hsk_dns_msg_t *msg;
 
-  if (!hsk_cache_get_data(c, req->name, req->type, &data, &data_len))
+  hsk_cache_item_t *cache = hsk_cache_lookup(c, req);
+
+  if (!cache)
     return NULL;
 
   hsk_cache_log(c, "cache hit for: %s\n", req->name);
 
-  if (!hsk_dns_msg_decode(data, data_len, &msg)) {
+  if (!hsk_dns_msg_decode(cache->msg, cache->msg_len, &msg)) {
     hsk_cache_log(c, "could not deserialize cached item\n");
     return NULL;
   }
@@ -191,6 +403,151 @@ hsk_cache_get(hsk_cache_t *c, const hsk_dns_req_t *req) {
   return msg;
 }
 
+static uint8_t
+hsk_cache_signed_flags(const hsk_dns_req_t *req) {
+  return (req->rd ? 1 : 0)
+       | (req->cd ? 2 : 0)
+       | (req->edns ? 4 : 0)
+       | (req->dnssec ? 8 : 0);
+}
+
+static bool
+hsk_cache_signed_match(
+  const hsk_cache_signed_t *cs,
+  const hsk_dns_req_t *req
+) {
+  return cs->wire
+      && cs->type == req->type
+      && cs->class == req->class
+      && cs->flags == hsk_cache_signed_flags(req)
+      && cs->max_size == req->max_size
+      && strcmp(cs->name, req->name) == 0;
+}
+
+static void
+hsk_cache_signed_clear(hsk_cache_signed_t *cs) {
+  if (cs->wire)
+    free(cs->wire);
+
+  cs->name[0] = '\0';
+  cs->type = 0;
+  cs->class = 0;
+  cs->flags = 0;
+  cs->max_size = 0;
+  cs->wire = NULL;
+  cs->wire_len = 0;
+  cs->time = 0;
+}
+
+bool
+hsk_cache_get_signed(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  uint8_t **wire,
+  size_t *wire_len
+) {
+  assert(c && req && wire && wire_len);
+
+  hsk_cache_item_t *cache = hsk_cache_lookup(c, req);
+
+  if (!cache || !cache->sigs)
+    return false;
+
+  int64_t now = hsk_now();
+
+  for (int i = 0; i < HSK_CACHE_SIGNED; i++) {
+    hsk_cache_signed_t *cs = &cache->sigs[i];
+
+    if (!hsk_cache_signed_match(cs, req))
+      continue;
+
+    if (now >= cs->time + HSK_CACHE_SIGNED_TTL) {
+      hsk_cache_signed_clear(cs);
+      return false;
+    }
+
+    uint8_t *data = malloc(cs->wire_len);
+
+    if (!data)
+      return false;
+
+    memcpy(data, cs->wire, cs->wire_len);
+    set_u16be(&data[0], req->id);
+
+    hsk_cache_log(c, "signed cache hit for: %s\n", req->name);
+
+    *wire = data;
+    *wire_len = cs->wire_len;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool
+hsk_cache_set_signed(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  const uint8_t *wire,
+  size_t wire_len
+) {
+  assert(c && req && wire);
+
+  hsk_cache_item_t *cache = hsk_cache_lookup(c, req);
+
+  if (!cache)
+    return false;
+
+  if (!cache->sigs) {
+    cache->sigs = malloc(HSK_CACHE_SIGNED * sizeof(hsk_cache_signed_t));
+
+    if (!cache->sigs)
+      return false;
+
+    for (int i = 0; i < HSK_CACHE_SIGNED; i++) {
+      cache->sigs[i].wire = NULL;
+      hsk_cache_signed_clear(&cache->sigs[i]);
+    }
+  }
+
+  // Replace a stale copy of this variant,
+  // otherwise evict round-robin.
+  hsk_cache_signed_t *cs = NULL;
+
+  for (int i = 0; i < HSK_CACHE_SIGNED; i++) {
+    if (hsk_cache_signed_match(&cache->sigs[i], req)) {
+      cs = &cache->sigs[i];
+      break;
+    }
+  }
+
+  if (!cs) {
+    cs = &cache->sigs[cache->sigs_next];
+    cache->sigs_next = (cache->sigs_next + 1) % HSK_CACHE_SIGNED;
+  }
+
+  uint8_t *data = malloc(wire_len);
+
+  if (!data)
+    return false;
+
+  memcpy(data, wire, wire_len);
+
+  hsk_cache_signed_clear(cs);
+
+  strcpy(cs->name, req->name);
+  cs->type = req->type;
+  cs->class = req->class;
+  cs->flags = hsk_cache_signed_flags(req);
+  cs->max_size = req->max_size;
+  cs->wire = data;
+  cs->wire_len = wire_len;
+  cs->time = hsk_now();
+
+  return true;
+}
+
 void
 hsk_cache_key_init(hsk_cache_key_t *ck) {
   assert(ck);
@@ -259,14 +616,28 @@ bool
 hsk_cache_key_set(hsk_cache_key_t *ck, const char *name, uint16_t type) {
   assert(ck);
 
-  if (!hsk_dns_name_verify(name))
+  hsk_dns_name_t n;
+
+  if (!hsk_dns_name_set(&n, name))
     return false;
 
-  if (hsk_dns_name_dirty(name))
+  return hsk_cache_key_set_name(ck, &n, type);
+}
+
+bool
+hsk_cache_key_set_name(
+  hsk_cache_key_t *ck,
+  const hsk_dns_name_t *name,
+  uint16_t type
+) {
+  assert(ck && name);
+
+  if (name->dirty)
     return false;
 
-  int labels = hsk_dns_label_count(name);
+  int labels = name->count;
   bool ref = false;
+  char str[HSK_DNS_MAX_NAME + 1];
 
   switch (labels) {
     case 0:
@@ -274,24 +645,31 @@ hsk_cache_key_set(hsk_cache_key_t *ck, const char *name, uint16_t type) {
       ref = false;
       break;
     case 2:
-      ref = !hsk_resource_is_ptr(name);
+      // Synth names all start with an underscore.
+      if (name->data[1] != '_') {
+        ref = true;
+        break;
+      }
+      hsk_dns_name_from(name, 0, str);
+      ref = !hsk_resource_is_ptr(str);
       break;
     case 3:
+      hsk_dns_name_from(name, 0, str);
       switch (type) {
         case HSK_DNS_SRV: {
-          ref = !hsk_dns_label_is_srv(name);
+          ref = !hsk_dns_label_is_srv(str);
           break;
         }
         case HSK_DNS_TLSA: {
-          ref = !hsk_dns_label_is_tlsa(name);
+          ref = !hsk_dns_label_is_tlsa(str);
           break;
         }
         case HSK_DNS_SMIMEA: {
-          ref = !hsk_dns_label_is_smimea(name);
+          ref = !hsk_dns_label_is_smimea(str);
           break;
         }
         case HSK_DNS_OPENPGPKEY: {
-          ref = !hsk_dns_label_is_openpgpkey(name);
+          ref = !hsk_dns_label_is_openpgpkey(str);
           break;
         }
         default: {
@@ -308,8 +686,12 @@ hsk_cache_key_set(hsk_cache_key_t *ck, const char *name, uint16_t type) {
   if (ref)
     labels = 1;
 
-  ck->name_len = hsk_dns_label_from(name, -labels, (char *)ck->name);
-  hsk_to_lower((char *)ck->name);
+  // Keyed by the lowercase wire suffix.
+  size_t size;
+  const uint8_t *suffix = hsk_dns_name_suffix(name, -labels, &size);
+
+  memcpy(ck->name, suffix, size);
+  ck->name_len = size;
   ck->ref = ref;
   ck->type = type;
 
@@ -323,6 +705,8 @@ hsk_cache_item_init(hsk_cache_item_t *ci) {
   ci->msg = NULL;
   ci->msg_len = 0;
   ci->time = 0;
+  ci->sigs = NULL;
+  ci->sigs_next = 0;
 }
 
 void
@@ -333,6 +717,14 @@ hsk_cache_item_uninit(hsk_cache_item_t *ci) {
     ci->msg = NULL;
     ci->msg_len = 0;
   }
+
+  if (ci->sigs) {
+    for (int i = 0; i < HSK_CACHE_SIGNED; i++)
+      hsk_cache_signed_clear(&ci->sigs[i]);
+
+    free(ci->sigs);
+    ci->sigs = NULL;
+  }
 }
 
 hsk_cache_item_t *
@@ -9,10 +9,20 @@
 #include "map.h"
 #include "req.h"
 
+// Default size and lifetime of the cache (see hsk_cache_set_limits()).
 #define HSK_CACHE_LIMIT 2000
+#define HSK_CACHE_TTL (6 * 60 * 60)
+
+// Signed answers kept per entry, and how long one is reused. The SIG(0)
+// record is valid for +/-6h from signing, so an hour of reuse leaves every
+// answer with at least 5h of validity left.
+#define HSK_CACHE_SIGNED 4
+#define HSK_CACHE_SIGNED_TTL (60 * 60)
 
 typedef struct hsk_cache_s {
   hsk_map_t map;
+  size_t limit;
+  int64_t ttl;
 } hsk_cache_t;
 
 typedef struct hsk_cache_key_s {
@@ -22,11 +32,31 @@ typedef struct hsk_cache_key_s {
   bool ref;
 } hsk_cache_key_t;
 
+// A finalized, SIG(0)-signed answer for one variant of a query. The same
+// entry serves several questions (referrals are keyed by TLD), and the bytes
+// also depend on the flags and size limit of the query, so all of these are
+// part of the match. The message ID is not: it is patched on the way out,
+// which only works if the signature does not cover it.
+typedef struct hsk_cache_signed_s {
+  char name[HSK_DNS_MAX_NAME + 1];
+  uint16_t type;
+  uint16_t class;
+  uint8_t flags;
+  size_t max_size;
+  uint8_t *wire;
+  size_t wire_len;
+  int64_t time;
+} hsk_cache_signed_t;
+
 typedef struct hsk_cache_item_s {
   hsk_cache_key_t key;
   uint8_t *msg;
   size_t msg_len;
   int64_t time;
+  // HSK_CACHE_SIGNED of them, allocated the first time an answer from this
+  // entry is signed.
+  hsk_cache_signed_t *sigs;
+  int sigs_next;
 } hsk_cache_item_t;
 
 void
@@ -41,6 +71,20 @@ hsk_cache_alloc(void);
 void
 hsk_cache_free(hsk_cache_t *c);
 
+// Entries kept before the cache is cleared, and how long each one is served
+// (in seconds). Entries already cached expire under the new TTL.
+bool
+hsk_cache_set_limits(hsk_cache_t *c, size_t limit, int64_t ttl);
+
+// Serialize the unexpired answers (not the signed ones, which belong to a
+// key) so that another process can pick them up with hsk_cache_decode().
+bool
+hsk_cache_encode(const hsk_cache_t *c, uint8_t **data, size_t *data_len);
+
+// Add the answers from hsk_cache_encode(), keeping their age.
+bool
+hsk_cache_decode(hsk_cache_t *c, const uint8_t *data, size_t data_len);
+
 bool
 hsk_cache_insert_data(
   hsk_cache_t *c,
@@ -50,6 +94,15 @@ hsk_cache_insert_data(
   size_t wire_len
 );
 
+// Same as hsk_cache_insert_data(), keyed by the request.
+bool
+hsk_cache_insert_wire(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  uint8_t *wire,
+  size_t wire_len
+);
+
 bool
 hsk_cache_insert(
   hsk_cache_t *c,
@@ -69,6 +122,24 @@ hsk_cache_get_data(
 hsk_dns_msg_t *
 hsk_cache_get(hsk_cache_t *c, const hsk_dns_req_t *req);
 
+// Look up a signed answer stored with hsk_cache_set_signed(). Returns a copy
+// with the ID set to req->id.
+bool
+hsk_cache_get_signed(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  uint8_t **wire,
+  size_t *wire_len
+);
+
+bool
+hsk_cache_set_signed(
+  hsk_cache_t *c,
+  const hsk_dns_req_t *req,
+  const uint8_t *wire,
+  size_t wire_len
+);
+
 void
 hsk_cache_key_init(hsk_cache_key_t *ck);
 
@@ -90,6 +161,13 @@ hsk_cache_key_equal(const void *a, const void *b);
 bool
 hsk_cache_key_set(hsk_cache_key_t *ck, const char *name, uint16_t type);
 
+bool
+hsk_cache_key_set_name(
+  hsk_cache_key_t *ck,
+  const hsk_dns_name_t *name,
+  uint16_t type
+);
+
 void
 hsk_cache_item_init(hsk_cache_item_t *ci);
 
@@ -159,6 +159,115 @@ hsk_chacha20_block(hsk_chacha20_ctx *ctx, uint32_t output[16]) {
   }
 }
 
+#if defined(__GNUC__)
+// Four blocks at a time, one per vector lane.
+typedef uint32_t hsk_chacha20_u32x4 __attribute__((vector_size(16)));
+
+#define ROTLV(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUNDV(x, a, b, c, d)            \
+  x[a] += x[b]; x[d] = ROTLV(x[d] ^ x[a], 16); \
+  x[c] += x[d]; x[b] = ROTLV(x[b] ^ x[c], 12); \
+  x[a] += x[b]; x[d] = ROTLV(x[d] ^ x[a], 8);  \
+  x[c] += x[d]; x[b] = ROTLV(x[b] ^ x[c], 7);
+
+static void
+hsk_chacha20_block_x4(hsk_chacha20_ctx *ctx, uint8_t *out) {
+  hsk_chacha20_u32x4 s[16];
+  hsk_chacha20_u32x4 x[16];
+  uint32_t *nonce = ctx->schedule + 12;
+  int i, j;
+
+  for (i = 0; i < 16; i++) {
+    uint32_t w = ctx->schedule[i];
+    s[i] = (hsk_chacha20_u32x4){ w, w, w, w };
+  }
+
+  for (j = 0; j < 4; j++) {
+    uint32_t counter = nonce[0] + j;
+
+    s[12][j] = counter;
+
+    // Same carry as the one-block path.
+    if (ctx->nonce_size == 8 && counter < nonce[0])
+      s[13][j] += 1;
+  }
+
+  memcpy(x, s, sizeof(s));
+
+  for (i = 0; i < 10; i++) {
+    QUARTERROUNDV(x, 0, 4, 8, 12)
+    QUARTERROUNDV(x, 1, 5, 9, 13)
+    QUARTERROUNDV(x, 2, 6, 10, 14)
+    QUARTERROUNDV(x, 3, 7, 11, 15)
+    QUARTERROUNDV(x, 0, 5, 10, 15)
+    QUARTERROUNDV(x, 1, 6, 11, 12)
+    QUARTERROUNDV(x, 2, 7, 8, 13)
+    QUARTERROUNDV(x, 3, 4, 9, 14)
+  }
+
+  for (i = 0; i < 16; i++)
+    x[i] += s[i];
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+    && !defined(__clang__)
+  // Transpose each 4x4 group of words so lane j becomes
+  // 16 contiguous bytes of block j.
+  for (i = 0; i < 16; i += 4) {
+    const hsk_chacha20_u32x4 lo = { 0, 4, 1, 5 };
+    const hsk_chacha20_u32x4 hi = { 2, 6, 3, 7 };
+    const hsk_chacha20_u32x4 l2 = { 0, 1, 4, 5 };
+    const hsk_chacha20_u32x4 h2 = { 2, 3, 6, 7 };
+    hsk_chacha20_u32x4 t0 = __builtin_shuffle(x[i + 0], x[i + 1], lo);
+    hsk_chacha20_u32x4 t1 = __builtin_shuffle(x[i + 2], x[i + 3], lo);
+    hsk_chacha20_u32x4 t2 = __builtin_shuffle(x[i + 0], x[i + 1], hi);
+    hsk_chacha20_u32x4 t3 = __builtin_shuffle(x[i + 2], x[i + 3], hi);
+    hsk_chacha20_u32x4 b0 = __builtin_shuffle(t0, t1, l2);
+    hsk_chacha20_u32x4 b1 = __builtin_shuffle(t0, t1, h2);
+    hsk_chacha20_u32x4 b2 = __builtin_shuffle(t2, t3, l2);
+    hsk_chacha20_u32x4 b3 = __builtin_shuffle(t2, t3, h2);
+
+    memcpy(out + 0 * 64 + i * 4, &b0, 16);
+    memcpy(out + 1 * 64 + i * 4, &b1, 16);
+    memcpy(out + 2 * 64 + i * 4, &b2, 16);
+    memcpy(out + 3 * 64 + i * 4, &b3, 16);
+  }
+#else
+  for (j = 0; j < 4; j++) {
+    for (i = 0; i < 16; i++) {
+      uint32_t w = x[i][j];
+      WRITELE(out + j * 64 + i * 4, w);
+    }
+  }
+#endif
+
+  uint32_t prev = nonce[0];
+
+  nonce[0] += 4;
+
+  if (ctx->nonce_size == 8 && nonce[0] < prev)
+    nonce[1]++;
+}
+#endif
+
+static inline void
+hsk_chacha20_xor_words(
+  const uint8_t *k,
+  const uint8_t *in,
+  uint8_t *out,
+  size_t len
+) {
+  uint64_t x, y;
+  size_t i;
+
+  for (i = 0; i < len; i += 8) {
+    memcpy(&x, in + i, 8);
+    memcpy(&y, k + i, 8);
+    x ^= y;
+    memcpy(out + i, &x, 8);
+  }
+}
+
 static inline
 void hsk_chacha20_xor(
   uint8_t *keystream,
@@ -190,6 +299,31 @@ hsk_chacha20_encrypt(
       length -= amount;
     }
 
+#if defined(__GNUC__)
+    while (length >= 256) {
+      uint8_t ks[256];
+
+      hsk_chacha20_block_x4(ctx, ks);
+      hsk_chacha20_xor_words(ks, in, out, 256);
+
+      in += 256;
+      out += 256;
+      length -= 256;
+      ctx->available = 0;
+    }
+#endif
+
+    // Whole blocks, a word at a time.
+    while (length >= sizeof(ctx->keystream)) {
+      hsk_chacha20_block(ctx, ctx->keystream);
+      hsk_chacha20_xor_words(k, in, out, 64);
+
+      in += 64;
+      out += 64;
+      length -= 64;
+      ctx->available = 0;
+    }
+
     while (length) {
       size_t amount = MIN(length, sizeof(ctx->keystream));
       hsk_chacha20_block(ctx, ctx->keystream);
@@ -18,6 +18,16 @@
 #include "timedata.h"
 #include "utils.h"
 
+/*
+ * Types
+ */
+
+// Orphans held for a peer.
+typedef struct {
+  uint64_t id;
+  int count;
+} hsk_chain_source_t;
+
 /*
  * Prototypes
  */
@@ -29,12 +39,25 @@ static int
 hsk_chain_insert(
   hsk_chain_t *chain,
   hsk_header_t *hdr,
-  const hsk_header_t *prev
+  const hsk_header_t *prev,
+  bool batch
 );
 
+static void
+hsk_chain_tip_changed(hsk_chain_t *chain);
+
 static void
 hsk_chain_maybe_sync(hsk_chain_t *chain);
 
+static bool
+hsk_chain_update_safe_root(hsk_chain_t *chain);
+
+static void
+hsk_chain_emit(const hsk_chain_t *chain, int event);
+
+static void
+hsk_chain_drop_orphan(hsk_chain_t *chain, hsk_chain_orphan_t *orphan);
+
 /*
  * Helpers
  */
@@ -53,6 +76,37 @@ qsort_cmp(const void *a, const void *b) {
   return 0;
 }
 
+static uint32_t
+hsk_chain_source_hash(const void *key) {
+  uint64_t id = *((const uint64_t *)key);
+  return (uint32_t)(id ^ (id >> 32)) * 2654435761u;
+}
+
+static bool
+hsk_chain_source_equal(const void *a, const void *b) {
+  return *((const uint64_t *)a) == *((const uint64_t *)b);
+}
+
+static uint32_t
+invert_lowest_one(uint32_t n) {
+  return n & (n - 1);
+}
+
+// Height of the header a header at this height skips back to. Spacing them
+// like this lets any ancestor be reached in O(log n) hops.
+static uint32_t
+hsk_chain_skip_height(uint32_t height) {
+  if (height < 2)
+    return 0;
+
+  // Odd heights skip a little less far than even ones, so that long walks
+  // alternate between big and small jumps.
+  if (height & 1)
+    return invert_lowest_one(invert_lowest_one(height - 1)) + 1;
+
+  return invert_lowest_one(height);
+}
+
 /*
  * Chain
  */
@@ -70,8 +124,18 @@ hsk_chain_init(hsk_chain_t *chain, const hsk_timedata_t *td) {
 
   hsk_map_init_hash_map(&chain->hashes, free);
   hsk_map_init_int_map(&chain->heights, NULL);
-  hsk_map_init_hash_map(&chain->orphans, free);
+  hsk_map_init_hash_map(&chain->orphans, NULL);
   hsk_map_init_hash_map(&chain->prevs, NULL);
+  hsk_map_init_map(&chain->sources, hsk_chain_source_hash,
+                   hsk_chain_source_equal, free);
+  chain->oldest = NULL;
+  chain->newest = NULL;
+  chain->orphan_limit = HSK_CHAIN_ORPHANS;
+  chain->peer_orphan_limit = HSK_CHAIN_PEER_ORPHANS;
+  memset(chain->window, 0, sizeof(chain->window));
+  memset(&chain->safe_root, 0, sizeof(chain->safe_root));
+  chain->event_cb = NULL;
+  chain->event_arg = NULL;
 
   return hsk_chain_init_genesis(chain);
 }
@@ -106,7 +170,9 @@ hsk_chain_init_genesis(hsk_chain_t *chain) {
   chain->height = tip->height;
   chain->tip = tip;
   chain->genesis = tip;
+  chain->window[tip->height % HSK_CHAIN_WINDOW] = tip;
 
+  hsk_chain_update_safe_root(chain);
   hsk_chain_maybe_sync(chain);
 
   return HSK_SUCCESS;
@@ -117,13 +183,18 @@ hsk_chain_uninit(hsk_chain_t *chain) {
   if (!chain)
     return;
 
+  while (chain->oldest)
+    hsk_chain_drop_orphan(chain, chain->oldest);
+
   hsk_map_uninit(&chain->heights);
   hsk_map_uninit(&chain->hashes);
   hsk_map_uninit(&chain->prevs);
   hsk_map_uninit(&chain->orphans);
+  hsk_map_uninit(&chain->sources);
 
   chain->tip = NULL;
   chain->genesis = NULL;
+  memset(chain->window, 0, sizeof(chain->window));
 }
 
 hsk_chain_t *
@@ -182,11 +253,40 @@ hsk_chain_has_orphan(const hsk_chain_t *chain, const uint8_t *hash) {
 
 hsk_header_t *
 hsk_chain_get_orphan(const hsk_chain_t *chain, const uint8_t *hash) {
-  return hsk_map_get(&chain->orphans, hash);
+  hsk_chain_orphan_t *orphan = hsk_map_get(&chain->orphans, hash);
+
+  if (!orphan)
+    return NULL;
+
+  return orphan->hdr;
 }
 
 const uint8_t *
 hsk_chain_safe_root(const hsk_chain_t *chain) {
+  return chain->safe_root.root;
+}
+
+const hsk_chain_root_t *
+hsk_chain_get_safe_root(const hsk_chain_t *chain) {
+  return &chain->safe_root;
+}
+
+void
+hsk_chain_set_events(hsk_chain_t *chain, hsk_chain_event_cb cb, void *arg) {
+  assert(chain);
+  chain->event_cb = cb;
+  chain->event_arg = arg;
+}
+
+static void
+hsk_chain_emit(const hsk_chain_t *chain, int event) {
+  if (chain->event_cb)
+    chain->event_cb(chain, event, chain->event_arg);
+}
+
+// Recompute the safe root for a new tip. Returns true if the root changed.
+static bool
+hsk_chain_update_safe_root(hsk_chain_t *chain) {
   // The tree is committed on an interval.
   // Mainnet is 72 blocks, meaning at height 72,
   // the name set of the past 72 blocks are
@@ -208,27 +308,213 @@ hsk_chain_safe_root(const hsk_chain_t *chain) {
 
   uint32_t height = (uint32_t)chain->height - mod;
 
-  hsk_header_t *prev = hsk_chain_get_by_height(chain, height);
+  hsk_header_t *prev = hsk_chain_get_ancestor(chain, chain->tip, height);
   assert(prev);
 
+  hsk_chain_root_t *safe = &chain->safe_root;
+
+  safe->height = height;
+
+  if (safe->version != 0 && memcmp(safe->root, prev->name_root, 32) == 0)
+    return false;
+
+  memcpy(safe->root, prev->name_root, 32);
+  safe->version += 1;
+
   hsk_chain_log(chain,
-    "using safe height of %u for resolution\n",
-    height);
+    "using safe height of %u for resolution: %s\n",
+    height, hsk_hex_encode32(safe->root));
 
-  return prev->name_root;
+  return true;
 }
 
-static hsk_header_t *
-hsk_chain_resolve_orphan(hsk_chain_t *chain, const uint8_t *hash) {
-  hsk_header_t *orphan = hsk_map_get(&chain->prevs, hash);
+/*
+ * Orphans
+ */
+
+static int
+hsk_chain_source_count(const hsk_chain_t *chain, uint64_t source) {
+  hsk_chain_source_t *src = hsk_map_get(&chain->sources, &source);
+
+  if (!src)
+    return 0;
+
+  return src->count;
+}
+
+static bool
+hsk_chain_source_add(hsk_chain_t *chain, uint64_t source, int count) {
+  hsk_chain_source_t *src = hsk_map_get(&chain->sources, &source);
+
+  if (!src) {
+    assert(count > 0);
+
+    src = malloc(sizeof(hsk_chain_source_t));
+
+    if (!src)
+      return false;
+
+    src->id = source;
+    src->count = 0;
+
+    if (!hsk_map_set(&chain->sources, &src->id, (void *)src)) {
+      free(src);
+      return false;
+    }
+  }
+
+  src->count += count;
+
+  assert(src->count >= 0);
+
+  if (src->count == 0) {
+    hsk_map_del(&chain->sources, &source);
+    free(src);
+  }
+
+  return true;
+}
+
+// Remove from everything but the parent's list of orphans.
+static void
+hsk_chain_forget_orphan(hsk_chain_t *chain, hsk_chain_orphan_t *orphan) {
+  hsk_map_del(&chain->orphans, hsk_header_cache(orphan->hdr));
+
+  if (orphan->older)
+    orphan->older->newer = orphan->newer;
+  else
+    chain->oldest = orphan->newer;
+
+  if (orphan->newer)
+    orphan->newer->older = orphan->older;
+  else
+    chain->newest = orphan->older;
+
+  orphan->older = NULL;
+  orphan->newer = NULL;
+
+  assert(hsk_chain_source_add(chain, orphan->source, -1));
+}
+
+static void
+hsk_chain_drop_orphan(hsk_chain_t *chain, hsk_chain_orphan_t *orphan) {
+  const uint8_t *prev_block = orphan->hdr->prev_block;
+  hsk_chain_orphan_t *head = hsk_map_get(&chain->prevs, prev_block);
+
+  assert(head);
+
+  if (head == orphan) {
+    // The map's key is this orphan's header.
+    hsk_map_del(&chain->prevs, prev_block);
+
+    if (orphan->sibling) {
+      hsk_chain_orphan_t *next = orphan->sibling;
+      assert(hsk_map_set(&chain->prevs, next->hdr->prev_block, (void *)next));
+    }
+  } else {
+    while (head->sibling != orphan)
+      head = head->sibling;
+
+    head->sibling = orphan->sibling;
+  }
+
+  hsk_chain_forget_orphan(chain, orphan);
+
+  free(orphan->hdr);
+  free(orphan);
+}
+
+static void
+hsk_chain_expire_orphans(hsk_chain_t *chain, int64_t now) {
+  while (chain->oldest
+         && chain->oldest->time + HSK_CHAIN_ORPHAN_AGE < now) {
+    hsk_chain_drop_orphan(chain, chain->oldest);
+  }
+}
+
+static void
+hsk_chain_prune_orphans(hsk_chain_t *chain, int64_t now) {
+  hsk_chain_expire_orphans(chain, now);
+
+  while (chain->oldest && (int)chain->orphans.size >= chain->orphan_limit)
+    hsk_chain_drop_orphan(chain, chain->oldest);
+}
+
+static int
+hsk_chain_store_orphan(
+  hsk_chain_t *chain,
+  hsk_header_t *hdr,
+  uint64_t source
+) {
+  hsk_chain_prune_orphans(chain, hsk_now());
+
+  if (hsk_chain_source_count(chain, source) >= chain->peer_orphan_limit)
+    return HSK_EFAILURE;
+
+  hsk_chain_orphan_t *orphan = malloc(sizeof(hsk_chain_orphan_t));
 
   if (!orphan)
+    return HSK_ENOMEM;
+
+  orphan->hdr = hdr;
+  orphan->source = source;
+  orphan->time = hsk_now();
+  orphan->older = chain->newest;
+  orphan->newer = NULL;
+  orphan->sibling = NULL;
+
+  hsk_chain_orphan_t *head = hsk_map_get(&chain->prevs, hdr->prev_block);
+
+  if (!hsk_map_set(&chain->orphans, hsk_header_cache(hdr), (void *)orphan))
+    goto fail;
+
+  if (!head && !hsk_map_set(&chain->prevs, hdr->prev_block, (void *)orphan)) {
+    hsk_map_del(&chain->orphans, hsk_header_cache(hdr));
+    goto fail;
+  }
+
+  if (!hsk_chain_source_add(chain, source, 1)) {
+    if (!head)
+      hsk_map_del(&chain->prevs, hdr->prev_block);
+    hsk_map_del(&chain->orphans, hsk_header_cache(hdr));
+    goto fail;
+  }
+
+  if (head) {
+    orphan->sibling = head->sibling;
+    head->sibling = orphan;
+  }
+
+  if (chain->newest)
+    chain->newest->newer = orphan;
+  else
+    chain->oldest = orphan;
+
+  chain->newest = orphan;
+
+  return HSK_SUCCESS;
+
+fail:
+  free(orphan);
+  return HSK_ENOMEM;
+}
+
+// Take all orphans waiting for this parent, linked through `sibling`.
+static hsk_chain_orphan_t *
+hsk_chain_take_orphans(hsk_chain_t *chain, const uint8_t *hash) {
+  hsk_chain_orphan_t *head = hsk_map_get(&chain->prevs, hash);
+
+  if (!head)
     return NULL;
 
-  hsk_map_del(&chain->prevs, orphan->prev_block);
-  hsk_map_del(&chain->orphans, hsk_header_cache(orphan));
+  hsk_map_del(&chain->prevs, hash);
+
+  hsk_chain_orphan_t *orphan;
+
+  for (orphan = head; orphan; orphan = orphan->sibling)
+    hsk_chain_forget_orphan(chain, orphan);
 
-  return orphan;
+  return head;
 }
 
 hsk_header_t *
@@ -242,9 +528,35 @@ hsk_chain_get_ancestor(
 
   hsk_header_t *h = (hsk_header_t *)hdr;
 
-  while (h->height != height) {
-    h = hsk_map_get(&chain->hashes, h->prev_block);
-    assert(h);
+  // Recent main chain headers are in the window. An entry is on the main
+  // chain as long as it is not above the tip.
+  if (hdr->height <= chain->height
+      && chain->window[hdr->height % HSK_CHAIN_WINDOW] == hdr) {
+    hsk_header_t *w = chain->window[height % HSK_CHAIN_WINDOW];
+
+    if (w && w->height == height)
+      return w;
+  }
+
+  uint32_t walk = h->height;
+
+  while (walk > height) {
+    uint32_t skip = hsk_chain_skip_height(walk);
+    uint32_t skip_prev = hsk_chain_skip_height(walk - 1);
+
+    // Only skip if the previous header's skip would not get closer.
+    if (h->skip
+        && (skip == height
+            || (skip > height
+                && !(skip_prev + 2 < skip && skip_prev >= height)))) {
+      h = h->skip;
+      walk = skip;
+    } else {
+      h = h->prev;
+      walk -= 1;
+    }
+
+    assert(h && h->height == walk);
   }
 
   return h;
@@ -334,7 +646,7 @@ hsk_chain_get_mtp(const hsk_chain_t *chain, const hsk_header_t *prev) {
 
   for (i = 0; i < timespan && prev; i++) {
     median[i] = (int64_t)prev->time;
-    prev = hsk_map_get(&chain->hashes, prev->prev_block);
+    prev = prev->prev;
     size += 1;
   }
 
@@ -355,10 +667,10 @@ hsk_chain_suitable_block(const hsk_chain_t *chain, const hsk_header_t *prev) {
   hsk_header_t *z = (hsk_header_t *)prev;
   assert(z);
 
-  hsk_header_t *y = hsk_map_get(&chain->hashes, z->prev_block);
+  hsk_header_t *y = z->prev;
   assert(y);
 
-  hsk_header_t *x = hsk_map_get(&chain->hashes, y->prev_block);
+  hsk_header_t *x = y->prev;
   assert(x);
 
   if (x->time > z->time)
@@ -459,12 +771,12 @@ hsk_chain_get_target(
       return HSK_BITS;
    }
 
-  if (prev->height < 144 + 2)
+  if (prev->height < HSK_TARGET_WINDOW + 2)
     return HSK_BITS;
 
   hsk_header_t *last = hsk_chain_suitable_block(chain, prev);
 
-  int64_t height = prev->height - 144;
+  int64_t height = prev->height - HSK_TARGET_WINDOW;
   hsk_header_t *ancestor = hsk_chain_get_ancestor(chain, prev, height);
   hsk_header_t *first = hsk_chain_suitable_block(chain, ancestor);
 
@@ -479,19 +791,16 @@ hsk_chain_find_fork(
 ) {
   assert(chain && fork && longer);
 
-  while (!hsk_header_equal(fork, longer)) {
-    while (longer->height > fork->height) {
-      longer = hsk_map_get(&chain->hashes, longer->prev_block);
-      if (!longer)
-        return NULL;
-    }
+  if (fork->height > longer->height)
+    fork = hsk_chain_get_ancestor(chain, fork, longer->height);
+  else
+    longer = hsk_chain_get_ancestor(chain, longer, fork->height);
 
-    if (hsk_header_equal(fork, longer))
-      return fork;
-
-    fork = hsk_map_get(&chain->hashes, fork->prev_block);
+  while (!hsk_header_equal(fork, longer)) {
+    fork = fork->prev;
+    longer = longer->prev;
 
-    if (!fork)
+    if (!fork || !longer)
       return NULL;
   }
 
@@ -522,7 +831,7 @@ hsk_chain_reorganize(hsk_chain_t *chain, hsk_header_t *competitor) {
 
     tail = entry;
 
-    entry = hsk_map_get(&chain->hashes, entry->prev_block);
+    entry = entry->prev;
     assert(entry);
   }
 
@@ -538,7 +847,7 @@ hsk_chain_reorganize(hsk_chain_t *chain, hsk_header_t *competitor) {
 
     connect = entry;
 
-    entry = hsk_map_get(&chain->hashes, entry->prev_block);
+    entry = entry->prev;
     assert(entry);
   }
 
@@ -559,11 +868,66 @@ hsk_chain_reorganize(hsk_chain_t *chain, hsk_header_t *competitor) {
       break;
 
     assert(hsk_map_set(&chain->heights, &c->height, (void *)c));
+    chain->window[c->height % HSK_CHAIN_WINDOW] = c;
   }
 }
 
 int
 hsk_chain_add(hsk_chain_t *chain, const hsk_header_t *h) {
+  return hsk_chain_add_from(chain, h, 0);
+}
+
+// Connect everything that was waiting on a header just added.
+static void
+hsk_chain_resolve_orphans(
+  hsk_chain_t *chain,
+  const hsk_header_t *parent,
+  bool batch
+) {
+  hsk_chain_orphan_t *queue = hsk_chain_take_orphans(chain, parent->hash);
+
+  while (queue) {
+    hsk_chain_orphan_t *orphan = queue;
+    hsk_header_t *hdr = orphan->hdr;
+
+    queue = orphan->sibling;
+    free(orphan);
+
+    const uint8_t *hash = hsk_header_cache(hdr);
+    hsk_header_t *prev = hsk_chain_get(chain, hdr->prev_block);
+    assert(prev);
+
+    int rc = hsk_chain_insert(chain, hdr, prev, batch);
+
+    if (rc != HSK_SUCCESS) {
+      hsk_chain_log(chain, "rejected orphan: %s: %s\n",
+                    hsk_hex_encode32(hash), hsk_strerror(rc));
+      free(hdr);
+      continue;
+    }
+
+    hsk_chain_log(chain, "resolved orphan: %s\n", hsk_hex_encode32(hash));
+
+    hsk_chain_orphan_t *children = hsk_chain_take_orphans(chain, hash);
+
+    if (children) {
+      hsk_chain_orphan_t *tail = children;
+
+      while (tail->sibling)
+        tail = tail->sibling;
+
+      tail->sibling = queue;
+      queue = children;
+    }
+  }
+}
+
+int
+hsk_chain_add_from(
+  hsk_chain_t *chain,
+  const hsk_header_t *h,
+  uint64_t source
+) {
   if (!chain || !h)
     return HSK_EBADARGS;
 
@@ -609,66 +973,211 @@ hsk_chain_add(hsk_chain_t *chain, const hsk_header_t *h) {
   hsk_header_t *prev = hsk_chain_get(chain, hdr->prev_block);
 
   if (!prev) {
-    hsk_chain_log(chain, "  stored as orphan\n");
-
-    if (chain->orphans.size > 10000) {
-      hsk_chain_log(chain, "clearing orphans: %d\n", chain->orphans.size);
-      hsk_map_clear(&chain->prevs);
-      hsk_map_clear(&chain->orphans);
-    }
+    rc = hsk_chain_store_orphan(chain, hdr, source);
 
-    if (!hsk_map_set(&chain->orphans, hash, (void *)hdr)) {
-      rc = HSK_ENOMEM;
+    if (rc == HSK_ENOMEM)
       goto fail;
-    }
 
-    if (!hsk_map_set(&chain->prevs, hdr->prev_block, (void *)hdr)) {
-      hsk_map_del(&chain->orphans, hash);
-      rc = HSK_ENOMEM;
-      goto fail;
+    if (rc == HSK_SUCCESS) {
+      hsk_chain_log(chain, "  stored as orphan\n");
+    } else {
+      hsk_chain_log(chain, "  not stored: peer has too many orphans\n");
+      free(hdr);
     }
 
     return HSK_EORPHAN;
   }
 
-  rc = hsk_chain_insert(chain, hdr, prev);
+  rc = hsk_chain_insert(chain, hdr, prev, false);
 
   if (rc != HSK_SUCCESS)
     goto fail;
 
-  for (;;) {
-    prev = hdr;
-    hdr = hsk_chain_resolve_orphan(chain, hash);
+  hsk_chain_resolve_orphans(chain, hdr, false);
 
-    if (!hdr)
-      break;
+  return HSK_SUCCESS;
+
+fail:
+  if (hdr)
+    free(hdr);
+
+  return rc;
+}
 
-    hash = hsk_header_cache(hdr);
+// Make room for `count` more entries so the map is not grown one
+// rehash at a time in the middle of a batch.
+static bool
+hsk_chain_reserve(hsk_map_t *map, size_t count) {
+  size_t size = (size_t)map->size + count;
 
-    rc = hsk_chain_insert(chain, hdr, prev);
+  if (size <= map->upper_bound)
+    return true;
 
-    hsk_chain_log(chain, "resolved orphan: %s\n", hsk_hex_encode32(hash));
+  return hsk_map_resize(map, (uint32_t)(size + size / 3 + 1)) == 0;
+}
+
+int
+hsk_chain_add_batch(
+  hsk_chain_t *chain,
+  hsk_header_t *headers,
+  uint64_t source,
+  int *added
+) {
+  if (added)
+    *added = 0;
+
+  if (!chain)
+    return HSK_EBADARGS;
+
+  if (!headers)
+    return HSK_SUCCESS;
+
+  int rc = HSK_SUCCESS;
+  size_t count = 0;
+  hsk_header_t *hdr;
+
+  // All or nothing: a bad proof anywhere rejects the batch before the
+  // chain is touched.
+  for (hdr = headers; hdr; hdr = hdr->next) {
+    rc = hsk_header_verify_pow(hdr);
 
     if (rc != HSK_SUCCESS) {
-      free(hdr);
+      hsk_chain_log(chain, "rejected block: %s: pow error: %s\n",
+                    hsk_hex_encode32(hsk_header_cache(hdr)),
+                    hsk_strerror(rc));
       return rc;
     }
+
+    count += 1;
   }
 
-  return rc;
+  if (!hsk_chain_reserve(&chain->hashes, count)
+      || !hsk_chain_reserve(&chain->heights, count)) {
+    return HSK_ENOMEM;
+  }
 
-fail:
-  if (hdr)
-    free(hdr);
+  // So that a peer's expired orphans don't count against it below.
+  hsk_chain_expire_orphans(chain, hsk_now());
 
-  return rc;
+  const hsk_header_t *tip = chain->tip;
+  int64_t now = hsk_timedata_now(chain->td);
+  hsk_header_t *last = NULL;
+  int connected = 0;
+  int orphans = 0;
+  int dropped = 0;
+  bool orphan = false;
+
+  for (hdr = headers; hdr; hdr = hdr->next) {
+    const uint8_t *hash = hsk_header_cache(hdr);
+
+    if (hdr->time > now + 2 * 60 * 60) {
+      rc = HSK_ETIMETOONEW;
+      break;
+    }
+
+    if (hsk_map_has(&chain->hashes, hash)) {
+      rc = HSK_EDUPLICATE;
+      break;
+    }
+
+    hsk_header_t *prev;
+
+    if (last && memcmp(hdr->prev_block, last->hash, 32) == 0)
+      prev = last;
+    else
+      prev = hsk_chain_get(chain, hdr->prev_block);
+
+    // Orphans never have their parent in the chain, so only look for
+    // one here.
+    if (!prev && hsk_map_has(&chain->orphans, hash)) {
+      orphan = true;
+      continue;
+    }
+
+    if (!prev && hsk_chain_source_count(chain, source)
+                 >= chain->peer_orphan_limit) {
+      orphan = true;
+      dropped += 1;
+      continue;
+    }
+
+    // Only what the chain keeps is copied out of the caller's headers.
+    hsk_header_t *copy = hsk_header_clone(hdr);
+
+    if (!copy) {
+      rc = HSK_ENOMEM;
+      break;
+    }
+
+    if (!prev) {
+      orphan = true;
+      rc = hsk_chain_store_orphan(chain, copy, source);
+
+      if (rc != HSK_SUCCESS) {
+        free(copy);
+
+        if (rc == HSK_ENOMEM)
+          break;
+
+        dropped += 1;
+        rc = HSK_SUCCESS;
+        continue;
+      }
+
+      orphans += 1;
+      continue;
+    }
+
+    rc = hsk_chain_insert(chain, copy, prev, true);
+
+    if (rc != HSK_SUCCESS) {
+      free(copy);
+      break;
+    }
+
+    connected += 1;
+    last = copy;
+
+    hsk_chain_resolve_orphans(chain, copy, true);
+  }
+
+  if (hdr) {
+    hsk_chain_log(chain, "rejected block: %s: %s\n",
+                  hsk_hex_encode32(hsk_header_cache(hdr)),
+                  hsk_strerror(rc));
+  }
+
+  hsk_chain_log(chain, "added %d of %zu headers\n", connected, count);
+
+  if (orphans > 0)
+    hsk_chain_log(chain, "  stored %d as orphans\n", orphans);
+
+  if (dropped > 0)
+    hsk_chain_log(chain, "  not stored: peer has too many orphans (%d)\n",
+                  dropped);
+
+  if (chain->tip != tip) {
+    hsk_chain_log(chain, "  new height: %u\n", (uint32_t)chain->height);
+    hsk_chain_tip_changed(chain);
+  }
+
+  if (added)
+    *added = connected;
+
+  if (rc != HSK_SUCCESS)
+    return rc;
+
+  return orphan ? HSK_EORPHAN : HSK_SUCCESS;
 }
 
+// In a batch, the per-tip work (logging, the safe root, the sync check
+// and events) is left to the caller to do once at the end.
 static int
 hsk_chain_insert(
   hsk_chain_t *chain,
   hsk_header_t *hdr,
-  const hsk_header_t *prev
+  const hsk_header_t *prev,
+  bool batch
 ) {
   const uint8_t *hash = hsk_header_cache(hdr);
   int64_t mtp = hsk_chain_get_mtp(chain, prev);
@@ -688,6 +1197,9 @@ hsk_chain_insert(
   }
 
   hdr->height = prev->height + 1;
+  hdr->prev = (hsk_header_t *)prev;
+  hdr->skip = hsk_chain_get_ancestor(chain, prev,
+                                     hsk_chain_skip_height(hdr->height));
 
   assert(hsk_header_calc_work(hdr, prev));
 
@@ -712,12 +1224,26 @@ hsk_chain_insert(
 
     chain->height = hdr->height;
     chain->tip = hdr;
+    chain->window[hdr->height % HSK_CHAIN_WINDOW] = hdr;
 
-    hsk_chain_log(chain, "  added to main chain\n");
-    hsk_chain_log(chain, "  new height: %u\n", (uint32_t)chain->height);
-
-    hsk_chain_maybe_sync(chain);
+    if (!batch) {
+      hsk_chain_log(chain, "  added to main chain\n");
+      hsk_chain_log(chain, "  new height: %u\n", (uint32_t)chain->height);
+      hsk_chain_tip_changed(chain);
+    }
   }
 
   return HSK_SUCCESS;
 }
+
+static void
+hsk_chain_tip_changed(hsk_chain_t *chain) {
+  bool root_changed = hsk_chain_update_safe_root(chain);
+
+  hsk_chain_maybe_sync(chain);
+
+  hsk_chain_emit(chain, HSK_CHAIN_TIP);
+
+  if (root_changed)
+    hsk_chain_emit(chain, HSK_CHAIN_SAFE_ROOT);
+}
@@ -5,14 +5,65 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "constants.h"
 #include "map.h"
 #include "header.h"
 #include "timedata.h"
 
+/*
+ * Defs
+ */
+
+// Orphan headers kept in all. Past this, the oldest are dropped.
+#define HSK_CHAIN_ORPHANS 10000
+
+// Orphan headers kept from any one peer: a full headers message.
+#define HSK_CHAIN_PEER_ORPHANS 2000
+
+// Seconds an orphan is kept waiting for its parent.
+#define HSK_CHAIN_ORPHAN_AGE (20 * 60)
+
+// Main chain headers kept at hand by height: enough for a retarget.
+#define HSK_CHAIN_WINDOW (HSK_TARGET_WINDOW + 1)
+
+// Chain events.
+#define HSK_CHAIN_TIP 1
+#define HSK_CHAIN_SAFE_ROOT 2
+
 /*
  * Types
  */
 
+// The name root to resolve against. The version goes up whenever the root
+// changes, so anything keyed by root can tell its entries are stale.
+typedef struct hsk_chain_root_s {
+  uint64_t version;
+  uint32_t height;
+  uint8_t root[32];
+} hsk_chain_root_t;
+
+// A header whose parent we don't have yet.
+typedef struct hsk_chain_orphan_s {
+  hsk_header_t *hdr;
+  // Peer it came from, for its quota.
+  uint64_t source;
+  int64_t time;
+  // Oldest first.
+  struct hsk_chain_orphan_s *older;
+  struct hsk_chain_orphan_s *newer;
+  // Others waiting for the same parent.
+  struct hsk_chain_orphan_s *sibling;
+} hsk_chain_orphan_t;
+
+struct hsk_chain_s;
+
+// Called after the event has taken effect.
+typedef void (*hsk_chain_event_cb)(
+  const struct hsk_chain_s *chain,
+  int event,
+  void *arg
+);
+
 typedef struct hsk_chain_s {
   int64_t height;
   hsk_header_t *tip;
@@ -21,8 +72,21 @@ typedef struct hsk_chain_s {
   hsk_timedata_t *td;
   hsk_map_t hashes;
   hsk_map_t heights;
+  // Orphans by hash, by parent hash (one per parent, the rest are its
+  // siblings), and counts per peer.
   hsk_map_t orphans;
   hsk_map_t prevs;
+  hsk_map_t sources;
+  hsk_chain_orphan_t *oldest;
+  hsk_chain_orphan_t *newest;
+  int orphan_limit;
+  int peer_orphan_limit;
+  // The last HSK_CHAIN_WINDOW headers of the main chain, indexed by height
+  // modulo the size. Entries above the tip are left over from a reorg.
+  hsk_header_t *window[HSK_CHAIN_WINDOW];
+  hsk_chain_root_t safe_root;
+  hsk_chain_event_cb event_cb;
+  void *event_arg;
 } hsk_chain_t;
 
 /*
@@ -59,6 +123,12 @@ hsk_chain_get_orphan(const hsk_chain_t *chain, const uint8_t *hash);
 const uint8_t *
 hsk_chain_safe_root(const hsk_chain_t *chain);
 
+const hsk_chain_root_t *
+hsk_chain_get_safe_root(const hsk_chain_t *chain);
+
+void
+hsk_chain_set_events(hsk_chain_t *chain, hsk_chain_event_cb cb, void *arg);
+
 hsk_header_t *
 hsk_chain_get_ancestor(
   const hsk_chain_t *chain,
@@ -71,4 +141,26 @@ hsk_chain_synced(const hsk_chain_t *chain);
 
 int
 hsk_chain_add(hsk_chain_t *chain, const hsk_header_t *h);
+
+// Like hsk_chain_add(), noting which peer the header came from so that no
+// one peer can fill the orphan pool.
+int
+hsk_chain_add_from(
+  hsk_chain_t *chain,
+  const hsk_header_t *h,
+  uint64_t source
+);
+
+// Add a list of headers linked through `next`, such as a decoded headers
+// message. The headers stay the caller's; the ones the chain keeps are
+// copied. It stops at the first header that fails and returns its error;
+// otherwise it returns HSK_EORPHAN if any were orphans. `added` gets the
+// number connected.
+int
+hsk_chain_add_batch(
+  hsk_chain_t *chain,
+  hsk_header_t *headers,
+  uint64_t source,
+  int *added
+);
 #endif
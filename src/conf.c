@@ -0,0 +1,298 @@
+#include "config.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "chain.h"
+#include "conf.h"
+#include "constants.h"
+#include "error.h"
+#include "ns.h"
+#include "pool.h"
+#include "workers.h"
+
+/*
+ * Types
+ */
+
+typedef struct {
+  const char *name;
+  size_t offset;
+  int min;
+  int max;
+  // Can change on reload. Otherwise it takes a restart.
+  bool reload;
+} hsk_conf_opt_t;
+
+/*
+ * Options
+ */
+
+#define HSK_CONF_OPT(name, field, min, max, reload) \
+  { (name), offsetof(hsk_conf_t, field), (min), (max), (reload) }
+
+static const hsk_conf_opt_t hsk_conf_opts[] = {
+  HSK_CONF_OPT("pool-size", pool_size, 1, 1000, true),
+  HSK_CONF_OPT("threads", threads, 0, HSK_WORKERS_MAX, false),
+  // Only peers connected after a reload use a new size.
+  HSK_CONF_OPT("peer-buffer", peer_buffer, 4096, HSK_MAX_MESSAGE, true),
+  HSK_CONF_OPT("orphans", orphans, 1, 1000000, true),
+  HSK_CONF_OPT("handshake-timeout", timeouts.handshake, 1, 86400, true),
+  HSK_CONF_OPT("stall-timeout", timeouts.stall, 1, 86400, true),
+  HSK_CONF_OPT("ping-interval", timeouts.ping, 1, 86400, true),
+  HSK_CONF_OPT("headers-timeout", timeouts.headers, 1, 86400, true),
+  HSK_CONF_OPT("verack-timeout", timeouts.verack, 1, 86400, true),
+  HSK_CONF_OPT("proof-timeout", timeouts.proof, 1, 86400, true),
+  HSK_CONF_OPT("block-timeout", timeouts.block, 1, 86400, true),
+  HSK_CONF_OPT("getheaders-interval", timeouts.getheaders, 1, 86400, true),
+  HSK_CONF_OPT("cache-size", cache_size, 1, 10000000, true),
+  HSK_CONF_OPT("cache-ttl", cache_ttl, 1, 86400, true),
+  HSK_CONF_OPT("udp-buffer", udp_buffer, HSK_UDP_BUFFER, 1 << 26, true),
+  HSK_CONF_OPT("rate-limit", rate_limit, 0, 10000000, true)
+};
+
+#define HSK_CONF_OPTS (sizeof(hsk_conf_opts) / sizeof(hsk_conf_opts[0]))
+
+// Config files are small; anything bigger is likely the wrong file.
+#define HSK_CONF_MAX_FILE (1 << 20)
+
+/*
+ * Helpers
+ */
+
+static void
+hsk_conf_log(const char *fmt, ...) {
+  printf("config: ");
+
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static int *
+hsk_conf_field(hsk_conf_t *conf, const hsk_conf_opt_t *opt) {
+  return (int *)((uint8_t *)conf + opt->offset);
+}
+
+static const int *
+hsk_conf_get(const hsk_conf_t *conf, const hsk_conf_opt_t *opt) {
+  return (const int *)((const uint8_t *)conf + opt->offset);
+}
+
+static const hsk_conf_opt_t *
+hsk_conf_find(const char *name, size_t name_len) {
+  size_t i;
+  for (i = 0; i < HSK_CONF_OPTS; i++) {
+    const hsk_conf_opt_t *opt = &hsk_conf_opts[i];
+
+    if (strlen(opt->name) == name_len
+        && memcmp(opt->name, name, name_len) == 0) {
+      return opt;
+    }
+  }
+  return NULL;
+}
+
+static bool
+hsk_conf_read_int(const char *str, size_t len, int *value) {
+  char buf[16];
+
+  if (len == 0 || len >= sizeof(buf))
+    return false;
+
+  size_t i;
+  for (i = 0; i < len; i++) {
+    if (!isdigit((unsigned char)str[i]))
+      return false;
+  }
+
+  memcpy(buf, str, len);
+  buf[len] = '\0';
+
+  errno = 0;
+
+  long n = strtol(buf, NULL, 10);
+
+  if (errno != 0 || n > INT32_MAX)
+    return false;
+
+  *value = (int)n;
+
+  return true;
+}
+
+static bool
+hsk_conf_is_space(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+/*
+ * Config
+ */
+
+void
+hsk_conf_init(hsk_conf_t *conf) {
+  assert(conf);
+  conf->pool_size = HSK_POOL_SIZE;
+  conf->threads = HSK_POOL_THREADS;
+  conf->peer_buffer = HSK_BUFFER_SIZE;
+  conf->orphans = HSK_CHAIN_ORPHANS;
+  hsk_pool_timeouts_init(&conf->timeouts);
+  conf->cache_size = HSK_CACHE_LIMIT;
+  conf->cache_ttl = HSK_CACHE_TTL;
+  conf->udp_buffer = HSK_UDP_BUFFER;
+  conf->rate_limit = 0;
+}
+
+int
+hsk_conf_parse(hsk_conf_t *conf, const char *text, size_t text_len) {
+  assert(conf && (text || text_len == 0));
+
+  hsk_conf_t next = *conf;
+  const char *end = text + text_len;
+  const char *line = text;
+  int num = 0;
+
+  while (line < end) {
+    const char *eol = memchr(line, '\n', end - line);
+
+    if (!eol)
+      eol = end;
+
+    num += 1;
+
+    const char *hash = memchr(line, '#', eol - line);
+    const char *stop = hash ? hash : eol;
+    const char *s = line;
+
+    line = eol + 1;
+
+    while (s < stop && hsk_conf_is_space(*s))
+      s++;
+
+    while (stop > s && hsk_conf_is_space(stop[-1]))
+      stop--;
+
+    if (s == stop)
+      continue;
+
+    const char *name = s;
+
+    while (s < stop && !hsk_conf_is_space(*s) && *s != '=')
+      s++;
+
+    size_t name_len = s - name;
+
+    while (s < stop && hsk_conf_is_space(*s))
+      s++;
+
+    if (s < stop && *s == '=') {
+      s++;
+      while (s < stop && hsk_conf_is_space(*s))
+        s++;
+    }
+
+    const hsk_conf_opt_t *opt = hsk_conf_find(name, name_len);
+
+    if (!opt) {
+      hsk_conf_log("line %d: unknown setting: %.*s\n",
+                   num, (int)name_len, name);
+      return HSK_EENCODING;
+    }
+
+    int value;
+
+    if (!hsk_conf_read_int(s, stop - s, &value)
+        || value < opt->min || value > opt->max) {
+      hsk_conf_log("line %d: %s must be a number from %d to %d\n",
+                   num, opt->name, opt->min, opt->max);
+      return HSK_EENCODING;
+    }
+
+    *hsk_conf_field(&next, opt) = value;
+  }
+
+  *conf = next;
+
+  return HSK_SUCCESS;
+}
+
+int
+hsk_conf_load(hsk_conf_t *conf, const char *file) {
+  assert(conf && file);
+
+  FILE *fp = fopen(file, "rb");
+
+  if (!fp) {
+    hsk_conf_log("could not open %s: %s\n", file, strerror(errno));
+    return HSK_EFAILURE;
+  }
+
+  char *text = malloc(HSK_CONF_MAX_FILE);
+
+  if (!text) {
+    fclose(fp);
+    return HSK_ENOMEM;
+  }
+
+  size_t len = fread(text, 1, HSK_CONF_MAX_FILE, fp);
+  bool failed = ferror(fp) != 0;
+  bool eof = feof(fp) != 0;
+
+  fclose(fp);
+
+  if (failed || !eof) {
+    hsk_conf_log("could not read %s%s\n", file, failed ? "" : ": too big");
+    free(text);
+    return HSK_EFAILURE;
+  }
+
+  int rc = hsk_conf_parse(conf, text, len);
+
+  free(text);
+
+  if (rc != HSK_SUCCESS)
+    hsk_conf_log("could not load %s\n", file);
+
+  return rc;
+}
+
+int
+hsk_conf_reload(hsk_conf_t *conf, const hsk_conf_t *next) {
+  assert(conf && next);
+
+  int changed = 0;
+  size_t i;
+
+  for (i = 0; i < HSK_CONF_OPTS; i++) {
+    const hsk_conf_opt_t *opt = &hsk_conf_opts[i];
+    int *value = hsk_conf_field(conf, opt);
+    int update = *hsk_conf_get(next, opt);
+
+    if (*value == update)
+      continue;
+
+    if (!opt->reload) {
+      hsk_conf_log("%s needs a restart to change (keeping %d)\n",
+                   opt->name, *value);
+      continue;
+    }
+
+    hsk_conf_log("%s: %d -> %d\n", opt->name, *value, update);
+
+    *value = update;
+    changed += 1;
+  }
+
+  return changed;
+}
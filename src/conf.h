@@ -0,0 +1,51 @@
+#ifndef _HSK_CONF_H
+#define _HSK_CONF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/*
+ * Types
+ */
+
+// Runtime tuning read from the --config file. Each line is `name = value`
+// (or `name value`), with `#` starting a comment. Every value is an integer;
+// see conf.c for the names and ranges.
+typedef struct hsk_conf_s {
+  // Pool
+  int pool_size;
+  int threads;
+  int peer_buffer;
+  int orphans;
+  hsk_pool_timeouts_t timeouts;
+  // Root nameserver
+  int cache_size;
+  int cache_ttl;
+  int udp_buffer;
+  // Queries per second across all clients, not per client.
+  int rate_limit;
+} hsk_conf_t;
+
+/*
+ * Config
+ */
+
+void
+hsk_conf_init(hsk_conf_t *conf);
+
+// Parse settings on top of what `conf` already holds. Errors are logged
+// with their line number, and `conf` is left as it was.
+int
+hsk_conf_parse(hsk_conf_t *conf, const char *text, size_t text_len);
+
+int
+hsk_conf_load(hsk_conf_t *conf, const char *file);
+
+// Take the settings from `next` that can change while running. Returns the
+// number that changed; the others are logged and left as they were.
+int
+hsk_conf_reload(hsk_conf_t *conf, const hsk_conf_t *next);
+#endif
@@ -16,6 +16,10 @@
 #define HSK_USER_AGENT "/hnsd:1.0.0/"
 #define HSK_PROTO_VERSION 1
 #define HSK_SERVICES 0
+
+// Willing to keep brontide resumption tickets. Not assigned by hsd, which
+// ignores service bits it doesn't know.
+#define HSK_SERVICE_RESUME (1ull << 24)
 #define HSK_MAX_DATA_SIZE 668
 #define HSK_MAX_VALUE_SIZE 512
 
@@ -12,14 +12,23 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "activation.h"
+#include "conf.h"
+#include "handoff.h"
 #include "hsk.h"
 #include "pool.h"
 #include "ns.h"
 #include "rs.h"
 #include "signals.h"
+#include "utils.h"
 #include "uv.h"
 #include "platform-net.h"
 
+#ifndef _WIN32
+// How often to check whether the chain is ready, in milliseconds.
+#define HSK_DAEMON_WAIT_POLL 100
+#endif
+
 extern char *optarg;
 extern int optind, opterr, optopt;
 
@@ -36,7 +45,14 @@ typedef struct hsk_options_s {
   uint8_t *identity_key;
   char *seeds;
   int pool_size;
+  int threads;
   char *user_agent;
+  bool sig0_worker;
+  bool sig0_noid;
+  bool resume;
+  char *handoff;
+  int ns_fd;
+  int rs_fd;
 } hsk_options_t;
 
 static void
@@ -52,8 +68,16 @@ hsk_options_init(hsk_options_t *opt) {
   memset(opt->identity_key_, 0, sizeof(opt->identity_key_));
   opt->identity_key = NULL;
   opt->seeds = NULL;
-  opt->pool_size = HSK_POOL_SIZE;
+  // Unless given, these come from the config file.
+  opt->pool_size = -1;
+  opt->threads = -1;
   opt->user_agent = NULL;
+  opt->sig0_worker = false;
+  opt->sig0_noid = false;
+  opt->resume = false;
+  opt->handoff = NULL;
+  opt->ns_fd = -1;
+  opt->rs_fd = -1;
 }
 
 static void
@@ -115,7 +139,10 @@ help(int r) {
     "Usage: hnsd [options]\n"
     "\n"
     "  -c, --config <config>\n"
-    "    Path to config file.\n"
+    "    Path to config file with runtime tuning (see README.md). It is\n"
+    "    reloaded on SIGHUP. --pool-size and --threads take precedence.\n"
+    "    Its rate-limit caps all root nameserver queries together, not\n"
+    "    each client.\n"
     "\n"
     "  -n, --ns-host <ip[:port]>\n"
     "    IP address and port for root nameserver, e.g. 127.0.0.1:5369.\n"
@@ -132,9 +159,33 @@ help(int r) {
     "  -p, --pool-size <size>\n"
     "    Size of peer pool.\n"
     "\n"
+    "  -t, --threads <count>\n"
+    "    Worker threads for proof verification and building responses\n"
+    "    (default: 2). Use 0 to do this work on the event loop.\n"
+    "\n"
     "  -k, --identity-key <hex-string>\n"
     "    Identity key for signing DNS responses as well as P2P messages.\n"
     "\n"
+    "  -w, --sig0-worker\n"
+    "    Sign DNS responses on a worker thread whenever no precomputed\n"
+    "    SIG(0) nonce is ready, instead of on the event loop.\n"
+    "\n"
+    "  -x, --sig0-no-id\n"
+    "    Leave the message ID out of the SIG(0) signature of root nameserver\n"
+    "    answers, so a signed answer to a cached query can be reused for an\n"
+    "    hour instead of being signed again. Verifiers must hash the ID as\n"
+    "    zero. The signature then no longer ties an answer to the query that\n"
+    "    asked for it: anyone who sees one signed answer can replay it to any\n"
+    "    client asking the same question until it expires (up to 6 hours).\n"
+    "    It still proves the answer came from this key. Only use this when\n"
+    "    clients check SIG(0) for origin, not against spoofed replies.\n"
+    "\n"
+    "  -e, --resume-sessions\n"
+    "    Offer brontide session resumption to peers. Reconnecting to a peer\n"
+    "    that also offers it skips the handshake, using a single-use ticket\n"
+    "    from the previous session that expires after 10 minutes. Resumed\n"
+    "    sessions are not forward secret with respect to that ticket.\n"
+    "\n"
     "  -s, --seeds <seed1,seed2,...>\n"
     "    Extra seeds to connect to on the P2P network.\n"
     "    Example:\n"
@@ -150,6 +201,19 @@ help(int r) {
     "  -d, --daemon\n"
     "    Fork and background the process.\n"
     "\n"
+    "  -g, --handoff <path>\n"
+    "    Unix socket for graceful restarts. A new hnsd started with the\n"
+    "    same path takes over the sockets and cache of the running one,\n"
+    "    which exits once the new one is synced.\n"
+    "\n"
+    "  -N, --ns-fd <fd>\n"
+    "    Serve the root nameserver on an already bound UDP socket instead\n"
+    "    of --ns-host. Sockets passed by systemd (LISTEN_FDS) are used the\n"
+    "    same way. Queries wait in the socket until the chain is synced.\n"
+    "\n"
+    "  -R, --rs-fd <fd>\n"
+    "    Same for the recursive nameserver, instead of --rs-host.\n"
+    "\n"
 #endif
     "  -h, --help\n"
     "    This help message.\n"
@@ -161,9 +225,9 @@ help(int r) {
 
 static void
 parse_arg(int argc, char **argv, hsk_options_t *opt) {
-  const static char *optstring = "c:n:r:i:u:p:k:s:l:h:a"
+  const static char *optstring = "c:n:r:i:u:p:t:k:wxes:l:h:a"
 #ifndef _WIN32
-    ":d"
+    ":dg:N:R:"
 #endif
     ;
 
@@ -174,12 +238,19 @@ parse_arg(int argc, char **argv, hsk_options_t *opt) {
     { "ns-ip", required_argument, NULL, 'i' },
     { "rs-config", required_argument, NULL, 'u' },
     { "pool-size", required_argument, NULL, 'p' },
+    { "threads", required_argument, NULL, 't' },
     { "identity-key", required_argument, NULL, 'k' },
+    { "sig0-worker", no_argument, NULL, 'w' },
+    { "sig0-no-id", no_argument, NULL, 'x' },
+    { "resume-sessions", no_argument, NULL, 'e' },
     { "seeds", required_argument, NULL, 's' },
     { "log-file", required_argument, NULL, 'l' },
     { "user-agent", required_argument, NULL, 'a' },
 #ifndef _WIN32
     { "daemon", no_argument, NULL, 'd' },
+    { "handoff", required_argument, NULL, 'g' },
+    { "ns-fd", required_argument, NULL, 'N' },
+    { "rs-fd", required_argument, NULL, 'R' },
 #endif
     { "help", no_argument, NULL, 'h' }
   };
@@ -274,6 +345,20 @@ parse_arg(int argc, char **argv, hsk_options_t *opt) {
         break;
       }
 
+      case 't': {
+        if (!optarg || strlen(optarg) == 0)
+          return help(1);
+
+        int threads = atoi(optarg);
+
+        if (threads < 0 || threads > HSK_WORKERS_MAX)
+          return help(1);
+
+        opt->threads = threads;
+
+        break;
+      }
+
       case 'k': {
         if (!optarg || strlen(optarg) == 0)
           return help(1);
@@ -289,6 +374,21 @@ parse_arg(int argc, char **argv, hsk_options_t *opt) {
         break;
       }
 
+      case 'w': {
+        opt->sig0_worker = true;
+        break;
+      }
+
+      case 'x': {
+        opt->sig0_noid = true;
+        break;
+      }
+
+      case 'e': {
+        opt->resume = true;
+        break;
+      }
+
       case 's': {
         if (!optarg || strlen(optarg) == 0)
           return help(1);
@@ -330,6 +430,42 @@ parse_arg(int argc, char **argv, hsk_options_t *opt) {
         background = true;
         break;
       }
+
+      case 'g': {
+        if (!optarg || strlen(optarg) == 0)
+          return help(1);
+
+        if (opt->handoff)
+          free(opt->handoff);
+
+        opt->handoff = strdup(optarg);
+
+        break;
+      }
+
+      case 'N': {
+        if (!optarg || strlen(optarg) == 0)
+          return help(1);
+
+        opt->ns_fd = atoi(optarg);
+
+        if (opt->ns_fd < 0)
+          return help(1);
+
+        break;
+      }
+
+      case 'R': {
+        if (!optarg || strlen(optarg) == 0)
+          return help(1);
+
+        opt->rs_fd = atoi(optarg);
+
+        if (opt->rs_fd < 0)
+          return help(1);
+
+        break;
+      }
 #endif
 
       case '?': {
@@ -341,6 +477,34 @@ parse_arg(int argc, char **argv, hsk_options_t *opt) {
   if (optind < argc)
     return help(1);
 
+#ifndef _WIN32
+  // Before daemonizing, which changes our pid. Given fds take precedence.
+  int ns_fd, rs_fd;
+
+  if (hsk_activation_listen_fds(&ns_fd, &rs_fd) != HSK_SUCCESS)
+    exit(1);
+
+  if (opt->ns_fd == -1)
+    opt->ns_fd = ns_fd;
+
+  if (opt->rs_fd == -1)
+    opt->rs_fd = rs_fd;
+
+  if (opt->ns_fd != -1 && opt->ns_fd == opt->rs_fd)
+    return help(1);
+
+  // The rs forwards to the ns, so it needs the address the ns is really on.
+  if (opt->ns_fd != -1) {
+    if (hsk_activation_check(opt->ns_fd, opt->ns_host) != HSK_SUCCESS)
+      exit(1);
+  }
+
+  if (opt->rs_fd != -1) {
+    if (hsk_activation_check(opt->rs_fd, opt->rs_host) != HSK_SUCCESS)
+      exit(1);
+  }
+#endif
+
   if (!has_ip)
     hsk_sa_copy(opt->ns_ip, opt->ns_host);
 
@@ -393,6 +557,13 @@ typedef struct {
   hsk_pool_t *pool;
   hsk_ns_t *ns;
   hsk_rs_t *rs;
+#ifndef _WIN32
+  hsk_handoff_t *handoff;
+  // Polls the pool while passed-in sockets wait for the chain.
+  uv_timer_t *wait_timer;
+#endif
+  hsk_options_t *opt;
+  hsk_conf_t conf;
 } hsk_daemon_t;
 
 static void
@@ -400,7 +571,60 @@ hsk_daemon_after_close(void *data);
 static void
 hsk_daemon_signal_shutdown(void *data);
 static void
+hsk_daemon_signal_reload(void *data);
+static void
 hsk_daemon_uninit(hsk_daemon_t *data);
+void
+hsk_daemon_close(hsk_daemon_t *daemon);
+#ifndef _WIN32
+static void
+hsk_daemon_stop_waiting(hsk_daemon_t *daemon);
+#endif
+
+// Read the config file, if there is one. Command line options win.
+static int
+hsk_daemon_load_conf(hsk_conf_t *conf, const hsk_options_t *opt) {
+  hsk_conf_init(conf);
+
+  if (opt->config) {
+    int rc = hsk_conf_load(conf, opt->config);
+
+    if (rc != HSK_SUCCESS)
+      return rc;
+  }
+
+  if (opt->pool_size != -1)
+    conf->pool_size = opt->pool_size;
+
+  if (opt->threads != -1)
+    conf->threads = opt->threads;
+
+  return HSK_SUCCESS;
+}
+
+// Apply the settings that can change while running.
+static int
+hsk_daemon_apply_conf(hsk_daemon_t *daemon) {
+  const hsk_conf_t *conf = &daemon->conf;
+
+  // A smaller pool only stops new connections; peers stay connected.
+  if (!hsk_pool_set_size(daemon->pool, conf->pool_size)
+      || !hsk_pool_set_buffer(daemon->pool, conf->peer_buffer)
+      || !hsk_pool_set_orphans(daemon->pool, conf->orphans)
+      || !hsk_pool_set_timeouts(daemon->pool, &conf->timeouts)) {
+    fprintf(stderr, "failed configuring pool\n");
+    return HSK_EFAILURE;
+  }
+
+  if (!hsk_ns_set_cache(daemon->ns, conf->cache_size, conf->cache_ttl)
+      || !hsk_ns_set_buffer(daemon->ns, conf->udp_buffer)
+      || !hsk_ns_set_rate_limit(daemon->ns, conf->rate_limit)) {
+    fprintf(stderr, "failed configuring ns\n");
+    return HSK_EFAILURE;
+  }
+
+  return HSK_SUCCESS;
+}
 
 int
 hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
@@ -408,8 +632,18 @@ hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
   daemon->pool = NULL;
   daemon->ns = NULL;
   daemon->rs = NULL;
+#ifndef _WIN32
+  daemon->handoff = NULL;
+  daemon->wait_timer = NULL;
+#endif
+  daemon->opt = opt;
 
-  int rc = HSK_SUCCESS;
+  int rc = hsk_daemon_load_conf(&daemon->conf, opt);
+
+  if (rc != HSK_SUCCESS) {
+    fprintf(stderr, "failed loading config\n");
+    return rc;
+  }
 
   daemon->signals = hsk_signals_alloc(loop, (void *)daemon,
                                       hsk_daemon_signal_shutdown);
@@ -420,6 +654,13 @@ hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
     goto fail;
   }
 
+  if (hsk_signals_set_reload(daemon->signals,
+                             hsk_daemon_signal_reload) != HSK_SUCCESS) {
+    fprintf(stderr, "failed initializing reload handler\n");
+    rc = HSK_EFAILURE;
+    goto fail;
+  }
+
   daemon->pool = hsk_pool_alloc(loop);
 
   if (!daemon->pool) {
@@ -436,12 +677,14 @@ hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
     }
   }
 
-  if (!hsk_pool_set_size(daemon->pool, opt->pool_size)) {
-    fprintf(stderr, "failed setting pool size\n");
+  if (!hsk_pool_set_threads(daemon->pool, daemon->conf.threads)) {
+    fprintf(stderr, "failed setting worker threads\n");
     rc = HSK_EFAILURE;
     goto fail;
   }
 
+  hsk_pool_set_resume(daemon->pool, opt->resume);
+
   if (!hsk_pool_set_seeds(daemon->pool, opt->seeds)) {
     fprintf(stderr, "failed adding seeds\n");
     rc = HSK_EFAILURE;
@@ -476,6 +719,14 @@ hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
     }
   }
 
+  hsk_ns_set_sign_offload(daemon->ns, opt->sig0_worker);
+  hsk_ns_set_sign_noid(daemon->ns, opt->sig0_noid);
+
+  rc = hsk_daemon_apply_conf(daemon);
+
+  if (rc != HSK_SUCCESS)
+    goto fail;
+
   daemon->rs = hsk_rs_alloc(loop, opt->ns_host);
 
   if (!daemon->rs) {
@@ -500,6 +751,19 @@ hsk_daemon_init(hsk_daemon_t *daemon, uv_loop_t *loop, hsk_options_t *opt) {
     }
   }
 
+#ifndef _WIN32
+  if (opt->handoff) {
+    daemon->handoff = hsk_handoff_alloc(loop, opt->handoff,
+                                        daemon->ns, daemon->rs);
+
+    if (!daemon->handoff) {
+      fprintf(stderr, "failed initializing handoff\n");
+      rc = HSK_EFAILURE;
+      goto fail;
+    }
+  }
+#endif
+
   return HSK_SUCCESS;
 
 fail:
@@ -517,6 +781,15 @@ hsk_daemon_uninit(hsk_daemon_t *daemon) {
     daemon->signals = NULL;
   }
 
+#ifndef _WIN32
+  if (daemon->handoff) {
+    hsk_handoff_free(daemon->handoff);
+    daemon->handoff = NULL;
+  }
+
+  hsk_daemon_stop_waiting(daemon);
+#endif
+
   if (daemon->rs) {
     hsk_rs_free(daemon->rs);
     daemon->rs = NULL;
@@ -533,9 +806,124 @@ hsk_daemon_uninit(hsk_daemon_t *daemon) {
   }
 }
 
+#ifndef _WIN32
+static bool
+hsk_daemon_ready(void *data) {
+  hsk_daemon_t *daemon = (hsk_daemon_t *)data;
+  return hsk_pool_is_ready(daemon->pool);
+}
+
+static void
+hsk_daemon_handed_off(void *data) {
+  hsk_daemon_t *daemon = (hsk_daemon_t *)data;
+  printf("handed off, shutting down\n");
+  hsk_daemon_close(daemon);
+}
+
+static void
+hsk_daemon_stop_waiting(hsk_daemon_t *daemon) {
+  if (!daemon->wait_timer)
+    return;
+
+  uv_timer_stop(daemon->wait_timer);
+  daemon->wait_timer->data = NULL;
+  hsk_uv_close_free((uv_handle_t *)daemon->wait_timer);
+  daemon->wait_timer = NULL;
+}
+
+static void
+after_wait_timer(uv_timer_t *timer) {
+  hsk_daemon_t *daemon = (hsk_daemon_t *)timer->data;
+
+  if (!daemon || !hsk_pool_is_ready(daemon->pool))
+    return;
+
+  hsk_daemon_stop_waiting(daemon);
+
+  if (hsk_ns_resume(daemon->ns) != HSK_SUCCESS
+      || hsk_rs_resume(daemon->rs) != HSK_SUCCESS) {
+    fprintf(stderr, "failed to start reading queries\n");
+    hsk_daemon_close(daemon);
+    return;
+  }
+
+  printf("chain ready, answering queries\n");
+}
+
+// Sockets that were passed in may already have queries waiting. Leave them
+// there until the chain is ready to answer them, rather than failing them.
+static int
+hsk_daemon_wait(hsk_daemon_t *daemon) {
+  daemon->wait_timer = malloc(sizeof(uv_timer_t));
+
+  if (!daemon->wait_timer)
+    return HSK_ENOMEM;
+
+  if (uv_timer_init(daemon->ns->loop, daemon->wait_timer) != 0) {
+    free(daemon->wait_timer);
+    daemon->wait_timer = NULL;
+    return HSK_EFAILURE;
+  }
+
+  daemon->wait_timer->data = (void *)daemon;
+
+  if (hsk_ns_pause(daemon->ns) != HSK_SUCCESS
+      || hsk_rs_pause(daemon->rs) != HSK_SUCCESS) {
+    return HSK_EFAILURE;
+  }
+
+  if (uv_timer_start(daemon->wait_timer, after_wait_timer,
+                     HSK_DAEMON_WAIT_POLL, HSK_DAEMON_WAIT_POLL) != 0) {
+    return HSK_EFAILURE;
+  }
+
+  printf("waiting for the chain before answering queries\n");
+
+  return HSK_SUCCESS;
+}
+#endif
+
 int
 hsk_daemon_open(hsk_daemon_t *daemon, hsk_options_t *opt) {
   int rc = HSK_SUCCESS;
+  uv_udp_t *ns_socket = NULL;
+  uv_udp_t *rs_socket = NULL;
+  bool passed = false;
+
+#ifndef _WIN32
+  if (daemon->handoff) {
+    rc = hsk_handoff_take(daemon->handoff, &ns_socket, &rs_socket);
+
+    if (rc != HSK_SUCCESS) {
+      fprintf(stderr, "failed taking over: %s\n", hsk_strerror(rc));
+      return rc;
+    }
+  }
+
+  // Sockets from a previous process are already serving; the handoff waits
+  // for the chain with those itself.
+  if (!ns_socket && opt->ns_fd != -1) {
+    ns_socket = hsk_uv_udp_open(daemon->ns->loop, opt->ns_fd);
+
+    if (!ns_socket) {
+      fprintf(stderr, "failed opening ns fd %d\n", opt->ns_fd);
+      return HSK_EFAILURE;
+    }
+
+    passed = true;
+  }
+
+  if (!rs_socket && opt->rs_fd != -1) {
+    rs_socket = hsk_uv_udp_open(daemon->rs->loop, opt->rs_fd);
+
+    if (!rs_socket) {
+      fprintf(stderr, "failed opening rs fd %d\n", opt->rs_fd);
+      return HSK_EFAILURE;
+    }
+
+    passed = true;
+  }
+#endif
 
   rc = hsk_pool_open(daemon->pool);
 
@@ -544,20 +932,47 @@ hsk_daemon_open(hsk_daemon_t *daemon, hsk_options_t *opt) {
     return rc;
   }
 
-  rc = hsk_ns_open(daemon->ns, opt->ns_host);
+  if (ns_socket)
+    rc = hsk_ns_open_socket(daemon->ns, ns_socket);
+  else
+    rc = hsk_ns_open(daemon->ns, opt->ns_host);
 
   if (rc != HSK_SUCCESS) {
     fprintf(stderr, "failed opening ns: %s\n", hsk_strerror(rc));
     return rc;
   }
 
-  rc = hsk_rs_open(daemon->rs, opt->rs_host);
+  if (rs_socket)
+    rc = hsk_rs_open_socket(daemon->rs, rs_socket);
+  else
+    rc = hsk_rs_open(daemon->rs, opt->rs_host);
 
   if (rc != HSK_SUCCESS) {
     fprintf(stderr, "failed opening rns: %s\n", hsk_strerror(rc));
     return rc;
   }
 
+#ifndef _WIN32
+  if (daemon->handoff) {
+    rc = hsk_handoff_open(daemon->handoff, (void *)daemon,
+                          hsk_daemon_ready, hsk_daemon_handed_off);
+
+    if (rc != HSK_SUCCESS) {
+      fprintf(stderr, "failed opening handoff: %s\n", hsk_strerror(rc));
+      return rc;
+    }
+  }
+
+  if (passed) {
+    rc = hsk_daemon_wait(daemon);
+
+    if (rc != HSK_SUCCESS) {
+      fprintf(stderr, "failed waiting for chain: %s\n", hsk_strerror(rc));
+      return rc;
+    }
+  }
+#endif
+
   return HSK_SUCCESS;
 }
 
@@ -592,6 +1007,13 @@ static void
 hsk_daemon_after_close(void *data) {
   hsk_daemon_t *daemon = (hsk_daemon_t *)data;
 
+#ifndef _WIN32
+  if (daemon->handoff)
+    hsk_handoff_close(daemon->handoff);
+
+  hsk_daemon_stop_waiting(daemon);
+#endif
+
   if (daemon->ns) {
     int rc = hsk_ns_close(daemon->ns);
 
@@ -615,6 +1037,31 @@ hsk_daemon_signal_shutdown(void *data) {
   hsk_daemon_close(daemon);
 }
 
+static void
+hsk_daemon_signal_reload(void *data) {
+  hsk_daemon_t *daemon = (hsk_daemon_t *)data;
+
+  if (!daemon->opt->config) {
+    printf("no config file to reload\n");
+    return;
+  }
+
+  printf("reloading %s\n", daemon->opt->config);
+
+  hsk_conf_t next;
+
+  if (hsk_daemon_load_conf(&next, daemon->opt) != HSK_SUCCESS) {
+    printf("keeping the current config\n");
+    return;
+  }
+
+  if (hsk_conf_reload(&daemon->conf, &next) == 0)
+    return;
+
+  if (hsk_daemon_apply_conf(daemon) != HSK_SUCCESS)
+    printf("config only partly applied\n");
+}
+
 /*
  * Main
  */
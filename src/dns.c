@@ -15,16 +15,37 @@
 #include "sha256.h"
 #include "utils.h"
 
-typedef struct hsk_dns_raw_rr_s {
-  uint8_t *data;
-  size_t size;
-} hsk_dns_raw_rr_t;
+// Canonical RRset encoding in hsk_dns_sighash() stays on the stack
+// unless the set is larger than this.
+#define HSK_DNS_SIGHASH_ARENA 4096
+#define HSK_DNS_SIGHASH_RRS 64
+
+static size_t
+canonical_name_lower(uint8_t *data, size_t len);
+
+static void
+canonical_rd_lower(uint8_t *rd, size_t len, uint16_t type);
 
 static int
-raw_rr_cmp(const void *a, const void *b);
+canonical_rd_cmp(const uint8_t *a, const uint8_t *b);
+
+static void
+hsk_dns_cmp_init(hsk_dns_cmp_t *cmp, uint8_t *msg);
+
+static void
+hsk_dns_cmp_uninit(hsk_dns_cmp_t *cmp);
+
+static void
+hsk_dns_cmp_add(hsk_dns_cmp_t *cmp, size_t slot, uint32_t hash, size_t off);
+
+static bool
+hsk_dns_name_skip(uint8_t **data, size_t *data_len);
 
 static bool
-raw_rr_equal(const hsk_dns_raw_rr_t *a, const hsk_dns_raw_rr_t *b);
+hsk_dns_cmp_match(const hsk_dns_cmp_t *cmp, size_t off, const uint8_t *name);
+
+static int
+hsk_dns_cmp_compress(hsk_dns_cmp_t *cmp, uint8_t *data, int len);
 
 /*
  * Message
@@ -108,8 +129,7 @@ hsk_dns_msg_write(const hsk_dns_msg_t *msg, uint8_t **data) {
 
   if (data) {
     cmp = &cmp_;
-    hsk_map_init_str_map(&cmp->map, NULL);
-    cmp->msg = *data;
+    hsk_dns_cmp_init(cmp, *data);
   }
 
   flags &= ~(0x0f << 11);
@@ -162,7 +182,7 @@ hsk_dns_msg_write(const hsk_dns_msg_t *msg, uint8_t **data) {
   }
 
   if (cmp)
-    hsk_map_uninit(&cmp->map);
+    hsk_dns_cmp_uninit(cmp);
 
   return size;
 }
@@ -368,10 +388,11 @@ hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg) {
     if (!qs)
       goto fail;
 
-    if (!hsk_dns_qs_read(data, data_len, &dmp, qs))
+    if (!hsk_dns_qs_read(data, data_len, &dmp, qs)
+        || !hsk_dns_rrs_push(&msg->qd, qs)) {
+      hsk_dns_qs_free(qs);
       goto fail;
-
-    hsk_dns_rrs_push(&msg->qd, qs);
+    }
   }
 
   for (i = 0; i < ancount; i++) {
@@ -383,10 +404,11 @@ hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg) {
     if (!rr)
       goto fail;
 
-    if (!hsk_dns_rr_read(data, data_len, &dmp, rr))
+    if (!hsk_dns_rr_read(data, data_len, &dmp, rr)
+        || !hsk_dns_rrs_push(&msg->an, rr)) {
+      hsk_dns_rr_free(rr);
       goto fail;
-
-    hsk_dns_rrs_push(&msg->an, rr);
+    }
   }
 
   for (i = 0; i < nscount; i++) {
@@ -398,10 +420,11 @@ hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg) {
     if (!rr)
       goto fail;
 
-    if (!hsk_dns_rr_read(data, data_len, &dmp, rr))
+    if (!hsk_dns_rr_read(data, data_len, &dmp, rr)
+        || !hsk_dns_rrs_push(&msg->ns, rr)) {
+      hsk_dns_rr_free(rr);
       goto fail;
-
-    hsk_dns_rrs_push(&msg->ns, rr);
+    }
   }
 
   for (i = 0; i < arcount; i++) {
@@ -413,8 +436,10 @@ hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg) {
     if (!rr)
       goto fail;
 
-    if (!hsk_dns_rr_read(data, data_len, &dmp, rr))
+    if (!hsk_dns_rr_read(data, data_len, &dmp, rr)) {
+      hsk_dns_rr_free(rr);
       goto fail;
+    }
 
     if (rr->type == HSK_DNS_OPT) {
       hsk_dns_opt_rd_t *opt = (hsk_dns_opt_rd_t *)rr->rd;
@@ -437,20 +462,381 @@ hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg) {
       continue;
     }
 
-    hsk_dns_rrs_push(&msg->ar, rr);
+    if (!hsk_dns_rrs_push(&msg->ar, rr)) {
+      hsk_dns_rr_free(rr);
+      goto fail;
+    }
   }
 
   return true;
 
 fail:
-  hsk_dns_rrs_uninit(&msg->qd);
-  hsk_dns_rrs_uninit(&msg->an);
-  hsk_dns_rrs_uninit(&msg->ns);
-  hsk_dns_rrs_uninit(&msg->ar);
+  hsk_dns_msg_uninit(msg);
   hsk_dns_msg_init(msg);
   return false;
 }
 
+/*
+ * View
+ */
+
+// Step over a name without following compression pointers.
+static bool
+hsk_dns_name_skip(uint8_t **data, size_t *data_len) {
+  uint8_t *d = *data;
+  size_t len = *data_len;
+
+  for (;;) {
+    if (len == 0)
+      return false;
+
+    uint8_t c = d[0];
+
+    if ((c & 0xc0) == 0xc0) {
+      if (len < 2)
+        return false;
+      d += 2;
+      len -= 2;
+      break;
+    }
+
+    if (c & 0xc0)
+      return false;
+
+    if (len < 1 + (size_t)c)
+      return false;
+
+    d += 1 + c;
+    len -= 1 + c;
+
+    if (c == 0)
+      break;
+  }
+
+  *data = d;
+  *data_len = len;
+
+  return true;
+}
+
+bool
+hsk_dns_view_init(hsk_dns_view_t *view, const uint8_t *data, size_t data_len) {
+  assert(view && data);
+
+  uint8_t *d = (uint8_t *)data;
+  size_t len = data_len;
+  uint16_t counts[4];
+
+  hsk_dns_dmp_t dmp;
+  dmp.msg = (uint8_t *)data;
+  dmp.msg_len = data_len;
+
+  memset(view, 0x00, sizeof(hsk_dns_view_t));
+
+  view->msg = data;
+  view->msg_len = data_len;
+
+  if (!read_u16be(&d, &len, &view->id))
+    return false;
+
+  if (!read_u16be(&d, &len, &view->flags))
+    return false;
+
+  int s;
+  for (s = 0; s < 4; s++) {
+    if (!read_u16be(&d, &len, &counts[s]))
+      return false;
+  }
+
+  view->opcode = (view->flags >> 11) & 0x0f;
+  view->code = view->flags & 0x0f;
+
+  // Same leniency as hsk_dns_msg_read():
+  // a short message ends early.
+  for (s = 0; s < 4; s++) {
+    uint32_t i;
+
+    view->offsets[s] = d - data;
+
+    for (i = 0; i < counts[s]; i++) {
+      if (len == 0)
+        break;
+
+      if (!hsk_dns_name_read(&d, &len, &dmp, NULL))
+        return false;
+
+      if (s == HSK_DNS_SECTION_QD) {
+        if (len < 4)
+          return false;
+
+        d += 4;
+        len -= 4;
+
+        view->counts[s] += 1;
+
+        continue;
+      }
+
+      uint16_t type, class, rdlen;
+      uint32_t ttl;
+
+      if (!read_u16be(&d, &len, &type))
+        return false;
+
+      if (!read_u16be(&d, &len, &class))
+        return false;
+
+      if (!read_u32be(&d, &len, &ttl))
+        return false;
+
+      if (!read_u16be(&d, &len, &rdlen))
+        return false;
+
+      if (len < rdlen)
+        return false;
+
+      if (s == HSK_DNS_SECTION_AR && type == HSK_DNS_OPT) {
+        view->edns.enabled = true;
+        view->edns.code = (ttl >> 24) & 0xff;
+        view->edns.version = (ttl >> 16) & 0xff;
+        view->edns.flags = ttl & 0xffff;
+        view->edns.size = class;
+        view->edns.rd_off = d - data;
+        view->edns.rd_len = rdlen;
+      } else {
+        view->counts[s] += 1;
+      }
+
+      d += rdlen;
+      len -= rdlen;
+    }
+  }
+
+  view->offsets[4] = d - data;
+
+  if (view->edns.enabled)
+    view->code |= view->edns.code << 4;
+
+  return true;
+}
+
+void
+hsk_dns_view_iter(
+  const hsk_dns_view_t *view,
+  int section,
+  hsk_dns_iter_t *it
+) {
+  assert(view && it);
+  assert(section >= 0 && section < 4);
+
+  it->view = view;
+  it->section = section;
+  it->off = view->offsets[section];
+  it->end = view->offsets[section + 1];
+}
+
+bool
+hsk_dns_iter_next(hsk_dns_iter_t *it, hsk_dns_view_rr_t *rr) {
+  assert(it && rr);
+
+  const hsk_dns_view_t *view = it->view;
+
+  while (it->off < it->end) {
+    uint8_t *d = (uint8_t *)&view->msg[it->off];
+    size_t len = it->end - it->off;
+
+    rr->section = it->section;
+    rr->off = it->off;
+    rr->ttl = 0;
+    rr->rd_len = 0;
+
+    // Already checked by hsk_dns_view_init().
+    if (!hsk_dns_name_skip(&d, &len))
+      return false;
+
+    if (!read_u16be(&d, &len, &rr->type))
+      return false;
+
+    if (!read_u16be(&d, &len, &rr->class))
+      return false;
+
+    if (it->section != HSK_DNS_SECTION_QD) {
+      if (!read_u32be(&d, &len, &rr->ttl))
+        return false;
+
+      if (!read_u16be(&d, &len, &rr->rd_len))
+        return false;
+
+      if (len < rr->rd_len)
+        return false;
+    }
+
+    rr->rd_off = d - view->msg;
+
+    it->off = rr->rd_off + rr->rd_len;
+
+    if (it->section == HSK_DNS_SECTION_AR && rr->type == HSK_DNS_OPT)
+      continue;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool
+hsk_dns_view_name(const hsk_dns_view_t *view, size_t off, char *name) {
+  assert(view && name);
+
+  if (off >= view->msg_len)
+    return false;
+
+  uint8_t *d = (uint8_t *)&view->msg[off];
+  size_t len = view->msg_len - off;
+
+  hsk_dns_dmp_t dmp;
+  dmp.msg = (uint8_t *)view->msg;
+  dmp.msg_len = view->msg_len;
+
+  return hsk_dns_name_read(&d, &len, &dmp, name);
+}
+
+bool
+hsk_dns_view_rd(
+  const hsk_dns_view_t *view,
+  const hsk_dns_view_rr_t *rr,
+  void **rd
+) {
+  assert(view && rr && rd);
+
+  if (rr->section == HSK_DNS_SECTION_QD)
+    return false;
+
+  void *r = hsk_dns_rd_alloc(rr->type);
+
+  if (!r)
+    return false;
+
+  uint8_t *d = (uint8_t *)&view->msg[rr->rd_off];
+  size_t len = rr->rd_len;
+
+  hsk_dns_dmp_t dmp;
+  dmp.msg = (uint8_t *)view->msg;
+  dmp.msg_len = view->msg_len;
+
+  if (!hsk_dns_rd_read(&d, &len, &dmp, r, rr->type)) {
+    hsk_dns_rd_free(r, rr->type);
+    return false;
+  }
+
+  *rd = r;
+
+  return true;
+}
+
+bool
+hsk_dns_view_rr(
+  const hsk_dns_view_t *view,
+  const hsk_dns_view_rr_t *rr,
+  hsk_dns_rr_t **ret
+) {
+  assert(view && rr && ret);
+
+  hsk_dns_rr_t *r = hsk_dns_rr_alloc();
+
+  if (!r)
+    return false;
+
+  if (!hsk_dns_view_name(view, rr->off, r->name))
+    goto fail;
+
+  r->type = rr->type;
+  r->class = rr->class;
+  r->ttl = rr->ttl;
+
+  if (rr->section != HSK_DNS_SECTION_QD) {
+    if (!hsk_dns_view_rd(view, rr, &r->rd))
+      goto fail;
+  }
+
+  *ret = r;
+
+  return true;
+
+fail:
+  hsk_dns_rr_free(r);
+  return false;
+}
+
+bool
+hsk_dns_view_msg(
+  const hsk_dns_view_t *view,
+  int sections,
+  hsk_dns_msg_t **msg
+) {
+  assert(view && msg);
+
+  hsk_dns_msg_t *m = hsk_dns_msg_alloc();
+
+  if (!m)
+    return false;
+
+  m->id = view->id;
+  m->opcode = view->opcode;
+  m->code = view->code;
+  m->flags = view->flags;
+
+  if (view->edns.enabled) {
+    m->edns.enabled = true;
+    m->edns.code = view->edns.code;
+    m->edns.version = view->edns.version;
+    m->edns.flags = view->edns.flags;
+    m->edns.size = view->edns.size;
+
+    if (view->edns.rd_len > 0) {
+      m->edns.rd = malloc(view->edns.rd_len);
+
+      if (!m->edns.rd)
+        goto fail;
+
+      memcpy(m->edns.rd, &view->msg[view->edns.rd_off], view->edns.rd_len);
+      m->edns.rd_len = view->edns.rd_len;
+    }
+  }
+
+  hsk_dns_rrs_t *rrs[4] = { &m->qd, &m->an, &m->ns, &m->ar };
+  int s;
+
+  for (s = 0; s < 4; s++) {
+    if (!(sections & (1 << s)))
+      continue;
+
+    hsk_dns_iter_t it;
+    hsk_dns_view_rr_t vr;
+
+    hsk_dns_view_iter(view, s, &it);
+
+    while (hsk_dns_iter_next(&it, &vr)) {
+      hsk_dns_rr_t *rr;
+
+      if (!hsk_dns_view_rr(view, &vr, &rr))
+        goto fail;
+
+      // Sets hold 255 records at most.
+      if (hsk_dns_rrs_push(rrs[s], rr) == 0)
+        hsk_dns_rr_free(rr);
+    }
+  }
+
+  *msg = m;
+
+  return true;
+
+fail:
+  hsk_dns_msg_free(m);
+  return false;
+}
+
 /*
  * RRSet
  */
@@ -2209,6 +2595,159 @@ hsk_dns_name_parse(
   return noff;
 }
 
+static void
+hsk_dns_cmp_init(hsk_dns_cmp_t *cmp, uint8_t *msg) {
+  cmp->msg = msg;
+  cmp->count = 0;
+  memset(cmp->offsets, 0x00, sizeof(cmp->offsets));
+  cmp->spill = NULL;
+  cmp->spill_count = 0;
+  cmp->spill_cap = 0;
+}
+
+static void
+hsk_dns_cmp_uninit(hsk_dns_cmp_t *cmp) {
+  free(cmp->spill);
+  cmp->spill = NULL;
+  cmp->spill_count = 0;
+  cmp->spill_cap = 0;
+}
+
+static void
+hsk_dns_cmp_add(hsk_dns_cmp_t *cmp, size_t slot, uint32_t hash, size_t off) {
+  // Pointers are 14 bits.
+  if (off >= (1 << 14))
+    return;
+
+  // Keep the table at most three quarters full.
+  if (cmp->count < (HSK_DNS_CMP_SLOTS / 4) * 3) {
+    cmp->hashes[slot] = hash;
+    cmp->offsets[slot] = (uint16_t)(off + 1);
+    cmp->count += 1;
+    return;
+  }
+
+  if (cmp->spill_count == cmp->spill_cap) {
+    size_t cap = cmp->spill_cap ? cmp->spill_cap * 2 : 64;
+    hsk_dns_cmp_spill_t *spill =
+      realloc(cmp->spill, cap * sizeof(hsk_dns_cmp_spill_t));
+
+    // Out of memory only costs us compression.
+    if (!spill)
+      return;
+
+    cmp->spill = spill;
+    cmp->spill_cap = cap;
+  }
+
+  cmp->spill[cmp->spill_count].hash = hash;
+  cmp->spill[cmp->spill_count].offset = (uint16_t)off;
+  cmp->spill_count += 1;
+}
+
+// Whether the (possibly compressed) name at `off` in the
+// message is byte-for-byte the uncompressed name `name`.
+static bool
+hsk_dns_cmp_match(const hsk_dns_cmp_t *cmp, size_t off, const uint8_t *name) {
+  const uint8_t *msg = cmp->msg;
+  int hops = 0;
+
+  for (;;) {
+    uint8_t c = msg[off];
+
+    if ((c & 0xc0) == 0xc0) {
+      // We only ever point backwards, but be safe.
+      if (++hops > HSK_DNS_MAX_LABELS)
+        return false;
+      off = ((c & 0x3f) << 8) | msg[off + 1];
+      continue;
+    }
+
+    if (c != name[0])
+      return false;
+
+    if (c == 0)
+      return true;
+
+    if (memcmp(&msg[off + 1], &name[1], c) != 0)
+      return false;
+
+    off += 1 + c;
+    name += 1 + c;
+  }
+}
+
+// `data` holds a name just written out uncompressed. Replace its longest
+// suffix seen earlier in the message with a pointer, index the suffixes in
+// front of that, and return the new length.
+static int
+hsk_dns_cmp_compress(hsk_dns_cmp_t *cmp, uint8_t *data, int len) {
+  const size_t mask = HSK_DNS_CMP_SLOTS - 1;
+  int labels[HSK_DNS_MAX_LABELS];
+  uint32_t hashes[HSK_DNS_MAX_LABELS];
+  int count = 0;
+  int off = 0;
+  int i;
+
+  while (data[off] != 0) {
+    if (count == HSK_DNS_MAX_LABELS)
+      return len;
+    labels[count++] = off;
+    off += 1 + data[off];
+  }
+
+  // Hash each suffix from the right, so
+  // every label is only hashed once.
+  uint32_t hash = 0x811c9dc5;
+
+  for (i = count - 1; i >= 0; i--) {
+    int j = labels[i];
+    int end = j + 1 + data[j];
+
+    for (; j < end; j++)
+      hash = (hash ^ data[j]) * 0x01000193;
+
+    hashes[i] = hash;
+  }
+
+  for (i = 0; i < count; i++) {
+    const uint8_t *name = &data[labels[i]];
+    size_t slot = hashes[i] & mask;
+    size_t ptr = SIZE_MAX;
+    size_t j;
+
+    while (cmp->offsets[slot] != 0) {
+      size_t o = cmp->offsets[slot] - 1;
+
+      if (cmp->hashes[slot] == hashes[i] && hsk_dns_cmp_match(cmp, o, name)) {
+        ptr = o;
+        break;
+      }
+
+      slot = (slot + 1) & mask;
+    }
+
+    for (j = 0; ptr == SIZE_MAX && j < cmp->spill_count; j++) {
+      const hsk_dns_cmp_spill_t *s = &cmp->spill[j];
+
+      if (s->hash == hashes[i] && hsk_dns_cmp_match(cmp, s->offset, name))
+        ptr = s->offset;
+    }
+
+    if (ptr != SIZE_MAX) {
+      off = labels[i];
+      ptr ^= 0xc000;
+      data[off] = (ptr >> 8) & 0xff;
+      data[off + 1] = ptr & 0xff;
+      return off + 2;
+    }
+
+    hsk_dns_cmp_add(cmp, slot, hashes[i], (size_t)(name - cmp->msg));
+  }
+
+  return len;
+}
+
 static bool
 hsk_dns_name_serialize(
   const char *name,
@@ -2217,8 +2756,6 @@ hsk_dns_name_serialize(
   hsk_dns_cmp_t *cmp
 ) {
   int off = 0;
-  int pos = -1;
-  int ptr = -1;
   int begin = 0;
   size_t data_len = 256;
   int size;
@@ -2247,25 +2784,6 @@ hsk_dns_name_serialize(
         data[off] = size;
       }
 
-      if (cmp) {
-        char *sub = (char *)&name[begin];
-        if (strcmp(sub, ".") != 0) {
-          size_t p = (size_t)hsk_map_get(&cmp->map, sub);
-          if (p == 0) {
-            size_t o = (size_t)(&data[off] - cmp->msg);
-            if (o < (2 << 13))
-              hsk_map_set(&cmp->map, sub, (void *)o);
-          } else {
-            if (ptr == -1) {
-              ptr = p;
-              pos = off;
-              i += strlen(s);
-              break;
-            }
-          }
-        }
-      }
-
       off += 1;
 
       if (data) {
@@ -2306,23 +2824,6 @@ hsk_dns_name_serialize(
     return true;
   }
 
-  if (ptr != -1) {
-    off = pos;
-
-    if (data) {
-      if (off + 2 > data_len)
-        return false;
-      ptr ^= 0xc000;
-      data[off] = (ptr >> 8) & 0xff;
-      data[off + 1] = ptr & 0xff;
-    }
-
-    off += 2;
-    *len = off;
-
-    return true;
-  }
-
   if (data) {
     if (off >= data_len) {
       *len = off;
@@ -2333,6 +2834,11 @@ hsk_dns_name_serialize(
 
   off += 1;
 
+  // The name is written out in full first, then
+  // cut short at its longest previously seen suffix.
+  if (cmp && data)
+    off = hsk_dns_cmp_compress(cmp, data, off);
+
   *len = off;
 
   return true;
@@ -2402,25 +2908,28 @@ hsk_dns_name_alloc(
   return true;
 }
 
+static bool
+hsk_dns_char_dirty(uint8_t c) {
+  switch (c) {
+    case 0x28 /*(*/:
+    case 0x29 /*)*/:
+    case 0x3b /*;*/:
+    case 0x20 /* */:
+    case 0x40 /*@*/:
+    case 0x22 /*"*/:
+    case 0x5c /*\\*/:
+      return true;
+  }
+
+  return c < 0x20 || c > 0x7e;
+}
+
 bool
 hsk_dns_name_dirty(const char *name) {
   char *s = (char *)name;
 
   while (*s) {
-    uint8_t c = (uint8_t)*s;
-
-    switch (c) {
-      case 0x28 /*(*/:
-      case 0x29 /*)*/:
-      case 0x3b /*;*/:
-      case 0x20 /* */:
-      case 0x40 /*@*/:
-      case 0x22 /*"*/:
-      case 0x5c /*\\*/:
-        return true;
-    }
-
-    if (c < 0x20 || c > 0x7e)
+    if (hsk_dns_char_dirty((uint8_t)*s))
       return true;
 
     s += 1;
@@ -2565,6 +3074,185 @@ hsk_dns_name_cmp(const char *a, const char *b) {
   return 0;
 }
 
+void
+hsk_dns_name_init(hsk_dns_name_t *name) {
+  assert(name);
+  name->data[0] = 0;
+  name->size = 1;
+  name->count = 0;
+  name->hash = 0;
+  name->dirty = false;
+}
+
+bool
+hsk_dns_name_set(hsk_dns_name_t *name, const char *str) {
+  assert(name && str);
+
+  int len;
+
+  if (!hsk_dns_name_serialize(str, name->data, &len, NULL))
+    return false;
+
+  uint8_t *data = name->data;
+  size_t size = (size_t)len;
+  size_t off = 0;
+  int count = 0;
+
+  // FNV-1a, over the lowercased name.
+  uint32_t hash = 0x811c9dc5;
+  bool dirty = false;
+
+  while (off < size && data[off] != 0) {
+    size_t end = off + 1 + data[off];
+
+    if (end >= size || count == HSK_DNS_MAX_LABELS)
+      return false;
+
+    name->labels[count++] = off;
+
+    hash = (hash ^ data[off]) * 0x01000193;
+
+    for (off += 1; off < end; off++) {
+      // A dot within a label was 0xfe in the string.
+      if (data[off] == '.' || hsk_dns_char_dirty(data[off]))
+        dirty = true;
+
+      if (data[off] >= 'A' && data[off] <= 'Z')
+        data[off] += ' ';
+
+      hash = (hash ^ data[off]) * 0x01000193;
+    }
+  }
+
+  name->size = size;
+  name->count = count;
+  name->hash = hash;
+  name->dirty = dirty;
+
+  return true;
+}
+
+static bool
+hsk_dns_name_index(const hsk_dns_name_t *name, int *index) {
+  if (*index < 0)
+    *index += name->count;
+
+  return *index >= 0 && *index < name->count;
+}
+
+static char
+hsk_dns_name_char(uint8_t ch) {
+  // Inverse of hsk_dns_name_serialize().
+  if (ch == 0x00)
+    return (char)0xff;
+
+  if (ch == 0x2e)
+    return (char)0xfe;
+
+  return (char)ch;
+}
+
+static size_t
+hsk_dns_name_to_string(const uint8_t *data, size_t size, char *ret) {
+  size_t off = 0;
+  size_t len = 0;
+
+  while (off < size && data[off] != 0) {
+    size_t end = off + 1 + data[off];
+
+    for (off += 1; off < end; off++)
+      ret[len++] = hsk_dns_name_char(data[off]);
+
+    ret[len++] = '.';
+  }
+
+  ret[len] = '\0';
+
+  return len;
+}
+
+int
+hsk_dns_name_label(const hsk_dns_name_t *name, int index, char *ret) {
+  assert(name && ret);
+
+  if (!hsk_dns_name_index(name, &index)) {
+    ret[0] = '\0';
+    return 0;
+  }
+
+  const uint8_t *label = &name->data[name->labels[index]];
+  int i;
+
+  for (i = 0; i < label[0]; i++)
+    ret[i] = hsk_dns_name_char(label[1 + i]);
+
+  ret[i] = '\0';
+
+  return label[0];
+}
+
+int
+hsk_dns_name_from(const hsk_dns_name_t *name, int index, char *ret) {
+  assert(name && ret);
+
+  if (!hsk_dns_name_index(name, &index)) {
+    ret[0] = '\0';
+    return 0;
+  }
+
+  size_t off = name->labels[index];
+
+  return hsk_dns_name_to_string(&name->data[off], name->size - off, ret);
+}
+
+const uint8_t *
+hsk_dns_name_suffix(const hsk_dns_name_t *name, int index, size_t *size) {
+  assert(name && size);
+
+  if (!hsk_dns_name_index(name, &index)) {
+    *size = 1;
+    return &name->data[name->size - 1];
+  }
+
+  size_t off = name->labels[index];
+
+  *size = name->size - off;
+
+  return &name->data[off];
+}
+
+bool
+hsk_dns_name_equal(const hsk_dns_name_t *a, const hsk_dns_name_t *b) {
+  assert(a && b);
+
+  if (a->hash != b->hash || a->size != b->size)
+    return false;
+
+  return memcmp(a->data, b->data, a->size) == 0;
+}
+
+bool
+hsk_dns_name_is_subdomain(
+  const hsk_dns_name_t *parent,
+  const hsk_dns_name_t *child
+) {
+  assert(parent && child);
+
+  if (parent->count >= child->count)
+    return false;
+
+  // Everything is under the root, which has no label to index.
+  if (parent->count == 0)
+    return true;
+
+  size_t off = child->labels[child->count - parent->count];
+
+  if (child->size - off != parent->size)
+    return false;
+
+  return memcmp(&child->data[off], parent->data, parent->size) == 0;
+}
+
 /*
  * Labels
  */
@@ -2613,7 +3301,7 @@ hsk_dns_label_from2(
   if (index < 0)
     index += count;
 
-  if (index >= count) {
+  if (index < 0 || index >= count) {
     ret[0] = '\0';
     return 0;
   }
@@ -2661,7 +3349,7 @@ hsk_dns_label_get2(
   if (index < 0)
     index += count;
 
-  if (index >= count) {
+  if (index < 0 || index >= count) {
     ret[0] = '\0';
     return 0;
   }
@@ -3173,113 +3861,121 @@ hsk_dns_sighash(hsk_dns_rrs_t *rrset, hsk_dns_rr_t *sig, uint8_t *hash) {
     return false;
 
   hsk_dns_rrsig_rd_t *rrsig = (hsk_dns_rrsig_rd_t *)sig->rd;
+  hsk_dns_rr_t *first = rrset->items[0];
+
+  // Every record in the set shares the same owner, type, class and
+  // (original) TTL, so the canonical prefix only has to be built once.
+  uint8_t prefix[256 + 8];
+  uint8_t *data = prefix;
+  size_t prefix_len = 0;
+
+  prefix_len += hsk_dns_name_write(first->name, &data, NULL);
+  canonical_name_lower(prefix, prefix_len);
+  prefix_len += write_u16be(&data, first->type);
+  prefix_len += write_u16be(&data, first->class);
+  prefix_len += write_u32be(&data, rrsig->orig_ttl);
+
+  // Lay out rdlen || rdata for each record in an arena, on the
+  // stack for anything but unusually large RRsets.
+  uint8_t stack_arena[HSK_DNS_SIGHASH_ARENA];
+  size_t stack_offsets[HSK_DNS_SIGHASH_RRS];
+  uint8_t *arena = stack_arena;
+  size_t *offsets = stack_offsets;
+  uint8_t *heap = NULL;
+  size_t total = 0;
+  int count = rrset->size;
+  int i, j;
 
-  hsk_dns_raw_rr_t *records =
-    calloc(rrset->size, sizeof(hsk_dns_raw_rr_t));
+  for (i = 0; i < count; i++) {
+    hsk_dns_rr_t *rr = rrset->items[i];
+    total += 2;
+    if (rr->rd)
+      total += hsk_dns_rd_size(rr->rd, rr->type);
+  }
 
-  if (!records)
-    return false;
+  if (count > HSK_DNS_SIGHASH_RRS || total > sizeof(stack_arena)) {
+    heap = malloc(count * sizeof(size_t) + total);
 
-  int i, j;
-  uint8_t *data;
-  size_t size;
-  bool ret = true;
+    if (!heap)
+      return false;
 
-  for (i = 0; i < rrset->size; i++) {
-    hsk_dns_rr_t *item = rrset->items[i];
-    hsk_dns_rr_t *rr = hsk_dns_rr_clone(item);
+    offsets = (size_t *)heap;
+    arena = heap + count * sizeof(size_t);
+  }
 
-    if (!rr)
-      goto fail;
+  data = arena;
 
-    hsk_to_lower(rr->name);
+  for (i = 0; i < count; i++) {
+    hsk_dns_rr_t *rr = rrset->items[i];
+    uint8_t *pos = data;
+    int rdlen = 0;
 
-    rr->ttl = rrsig->orig_ttl;
+    data += 2;
 
-    switch (rr->type) {
-      case HSK_DNS_NS:
-        hsk_to_lower(((hsk_dns_ns_rd_t *)rr->rd)->ns);
-        break;
-      case HSK_DNS_CNAME:
-        hsk_to_lower(((hsk_dns_cname_rd_t *)rr->rd)->target);
-        break;
-      case HSK_DNS_SOA:
-        hsk_to_lower(((hsk_dns_soa_rd_t *)rr->rd)->ns);
-        hsk_to_lower(((hsk_dns_soa_rd_t *)rr->rd)->mbox);
-        break;
-      case HSK_DNS_PTR:
-        hsk_to_lower(((hsk_dns_ptr_rd_t *)rr->rd)->ptr);
-        break;
-      case HSK_DNS_MX:
-        hsk_to_lower(((hsk_dns_mx_rd_t *)rr->rd)->mx);
-        break;
-      case HSK_DNS_SIG:
-      case HSK_DNS_RRSIG:
-        hsk_to_lower(((hsk_dns_rrsig_rd_t *)rr->rd)->signer_name);
-        break;
-      case HSK_DNS_SRV:
-        hsk_to_lower(((hsk_dns_srv_rd_t *)rr->rd)->target);
-        break;
-      case HSK_DNS_DNAME:
-        hsk_to_lower(((hsk_dns_dname_rd_t *)rr->rd)->target);
-        break;
-    }
+    if (rr->rd)
+      rdlen = hsk_dns_rd_write(rr->rd, rr->type, &data, NULL);
 
-    if (!hsk_dns_rr_encode(rr, &data, &size)) {
-      hsk_dns_rr_free(rr);
-      goto fail;
-    }
+    write_u16be(&pos, rdlen);
+    canonical_rd_lower(pos, rdlen, rr->type);
 
-    hsk_dns_rr_free(rr);
+    offsets[i] = pos - 2 - arena;
+  }
 
-    hsk_dns_raw_rr_t *raw = &records[i];
+  // RRsets are nearly always tiny, insertion sort beats qsort here.
+  for (i = 1; i < count; i++) {
+    size_t off = offsets[i];
 
-    raw->size = size;
-    raw->data = data;
+    for (j = i; j > 0; j--) {
+      if (canonical_rd_cmp(&arena[offsets[j - 1]], &arena[off]) <= 0)
+        break;
+      offsets[j] = offsets[j - 1];
+    }
+
+    offsets[j] = off;
   }
 
-  qsort((void *)records, rrset->size, sizeof(hsk_dns_raw_rr_t), raw_rr_cmp);
+  // RRSIG RDATA minus the signature, with a lowercase signer.
+  uint8_t tbs[18 + 256];
 
-  if (!hsk_dns_rrsig_tbs(rrsig, &data, &size))
-    goto fail;
+  data = tbs;
+
+  size_t tbs_len = 0;
+  tbs_len += write_u16be(&data, rrsig->type_covered);
+  tbs_len += write_u8(&data, rrsig->algorithm);
+  tbs_len += write_u8(&data, rrsig->labels);
+  tbs_len += write_u32be(&data, rrsig->orig_ttl);
+  tbs_len += write_u32be(&data, rrsig->expiration);
+  tbs_len += write_u32be(&data, rrsig->inception);
+  tbs_len += write_u16be(&data, rrsig->key_tag);
+  tbs_len += hsk_dns_name_write(rrsig->signer_name, &data, NULL);
+  canonical_name_lower(&tbs[18], tbs_len - 18);
 
   hsk_sha256_ctx ctx;
   hsk_sha256_init(&ctx);
-  hsk_sha256_update(&ctx, data, size);
-
-  free(data);
+  hsk_sha256_update(&ctx, tbs, tbs_len);
 
-  hsk_dns_raw_rr_t *last = NULL;
+  const uint8_t *last = NULL;
 
-  for (j = 0; j < rrset->size; j++) {
-    hsk_dns_raw_rr_t *raw = &records[j];
+  for (i = 0; i < count; i++) {
+    const uint8_t *rd = &arena[offsets[i]];
+    size_t size = 2 + ((rd[0] << 8) | rd[1]);
 
-    if (last && raw_rr_equal(raw, last))
+    // Duplicates are adjacent once sorted.
+    if (last && canonical_rd_cmp(last, rd) == 0)
       continue;
 
-    hsk_sha256_update(&ctx, raw->data, raw->size);
+    hsk_sha256_update(&ctx, prefix, prefix_len);
+    hsk_sha256_update(&ctx, rd, size);
 
-    last = raw;
+    last = rd;
   }
 
   hsk_sha256_final(&ctx, hash);
 
-  goto done;
+  if (heap)
+    free(heap);
 
-fail:
-  ret = false;
-
-done:
-  for (j = 0; j < i; j++) {
-    hsk_dns_raw_rr_t *raw = &records[j];
-
-    if (raw->data)
-      free(raw->data);
-  }
-
-  free(records);
-
-  return ret;
+  return true;
 }
 
 bool
@@ -3352,66 +4048,96 @@ hsk_dns_rrs_clean(hsk_dns_rrs_t *rrs, uint16_t type) {
 
 bool
 hsk_dns_is_subdomain(const char *parent, const char *child) {
-  int parent_count = hsk_dns_label_count(parent);
-  int child_count = hsk_dns_label_count(child);
+  hsk_dns_name_t p, c;
 
-  if (parent_count >= child_count)
+  if (!hsk_dns_name_set(&p, parent) || !hsk_dns_name_set(&c, child))
     return false;
 
-  uint8_t child_labels[child_count];
-  hsk_dns_label_split(child, child_labels, child_count);
+  return hsk_dns_name_is_subdomain(&p, &c);
+}
 
-  char sub[HSK_DNS_MAX_LABEL + 1];
-  hsk_dns_label_from2(child, child_labels, child_count, parent_count * -1, sub);
+static size_t
+canonical_name_lower(uint8_t *data, size_t len) {
+  // Label lengths never fall in A-Z, but stop at the
+  // terminator so trailing RDATA is left untouched.
+  size_t i = 0;
 
-  return strcmp(sub, parent) == 0;
-}
+  while (i < len) {
+    uint8_t size = data[i];
 
-static int
-raw_rr_cmp(const void *a, const void *b) {
-  assert(a && b);
+    if (size == 0)
+      return i + 1;
 
-  hsk_dns_raw_rr_t *x = (hsk_dns_raw_rr_t *)a;
-  hsk_dns_raw_rr_t *y = (hsk_dns_raw_rr_t *)b;
+    if (size > HSK_DNS_MAX_LABEL || i + 1 + size > len)
+      break;
+
+    size_t j;
+    for (j = i + 1; j <= i + size; j++) {
+      if (data[j] >= 'A' && data[j] <= 'Z')
+        data[j] += ' ';
+    }
 
-  uint8_t *xd = x->data;
-  size_t xs = x->size;
-  uint8_t *yd = y->data;
-  size_t ys = y->size;
+    i += 1 + size;
+  }
 
-  assert(hsk_dns_name_parse(&xd, &xs, NULL, NULL) != -1);
-  assert(hsk_dns_name_parse(&yd, &ys, NULL, NULL) != -1);
+  return i;
+}
 
-  assert(xs >= 10);
-  assert(ys >= 10);
+static void
+canonical_rd_lower(uint8_t *rd, size_t len, uint16_t type) {
+  // RFC 4034, section 6.2 (as far as we emit any of these).
+  switch (type) {
+    case HSK_DNS_NS:
+    case HSK_DNS_CNAME:
+    case HSK_DNS_PTR:
+    case HSK_DNS_DNAME: {
+      canonical_name_lower(rd, len);
+      break;
+    }
+    case HSK_DNS_SOA: {
+      size_t size = canonical_name_lower(rd, len);
+      canonical_name_lower(rd + size, len - size);
+      break;
+    }
+    case HSK_DNS_MX: {
+      if (len > 2)
+        canonical_name_lower(rd + 2, len - 2);
+      break;
+    }
+    case HSK_DNS_SRV: {
+      if (len > 6)
+        canonical_name_lower(rd + 6, len - 6);
+      break;
+    }
+    case HSK_DNS_SIG:
+    case HSK_DNS_RRSIG: {
+      if (len > 18)
+        canonical_name_lower(rd + 18, len - 18);
+      break;
+    }
+  }
+}
 
-  xd += 10;
-  xs -= 10;
-  yd += 10;
-  ys -= 10;
+static int
+canonical_rd_cmp(const uint8_t *a, const uint8_t *b) {
+  assert(a && b);
 
-  size_t s = xs < ys ? xs : ys;
+  // Both point at rdlen || rdata. Order by RDATA as
+  // a left-justified octet string (RFC 4034, 6.3).
+  size_t as = (a[0] << 8) | a[1];
+  size_t bs = (b[0] << 8) | b[1];
+  size_t s = as < bs ? as : bs;
 
-  int r = memcmp(xd, yd, s);
+  int r = memcmp(a + 2, b + 2, s);
 
   if (r != 0)
     return r;
 
-  if (xs < ys)
+  if (as < bs)
     return -1;
 
-  if (xs > ys)
+  if (as > bs)
     return 1;
 
   return 0;
 }
-
-static bool
-raw_rr_equal(const hsk_dns_raw_rr_t *a, const hsk_dns_raw_rr_t *b) {
-  assert(a && b);
-
-  if (a->size != b->size)
-    return false;
-
-  return memcmp(a->data, b->data, a->size) == 0;
-}
@@ -190,9 +190,27 @@ typedef struct {
   uint8_t *type_map;
 } hsk_dns_nsec_rd_t;
 
+// Name compression state for hsk_dns_msg_write(). Every suffix written so
+// far is indexed by a hash of its wire form in a small open-addressed table,
+// so finding the longest earlier match for a name costs one probe per label.
+// Slots hold the suffix's offset into the message plus one (zero is empty).
+// Once the table is three quarters full, further suffixes go on a list that
+// is scanned in order, so big messages still compress every repeat.
+#define HSK_DNS_CMP_SLOTS 512
+
+typedef struct {
+  uint32_t hash;
+  uint16_t offset;
+} hsk_dns_cmp_spill_t;
+
 typedef struct {
-  hsk_map_t map;
   uint8_t *msg;
+  size_t count;
+  uint32_t hashes[HSK_DNS_CMP_SLOTS];
+  uint16_t offsets[HSK_DNS_CMP_SLOTS];
+  hsk_dns_cmp_spill_t *spill;
+  size_t spill_count;
+  size_t spill_cap;
 } hsk_dns_cmp_t;
 
 typedef struct {
@@ -210,6 +228,80 @@ typedef struct {
 #define HSK_DNS_MAX_EDNS 4096
 #define HSK_DNS_MAX_TCP 65535
 
+// A name in uncompressed wire format, lowercased, along with the offset of
+// each label's length octet and a hash of the whole thing. Label lookups
+// and suffixes are O(1) and comparisons are a memcmp, where the dotted
+// string helpers below rescan the name on every call.
+//
+// Escaped bytes are single characters in our dotted names (see
+// hsk_dns_name_parse()), so labels[i] is also the offset of label i in the
+// string the name was set from.
+typedef struct hsk_dns_name_s {
+  uint8_t data[HSK_DNS_MAX_NAME + 1];
+  size_t size;
+  int count;
+  uint8_t labels[HSK_DNS_MAX_LABELS];
+  uint32_t hash;
+  // Same as hsk_dns_name_dirty() on the original string.
+  bool dirty;
+} hsk_dns_name_t;
+
+// Message sections, and masks of them for hsk_dns_view_msg().
+#define HSK_DNS_SECTION_QD 0
+#define HSK_DNS_SECTION_AN 1
+#define HSK_DNS_SECTION_NS 2
+#define HSK_DNS_SECTION_AR 3
+#define HSK_DNS_SECTIONS_ALL 0x0f
+
+// A read-only view of a wire message. hsk_dns_view_init() walks the message
+// once to find where each section starts and to pick up the header and the
+// OPT record, without allocating anything or decoding rdata. Records are
+// then visited with an iterator, and names, rdata or whole records are only
+// decoded for the ones the caller asks about.
+//
+// The view points into the caller's buffer, which has to outlive it.
+typedef struct hsk_dns_view_s {
+  const uint8_t *msg;
+  size_t msg_len;
+  uint16_t id;
+  uint8_t opcode;
+  // Including the extended bits from EDNS, as in hsk_dns_msg_t.
+  uint16_t code;
+  uint16_t flags;
+  // Records present in each section. The OPT record is not counted.
+  uint16_t counts[4];
+  // Where each section begins, plus where the last one ends.
+  size_t offsets[5];
+  struct {
+    bool enabled;
+    uint8_t version;
+    uint16_t flags;
+    uint16_t size;
+    uint8_t code;
+    size_t rd_off;
+    size_t rd_len;
+  } edns;
+} hsk_dns_view_t;
+
+// A record in a view. Questions have no TTL or rdata.
+typedef struct hsk_dns_view_rr_s {
+  int section;
+  // Offset of the owner name.
+  size_t off;
+  uint16_t type;
+  uint16_t class;
+  uint32_t ttl;
+  size_t rd_off;
+  uint16_t rd_len;
+} hsk_dns_view_rr_t;
+
+typedef struct hsk_dns_iter_s {
+  const hsk_dns_view_t *view;
+  int section;
+  size_t off;
+  size_t end;
+} hsk_dns_iter_t;
+
 // Opcodes
 #define HSK_DNS_QUERY 0
 #define HSK_DNS_IQUERY 1
@@ -401,6 +493,49 @@ hsk_dns_msg_truncate(uint8_t *msg, size_t msg_len, size_t max, size_t *len);
 bool
 hsk_dns_msg_read(uint8_t **data, size_t *data_len, hsk_dns_msg_t *msg);
 
+bool
+hsk_dns_view_init(hsk_dns_view_t *view, const uint8_t *data, size_t data_len);
+
+void
+hsk_dns_view_iter(
+  const hsk_dns_view_t *view,
+  int section,
+  hsk_dns_iter_t *it
+);
+
+// Step to the next record in the section. OPT records are skipped.
+bool
+hsk_dns_iter_next(hsk_dns_iter_t *it, hsk_dns_view_rr_t *rr);
+
+// Decode the (possibly compressed) name at `off`, e.g. `rr->off`.
+bool
+hsk_dns_view_name(const hsk_dns_view_t *view, size_t off, char *name);
+
+// Decode a record's rdata. Free with hsk_dns_rd_free().
+bool
+hsk_dns_view_rd(
+  const hsk_dns_view_t *view,
+  const hsk_dns_view_rr_t *rr,
+  void **rd
+);
+
+// Materialize a record (a question for HSK_DNS_SECTION_QD).
+bool
+hsk_dns_view_rr(
+  const hsk_dns_view_t *view,
+  const hsk_dns_view_rr_t *rr,
+  hsk_dns_rr_t **ret
+);
+
+// Materialize a message holding only the sections in the `sections` mask
+// (e.g. `1 << HSK_DNS_SECTION_AN`), along with the header and EDNS.
+bool
+hsk_dns_view_msg(
+  const hsk_dns_view_t *view,
+  int sections,
+  hsk_dns_msg_t **msg
+);
+
 void
 hsk_dns_rrs_init(hsk_dns_rrs_t *rrs);
 
@@ -640,6 +775,35 @@ hsk_dns_name_is_fqdn(const char *name);
 int
 hsk_dns_name_cmp(const char *a, const char *b);
 
+void
+hsk_dns_name_init(hsk_dns_name_t *name);
+
+// Index a fully qualified dotted name. Fails on anything
+// hsk_dns_name_write() would refuse.
+bool
+hsk_dns_name_set(hsk_dns_name_t *name, const char *str);
+
+// Same as hsk_dns_label_get(), in lowercase.
+int
+hsk_dns_name_label(const hsk_dns_name_t *name, int index, char *ret);
+
+// Same as hsk_dns_label_from(), in lowercase.
+int
+hsk_dns_name_from(const hsk_dns_name_t *name, int index, char *ret);
+
+// Wire format of the name from label `index` (-1 = TLD) through the root.
+const uint8_t *
+hsk_dns_name_suffix(const hsk_dns_name_t *name, int index, size_t *size);
+
+bool
+hsk_dns_name_equal(const hsk_dns_name_t *a, const hsk_dns_name_t *b);
+
+bool
+hsk_dns_name_is_subdomain(
+  const hsk_dns_name_t *parent,
+  const hsk_dns_name_t *child
+);
+
 /**
  * Returns: number of labels found in the name
  * In:      name:   pointer to string containing full domain name
@@ -120,6 +120,52 @@ hsk_ec_sign_msg(
   return true;
 }
 
+bool
+hsk_ec_create_nonce(const hsk_ec_t *ec, hsk_ec_nonce_t *nonce) {
+  assert(ec && nonce);
+
+  uint8_t k[32];
+  int i = 0;
+
+  for (;;) {
+    if (i > 1000)
+      return false;
+
+    if (!hsk_randombytes(k, 32))
+      return false;
+
+    if (hsk_secp256k1_ecdsa_nonce_create(ec, nonce, k))
+      break;
+
+    i += 1;
+  }
+
+  memset(k, 0, 32);
+
+  return true;
+}
+
+bool
+hsk_ec_sign_msg_nonce(
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  const uint8_t *msg,
+  hsk_ec_nonce_t *nonce,
+  uint8_t *sig,
+  int *rec
+) {
+  assert(ec && key && msg && nonce && sig);
+
+  hsk_secp256k1_ecdsa_recoverable_signature s;
+
+  if (!hsk_secp256k1_ecdsa_sign_recoverable_nonce(ec, &s, msg, key, nonce))
+    return false;
+
+  hsk_secp256k1_ecdsa_recoverable_signature_serialize_compact(ec, sig, rec, &s);
+
+  return true;
+}
+
 bool
 hsk_ec_verify_msg(
   const hsk_ec_t *ec,
@@ -12,6 +12,7 @@
 
 
 typedef hsk_secp256k1_context hsk_ec_t;
+typedef hsk_secp256k1_ecdsa_nonce hsk_ec_nonce_t;
 
 hsk_ec_t *
 hsk_ec_alloc(void);
@@ -46,6 +47,22 @@ hsk_ec_sign_msg(
   int *rec
 );
 
+// Precompute k*G and k^-1 for a random k. The nonce is independent of the
+// message, so it can be generated ahead of time (e.g. on another thread).
+bool
+hsk_ec_create_nonce(const hsk_ec_t *ec, hsk_ec_nonce_t *nonce);
+
+// Sign with a nonce from hsk_ec_create_nonce(). The nonce is consumed.
+bool
+hsk_ec_sign_msg_nonce(
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  const uint8_t *msg,
+  hsk_ec_nonce_t *nonce,
+  uint8_t *sig,
+  int *rec
+);
+
 bool
 hsk_ec_verify_msg(
   const hsk_ec_t *ec,
@@ -0,0 +1,831 @@
+#include "config.h"
+
+#ifndef _WIN32
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bio.h"
+#include "error.h"
+#include "handoff.h"
+#include "ns.h"
+#include "resolver.h"
+#include "rs.h"
+#include "utils.h"
+#include "uv.h"
+
+/*
+ * Defs
+ */
+
+// Sent by the old process: its sockets (each one byte, carrying the fd),
+// then the cache (a u32 length and the data), then the end.
+#define HSK_HANDOFF_NS 'n'
+#define HSK_HANDOFF_RS 'r'
+#define HSK_HANDOFF_CACHE 'c'
+#define HSK_HANDOFF_END 'e'
+
+// Sent by the new process once it is serving.
+#define HSK_HANDOFF_READY 'R'
+
+#define HSK_HANDOFF_MAX_CACHE (256 << 20)
+
+// Don't wait forever on an old process that stopped responding.
+#define HSK_HANDOFF_TIMEOUT 30
+
+/*
+ * Prototypes
+ */
+
+static void
+hsk_handoff_log(hsk_handoff_t *handoff, const char *fmt, ...);
+
+static int
+hsk_handoff_listen(hsk_handoff_t *handoff);
+
+static void
+hsk_handoff_take_over(hsk_handoff_t *handoff, bool notify);
+
+static int
+hsk_handoff_write(
+  hsk_handoff_t *handoff,
+  uv_stream_t *stream,
+  uint8_t *data,
+  size_t data_len,
+  uv_stream_t *send_handle,
+  uv_write_cb callback
+);
+
+static void
+after_write(uv_write_t *req, int status);
+
+static void
+after_ready_write(uv_write_t *req, int status);
+
+static void
+alloc_buffer(uv_handle_t *handle, size_t size, uv_buf_t *buf);
+
+static void
+after_prev_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf);
+
+static void
+after_next_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf);
+
+static void
+after_connection(uv_stream_t *server, int status);
+
+static void
+after_timer(uv_timer_t *timer);
+
+static void
+after_drain(uv_timer_t *timer);
+
+/*
+ * Handoff
+ */
+
+int
+hsk_handoff_init(
+  hsk_handoff_t *handoff,
+  const uv_loop_t *loop,
+  const char *path,
+  hsk_ns_t *ns,
+  hsk_rs_t *rs
+) {
+  if (!handoff || !loop || !path || !ns || !rs)
+    return HSK_EBADARGS;
+
+  if (strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+    return HSK_EBADARGS;
+
+  handoff->loop = (uv_loop_t *)loop;
+  handoff->path = strdup(path);
+  handoff->ns = ns;
+  handoff->rs = rs;
+  handoff->data = NULL;
+  handoff->ready_func = NULL;
+  handoff->done_func = NULL;
+  handoff->prev_fd = -1;
+  handoff->prev = NULL;
+  handoff->timer = NULL;
+  handoff->server = NULL;
+  handoff->next = NULL;
+  handoff->next_msg = 0;
+  handoff->handed_off = false;
+
+  if (!handoff->path)
+    return HSK_ENOMEM;
+
+  return HSK_SUCCESS;
+}
+
+void
+hsk_handoff_uninit(hsk_handoff_t *handoff) {
+  if (!handoff)
+    return;
+
+  hsk_handoff_close(handoff);
+
+  if (handoff->path) {
+    free(handoff->path);
+    handoff->path = NULL;
+  }
+}
+
+hsk_handoff_t *
+hsk_handoff_alloc(
+  const uv_loop_t *loop,
+  const char *path,
+  hsk_ns_t *ns,
+  hsk_rs_t *rs
+) {
+  hsk_handoff_t *handoff = malloc(sizeof(hsk_handoff_t));
+
+  if (!handoff)
+    return NULL;
+
+  if (hsk_handoff_init(handoff, loop, path, ns, rs) != HSK_SUCCESS) {
+    free(handoff);
+    return NULL;
+  }
+
+  return handoff;
+}
+
+void
+hsk_handoff_free(hsk_handoff_t *handoff) {
+  if (!handoff)
+    return;
+
+  hsk_handoff_uninit(handoff);
+  free(handoff);
+}
+
+static bool
+hsk_handoff_recv_tag(int fd, uint8_t *tag, int *passed) {
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  struct iovec iov;
+  iov.iov_base = tag;
+  iov.iov_len = 1;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n;
+
+  do {
+    n = recvmsg(fd, &msg, 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n != 1)
+    return false;
+
+  *passed = -1;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+  if (cmsg
+      && cmsg->cmsg_level == SOL_SOCKET
+      && cmsg->cmsg_type == SCM_RIGHTS
+      && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+    memcpy(passed, CMSG_DATA(cmsg), sizeof(int));
+  }
+
+  return true;
+}
+
+static bool
+hsk_handoff_recv_all(int fd, uint8_t *data, size_t data_len) {
+  while (data_len > 0) {
+    ssize_t n = read(fd, data, data_len);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return false;
+
+    data += n;
+    data_len -= n;
+  }
+
+  return true;
+}
+
+int
+hsk_handoff_take(
+  hsk_handoff_t *handoff,
+  uv_udp_t **ns_socket,
+  uv_udp_t **rs_socket
+) {
+  if (!handoff || !ns_socket || !rs_socket)
+    return HSK_EBADARGS;
+
+  *ns_socket = NULL;
+  *rs_socket = NULL;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return HSK_EFAILURE;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, handoff->path);
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    int err = errno;
+
+    close(fd);
+
+    // Nobody to take over from.
+    if (err == ENOENT || err == ECONNREFUSED)
+      return HSK_SUCCESS;
+
+    hsk_handoff_log(handoff, "could not connect to %s: %s\n",
+                    handoff->path, strerror(err));
+
+    return HSK_EFAILURE;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = HSK_HANDOFF_TIMEOUT;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  hsk_handoff_log(handoff, "taking over from %s\n", handoff->path);
+
+  uv_udp_t *ns = NULL;
+  uv_udp_t *rs = NULL;
+  uint8_t *cache = NULL;
+
+  for (;;) {
+    uint8_t tag;
+    int passed;
+
+    if (!hsk_handoff_recv_tag(fd, &tag, &passed))
+      goto fail;
+
+    if (tag == HSK_HANDOFF_NS || tag == HSK_HANDOFF_RS) {
+      uv_udp_t **socket = tag == HSK_HANDOFF_NS ? &ns : &rs;
+
+      if (passed < 0 || *socket) {
+        if (passed >= 0)
+          close(passed);
+        goto fail;
+      }
+
+      *socket = hsk_uv_udp_open(handoff->loop, passed);
+
+      if (!*socket) {
+        close(passed);
+        goto fail;
+      }
+
+      continue;
+    }
+
+    if (passed >= 0) {
+      close(passed);
+      goto fail;
+    }
+
+    if (tag == HSK_HANDOFF_CACHE) {
+      uint8_t len_[4];
+      uint8_t *p = len_;
+      size_t left = sizeof(len_);
+      uint32_t len;
+
+      if (!hsk_handoff_recv_all(fd, len_, sizeof(len_)))
+        goto fail;
+
+      read_u32(&p, &left, &len);
+
+      if (len > HSK_HANDOFF_MAX_CACHE)
+        goto fail;
+
+      cache = malloc(len ? len : 1);
+
+      if (!cache || !hsk_handoff_recv_all(fd, cache, len))
+        goto fail;
+
+      if (!hsk_resolver_load_cache(handoff->ns->resolver, cache, len))
+        hsk_handoff_log(handoff, "could not load cache\n");
+
+      free(cache);
+      cache = NULL;
+
+      continue;
+    }
+
+    if (tag == HSK_HANDOFF_END)
+      break;
+
+    goto fail;
+  }
+
+  if (!ns || !rs)
+    goto fail;
+
+  handoff->prev_fd = fd;
+
+  *ns_socket = ns;
+  *rs_socket = rs;
+
+  return HSK_SUCCESS;
+
+fail:
+  hsk_handoff_log(handoff, "handoff from %s failed\n", handoff->path);
+
+  if (cache)
+    free(cache);
+
+  if (ns)
+    hsk_uv_close_free((uv_handle_t *)ns);
+
+  if (rs)
+    hsk_uv_close_free((uv_handle_t *)rs);
+
+  close(fd);
+
+  return HSK_EFAILURE;
+}
+
+int
+hsk_handoff_open(
+  hsk_handoff_t *handoff,
+  void *data,
+  bool (*ready_func)(void *),
+  void (*done_func)(void *)
+) {
+  if (!handoff || !ready_func || !done_func)
+    return HSK_EBADARGS;
+
+  handoff->data = data;
+  handoff->ready_func = ready_func;
+  handoff->done_func = done_func;
+
+  handoff->timer = malloc(sizeof(uv_timer_t));
+
+  if (!handoff->timer)
+    return HSK_ENOMEM;
+
+  if (uv_timer_init(handoff->loop, handoff->timer) != 0) {
+    free(handoff->timer);
+    handoff->timer = NULL;
+    return HSK_EFAILURE;
+  }
+
+  handoff->timer->data = (void *)handoff;
+
+  if (handoff->prev_fd < 0)
+    return hsk_handoff_listen(handoff);
+
+  // Leave the queries to the old process until we can answer them.
+  if (hsk_ns_pause(handoff->ns) != HSK_SUCCESS
+      || hsk_rs_pause(handoff->rs) != HSK_SUCCESS) {
+    return HSK_EFAILURE;
+  }
+
+  handoff->prev = malloc(sizeof(uv_pipe_t));
+
+  if (!handoff->prev)
+    return HSK_ENOMEM;
+
+  if (uv_pipe_init(handoff->loop, handoff->prev, 0) != 0) {
+    free(handoff->prev);
+    handoff->prev = NULL;
+    return HSK_EFAILURE;
+  }
+
+  handoff->prev->data = (void *)handoff;
+
+  if (uv_pipe_open(handoff->prev, handoff->prev_fd) != 0)
+    return HSK_EFAILURE;
+
+  handoff->prev_fd = -1;
+
+  // Only to notice if it goes away.
+  if (uv_read_start((uv_stream_t *)handoff->prev,
+                    alloc_buffer, after_prev_read) != 0) {
+    return HSK_EFAILURE;
+  }
+
+  if (uv_timer_start(handoff->timer, after_timer, 1000, 1000) != 0)
+    return HSK_EFAILURE;
+
+  hsk_handoff_log(handoff, "waiting to be ready before taking over\n");
+
+  return HSK_SUCCESS;
+}
+
+int
+hsk_handoff_close(hsk_handoff_t *handoff) {
+  if (!handoff)
+    return HSK_EBADARGS;
+
+  if (handoff->timer) {
+    uv_timer_stop(handoff->timer);
+    handoff->timer->data = NULL;
+    hsk_uv_close_free((uv_handle_t *)handoff->timer);
+    handoff->timer = NULL;
+  }
+
+  if (handoff->prev_fd >= 0) {
+    close(handoff->prev_fd);
+    handoff->prev_fd = -1;
+  }
+
+  if (handoff->prev) {
+    handoff->prev->data = NULL;
+    hsk_uv_close_free((uv_handle_t *)handoff->prev);
+    handoff->prev = NULL;
+  }
+
+  if (handoff->next) {
+    handoff->next->data = NULL;
+    hsk_uv_close_free((uv_handle_t *)handoff->next);
+    handoff->next = NULL;
+  }
+
+  if (handoff->server) {
+    handoff->server->data = NULL;
+    hsk_uv_close_free((uv_handle_t *)handoff->server);
+    handoff->server = NULL;
+
+    // After a handoff, the path belongs to the new process.
+    if (!handoff->handed_off)
+      unlink(handoff->path);
+  }
+
+  return HSK_SUCCESS;
+}
+
+static void
+hsk_handoff_log(hsk_handoff_t *handoff, const char *fmt, ...) {
+  printf("handoff: ");
+
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static int
+hsk_handoff_listen(hsk_handoff_t *handoff) {
+  assert(!handoff->server);
+
+  handoff->server = malloc(sizeof(uv_pipe_t));
+
+  if (!handoff->server)
+    return HSK_ENOMEM;
+
+  if (uv_pipe_init(handoff->loop, handoff->server, 1) != 0) {
+    free(handoff->server);
+    handoff->server = NULL;
+    return HSK_EFAILURE;
+  }
+
+  handoff->server->data = (void *)handoff;
+
+  // Whatever was here belonged to the process we took over from, or to
+  // one that has exited.
+  unlink(handoff->path);
+
+  // Whoever can connect can take our sockets: owner only.
+  mode_t mask = umask(0077);
+  int rc = uv_pipe_bind(handoff->server, handoff->path);
+  umask(mask);
+
+  if (rc != 0) {
+    hsk_handoff_log(handoff, "could not bind %s: %s\n",
+                    handoff->path, uv_strerror(rc));
+    return HSK_EFAILURE;
+  }
+
+  rc = uv_listen((uv_stream_t *)handoff->server, 1, after_connection);
+
+  if (rc != 0) {
+    hsk_handoff_log(handoff, "could not listen: %s\n", uv_strerror(rc));
+    return HSK_EFAILURE;
+  }
+
+  hsk_handoff_log(handoff, "listening on %s\n", handoff->path);
+
+  return HSK_SUCCESS;
+}
+
+static void
+hsk_handoff_close_prev(hsk_handoff_t *handoff) {
+  if (!handoff->prev)
+    return;
+
+  handoff->prev->data = NULL;
+  hsk_uv_close_free((uv_handle_t *)handoff->prev);
+  handoff->prev = NULL;
+}
+
+static void
+hsk_handoff_take_over(hsk_handoff_t *handoff, bool notify) {
+  uv_timer_stop(handoff->timer);
+
+  if (hsk_ns_resume(handoff->ns) != HSK_SUCCESS)
+    hsk_handoff_log(handoff, "could not resume ns\n");
+
+  if (hsk_rs_resume(handoff->rs) != HSK_SUCCESS)
+    hsk_handoff_log(handoff, "could not resume rs\n");
+
+  // Take the path before telling the old process
+  // to go, so there is always someone listening.
+  if (hsk_handoff_listen(handoff) != HSK_SUCCESS)
+    hsk_handoff_log(handoff, "graceful restart is unavailable\n");
+
+  if (!notify) {
+    hsk_handoff_close_prev(handoff);
+    return;
+  }
+
+  uv_read_stop((uv_stream_t *)handoff->prev);
+
+  uint8_t *msg = malloc(1);
+
+  if (!msg) {
+    hsk_handoff_close_prev(handoff);
+    return;
+  }
+
+  msg[0] = HSK_HANDOFF_READY;
+
+  int rc = hsk_handoff_write(handoff, (uv_stream_t *)handoff->prev,
+                             msg, 1, NULL, after_ready_write);
+
+  if (rc != HSK_SUCCESS)
+    hsk_handoff_close_prev(handoff);
+
+  hsk_handoff_log(handoff, "took over\n");
+}
+
+static int
+hsk_handoff_write(
+  hsk_handoff_t *handoff,
+  uv_stream_t *stream,
+  uint8_t *data,
+  size_t data_len,
+  uv_stream_t *send_handle,
+  uv_write_cb callback
+) {
+  uv_write_t *req = malloc(sizeof(uv_write_t));
+
+  if (!req) {
+    free(data);
+    return HSK_ENOMEM;
+  }
+
+  req->data = (void *)data;
+
+  uv_buf_t bufs[] = {
+    { .base = (char *)data, .len = data_len }
+  };
+
+  int rc;
+
+  if (send_handle)
+    rc = uv_write2(req, stream, bufs, 1, send_handle, callback);
+  else
+    rc = uv_write(req, stream, bufs, 1, callback);
+
+  if (rc != 0) {
+    hsk_handoff_log(handoff, "write failed: %s\n", uv_strerror(rc));
+    free(data);
+    free(req);
+    return HSK_EFAILURE;
+  }
+
+  return HSK_SUCCESS;
+}
+
+static int
+hsk_handoff_send_tag(
+  hsk_handoff_t *handoff,
+  uint8_t tag,
+  uv_stream_t *send_handle
+) {
+  uint8_t *msg = malloc(1);
+
+  if (!msg)
+    return HSK_ENOMEM;
+
+  msg[0] = tag;
+
+  return hsk_handoff_write(handoff, (uv_stream_t *)handoff->next,
+                           msg, 1, send_handle, after_write);
+}
+
+static int
+hsk_handoff_send_cache(hsk_handoff_t *handoff) {
+  uint8_t *cache;
+  size_t cache_len;
+
+  // Not worth failing over.
+  if (!hsk_resolver_save_cache(handoff->ns->resolver, &cache, &cache_len))
+    return HSK_SUCCESS;
+
+  if (cache_len > HSK_HANDOFF_MAX_CACHE) {
+    free(cache);
+    return HSK_SUCCESS;
+  }
+
+  uint8_t *msg = malloc(5 + cache_len);
+
+  if (!msg) {
+    free(cache);
+    return HSK_ENOMEM;
+  }
+
+  uint8_t *p = msg;
+  write_u8(&p, HSK_HANDOFF_CACHE);
+  write_u32(&p, cache_len);
+  write_bytes(&p, cache, cache_len);
+
+  free(cache);
+
+  return hsk_handoff_write(handoff, (uv_stream_t *)handoff->next,
+                           msg, 5 + cache_len, NULL, after_write);
+}
+
+static void
+hsk_handoff_close_next(hsk_handoff_t *handoff) {
+  if (!handoff->next)
+    return;
+
+  handoff->next->data = NULL;
+  hsk_uv_close_free((uv_handle_t *)handoff->next);
+  handoff->next = NULL;
+}
+
+/*
+ * UV behavior
+ */
+
+static void
+after_write(uv_write_t *req, int status) {
+  free(req->data);
+  free(req);
+}
+
+static void
+after_ready_write(uv_write_t *req, int status) {
+  uv_stream_t *stream = req->handle;
+  hsk_handoff_t *handoff = (hsk_handoff_t *)stream->data;
+
+  free(req->data);
+  free(req);
+
+  if (handoff)
+    hsk_handoff_close_prev(handoff);
+}
+
+static void
+alloc_buffer(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)handle->data;
+
+  if (!handoff) {
+    buf->base = NULL;
+    buf->len = 0;
+    return;
+  }
+
+  buf->base = (char *)&handoff->next_msg;
+  buf->len = 1;
+}
+
+static void
+after_prev_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)stream->data;
+
+  if (!handoff || nread >= 0)
+    return;
+
+  hsk_handoff_log(handoff, "old process went away, taking over now\n");
+
+  hsk_handoff_take_over(handoff, false);
+}
+
+static void
+after_next_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)stream->data;
+
+  if (!handoff || nread == 0)
+    return;
+
+  if (nread < 0 || handoff->next_msg != HSK_HANDOFF_READY) {
+    hsk_handoff_log(handoff, "new process went away, still serving\n");
+    hsk_handoff_close_next(handoff);
+    return;
+  }
+
+  hsk_handoff_log(handoff, "new process is serving, draining\n");
+
+  hsk_handoff_close_next(handoff);
+
+  handoff->handed_off = true;
+
+  hsk_ns_pause(handoff->ns);
+  hsk_rs_pause(handoff->rs);
+
+  uv_timer_stop(handoff->timer);
+  uv_timer_start(handoff->timer, after_drain, HSK_HANDOFF_DRAIN * 1000, 0);
+}
+
+static void
+after_connection(uv_stream_t *server, int status) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)server->data;
+
+  if (!handoff || status != 0)
+    return;
+
+  uv_pipe_t *client = malloc(sizeof(uv_pipe_t));
+
+  if (!client)
+    return;
+
+  if (uv_pipe_init(handoff->loop, client, 1) != 0) {
+    free(client);
+    return;
+  }
+
+  client->data = NULL;
+
+  if (uv_accept(server, (uv_stream_t *)client) != 0) {
+    hsk_uv_close_free((uv_handle_t *)client);
+    return;
+  }
+
+  if (handoff->next || handoff->handed_off
+      || !handoff->ns->socket || !handoff->rs->socket) {
+    hsk_handoff_log(handoff, "refusing a second handoff\n");
+    hsk_uv_close_free((uv_handle_t *)client);
+    return;
+  }
+
+  hsk_handoff_log(handoff, "handing off to a new process\n");
+
+  client->data = (void *)handoff;
+  handoff->next = client;
+
+  if (hsk_handoff_send_tag(handoff, HSK_HANDOFF_NS,
+                           (uv_stream_t *)handoff->ns->socket) != HSK_SUCCESS
+      || hsk_handoff_send_tag(handoff, HSK_HANDOFF_RS,
+                              (uv_stream_t *)handoff->rs->socket) != HSK_SUCCESS
+      || hsk_handoff_send_cache(handoff) != HSK_SUCCESS
+      || hsk_handoff_send_tag(handoff, HSK_HANDOFF_END, NULL) != HSK_SUCCESS
+      || uv_read_start((uv_stream_t *)client,
+                       alloc_buffer, after_next_read) != 0) {
+    hsk_handoff_log(handoff, "handoff failed, still serving\n");
+    hsk_handoff_close_next(handoff);
+  }
+}
+
+static void
+after_timer(uv_timer_t *timer) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)timer->data;
+
+  if (!handoff || !handoff->prev)
+    return;
+
+  if (handoff->ready_func(handoff->data))
+    hsk_handoff_take_over(handoff, true);
+}
+
+static void
+after_drain(uv_timer_t *timer) {
+  hsk_handoff_t *handoff = (hsk_handoff_t *)timer->data;
+
+  if (!handoff)
+    return;
+
+  handoff->done_func(handoff->data);
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _HSK_HANDOFF_H
+#define _HSK_HANDOFF_H
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ns.h"
+#include "rs.h"
+#include "uv.h"
+
+/*
+ * Defs
+ */
+
+// Seconds the old process keeps running after it stops reading queries, so
+// that answers to what it already read still go out.
+#define HSK_HANDOFF_DRAIN 5
+
+/*
+ * Types
+ */
+
+// Graceful restart. A running hnsd listens on a Unix socket; a new one
+// started with the same path connects to it and receives its UDP sockets
+// (over SCM_RIGHTS) and root nameserver cache. The old process keeps
+// answering until the new one is ready, then stops reading queries and
+// exits. Queries that arrive in between sit in the shared sockets, so none
+// are dropped.
+typedef struct hsk_handoff_s {
+  uv_loop_t *loop;
+  char *path;
+  hsk_ns_t *ns;
+  hsk_rs_t *rs;
+  void *data;
+  bool (*ready_func)(void *);
+  void (*done_func)(void *);
+  // The process we took over from, until we're ready.
+  int prev_fd;
+  uv_pipe_t *prev;
+  uv_timer_t *timer;
+  // Listening for the next one.
+  uv_pipe_t *server;
+  uv_pipe_t *next;
+  uint8_t next_msg;
+  bool handed_off;
+} hsk_handoff_t;
+
+/*
+ * Handoff
+ */
+
+int
+hsk_handoff_init(
+  hsk_handoff_t *handoff,
+  const uv_loop_t *loop,
+  const char *path,
+  hsk_ns_t *ns,
+  hsk_rs_t *rs
+);
+
+void
+hsk_handoff_uninit(hsk_handoff_t *handoff);
+
+hsk_handoff_t *
+hsk_handoff_alloc(
+  const uv_loop_t *loop,
+  const char *path,
+  hsk_ns_t *ns,
+  hsk_rs_t *rs
+);
+
+void
+hsk_handoff_free(hsk_handoff_t *handoff);
+
+// Take over from the hnsd listening at the path, if there is one, before
+// the ns and rs are opened: its sockets are returned (NULL if no one is
+// listening) and its cache loaded into the ns. This blocks.
+int
+hsk_handoff_take(
+  hsk_handoff_t *handoff,
+  uv_udp_t **ns_socket,
+  uv_udp_t **rs_socket
+);
+
+// Call once the ns and rs are open. If they took over sockets, they are
+// paused until ready_func returns true (checked every second), when the
+// previous process is told to exit. Then listen for the next process, and
+// call done_func when it has taken over and the drain period is over.
+int
+hsk_handoff_open(
+  hsk_handoff_t *handoff,
+  void *data,
+  bool (*ready_func)(void *),
+  void (*done_func)(void *)
+);
+
+int
+hsk_handoff_close(hsk_handoff_t *handoff);
+
+#endif
+#endif
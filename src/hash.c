@@ -240,7 +240,8 @@ hsk_hash_hkdf(
   uint8_t buf[buf_len];
 
   // First round:
-  memcpy(&buf[32], info, info_len);
+  if (info_len > 0)
+    memcpy(&buf[32], info, info_len);
   buf[buf_len - 1] = 1;
 
   // First block.
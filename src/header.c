@@ -43,6 +43,8 @@ hsk_header_init(hsk_header_t *hdr) {
   memset(hdr->work, 0, 32);
 
   hdr->next = NULL;
+  hdr->prev = NULL;
+  hdr->skip = NULL;
 }
 
 hsk_header_t *
@@ -64,6 +66,8 @@ hsk_header_clone(const hsk_header_t *hdr) {
 
   memcpy((void *)copy, (void *)hdr, sizeof(hsk_header_t));
   copy->next = NULL;
+  copy->prev = NULL;
+  copy->skip = NULL;
 
   return copy;
 }
@@ -30,6 +30,11 @@ typedef struct hsk_header_s {
   uint8_t work[32];
 
   struct hsk_header_s *next;
+
+  // Set once the header is in a chain: its parent, and an ancestor further
+  // back for skipping through the chain (see hsk_chain_get_ancestor).
+  struct hsk_header_s *prev;
+  struct hsk_header_s *skip;
 } hsk_header_t;
 
 void
@@ -27,8 +27,10 @@
 // #include "seeds.h"
 #include "sha256.h"
 #include "sig0.h"
+#include "signer.h"
 #include "siphash.h"
 #include "timedata.h"
 #include "utils.h"
+#include "workers.h"
 
 #endif
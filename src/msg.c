@@ -207,20 +207,30 @@ hsk_headers_msg_read(uint8_t **data, size_t *data_len, hsk_headers_msg_t *msg) {
   if (!read_varsize(data, data_len, &msg->header_count))
     return false;
 
-  if (msg->header_count > 2000)
+  if (msg->header_count > HSK_MAX_HEADERS)
     return false;
 
   hsk_header_t *tail = NULL;
   int i;
 
   for (i = 0; i < msg->header_count; i++) {
-    hsk_header_t *h = hsk_header_alloc();
+    hsk_header_t *h;
 
-    if (h == NULL)
-      goto fail;
+    if (msg->buf) {
+      h = &msg->buf[i];
+      hsk_header_init(h);
+    } else {
+      h = hsk_header_alloc();
+
+      if (h == NULL)
+        goto fail;
+    }
 
-    if (!hsk_header_read(data, data_len, h))
+    if (!hsk_header_read(data, data_len, h)) {
+      if (!msg->buf)
+        free(h);
       goto fail;
+    }
 
     if (msg->headers == NULL)
       msg->headers = h;
@@ -235,10 +245,12 @@ hsk_headers_msg_read(uint8_t **data, size_t *data_len, hsk_headers_msg_t *msg) {
 
 fail: ;
   hsk_header_t *c, *n;
-  for (c = msg->headers; c; c = n) {
+  for (c = msg->headers; c && !msg->buf; c = n) {
     n = c->next;
     free(c);
   }
+  msg->headers = NULL;
+  msg->header_count = 0;
   return false;
 }
 
@@ -313,7 +325,7 @@ hsk_proof_msg_write(const hsk_proof_msg_t *msg, uint8_t **data) {
 
   s += write_bytes(data, msg->root, 32);
   s += write_bytes(data, msg->key, 32);
-  // XXX
+  s += hsk_proof_write(&msg->proof, data);
 
   return s;
 }
@@ -462,6 +474,7 @@ hsk_msg_init(hsk_msg_t *msg) {
       m->cmd = HSK_MSG_HEADERS;
       m->header_count = 0;
       m->headers = NULL;
+      m->buf = NULL;
       break;
     }
     case HSK_MSG_SENDHEADERS: {
@@ -590,7 +603,7 @@ hsk_msg_free(hsk_msg_t *msg) {
     case HSK_MSG_HEADERS: {
       hsk_headers_msg_t *m = (hsk_headers_msg_t *)msg;
       hsk_header_t *c, *n;
-      for (c = m->headers; c; c = n) {
+      for (c = m->headers; c && !m->buf; c = n) {
         n = c->next;
         free(c);
       }
@@ -23,6 +23,9 @@
 #define HSK_MSG_PROOF 27
 #define HSK_MSG_UNKNOWN 255
 
+// Most headers in one headers message.
+#define HSK_MAX_HEADERS 2000
+
 typedef struct {
   uint8_t cmd;
 } hsk_msg_t;
@@ -74,6 +77,9 @@ typedef struct {
   uint8_t cmd;
   size_t header_count;
   hsk_header_t *headers;
+  // If set, headers are read into this array of HSK_MAX_HEADERS instead of
+  // being allocated one by one. They are only good until it is reused.
+  hsk_header_t *buf;
 } hsk_headers_msg_t;
 
 typedef struct {
@@ -6,9 +6,8 @@
 #include <stdbool.h>
 #include "uv.h"
 
-#include "cache.h"
-#include "ec.h"
 #include "pool.h"
+#include "resolver.h"
 
 /*
  * Defs
@@ -20,19 +19,20 @@
  * Types
  */
 
+// The root nameserver: UDP in front of an hsk_resolver_t.
 typedef struct {
   uv_loop_t *loop;
-  hsk_pool_t *pool;
-  hsk_addr_t ip_;
-  hsk_addr_t *ip;
+  hsk_resolver_t *resolver;
+  struct sockaddr_storage ip_;
+  struct sockaddr *ip;
   uv_udp_t *socket;
-  hsk_ec_t *ec;
-  hsk_cache_t cache;
-  uint8_t key_[32];
-  uint8_t *key;
-  uint8_t pubkey[33];
   uint8_t read_buffer[HSK_UDP_BUFFER];
+  int buffer_size;
   bool receiving;
+  // Queries per second, 0 for no limit.
+  int rate_limit;
+  uint64_t rate_window;
+  int rate_count;
 } hsk_ns_t;
 
 /*
@@ -51,9 +51,43 @@ hsk_ns_set_ip(hsk_ns_t *ns, const struct sockaddr *addr);
 bool
 hsk_ns_set_key(hsk_ns_t *ns, const uint8_t *key);
 
+void
+hsk_ns_set_sign_offload(hsk_ns_t *ns, bool offload);
+
+// Sign without covering the message ID and reuse signed answers for cache
+// hits. See --sig0-no-id in daemon.c for the trade-offs.
+void
+hsk_ns_set_sign_noid(hsk_ns_t *ns, bool noid);
+
+// Size of the socket's send and receive buffers (SO_SNDBUF/SO_RCVBUF).
+// Applied right away if the socket is open.
+bool
+hsk_ns_set_buffer(hsk_ns_t *ns, int size);
+
+// Drop queries past `limit` per second (0 for no limit). The limit is
+// shared by all clients; it bounds the work a flood can cause, not what any
+// one client gets.
+bool
+hsk_ns_set_rate_limit(hsk_ns_t *ns, int limit);
+
+bool
+hsk_ns_set_cache(hsk_ns_t *ns, size_t limit, int64_t ttl);
+
 int
 hsk_ns_open(hsk_ns_t *ns, const struct sockaddr *addr);
 
+// Open with a bound socket on ns->loop, which the ns takes ownership of.
+int
+hsk_ns_open_socket(hsk_ns_t *ns, uv_udp_t *socket);
+
+// Stop and start reading queries. Answers to queries already read still go
+// out while paused.
+int
+hsk_ns_pause(hsk_ns_t *ns);
+
+int
+hsk_ns_resume(hsk_ns_t *ns);
+
 int
 hsk_ns_close(hsk_ns_t *ns);
 
@@ -29,6 +29,7 @@
 #include "pool.h"
 #include "utils.h"
 #include "uv.h"
+#include "workers.h"
 
 #ifdef HSK_DEBUG_LOG
 #define hsk_pool_debug hsk_pool_log
@@ -101,6 +102,22 @@ hsk_peer_send_getproof(
   const uint8_t *root
 );
 
+static void
+hsk_ticket_entry_free(void *ptr);
+
+static void
+hsk_pool_save_ticket(hsk_pool_t *pool, const hsk_peer_t *peer);
+
+static bool
+hsk_pool_take_ticket(
+  hsk_pool_t *pool,
+  const hsk_addr_t *addr,
+  hsk_brontide_ticket_t *ticket
+);
+
+static void
+hsk_pool_flush_proofs(hsk_pool_t *pool);
+
 static void
 on_connect(uv_connect_t *conn, int status);
 
@@ -119,6 +136,12 @@ after_close(uv_handle_t *handle);
 static void
 after_timer(uv_timer_t *timer);
 
+static void
+run_verify(void *arg);
+
+static void
+after_verify(void *arg, bool ok);
+
 void
 hsk_chain_get_locator(hsk_chain_t *chain, hsk_getheaders_msg_t *msg);
 
@@ -175,6 +198,20 @@ hsk_pool_init(hsk_pool_t *pool, const uv_loop_t *loop) {
   pool->getheaders_time = 0;
   pool->user_agent = (char *)malloc(256);
   strcpy(pool->user_agent, HSK_USER_AGENT);
+  pool->threads = HSK_POOL_THREADS;
+  pool->workers = NULL;
+  pool->resume = false;
+  hsk_map_init_map(
+    &pool->tickets,
+    hsk_addr_hash,
+    hsk_addr_equal,
+    hsk_ticket_entry_free
+  );
+  pool->buffer_size = HSK_BUFFER_SIZE;
+  hsk_pool_timeouts_init(&pool->timeouts);
+  pool->headers = NULL;
+  pool->proofs = NULL;
+  pool->proof_count = 0;
 
   return HSK_SUCCESS;
 }
@@ -195,16 +232,38 @@ hsk_pool_uninit(hsk_pool_t *pool) {
     hsk_peer_destroy(peer);
   }
 
+  // Like the requests the peers had, the ones
+  // no peer ever got fail rather than vanish.
   hsk_name_req_t *req, *n;
   for (req = pool->pending; req; req = n) {
     n = req->next;
+
+    req->callback(
+      req->name,
+      HSK_EFAILURE,
+      false,
+      NULL,
+      0,
+      req->arg
+    );
+
     free(req);
   }
 
   pool->pending = NULL;
   pool->pending_count = 0;
 
+  // Queued proofs fail along with the rest of the workers' queue.
+  hsk_pool_flush_proofs(pool);
+
+  if (pool->workers) {
+    hsk_workers_close(pool->workers);
+    hsk_workers_free(pool->workers);
+    pool->workers = NULL;
+  }
+
   hsk_map_uninit(&pool->peers);
+  hsk_map_uninit(&pool->tickets);
   hsk_chain_uninit(&pool->chain);
   hsk_addrman_uninit(&pool->am);
   hsk_timedata_uninit(&pool->td);
@@ -213,6 +272,11 @@ hsk_pool_uninit(hsk_pool_t *pool) {
     free(pool->user_agent);
     pool->user_agent = NULL;
   }
+
+  if (pool->headers) {
+    free(pool->headers);
+    pool->headers = NULL;
+  }
 }
 
 bool
@@ -247,6 +311,81 @@ hsk_pool_set_size(hsk_pool_t *pool, int max_size) {
   return true;
 }
 
+bool
+hsk_pool_set_threads(hsk_pool_t *pool, int threads) {
+  assert(pool);
+
+  if (threads < 0 || threads > HSK_WORKERS_MAX)
+    return false;
+
+  pool->threads = threads;
+
+  return true;
+}
+
+bool
+hsk_pool_set_buffer(hsk_pool_t *pool, size_t size) {
+  assert(pool);
+
+  if (size < 4096 || size > HSK_MAX_MESSAGE)
+    return false;
+
+  pool->buffer_size = size;
+
+  return true;
+}
+
+void
+hsk_pool_timeouts_init(hsk_pool_timeouts_t *timeouts) {
+  assert(timeouts);
+  timeouts->handshake = 60;
+  timeouts->stall = 20 * 60;
+  timeouts->ping = 30;
+  timeouts->headers = 30;
+  timeouts->verack = 10;
+  timeouts->proof = 5;
+  timeouts->block = 10 * 60;
+  timeouts->getheaders = 5 * 60;
+}
+
+bool
+hsk_pool_set_timeouts(hsk_pool_t *pool, const hsk_pool_timeouts_t *timeouts) {
+  assert(pool && timeouts);
+
+  if (timeouts->handshake <= 0
+      || timeouts->stall <= 0
+      || timeouts->ping <= 0
+      || timeouts->headers <= 0
+      || timeouts->verack <= 0
+      || timeouts->proof <= 0
+      || timeouts->block <= 0
+      || timeouts->getheaders <= 0) {
+    return false;
+  }
+
+  pool->timeouts = *timeouts;
+
+  return true;
+}
+
+bool
+hsk_pool_set_orphans(hsk_pool_t *pool, int limit) {
+  assert(pool);
+
+  if (limit <= 0)
+    return false;
+
+  pool->chain.orphan_limit = limit;
+
+  return true;
+}
+
+void
+hsk_pool_set_resume(hsk_pool_t *pool, bool resume) {
+  assert(pool);
+  pool->resume = resume;
+}
+
 bool
 hsk_pool_set_seeds(hsk_pool_t *pool, const char *seeds) {
   assert(pool);
@@ -355,7 +494,20 @@ hsk_pool_open(hsk_pool_t *pool) {
   if (uv_timer_start(pool->timer, after_timer, 3000, 3000) != 0)
     return HSK_EFAILURE;
 
-  hsk_pool_log(pool, "pool opened (size=%u)\n", pool->max_size);
+  if (pool->threads > 0) {
+    pool->workers = hsk_workers_alloc(pool->loop);
+
+    if (!pool->workers)
+      return HSK_ENOMEM;
+
+    int rc = hsk_workers_open(pool->workers, pool->threads);
+
+    if (rc != HSK_SUCCESS)
+      return rc;
+  }
+
+  hsk_pool_log(pool, "pool opened (size=%u, threads=%d)\n",
+               pool->max_size, pool->threads);
 
   hsk_pool_refill(pool);
 
@@ -373,6 +525,11 @@ hsk_pool_close(hsk_pool_t *pool) {
   hsk_uv_close_free((uv_handle_t*)pool->timer);
   pool->timer = NULL;
 
+  // Finish or fail anything in flight while
+  // the peers and the nameserver still exist.
+  if (pool->workers)
+    hsk_workers_close(pool->workers);
+
   return HSK_SUCCESS;
 }
 
@@ -407,6 +564,116 @@ hsk_pool_getaddr(hsk_pool_t *pool, hsk_addr_t *addr) {
   return hsk_addrman_pick_addr(&pool->am, &pool->peers, addr);
 }
 
+/*
+ * Session resumption
+ */
+
+typedef struct {
+  hsk_addr_t addr;
+  hsk_brontide_ticket_t ticket;
+} hsk_ticket_entry_t;
+
+static void
+hsk_ticket_entry_free(void *ptr) {
+  hsk_ticket_entry_t *entry = (hsk_ticket_entry_t *)ptr;
+
+  if (!entry)
+    return;
+
+  memset(entry, 0, sizeof(hsk_ticket_entry_t));
+  free(entry);
+}
+
+static bool
+hsk_ticket_expired(const hsk_brontide_ticket_t *ticket, int64_t now) {
+  return now >= ticket->time + HSK_BRONTIDE_TICKET_LIFETIME;
+}
+
+static void
+hsk_pool_prune_tickets(hsk_pool_t *pool) {
+  hsk_map_t *map = &pool->tickets;
+  int64_t now = hsk_now();
+  uint32_t k;
+
+  for (k = 0; k < map->n_buckets; k++) {
+    if (!hsk_map_exists(map, k))
+      continue;
+
+    hsk_ticket_entry_t *entry = map->vals[k];
+
+    if (hsk_ticket_expired(&entry->ticket, now)) {
+      hsk_map_delete(map, k);
+      hsk_ticket_entry_free(entry);
+    }
+  }
+}
+
+// Called once a peer's version message arrives. A ticket is only kept if
+// both sides offered resumption, since the peer has to keep its half.
+static void
+hsk_pool_save_ticket(hsk_pool_t *pool, const hsk_peer_t *peer) {
+  if (!pool->resume || !peer->brontide)
+    return;
+
+  hsk_ticket_entry_t *entry = hsk_map_get(&pool->tickets, &peer->addr);
+
+  if (entry) {
+    hsk_map_del(&pool->tickets, &peer->addr);
+    hsk_ticket_entry_free(entry);
+  }
+
+  if (pool->tickets.size >= HSK_POOL_TICKETS)
+    hsk_pool_prune_tickets(pool);
+
+  if (pool->tickets.size >= HSK_POOL_TICKETS)
+    return;
+
+  entry = malloc(sizeof(hsk_ticket_entry_t));
+
+  if (!entry)
+    return;
+
+  hsk_addr_copy(&entry->addr, &peer->addr);
+
+  if (!hsk_brontide_get_ticket(peer->brontide, &entry->ticket)) {
+    hsk_ticket_entry_free(entry);
+    return;
+  }
+
+  if (!hsk_map_set(&pool->tickets, &entry->addr, (void *)entry))
+    hsk_ticket_entry_free(entry);
+}
+
+// Tickets are single use: whether or not the resumption works out, the
+// next connection to this peer does a full handshake unless this one gets
+// far enough to save a new ticket.
+static bool
+hsk_pool_take_ticket(
+  hsk_pool_t *pool,
+  const hsk_addr_t *addr,
+  hsk_brontide_ticket_t *ticket
+) {
+  if (!pool->resume)
+    return false;
+
+  hsk_ticket_entry_t *entry = hsk_map_get(&pool->tickets, addr);
+
+  if (!entry)
+    return false;
+
+  hsk_map_del(&pool->tickets, addr);
+
+  bool ok = !hsk_ticket_expired(&entry->ticket, hsk_now())
+    && memcmp(entry->ticket.remote_static, addr->key, 33) == 0;
+
+  if (ok)
+    memcpy(ticket, &entry->ticket, sizeof(hsk_brontide_ticket_t));
+
+  hsk_ticket_entry_free(entry);
+
+  return ok;
+}
+
 static int
 hsk_pool_refill(hsk_pool_t *pool) {
   if (pool->size < pool->max_size) {
@@ -499,6 +766,23 @@ hsk_pool_pick_prover(hsk_pool_t *pool, const uint8_t *name_hash) {
   return deterministic;
 }
 
+bool
+hsk_pool_is_ready(const hsk_pool_t *pool) {
+  assert(pool);
+
+  if (!hsk_chain_synced(&pool->chain))
+    return false;
+
+  hsk_peer_t *peer;
+
+  for (peer = pool->head; peer; peer = peer->next) {
+    if (peer->state == HSK_STATE_HANDSHAKE)
+      return true;
+  }
+
+  return false;
+}
+
 int
 hsk_pool_resolve(
   hsk_pool_t *pool,
@@ -565,7 +849,7 @@ hsk_pool_resend(hsk_pool_t *pool) {
   if (!hsk_chain_synced(&pool->chain))
     return;
 
-  uint8_t *root = pool->chain.tip->name_root;
+  const uint8_t *root = hsk_chain_safe_root(&pool->chain);
   hsk_name_req_t *req = pool->pending;
 
   if (!req)
@@ -592,6 +876,9 @@ hsk_pool_resend(hsk_pool_t *pool) {
     req->next = NULL;
     req->time = now;
 
+    // The proof has to match the root it was requested with.
+    memcpy(req->root, root, 32);
+
     hsk_name_req_t *head = hsk_map_get(&peer->names, req->hash);
 
     if (!hsk_map_set(&peer->names, req->hash, (void *)req)) {
@@ -710,6 +997,7 @@ hsk_peer_timeout_reqs(hsk_peer_t *peer) {
 
 static bool
 hsk_peer_is_overdue(hsk_peer_t *peer) {
+  hsk_pool_t *pool = (hsk_pool_t *)peer->pool;
   int64_t now = hsk_now();
 
   hsk_map_t *map = &peer->names;
@@ -722,7 +1010,7 @@ hsk_peer_is_overdue(hsk_peer_t *peer) {
     hsk_name_req_t *req = (hsk_name_req_t *)hsk_map_value(map, i);
     assert(req);
 
-    if (now > req->time + 5)
+    if (now > req->time + pool->timeouts.proof)
       return true;
   }
 
@@ -731,6 +1019,7 @@ hsk_peer_is_overdue(hsk_peer_t *peer) {
 
 static void
 hsk_pool_timer(hsk_pool_t *pool) {
+  const hsk_pool_timeouts_t *timeouts = &pool->timeouts;
   hsk_peer_t *peer, *next;
   int64_t now = hsk_now();
 
@@ -740,33 +1029,33 @@ hsk_pool_timer(hsk_pool_t *pool) {
     if (peer->state != HSK_STATE_HANDSHAKE)
       continue;
 
-    if (now > peer->conn_time + 60) {
+    if (now > peer->conn_time + timeouts->handshake) {
       if (peer->last_send == 0 || peer->last_recv == 0) {
         hsk_peer_log(peer, "peer is stalling (no message)\n");
         hsk_peer_destroy(peer);
         continue;
       }
 
-      if (now > peer->last_send + 20 * 60) {
+      if (now > peer->last_send + timeouts->stall) {
         hsk_peer_log(peer, "peer is stalling (no send)\n");
         hsk_peer_destroy(peer);
         continue;
       }
 
-      if (now > peer->last_recv + 20 * 60) {
+      if (now > peer->last_recv + timeouts->stall) {
         hsk_peer_log(peer, "peer is stalling (no recv)\n");
         hsk_peer_destroy(peer);
         continue;
       }
 
-      if (peer->challenge && now > peer->last_ping + 20 * 60) {
+      if (peer->challenge && now > peer->last_ping + timeouts->stall) {
         hsk_peer_log(peer, "peer is stalling (ping)\n");
         hsk_peer_destroy(peer);
         continue;
       }
     }
 
-    if (now > peer->ping_timer + 30) {
+    if (now > peer->ping_timer + timeouts->ping) {
       peer->ping_timer = now;
       if (peer->challenge) {
         hsk_peer_log(peer, "peer has not responded to ping\n");
@@ -779,14 +1068,15 @@ hsk_pool_timer(hsk_pool_t *pool) {
     }
 
     if (!hsk_chain_synced(&pool->chain)) {
-      if (peer->getheaders_time && now > peer->getheaders_time + 30) {
+      if (peer->getheaders_time
+          && now > peer->getheaders_time + timeouts->headers) {
         hsk_peer_log(peer, "peer is stalling (headers)\n");
         hsk_peer_destroy(peer);
         continue;
       }
     }
 
-    if (peer->version_time && now > peer->version_time + 10) {
+    if (peer->version_time && now > peer->version_time + timeouts->verack) {
       hsk_peer_log(peer, "peer is stalling (verack)\n");
       hsk_peer_destroy(peer);
       continue;
@@ -799,8 +1089,9 @@ hsk_pool_timer(hsk_pool_t *pool) {
     }
   }
 
-  if (pool->block_time && now > pool->block_time + 10 * 60) {
-    if (!pool->getheaders_time || now > pool->getheaders_time + 5 * 60) {
+  if (pool->block_time && now > pool->block_time + timeouts->block) {
+    if (!pool->getheaders_time
+        || now > pool->getheaders_time + timeouts->getheaders) {
       hsk_pool_log(pool, "resending getheaders to pool\n");
       hsk_pool_send_getheaders(pool);
     }
@@ -822,6 +1113,8 @@ hsk_peer_init(hsk_peer_t *peer, hsk_pool_t *pool, bool encrypted) {
 
   peer->pool = (void *)pool;
   peer->chain = &pool->chain;
+  peer->read_buffer = NULL;
+  peer->msg = NULL;
   peer->loop = pool->loop;
   // peer->socket;
 
@@ -845,7 +1138,8 @@ hsk_peer_init(hsk_peer_t *peer, hsk_pool_t *pool, bool encrypted) {
   memset(peer->host, 0, sizeof(peer->host));
   hsk_addr_init(&peer->addr);
   peer->state = HSK_STATE_DISCONNECTED;
-  memset(peer->read_buffer, 0, HSK_BUFFER_SIZE);
+  peer->read_buffer = (uint8_t *)malloc(pool->buffer_size);
+  peer->read_len = pool->buffer_size;
   peer->headers = 0;
   peer->proofs = 0;
   peer->height = 0;
@@ -867,7 +1161,7 @@ hsk_peer_init(hsk_peer_t *peer, hsk_pool_t *pool, bool encrypted) {
   peer->msg_cmd = 0;
   peer->next = NULL;
 
-  if (!peer->msg)
+  if (!peer->msg || !peer->read_buffer)
     goto fail;
 
   return HSK_SUCCESS;
@@ -884,6 +1178,11 @@ fail:
     peer->msg = NULL;
   }
 
+  if (peer->read_buffer) {
+    free(peer->read_buffer);
+    peer->read_buffer = NULL;
+  }
+
   return HSK_ENOMEM;
 }
 
@@ -904,6 +1203,11 @@ hsk_peer_uninit(hsk_peer_t *peer) {
     free(peer->msg);
     peer->msg = NULL;
   }
+
+  if (peer->read_buffer) {
+    free(peer->read_buffer);
+    peer->read_buffer = NULL;
+  }
 }
 
 static hsk_peer_t *
@@ -961,9 +1265,18 @@ hsk_peer_open(hsk_peer_t *peer, const hsk_addr_t *addr) {
 
   assert(hsk_addr_to_sa(addr, sa));
 
-  if (peer->brontide != NULL)
+  if (peer->brontide != NULL) {
     assert(hsk_brontide_connect(peer->brontide, pool->key, addr->key) == 0);
 
+    hsk_brontide_ticket_t ticket;
+
+    if (hsk_pool_take_ticket(pool, addr, &ticket)) {
+      hsk_peer_log(peer, "resuming session\n");
+      hsk_brontide_set_ticket(peer->brontide, &ticket);
+      memset(&ticket, 0, sizeof(hsk_brontide_ticket_t));
+    }
+  }
+
   if (uv_tcp_connect(conn, &peer->socket, sa, on_connect) != 0) {
     free(conn);
     return HSK_EFAILURE;
@@ -1219,6 +1532,9 @@ hsk_peer_send_version(hsk_peer_t *peer) {
 
   msg.version = HSK_PROTO_VERSION;
   msg.services = HSK_SERVICES;
+
+  if (pool->resume && peer->brontide)
+    msg.services |= HSK_SERVICE_RESUME;
   msg.time = hsk_timedata_now(&pool->td);
 
   const hsk_addrentry_t *entry = hsk_addrman_get(&pool->am, &peer->addr);
@@ -1320,6 +1636,9 @@ hsk_peer_handle_version(hsk_peer_t *peer, const hsk_version_msg_t *msg) {
   hsk_timedata_add(&pool->td, &peer->addr, msg->time);
   hsk_addrman_mark_ack(&pool->am, &peer->addr, msg->services);
 
+  if (msg->services & HSK_SERVICE_RESUME)
+    hsk_pool_save_ticket(pool, peer);
+
   hsk_peer_send_verack(peer);
 
   // At this point, we've sent a version and received VERACK.
@@ -1436,7 +1755,7 @@ hsk_peer_handle_headers(hsk_peer_t *peer, const hsk_headers_msg_t *msg) {
   if (msg->header_count == 0)
     return HSK_SUCCESS;
 
-  if (msg->header_count > 2000)
+  if (msg->header_count > HSK_MAX_HEADERS)
     return HSK_EFAILURE;
 
   const uint8_t *last = NULL;
@@ -1449,67 +1768,55 @@ hsk_peer_handle_headers(hsk_peer_t *peer, const hsk_headers_msg_t *msg) {
     }
 
     last = hsk_header_cache(hdr);
-
-    int rc = hsk_header_verify_pow(hdr);
-
-    if (rc != HSK_SUCCESS) {
-      hsk_peer_log(peer, "invalid header pow\n");
-      return rc;
-    }
   }
 
-  bool orphan = false;
-
-  for (hdr = msg->headers; hdr; hdr = hdr->next) {
-    int rc = hsk_chain_add(peer->chain, hdr);
-
-    if (rc == HSK_ETIMETOOOLD || rc == HSK_EBADDIFFBITS) {
-      hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
+  int added;
+  int rc = hsk_chain_add_batch(peer->chain, msg->headers, peer->id, &added);
 
-      if (!hsk_addrman_add_ban(&pool->am, &peer->addr))
-        return HSK_ENOMEM;
+  peer->headers += added;
 
-      hsk_peer_destroy(peer);
-      return rc;
-    }
+  if (rc == HSK_EHIGHHASH || rc == HSK_ENEGTARGET) {
+    hsk_peer_log(peer, "invalid header pow\n");
+    return rc;
+  }
 
-    if (rc == HSK_ETIMETOONEW) {
-      hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
-      hsk_peer_destroy(peer);
-      return rc;
-    }
+  if (rc == HSK_ETIMETOOOLD || rc == HSK_EBADDIFFBITS) {
+    hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
 
-    if (rc == HSK_EORPHAN || rc == HSK_EDUPLICATEORPHAN) {
-      if (!orphan)
-        hsk_peer_log(peer, "failed adding orphan\n");
-      orphan = true;
-      continue;
-    }
+    if (!hsk_addrman_add_ban(&pool->am, &peer->addr))
+      return HSK_ENOMEM;
 
-    if (rc != HSK_SUCCESS) {
-      hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
-      if (rc == HSK_EDUPLICATE)
-        return HSK_SUCCESS;
-      else
-        return rc;
-    }
+    hsk_peer_destroy(peer);
+    return rc;
+  }
 
-    peer->headers += 1;
+  if (rc == HSK_ETIMETOONEW) {
+    hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
+    hsk_peer_destroy(peer);
+    return rc;
   }
 
-  if (orphan) {
-    hsk_header_t *hdr = msg->headers;
-    const uint8_t *hash = hsk_header_cache(hdr);
+  if (rc == HSK_EORPHAN) {
+    hsk_peer_log(peer, "failed adding orphan\n");
+    const uint8_t *hash = hsk_header_cache(msg->headers);
     hsk_peer_log(peer, "peer sent orphan: %s\n", hsk_hex_encode32(hash));
     hsk_peer_log(peer, "peer sending orphan locator\n");
     hsk_peer_send_getheaders(peer, NULL);
     return HSK_SUCCESS;
   }
 
+  if (rc != HSK_SUCCESS) {
+    hsk_peer_log(peer, "failed adding block: %s\n", hsk_strerror(rc));
+    if (rc == HSK_EDUPLICATE)
+      return HSK_SUCCESS;
+    else
+      return rc;
+  }
+
   pool->block_time = hsk_now();
   peer->getheaders_time = 0;
 
-  if (msg->header_count == 2000) {
+  if (msg->header_count == HSK_MAX_HEADERS) {
     hsk_peer_log(peer, "requesting more headers\n");
     return hsk_peer_send_getheaders(peer, NULL);
   }
@@ -1517,6 +1824,190 @@ hsk_peer_handle_headers(hsk_peer_t *peer, const hsk_headers_msg_t *msg) {
   return HSK_SUCCESS;
 }
 
+static void
+hsk_pool_respond(
+  hsk_name_req_t *reqs,
+  int status,
+  bool exists,
+  const uint8_t *data,
+  size_t data_len
+) {
+  hsk_name_req_t *req, *next;
+
+  for (req = reqs; req; req = next) {
+    next = req->next;
+
+    req->callback(
+      req->name,
+      status,
+      exists,
+      data,
+      data_len,
+      req->arg
+    );
+
+    free(req);
+  }
+}
+
+// A proof being verified on a worker thread. The proof is moved out of the
+// message and the waiting requests out of the peer, so the work stays valid
+// if the peer goes away in the meantime.
+typedef struct hsk_proof_work_s {
+  uint64_t peer_id;
+  uint8_t root[32];
+  uint8_t key[32];
+  hsk_proof_t proof;
+  hsk_name_req_t *reqs;
+  struct hsk_proof_work_s *next;
+} hsk_proof_work_t;
+
+// Proofs verified together on one worker thread, so that their node hashes
+// share the 4-lane BLAKE2b.
+typedef struct {
+  hsk_pool_t *pool;
+  hsk_proof_work_t *head;
+  size_t count;
+  hsk_proof_job_t jobs[HSK_POOL_PROOF_BATCH];
+} hsk_proof_batch_t;
+
+static int
+hsk_peer_queue_proof(
+  hsk_peer_t *peer,
+  const hsk_proof_msg_t *msg,
+  hsk_name_req_t *reqs
+) {
+  hsk_pool_t *pool = (hsk_pool_t *)peer->pool;
+  hsk_proof_work_t *work = malloc(sizeof(hsk_proof_work_t));
+
+  if (!work)
+    return HSK_ENOMEM;
+
+  work->peer_id = peer->id;
+  memcpy(work->root, msg->root, 32);
+  memcpy(work->key, msg->key, 32);
+  work->proof = msg->proof;
+  work->reqs = reqs;
+  work->next = pool->proofs;
+
+  pool->proofs = work;
+  pool->proof_count += 1;
+
+  // The message is freed once we return.
+  hsk_proof_init((hsk_proof_t *)&msg->proof);
+  hsk_map_del(&peer->names, msg->key);
+
+  if (pool->proof_count == HSK_POOL_PROOF_BATCH)
+    hsk_pool_flush_proofs(pool);
+
+  return HSK_SUCCESS;
+}
+
+// Send the queued proofs to a worker. Called once everything that arrived
+// in a read has been handled.
+static void
+hsk_pool_flush_proofs(hsk_pool_t *pool) {
+  if (!pool->proofs)
+    return;
+
+  hsk_proof_batch_t *batch = malloc(sizeof(hsk_proof_batch_t));
+
+  if (!batch) {
+    hsk_proof_work_t *work, *next;
+
+    for (work = pool->proofs; work; work = next) {
+      next = work->next;
+      hsk_pool_respond(work->reqs, HSK_ENOMEM, false, NULL, 0);
+      hsk_proof_uninit(&work->proof);
+      free(work);
+    }
+
+    pool->proofs = NULL;
+    pool->proof_count = 0;
+    return;
+  }
+
+  batch->pool = pool;
+  batch->head = pool->proofs;
+  batch->count = (size_t)pool->proof_count;
+
+  pool->proofs = NULL;
+  pool->proof_count = 0;
+
+  hsk_proof_work_t *work;
+  size_t i = 0;
+
+  for (work = batch->head; work; work = work->next) {
+    hsk_proof_job_t *job = &batch->jobs[i++];
+    job->root = work->root;
+    job->key = work->key;
+    job->proof = &work->proof;
+    job->result = HSK_EFAILURE;
+    job->exists = false;
+    job->data = NULL;
+    job->data_len = 0;
+  }
+
+  int rc = hsk_workers_queue(pool->workers, run_verify, after_verify, batch);
+
+  if (rc != HSK_SUCCESS)
+    after_verify(batch, false);
+}
+
+static void
+run_verify(void *arg) {
+  hsk_proof_batch_t *batch = (hsk_proof_batch_t *)arg;
+  hsk_proof_verify_batch(batch->jobs, batch->count);
+}
+
+static void
+after_verify(void *arg, bool ok) {
+  hsk_proof_batch_t *batch = (hsk_proof_batch_t *)arg;
+  hsk_pool_t *pool = batch->pool;
+  hsk_proof_work_t *work, *next;
+  size_t i = 0;
+
+  for (work = batch->head; work; work = next) {
+    hsk_proof_job_t *job = &batch->jobs[i++];
+    hsk_peer_t *peer;
+
+    next = work->next;
+
+    for (peer = pool->head; peer; peer = peer->next) {
+      if (peer->id == work->peer_id)
+        break;
+    }
+
+    if (!ok) {
+      hsk_pool_respond(work->reqs, HSK_ETIMEOUT, false, NULL, 0);
+    } else if (job->result != HSK_SUCCESS) {
+      if (peer) {
+        hsk_peer_log(peer, "invalid proof: %s\n", hsk_strerror(job->result));
+        hsk_peer_destroy(peer);
+      }
+
+      hsk_pool_respond(work->reqs, HSK_ETIMEOUT, false, NULL, 0);
+    } else {
+      if (peer)
+        peer->proofs += 1;
+
+      hsk_pool_respond(
+        work->reqs,
+        HSK_SUCCESS,
+        job->exists,
+        job->data,
+        job->data_len
+      );
+    }
+
+    hsk_proof_uninit(&work->proof);
+    free(job->data);
+    free(work);
+  }
+
+  free(batch);
+}
+
 static int
 hsk_peer_handle_proof(hsk_peer_t *peer, const hsk_proof_msg_t *msg) {
   hsk_peer_log(peer, "received proof: %s\n", hsk_hex_encode32(msg->key));
@@ -1537,6 +2028,11 @@ hsk_peer_handle_proof(hsk_peer_t *peer, const hsk_proof_msg_t *msg) {
     return HSK_EHASHMISMATCH;
   }
 
+  hsk_pool_t *pool = (hsk_pool_t *)peer->pool;
+
+  if (hsk_workers_is_open(pool->workers))
+    return hsk_peer_queue_proof(peer, msg, reqs);
+
   bool exists;
   uint8_t *data;
   size_t data_len;
@@ -1557,22 +2053,7 @@ hsk_peer_handle_proof(hsk_peer_t *peer, const hsk_proof_msg_t *msg) {
 
   hsk_map_del(&peer->names, msg->key);
 
-  hsk_name_req_t *req, *next;
-
-  for (req = reqs; req; req = next) {
-    next = req->next;
-
-    req->callback(
-      req->name,
-      HSK_SUCCESS,
-      exists,
-      data,
-      data_len,
-      req->arg
-    );
-
-    free(req);
-  }
+  hsk_pool_respond(reqs, HSK_SUCCESS, exists, data, data_len);
 
   free(data);
 
@@ -1726,6 +2207,22 @@ hsk_peer_parse(hsk_peer_t *peer, const uint8_t *msg, size_t msg_len) {
     goto done;
   }
 
+  if (m->cmd == HSK_MSG_HEADERS) {
+    hsk_pool_t *pool = (hsk_pool_t *)peer->pool;
+
+    if (!pool->headers) {
+      pool->headers = malloc(HSK_MAX_HEADERS * sizeof(hsk_header_t));
+
+      if (!pool->headers) {
+        free(m);
+        rc = HSK_ENOMEM;
+        goto done;
+      }
+    }
+
+    ((hsk_headers_msg_t *)m)->buf = pool->headers;
+  }
+
   if (!hsk_msg_decode(msg, msg_len, m)) {
     hsk_peer_log(peer, "error parsing msg: %s\n", str);
     free(m);
@@ -1833,7 +2330,7 @@ alloc_buffer(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
   }
 
   buf->base = (char *)peer->read_buffer;
-  buf->len = HSK_BUFFER_SIZE;
+  buf->len = peer->read_len;
 }
 
 static void
@@ -1849,6 +2346,9 @@ after_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
     hsk_peer_destroy(peer);
     return;
   }
+
+  // The peer may be gone by the time the read is handled.
+  hsk_pool_t *pool = (hsk_pool_t *)peer->pool;
   
   if (peer->brontide != NULL) {
     int r = hsk_brontide_on_read(
@@ -1859,7 +2359,6 @@ after_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
     if (r != HSK_SUCCESS) {
       hsk_peer_log(peer, "brontide_on_read failed: %s\n", hsk_strerror(r));
       hsk_peer_destroy(peer);
-      return;
     }
   } else {
     hsk_peer_on_read(
@@ -1868,6 +2367,9 @@ after_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
         (size_t)nread
         );
   }
+
+  // Proofs that came in with this read are verified as one batch.
+  hsk_pool_flush_proofs(pool);
 }
 
 static void
@@ -1897,6 +2399,9 @@ after_brontide_connect(const void *arg) {
 
   hsk_addrman_mark_success(&pool->am, &peer->addr);
 
+  if (hsk_brontide_is_resumed(peer->brontide))
+    hsk_peer_log(peer, "session resumed\n");
+
   peer->state = HSK_STATE_HANDSHAKE;
 
   hsk_peer_send_version(peer);
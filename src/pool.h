@@ -14,6 +14,7 @@
 #include "header.h"
 #include "map.h"
 #include "timedata.h"
+#include "workers.h"
 
 /*
  * Defs
@@ -21,6 +22,10 @@
 
 #define HSK_BUFFER_SIZE 32768
 #define HSK_POOL_SIZE 8
+#define HSK_POOL_THREADS 2
+#define HSK_POOL_TICKETS 64
+// Most proofs handed to a worker thread to verify together.
+#define HSK_POOL_PROOF_BATCH 16
 #define HSK_STATE_DISCONNECTED 0
 #define HSK_STATE_CONNECTING 2
 #define HSK_STATE_CONNECTED 3
@@ -32,6 +37,25 @@
  * Types
  */
 
+// Peer timeouts, in seconds.
+typedef struct hsk_pool_timeouts_s {
+  // Grace period after connecting before a peer can be stalling.
+  int handshake;
+  // Nothing sent or received, or an unanswered ping.
+  int stall;
+  int ping;
+  // Replies to getheaders (while syncing), version and getproof.
+  int headers;
+  int verack;
+  int proof;
+  // Without a new block for this long, ask the pool for headers again,
+  // at most once per `getheaders`.
+  int block;
+  int getheaders;
+} hsk_pool_timeouts_t;
+
+struct hsk_proof_work_s;
+
 typedef void (*hsk_resolve_cb)(
   const char *name,
   int status,
@@ -61,7 +85,8 @@ typedef struct hsk_peer_s {
   char host[HSK_MAX_HOST];
   hsk_addr_t addr;
   int state;
-  uint8_t read_buffer[HSK_BUFFER_SIZE];
+  uint8_t *read_buffer;
+  size_t read_len;
   int headers;
   int proofs;
   int64_t height;
@@ -105,6 +130,18 @@ typedef struct hsk_pool_s {
   int64_t block_time;
   int64_t getheaders_time;
   char *user_agent;
+  int threads;
+  hsk_workers_t *workers;
+  bool resume;
+  hsk_map_t tickets;
+  size_t buffer_size;
+  hsk_pool_timeouts_t timeouts;
+  // Headers messages are read into this (HSK_MAX_HEADERS, allocated on the
+  // first one) for every peer; the chain copies the headers it keeps.
+  hsk_header_t *headers;
+  // Proofs waiting to go to the workers as one batch.
+  struct hsk_proof_work_s *proofs;
+  int proof_count;
 } hsk_pool_t;
 
 /*
@@ -129,6 +166,30 @@ hsk_pool_set_seeds(hsk_pool_t *pool, const char *seeds);
 bool
 hsk_pool_set_agent(hsk_pool_t *pool, const char *user_agent);
 
+// Worker threads for proof verification and response building. Zero keeps
+// everything on the event loop.
+bool
+hsk_pool_set_threads(hsk_pool_t *pool, int threads);
+
+// Offer brontide session resumption to peers (off by default). Reconnects
+// to a peer that also offered it skip the handshake.
+void
+hsk_pool_set_resume(hsk_pool_t *pool, bool resume);
+
+// Size of each peer's read buffer. Peers connected from now on use it.
+bool
+hsk_pool_set_buffer(hsk_pool_t *pool, size_t size);
+
+void
+hsk_pool_timeouts_init(hsk_pool_timeouts_t *timeouts);
+
+bool
+hsk_pool_set_timeouts(hsk_pool_t *pool, const hsk_pool_timeouts_t *timeouts);
+
+// Orphan headers to keep before dropping them all.
+bool
+hsk_pool_set_orphans(hsk_pool_t *pool, int limit);
+
 hsk_pool_t *
 hsk_pool_alloc(const uv_loop_t *loop);
 
@@ -144,6 +205,10 @@ hsk_pool_close(hsk_pool_t *pool);
 int
 hsk_pool_destroy(hsk_pool_t *pool);
 
+// Synced, with at least one peer to ask for proofs.
+bool
+hsk_pool_is_ready(const hsk_pool_t *pool);
+
 int
 hsk_pool_resolve(
   hsk_pool_t *pool,
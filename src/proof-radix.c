@@ -48,6 +48,17 @@ read_bitlen(uint8_t **data, size_t *data_len, uint16_t *bits, size_t *bytes) {
   return true;
 }
 
+static inline size_t
+write_bitlen(uint8_t **data, uint16_t bits) {
+  if (bits < 0x80)
+    return write_u8(data, (uint8_t)bits);
+
+  size_t s = 0;
+  s += write_u8(data, 0x80 | (uint8_t)(bits >> 8));
+  s += write_u8(data, (uint8_t)bits);
+  return s;
+}
+
 void
 hsk_proof_init(hsk_proof_t *proof) {
   assert(proof);
@@ -248,46 +259,131 @@ hsk_proof_decode(const uint8_t *data, size_t data_len, hsk_proof_t *proof) {
   return hsk_proof_read((uint8_t **)&data, &data_len, proof);
 }
 
-static void
-hsk_proof_hash_internal(
+int
+hsk_proof_write(const hsk_proof_t *proof, uint8_t **data) {
+  assert(proof);
+  assert(proof->node_count <= 256);
+
+  int s = 0;
+  size_t i;
+
+  s += write_u16(data, ((uint16_t)proof->type << 14) | proof->depth);
+  s += write_u16(data, proof->node_count);
+
+  uint8_t map[32];
+  size_t bsize = ((size_t)proof->node_count + 7) / 8;
+
+  memset(map, 0x00, sizeof(map));
+
+  for (i = 0; i < proof->node_count; i++) {
+    if (proof->nodes[i].prefix_size > 0)
+      map[i >> 3] |= 1 << (7 - (i & 7));
+  }
+
+  s += write_bytes(data, map, bsize);
+
+  for (i = 0; i < proof->node_count; i++) {
+    const hsk_proof_node_t *item = &proof->nodes[i];
+
+    if (item->prefix_size > 0) {
+      s += write_bitlen(data, item->prefix_size);
+      s += write_bytes(data, item->prefix, (item->prefix_size + 7) / 8);
+    }
+
+    s += write_bytes(data, item->node, 32);
+  }
+
+  switch (proof->type) {
+    case HSK_PROOF_DEADEND: {
+      break;
+    }
+
+    case HSK_PROOF_SHORT: {
+      s += write_bitlen(data, proof->prefix_size);
+      s += write_bytes(data, proof->prefix, (proof->prefix_size + 7) / 8);
+      s += write_bytes(data, proof->left, 32);
+      s += write_bytes(data, proof->right, 32);
+      break;
+    }
+
+    case HSK_PROOF_COLLISION: {
+      s += write_bytes(data, proof->nx_key, 32);
+      s += write_bytes(data, proof->nx_hash, 32);
+      break;
+    }
+
+    case HSK_PROOF_EXISTS: {
+      s += write_u16(data, proof->value_size);
+      s += write_bytes(data, proof->value, proof->value_size);
+      break;
+    }
+
+    default: {
+      assert(0 && "bad type");
+      break;
+    }
+  }
+
+  return s;
+}
+
+int
+hsk_proof_size(const hsk_proof_t *proof) {
+  return hsk_proof_write(proof, NULL);
+}
+
+// Internal nodes are at most 1 + 2 + 32 + 64 bytes, so
+// every node hash fits in a single BLAKE2b block.
+static size_t
+hsk_proof_write_internal(
   const uint8_t *prefix,
   uint16_t prefix_size,
   const uint8_t *left,
   const uint8_t *right,
-  uint8_t *out
+  uint8_t *block
 ) {
-  hsk_blake2b_ctx ctx;
-  assert(hsk_blake2b_init(&ctx, 32) == 0);
+  uint8_t *p = block;
 
   if (prefix_size == 0) {
-    hsk_blake2b_update(&ctx, hsk_proof_internal, 1);
-    hsk_blake2b_update(&ctx, left, 32);
-    hsk_blake2b_update(&ctx, right, 32);
+    *p++ = hsk_proof_internal[0];
   } else {
-    uint8_t size[2];
-    uint8_t *p = &size[0];
-    write_u16(&p, prefix_size);
-
     size_t bytes = ((size_t)prefix_size + 7) / 8;
 
-    hsk_blake2b_update(&ctx, hsk_proof_skip, 1);
-    hsk_blake2b_update(&ctx, size, 2);
-    hsk_blake2b_update(&ctx, prefix, bytes);
-    hsk_blake2b_update(&ctx, left, 32);
-    hsk_blake2b_update(&ctx, right, 32);
+    *p++ = hsk_proof_skip[0];
+    write_u16(&p, prefix_size);
+    memcpy(p, prefix, bytes);
+    p += bytes;
   }
 
-  assert(hsk_blake2b_final(&ctx, out, 32) == 0);
+  memcpy(p, left, 32);
+  p += 32;
+  memcpy(p, right, 32);
+  p += 32;
+
+  return p - block;
+}
+
+static void
+hsk_proof_hash_internal(
+  const uint8_t *prefix,
+  uint16_t prefix_size,
+  const uint8_t *left,
+  const uint8_t *right,
+  uint8_t *out
+) {
+  uint8_t block[HSK_BLAKE2B_BLOCKBYTES];
+  size_t len = hsk_proof_write_internal(prefix, prefix_size,
+                                        left, right, block);
+  hsk_blake2b_256_block(out, block, len);
 }
 
 static void
 hsk_proof_hash_leaf(const uint8_t *key, const uint8_t *hash, uint8_t *out) {
-  hsk_blake2b_ctx ctx;
-  assert(hsk_blake2b_init(&ctx, 32) == 0);
-  hsk_blake2b_update(&ctx, hsk_proof_leaf, 1);
-  hsk_blake2b_update(&ctx, key, 32);
-  hsk_blake2b_update(&ctx, hash, 32);
-  assert(hsk_blake2b_final(&ctx, out, 32) == 0);
+  uint8_t block[65];
+  block[0] = hsk_proof_leaf[0];
+  memcpy(&block[1], key, 32);
+  memcpy(&block[33], hash, 32);
+  hsk_blake2b_256_block(out, block, sizeof(block));
 }
 
 static void
@@ -367,26 +463,14 @@ hsk_parse_namestate(
   return true;
 }
 
-int
-hsk_proof_verify(
-  const uint8_t *root,
-  const uint8_t *key,
-  const hsk_proof_t *proof,
-  bool *exists,
-  uint8_t **data,
-  size_t *data_len
-) {
-  if (root == NULL || key == NULL || proof == NULL)
-    return HSK_EBADARGS;
-
-  uint8_t leaf[32];
-
+// Re-create the leaf.
+static int
+hsk_proof_start(const uint8_t *key, const hsk_proof_t *proof, uint8_t *leaf) {
   assert(proof->depth <= 256);
   assert(proof->nodes || proof->node_count == 0);
   assert(proof->node_count <= 256);
   assert(proof->value_size <= HSK_MAX_DATA_SIZE);
 
-  // Re-create the leaf.
   switch (proof->type) {
     case HSK_PROOF_DEADEND: {
       memset(leaf, 0x00, 32);
@@ -434,33 +518,60 @@ hsk_proof_verify(
       break;
   }
 
-  uint8_t *next = &leaf[0];
-  int depth = (int)proof->depth;
-  int i = ((int)proof->node_count) - 1;
+  return HSK_EPROOFOK;
+}
 
-  // Traverse bits right to left.
-  for (; i >= 0; i--) {
-    hsk_proof_node_t *item = &proof->nodes[i];
-    uint8_t *prefix = &item->prefix[0];
-    uint16_t prefix_size = item->prefix_size;
-    uint8_t *node = &item->node[0];
+// Serialize the next node up the path. The caller hashes
+// `block` into `next` and then calls hsk_proof_step_end().
+static int
+hsk_proof_step_begin(
+  const uint8_t *key,
+  const hsk_proof_node_t *item,
+  int *depth,
+  const uint8_t *next,
+  uint8_t *block,
+  size_t *len
+) {
+  if (*depth < item->prefix_size + 1)
+    return HSK_ENEGDEPTH;
 
-    if (depth < prefix_size + 1)
-      return HSK_ENEGDEPTH;
+  *depth -= 1;
 
-    depth -= 1;
+  if (HSK_HAS_BIT(key, *depth)) {
+    *len = hsk_proof_write_internal(item->prefix, item->prefix_size,
+                                    item->node, next, block);
+  } else {
+    *len = hsk_proof_write_internal(item->prefix, item->prefix_size,
+                                    next, item->node, block);
+  }
 
-    if (HSK_HAS_BIT(key, depth))
-      hsk_proof_hash_internal(prefix, prefix_size, node, next, next);
-    else
-      hsk_proof_hash_internal(prefix, prefix_size, next, node, next);
+  return HSK_EPROOFOK;
+}
+
+static int
+hsk_proof_step_end(
+  const uint8_t *key,
+  const hsk_proof_node_t *item,
+  int *depth
+) {
+  *depth -= item->prefix_size;
 
-    depth -= prefix_size;
+  if (!hsk_proof_has(item->prefix, item->prefix_size, key, *depth))
+    return HSK_EPATHMISMATCH;
 
-    if (!hsk_proof_has(prefix, prefix_size, key, depth))
-      return HSK_EPATHMISMATCH;
-  }
+  return HSK_EPROOFOK;
+}
 
+static int
+hsk_proof_finish(
+  const uint8_t *root,
+  const hsk_proof_t *proof,
+  const uint8_t *next,
+  int depth,
+  bool *exists,
+  uint8_t **data,
+  size_t *data_len
+) {
   if (depth != 0)
     return HSK_ETOODEEP;
 
@@ -480,3 +591,200 @@ hsk_proof_verify(
 
   return HSK_EPROOFOK;
 }
+
+int
+hsk_proof_verify(
+  const uint8_t *root,
+  const uint8_t *key,
+  const hsk_proof_t *proof,
+  bool *exists,
+  uint8_t **data,
+  size_t *data_len
+) {
+  if (root == NULL || key == NULL || proof == NULL)
+    return HSK_EBADARGS;
+
+  uint8_t next[32];
+  uint8_t block[HSK_BLAKE2B_BLOCKBYTES];
+  size_t len;
+
+  int rc = hsk_proof_start(key, proof, next);
+
+  if (rc != HSK_EPROOFOK)
+    return rc;
+
+  int depth = (int)proof->depth;
+  int i = ((int)proof->node_count) - 1;
+
+  // Traverse bits right to left.
+  for (; i >= 0; i--) {
+    const hsk_proof_node_t *item = &proof->nodes[i];
+
+    rc = hsk_proof_step_begin(key, item, &depth, next, block, &len);
+
+    if (rc != HSK_EPROOFOK)
+      return rc;
+
+    hsk_blake2b_256_block(next, block, len);
+
+    rc = hsk_proof_step_end(key, item, &depth);
+
+    if (rc != HSK_EPROOFOK)
+      return rc;
+  }
+
+  return hsk_proof_finish(root, proof, next, depth, exists, data, data_len);
+}
+
+/*
+ * Batch Verification
+ */
+
+typedef struct {
+  hsk_proof_job_t *job;
+  int depth;
+  int index;
+  uint8_t next[32];
+  uint8_t block[HSK_BLAKE2B_BLOCKBYTES];
+  size_t len;
+} hsk_proof_lane_t;
+
+// Pull jobs into an empty lane until one has a node left to hash. Jobs that
+// fail early or have no nodes are completed here.
+static bool
+hsk_proof_lane_fill(hsk_proof_lane_t *lane, hsk_proof_job_t *jobs,
+                    size_t count, size_t *pos) {
+  while (*pos < count) {
+    hsk_proof_job_t *job = &jobs[(*pos)++];
+
+    job->exists = false;
+    job->data = NULL;
+    job->data_len = 0;
+
+    if (job->root == NULL || job->key == NULL || job->proof == NULL) {
+      job->result = HSK_EBADARGS;
+      continue;
+    }
+
+    job->result = hsk_proof_start(job->key, job->proof, lane->next);
+
+    if (job->result != HSK_EPROOFOK)
+      continue;
+
+    lane->depth = (int)job->proof->depth;
+    lane->index = ((int)job->proof->node_count) - 1;
+
+    if (lane->index < 0) {
+      job->result = hsk_proof_finish(job->root, job->proof, lane->next,
+                                     lane->depth, &job->exists,
+                                     &job->data, &job->data_len);
+      continue;
+    }
+
+    lane->job = job;
+
+    return true;
+  }
+
+  return false;
+}
+
+void
+hsk_proof_verify_batch(hsk_proof_job_t *jobs, size_t count) {
+  assert(jobs || count == 0);
+
+  hsk_proof_lane_t lanes[4];
+  size_t pos = 0;
+  int l;
+
+  for (l = 0; l < 4; l++)
+    lanes[l].job = NULL;
+
+  for (;;) {
+    uint8_t *out[4];
+    const uint8_t *in[4];
+    size_t inlen[4];
+    int used[4];
+    int n = 0;
+
+    for (l = 0; l < 4; l++) {
+      hsk_proof_lane_t *lane = &lanes[l];
+
+      for (;;) {
+        if (!lane->job && !hsk_proof_lane_fill(lane, jobs, count, &pos))
+          break;
+
+        hsk_proof_job_t *job = lane->job;
+
+        job->result = hsk_proof_step_begin(
+          job->key,
+          &job->proof->nodes[lane->index],
+          &lane->depth,
+          lane->next,
+          lane->block,
+          &lane->len
+        );
+
+        if (job->result == HSK_EPROOFOK)
+          break;
+
+        lane->job = NULL;
+      }
+
+      if (!lane->job)
+        continue;
+
+      out[n] = lane->next;
+      in[n] = lane->block;
+      inlen[n] = lane->len;
+      used[n] = l;
+      n += 1;
+    }
+
+    if (n == 0)
+      break;
+
+    if (n == 1) {
+      hsk_blake2b_256_block(out[0], in[0], inlen[0]);
+    } else {
+      uint8_t scratch[4][32];
+      int j;
+
+      // Pad the idle lanes with copies of the first.
+      for (j = n; j < 4; j++) {
+        out[j] = scratch[j];
+        in[j] = in[0];
+        inlen[j] = inlen[0];
+      }
+
+      hsk_blake2b_256_block_x4(out, in, inlen);
+    }
+
+    int i;
+    for (i = 0; i < n; i++) {
+      hsk_proof_lane_t *lane = &lanes[used[i]];
+      hsk_proof_job_t *job = lane->job;
+      const hsk_proof_t *proof = job->proof;
+
+      job->result = hsk_proof_step_end(
+        job->key,
+        &proof->nodes[lane->index],
+        &lane->depth
+      );
+
+      if (job->result != HSK_EPROOFOK) {
+        lane->job = NULL;
+        continue;
+      }
+
+      lane->index -= 1;
+
+      if (lane->index < 0) {
+        job->result = hsk_proof_finish(job->root, proof, lane->next,
+                                       lane->depth, &job->exists,
+                                       &job->data, &job->data_len);
+        lane->job = NULL;
+      }
+    }
+  }
+}
@@ -49,6 +49,26 @@ hsk_proof_read(uint8_t **data, size_t *data_len, hsk_proof_t *proof);
 bool
 hsk_proof_decode(const uint8_t *data, size_t data_len, hsk_proof_t *proof);
 
+// Serialize a proof in the format hsk_proof_read() expects. Returns the
+// size, and only computes it if `data` is NULL.
+int
+hsk_proof_write(const hsk_proof_t *proof, uint8_t **data);
+
+int
+hsk_proof_size(const hsk_proof_t *proof);
+
+// A single proof check for hsk_proof_verify_batch(). The outputs mirror
+// the return value and out parameters of hsk_proof_verify().
+typedef struct hsk_proof_job_s {
+  const uint8_t *root;
+  const uint8_t *key;
+  const hsk_proof_t *proof;
+  int result;
+  bool exists;
+  uint8_t *data;
+  size_t data_len;
+} hsk_proof_job_t;
+
 int
 hsk_proof_verify(
   const uint8_t *root,
@@ -58,4 +78,10 @@ hsk_proof_verify(
   uint8_t **data,
   size_t *data_len
 );
+
+// Verify several proofs at once. Node hashes from up to four proofs are
+// computed together with the 4-lane BLAKE2b, so this is faster than calling
+// hsk_proof_verify() in a loop when there are many proofs to check.
+void
+hsk_proof_verify_batch(hsk_proof_job_t *jobs, size_t count);
 #endif
@@ -23,6 +23,7 @@ hsk_dns_req_init(hsk_dns_req_t *req) {
   req->id = 0;
   req->labels = 0;
   memset(req->name, 0x00, sizeof(req->name));
+  hsk_dns_name_init(&req->qname);
   req->type = 0;
   req->class = 0;
   req->rd = false;
@@ -62,72 +63,81 @@ hsk_dns_req_create(
   const struct sockaddr *addr
 ) {
   hsk_dns_req_t *req = NULL;
-  hsk_dns_msg_t *msg = NULL;
+  hsk_dns_view_t view;
+  hsk_dns_iter_t it;
+  hsk_dns_view_rr_t qs;
 
   req = hsk_dns_req_alloc();
 
   if (!req)
     goto fail;
 
-  if (!hsk_dns_msg_decode(data, data_len, &msg))
+  // We only need the header, the question and
+  // EDNS, so don't decode the message in full.
+  if (!hsk_dns_view_init(&view, data, data_len))
     goto fail;
 
-  if (msg->opcode != HSK_DNS_QUERY
-      || msg->code != HSK_DNS_NOERROR
-      || msg->qd.size != 1
-      || msg->an.size != 0
-      || msg->ns.size != 0) {
+  if (view.opcode != HSK_DNS_QUERY
+      || view.code != HSK_DNS_NOERROR
+      || view.counts[HSK_DNS_SECTION_QD] != 1
+      || view.counts[HSK_DNS_SECTION_AN] != 0
+      || view.counts[HSK_DNS_SECTION_NS] != 0) {
     goto fail;
   }
 
   // Grab the first question.
-  hsk_dns_qs_t *qs = msg->qd.items[0];
+  hsk_dns_view_iter(&view, HSK_DNS_SECTION_QD, &it);
+
+  if (!hsk_dns_iter_next(&it, &qs))
+    goto fail;
+
+  if (!hsk_dns_view_name(&view, qs.off, req->name))
+    goto fail;
 
 #if 0
-  if (qs->class != HSK_DNS_IN)
+  if (qs.class != HSK_DNS_IN)
     goto fail;
 
   // Don't allow dirty names.
-  if (hsk_dns_name_dirty(qs->name))
+  if (hsk_dns_name_dirty(req->name))
     goto fail;
 #endif
 
-  // Check for a TLD.
-  hsk_dns_label_get(qs->name, -1, req->tld);
+  // Index the name once. Everything
+  // downstream works off the labels.
+  if (!hsk_dns_name_set(&req->qname, req->name))
+    goto fail;
+
+  // Check for a TLD (lowercase).
+  hsk_dns_name_label(&req->qname, -1, req->tld);
 
   // Don't allow dirty TLDs.
   if (hsk_dns_name_dirty(req->tld))
     goto fail;
 
-  // Lowercase.
-  hsk_to_lower(req->tld);
-
   // Reference.
   req->ns = NULL;
 
   // DNS stuff.
-  req->id = msg->id;
-  req->labels = hsk_dns_label_count(qs->name);
-  strcpy(req->name, qs->name);
-  req->type = qs->type;
-  req->class = qs->class;
-  req->rd = (msg->flags & HSK_DNS_RD) != 0;
-  req->cd = (msg->flags & HSK_DNS_CD) != 0;
-  req->ad = (msg->flags & HSK_DNS_AD) != 0;
-  req->edns = msg->edns.enabled;
+  req->id = view.id;
+  req->labels = req->qname.count;
+  req->type = qs.type;
+  req->class = qs.class;
+  req->rd = (view.flags & HSK_DNS_RD) != 0;
+  req->cd = (view.flags & HSK_DNS_CD) != 0;
+  req->ad = (view.flags & HSK_DNS_AD) != 0;
+  req->edns = view.edns.enabled;
   req->max_size = HSK_DNS_MAX_UDP;
-  if (msg->edns.enabled && msg->edns.size >= HSK_DNS_MAX_UDP) {
-    req->max_size = msg->edns.size;
+  if (view.edns.enabled && view.edns.size >= HSK_DNS_MAX_UDP) {
+    req->max_size = view.edns.size;
     if (req->max_size > HSK_DNS_MAX_EDNS)
       req->max_size = HSK_DNS_MAX_EDNS;
   }
-  req->dnssec = (msg->edns.flags & HSK_DNS_DO) != 0;
+  req->dnssec = (view.edns.flags & HSK_DNS_DO) != 0;
 
-  // Sender address.
-  hsk_sa_copy(req->addr, addr);
-
-  // Free stuff up.
-  hsk_dns_msg_free(msg);
+  // Sender address, if there is one.
+  if (addr)
+    hsk_sa_copy(req->addr, addr);
 
   return req;
 
@@ -135,9 +145,6 @@ fail:
   if (req)
     free(req);
 
-  if (msg)
-    hsk_dns_msg_free(msg);
-
   return NULL;
 }
 
@@ -147,7 +154,8 @@ hsk_dns_req_print(const hsk_dns_req_t *req, const char *prefix) {
 
   char addr[HSK_MAX_HOST];
 
-  assert(hsk_sa_to_string(req->addr, addr, HSK_MAX_HOST, 1));
+  if (!hsk_sa_to_string(req->addr, addr, HSK_MAX_HOST, 1))
+    strcpy(addr, "none");
 
   printf("%squery\n", prefix);
   printf("%s  id=%d\n", prefix, req->id);
@@ -162,15 +170,14 @@ hsk_dns_req_print(const hsk_dns_req_t *req, const char *prefix) {
 }
 
 bool
-hsk_dns_msg_finalize(
+hsk_dns_msg_prepare(
   hsk_dns_msg_t **res,
   const hsk_dns_req_t *req,
-  const hsk_ec_t *ec,
-  const uint8_t *key,
+  bool sig0,
   uint8_t **wire,
   size_t *wire_len
 ) {
-  assert(res && req && ec && wire && wire_len);
+  assert(res && req && wire && wire_len);
 
   hsk_dns_msg_t *msg = *res;
 
@@ -215,7 +222,7 @@ hsk_dns_msg_finalize(
 
   if (!qs) {
     hsk_dns_msg_free(msg);
-    return NULL;
+    return false;
   }
 
   hsk_dns_rr_set_name(qs, req->name);
@@ -235,50 +242,63 @@ hsk_dns_msg_finalize(
     }
   }
 
-  // Reserialize.
-  uint8_t *data = NULL;
-  size_t data_len = 0;
+  // Reserialize, leaving room for the SIG(0)
+  // record at the tail of the buffer.
+  size_t reserve = sig0 ? HSK_SIG0_RR_SIZE : 0;
+  int size = hsk_dns_msg_size(msg);
+  uint8_t *data = malloc(size + reserve);
 
-  if (!hsk_dns_msg_encode(msg, &data, &data_len)) {
+  if (!data) {
     hsk_dns_msg_free(msg);
     return false;
   }
 
-  assert(data);
+  uint8_t *d = data;
+  size_t data_len = hsk_dns_msg_write(msg, &d);
 
   hsk_dns_msg_free(msg);
 
   // Truncate.
-  size_t max = req->max_size;
-
-  if (key)
-    max -= HSK_SIG0_RR_SIZE;
+  size_t max = req->max_size - reserve;
 
   if (!hsk_dns_msg_truncate(data, data_len, max, &data_len)) {
     free(data);
     return false;
   }
 
-  if (!key) {
-    *wire = data;
-    *wire_len = data_len;
-    return true;
-  }
+  *wire = data;
+  *wire_len = data_len;
 
-  // Sign.
-  uint8_t *out = NULL;
-  size_t out_len = 0;
+  return true;
+}
 
-  if (!hsk_sig0_sign(ec, key, data, data_len, &out, &out_len)) {
-    free(data);
+bool
+hsk_dns_msg_finalize(
+  hsk_dns_msg_t **res,
+  const hsk_dns_req_t *req,
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  uint8_t **wire,
+  size_t *wire_len
+) {
+  assert(res && req && ec && wire && wire_len);
+
+  uint8_t *data = NULL;
+  size_t data_len = 0;
+
+  if (!hsk_dns_msg_prepare(res, req, key != NULL, &data, &data_len))
     return false;
-  }
 
-  assert(out);
-  free(data);
+  // Sign into the reserved tail.
+  if (key) {
+    if (!hsk_sig0_sign_inplace(ec, key, data, data_len, &data_len)) {
+      free(data);
+      return false;
+    }
+  }
 
-  *wire = out;
-  *wire_len = out_len;
+  *wire = data;
+  *wire_len = data_len;
 
   return true;
 }
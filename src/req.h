@@ -18,6 +18,8 @@ typedef struct {
   uint16_t id;
   size_t labels;
   char name[HSK_DNS_MAX_NAME + 1];
+  // Lowercase, label-indexed copy of name.
+  hsk_dns_name_t qname;
   uint16_t type;
   uint16_t class;
   bool rd;
@@ -57,6 +59,19 @@ hsk_dns_req_create(
 void
 hsk_dns_req_print(const hsk_dns_req_t *req, const char *prefix);
 
+// Reset a response for the request it answers and serialize it. Takes
+// ownership of *res. If sig0 is true, the message is truncated to leave room
+// for a SIG(0) record and the buffer has HSK_SIG0_RR_SIZE bytes of spare
+// capacity past *wire_len (see hsk_sig0_sign_inplace()).
+bool
+hsk_dns_msg_prepare(
+  hsk_dns_msg_t **res,
+  const hsk_dns_req_t *req,
+  bool sig0,
+  uint8_t **wire,
+  size_t *wire_len
+);
+
 bool
 hsk_dns_msg_finalize(
   hsk_dns_msg_t **res,
@@ -0,0 +1,1531 @@
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "addr.h"
+#include "cache.h"
+#include "constants.h"
+#include "dns.h"
+#include "dnssec.h"
+#include "ec.h"
+#include "error.h"
+#include "pool.h"
+#include "req.h"
+#include "resolver.h"
+#include "resource.h"
+#include "signer.h"
+#include "tld.h"
+#include "utils.h"
+#include "uv.h"
+#include "workers.h"
+
+// A RRSIG NSEC
+static const uint8_t hsk_type_map_a[] = {
+  0x00, 0x06, 0x40, 0x00, 0x00, 0x00, 0x00, 0x03
+};
+
+// AAAA RRSIG NSEC
+static const uint8_t hsk_type_map_aaaa[] = {
+  0x00, 0x06, 0x00, 0x00, 0x00, 0x80, 0x00, 0x03
+};
+
+/*
+ * Types
+ */
+
+typedef struct hsk_resolver_job_s {
+  struct hsk_resolver_job_s *next;
+  hsk_resolver_t *resolver;
+  hsk_dns_req_t *req;
+  bool has_addr;
+  hsk_resolver_cb cb;
+  void *arg;
+} hsk_resolver_job_t;
+
+// A resolved name waiting for its response to be built off the loop.
+typedef struct {
+  hsk_resolver_job_t *job;
+  char name[HSK_DNS_MAX_NAME + 1];
+  int status;
+  bool exists;
+  uint8_t *data;
+  size_t data_len;
+  // Results
+  uint8_t *cache;
+  size_t cache_len;
+  uint8_t *wire;
+  size_t wire_len;
+  bool is_signed;
+} hsk_respond_data_t;
+
+struct hsk_resolver_s {
+  uv_loop_t *loop;
+  hsk_pool_t *pool;
+  hsk_ec_t *ec;
+  hsk_cache_t cache;
+  hsk_addr_t ip_;
+  hsk_addr_t *ip;
+  uint8_t key_[32];
+  uint8_t *key;
+  uint8_t pubkey[33];
+  hsk_signer_t *signer;
+  bool sign_offload;
+  bool sign_noid;
+  bool verbose;
+  bool opened;
+  // Set on the loop's thread once it is closing. Queries the pool fails
+  // from then on are failed, not answered.
+  bool closing;
+  // A loop and pool of our own, run on a thread.
+  bool owned;
+  uv_loop_t own_loop;
+  uv_thread_t thread;
+  int thread_rc;
+  // Everything below is protected by the mutex.
+  uv_mutex_t mutex;
+  // Signaled once the thread is up (or failed to start).
+  uv_cond_t cond;
+  // Queries waiting for the thread.
+  hsk_resolver_job_t *pending_head;
+  hsk_resolver_job_t *pending_tail;
+  uv_async_t *async;
+  bool started;
+  bool exit;
+};
+
+/*
+ * Prototypes
+ */
+
+static void
+hsk_resolver_log(hsk_resolver_t *resolver, const char *fmt, ...);
+
+static hsk_resolver_job_t *
+hsk_resolver_job_create(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len,
+  const struct sockaddr *addr,
+  hsk_resolver_cb cb,
+  void *arg
+);
+
+static void
+hsk_resolver_job_free(hsk_resolver_job_t *job);
+
+static bool
+hsk_resolver_push(
+  hsk_resolver_t *resolver,
+  hsk_resolver_job_t *head,
+  hsk_resolver_job_t *tail
+);
+
+static void
+hsk_resolver_query(hsk_resolver_job_t *job);
+
+static void
+hsk_resolver_done(
+  hsk_resolver_job_t *job,
+  int status,
+  uint8_t *wire,
+  size_t wire_len
+);
+
+static void
+after_resolve(
+  const char *name,
+  int status,
+  bool exists,
+  const uint8_t *data,
+  size_t data_len,
+  const void *arg
+);
+
+static bool
+hsk_resolver_finalize(
+  hsk_resolver_t *resolver,
+  hsk_dns_msg_t **msg,
+  const hsk_dns_req_t *req,
+  uint8_t **wire,
+  size_t *wire_len
+);
+
+static void
+hsk_resolver_reply(hsk_resolver_job_t *job, uint8_t *wire, size_t wire_len);
+
+static void
+after_sign(void *arg, bool ok, uint8_t *wire, size_t wire_len);
+
+static int
+hsk_resolver_decode(
+  hsk_resolver_t *resolver,
+  const char *name,
+  int status,
+  bool exists,
+  const uint8_t *data,
+  size_t data_len,
+  hsk_resource_t **res
+);
+
+static bool
+hsk_resolver_build(
+  hsk_resolver_t *resolver,
+  const hsk_dns_req_t *req,
+  int status,
+  const hsk_resource_t *res,
+  uint8_t **cache,
+  size_t *cache_len,
+  uint8_t **wire,
+  size_t *wire_len
+);
+
+static void
+hsk_resolver_cache_wire(
+  hsk_resolver_t *resolver,
+  const hsk_dns_req_t *req,
+  uint8_t *cache,
+  size_t cache_len
+);
+
+static void
+run_respond(void *arg);
+
+static void
+after_respond(void *arg, bool ok);
+
+static int
+hsk_resolver_start(hsk_resolver_t *resolver);
+
+static void
+hsk_resolver_stop(hsk_resolver_t *resolver);
+
+static void
+hsk_resolver_teardown(hsk_resolver_t *resolver);
+
+static bool
+hsk_resolver_is_open(hsk_resolver_t *resolver);
+
+static void
+run_thread(void *arg);
+
+static void
+after_async(uv_async_t *async);
+
+static int
+hsk_tld_index(const char *name);
+
+static const uint8_t *
+hsk_icann_lookup(const char *name);
+
+/*
+ * Resolver
+ */
+
+hsk_resolver_t *
+hsk_resolver_alloc(const uv_loop_t *loop, const struct hsk_pool_s *pool) {
+  // Either both are the caller's or both are ours.
+  if ((loop == NULL) != (pool == NULL))
+    return NULL;
+
+  hsk_resolver_t *resolver = malloc(sizeof(hsk_resolver_t));
+
+  if (!resolver)
+    return NULL;
+
+  resolver->ec = hsk_ec_alloc();
+
+  if (!resolver->ec) {
+    free(resolver);
+    return NULL;
+  }
+
+  resolver->loop = (uv_loop_t *)loop;
+  resolver->pool = (hsk_pool_t *)pool;
+  hsk_cache_init(&resolver->cache);
+  hsk_addr_init(&resolver->ip_);
+  resolver->ip = NULL;
+  memset(resolver->key_, 0x00, sizeof(resolver->key_));
+  resolver->key = NULL;
+  memset(resolver->pubkey, 0x00, sizeof(resolver->pubkey));
+  resolver->signer = NULL;
+  resolver->sign_offload = false;
+  resolver->sign_noid = false;
+  resolver->verbose = false;
+  resolver->opened = false;
+  resolver->closing = false;
+  resolver->owned = false;
+  resolver->thread_rc = HSK_SUCCESS;
+  resolver->pending_head = NULL;
+  resolver->pending_tail = NULL;
+  resolver->async = NULL;
+  resolver->started = false;
+  resolver->exit = false;
+
+  if (uv_mutex_init(&resolver->mutex) != 0)
+    goto fail_mutex;
+
+  if (uv_cond_init(&resolver->cond) != 0)
+    goto fail_cond;
+
+  if (loop)
+    return resolver;
+
+  // The pool only needs the loop once it's open,
+  // and the loop only needs to run on our thread.
+  if (uv_loop_init(&resolver->own_loop) != 0)
+    goto fail_loop;
+
+  resolver->loop = &resolver->own_loop;
+  resolver->pool = hsk_pool_alloc(resolver->loop);
+
+  if (!resolver->pool) {
+    uv_loop_close(resolver->loop);
+    goto fail_loop;
+  }
+
+  resolver->owned = true;
+
+  return resolver;
+
+fail_loop:
+  uv_cond_destroy(&resolver->cond);
+fail_cond:
+  uv_mutex_destroy(&resolver->mutex);
+fail_mutex:
+  hsk_ec_free(resolver->ec);
+  free(resolver);
+  return NULL;
+}
+
+void
+hsk_resolver_free(hsk_resolver_t *resolver) {
+  if (!resolver)
+    return;
+
+  assert(!resolver->opened);
+
+  if (resolver->owned) {
+    // Already done on the thread if it ever ran.
+    hsk_resolver_teardown(resolver);
+    uv_run(resolver->loop, UV_RUN_DEFAULT);
+    uv_loop_close(resolver->loop);
+  }
+
+  if (resolver->signer)
+    hsk_signer_free(resolver->signer);
+
+  hsk_ec_free(resolver->ec);
+  hsk_cache_uninit(&resolver->cache);
+  uv_cond_destroy(&resolver->cond);
+  uv_mutex_destroy(&resolver->mutex);
+  free(resolver);
+}
+
+bool
+hsk_resolver_set_ip(hsk_resolver_t *resolver, const struct sockaddr *addr) {
+  assert(resolver);
+
+  if (!addr) {
+    hsk_addr_init(&resolver->ip_);
+    resolver->ip = NULL;
+    return true;
+  }
+
+  if (!hsk_addr_from_sa(&resolver->ip_, addr))
+    return false;
+
+  if (!hsk_addr_localize(&resolver->ip_))
+    return false;
+
+  resolver->ip = &resolver->ip_;
+
+  return true;
+}
+
+bool
+hsk_resolver_set_key(hsk_resolver_t *resolver, const uint8_t *key) {
+  assert(resolver);
+
+  if (resolver->opened)
+    return false;
+
+  if (resolver->signer) {
+    hsk_signer_free(resolver->signer);
+    resolver->signer = NULL;
+  }
+
+  if (!key) {
+    memset(resolver->key_, 0x00, 32);
+    resolver->key = NULL;
+    memset(resolver->pubkey, 0x00, sizeof(resolver->pubkey));
+    return true;
+  }
+
+  if (!hsk_ec_create_pubkey(resolver->ec, key, resolver->pubkey))
+    return false;
+
+  resolver->signer = hsk_signer_alloc(resolver->loop, key);
+
+  if (!resolver->signer)
+    return false;
+
+  memcpy(&resolver->key_[0], key, 32);
+  resolver->key = &resolver->key_[0];
+
+  return true;
+}
+
+void
+hsk_resolver_set_sign_offload(hsk_resolver_t *resolver, bool offload) {
+  assert(resolver);
+  resolver->sign_offload = offload;
+}
+
+void
+hsk_resolver_set_sign_noid(hsk_resolver_t *resolver, bool noid) {
+  assert(resolver);
+  resolver->sign_noid = noid;
+}
+
+void
+hsk_resolver_set_verbose(hsk_resolver_t *resolver, bool verbose) {
+  assert(resolver);
+  resolver->verbose = verbose;
+}
+
+bool
+hsk_resolver_set_cache(hsk_resolver_t *resolver, size_t limit, int64_t ttl) {
+  assert(resolver);
+
+  // The cache belongs to the resolver's thread once it runs.
+  if (resolver->owned && resolver->opened)
+    return false;
+
+  return hsk_cache_set_limits(&resolver->cache, limit, ttl);
+}
+
+bool
+hsk_resolver_save_cache(
+  hsk_resolver_t *resolver,
+  uint8_t **data,
+  size_t *data_len
+) {
+  assert(resolver);
+
+  if (resolver->owned && resolver->opened)
+    return false;
+
+  return hsk_cache_encode(&resolver->cache, data, data_len);
+}
+
+bool
+hsk_resolver_load_cache(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len
+) {
+  assert(resolver);
+
+  if (resolver->owned && resolver->opened)
+    return false;
+
+  return hsk_cache_decode(&resolver->cache, data, data_len);
+}
+
+bool
+hsk_resolver_set_seeds(hsk_resolver_t *resolver, const char *seeds) {
+  assert(resolver);
+
+  if (!resolver->owned || resolver->opened)
+    return false;
+
+  return hsk_pool_set_seeds(resolver->pool, seeds);
+}
+
+bool
+hsk_resolver_set_pool_size(hsk_resolver_t *resolver, int size) {
+  assert(resolver);
+
+  if (!resolver->owned || resolver->opened)
+    return false;
+
+  return hsk_pool_set_size(resolver->pool, size);
+}
+
+bool
+hsk_resolver_set_threads(hsk_resolver_t *resolver, int threads) {
+  assert(resolver);
+
+  if (!resolver->owned || resolver->opened)
+    return false;
+
+  return hsk_pool_set_threads(resolver->pool, threads);
+}
+
+int
+hsk_resolver_open(hsk_resolver_t *resolver) {
+  if (!resolver)
+    return HSK_EBADARGS;
+
+  if (resolver->opened)
+    return HSK_EFAILURE;
+
+  resolver->closing = false;
+
+  // Create the lazily built DNSSEC keys up
+  // front, before any worker thread needs them.
+  hsk_dnssec_get_ds();
+  hsk_dnssec_get_zsk();
+
+  if (resolver->owned) {
+    // The pool goes away with the thread.
+    if (!resolver->pool)
+      return HSK_EFAILURE;
+
+    int rc = uv_thread_create(&resolver->thread, run_thread, resolver);
+
+    if (rc != 0)
+      return HSK_EFAILURE;
+
+    uv_mutex_lock(&resolver->mutex);
+
+    while (!resolver->started)
+      uv_cond_wait(&resolver->cond, &resolver->mutex);
+
+    rc = resolver->thread_rc;
+
+    uv_mutex_unlock(&resolver->mutex);
+
+    if (rc != HSK_SUCCESS) {
+      uv_thread_join(&resolver->thread);
+      return rc;
+    }
+
+    resolver->opened = true;
+
+    return HSK_SUCCESS;
+  }
+
+  int rc = hsk_resolver_start(resolver);
+
+  if (rc != HSK_SUCCESS)
+    return rc;
+
+  resolver->opened = true;
+
+  return HSK_SUCCESS;
+}
+
+int
+hsk_resolver_close(hsk_resolver_t *resolver) {
+  if (!resolver)
+    return HSK_EBADARGS;
+
+  if (!resolver->opened)
+    return HSK_SUCCESS;
+
+  if (resolver->owned) {
+    uv_mutex_lock(&resolver->mutex);
+    resolver->exit = true;
+    if (resolver->async)
+      uv_async_send(resolver->async);
+    uv_mutex_unlock(&resolver->mutex);
+
+    uv_thread_join(&resolver->thread);
+  } else {
+    resolver->closing = true;
+    hsk_resolver_stop(resolver);
+  }
+
+  resolver->opened = false;
+
+  return HSK_SUCCESS;
+}
+
+int
+hsk_resolver_resolve(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len,
+  const struct sockaddr *addr,
+  hsk_resolver_cb callback,
+  void *arg
+) {
+  if (!resolver || !data || !callback)
+    return HSK_EBADARGS;
+
+  if (!hsk_resolver_is_open(resolver))
+    return HSK_EFAILURE;
+
+  hsk_resolver_job_t *job = hsk_resolver_job_create(
+    resolver,
+    data,
+    data_len,
+    addr,
+    callback,
+    arg
+  );
+
+  if (!job)
+    return HSK_EENCODING;
+
+  // Or closed by another thread in the meantime.
+  if (!hsk_resolver_push(resolver, job, job)) {
+    hsk_resolver_job_free(job);
+    return HSK_EFAILURE;
+  }
+
+  return HSK_SUCCESS;
+}
+
+size_t
+hsk_resolver_resolve_batch(
+  hsk_resolver_t *resolver,
+  const hsk_resolver_query_t *queries,
+  size_t count,
+  hsk_resolver_cb callback
+) {
+  hsk_resolver_job_t *head = NULL;
+  hsk_resolver_job_t *tail = NULL;
+  size_t taken = 0;
+  size_t i;
+
+  if (!resolver || !callback)
+    return 0;
+
+  bool open = hsk_resolver_is_open(resolver);
+
+  // Parsing needs nothing from the loop, so
+  // it happens on the caller's thread.
+  for (i = 0; i < count; i++) {
+    const hsk_resolver_query_t *q = &queries[i];
+    hsk_resolver_job_t *job = NULL;
+
+    if (open) {
+      job = hsk_resolver_job_create(
+        resolver,
+        q->data,
+        q->data_len,
+        q->addr,
+        callback,
+        q->arg
+      );
+    }
+
+    if (!job) {
+      callback(q->arg, open ? HSK_EENCODING : HSK_EFAILURE, NULL, 0, q->addr);
+      continue;
+    }
+
+    if (tail)
+      tail->next = job;
+    else
+      head = job;
+
+    tail = job;
+    taken += 1;
+  }
+
+  if (!head)
+    return taken;
+
+  // Closed while we were parsing. The thread
+  // would never see these, so none are taken.
+  if (!hsk_resolver_push(resolver, head, tail)) {
+    hsk_resolver_job_t *next;
+
+    for (; head; head = next) {
+      next = head->next;
+      head->next = NULL;
+      hsk_resolver_done(head, HSK_EFAILURE, NULL, 0);
+    }
+
+    return 0;
+  }
+
+  return taken;
+}
+
+// Answer parsed queries, or hand them to the thread if we have one. Fails,
+// leaving the jobs to the caller, if the thread is going away.
+static bool
+hsk_resolver_push(
+  hsk_resolver_t *resolver,
+  hsk_resolver_job_t *head,
+  hsk_resolver_job_t *tail
+) {
+  if (!resolver->owned) {
+    hsk_resolver_job_t *next;
+
+    for (; head; head = next) {
+      next = head->next;
+      head->next = NULL;
+      hsk_resolver_query(head);
+    }
+
+    return true;
+  }
+
+  uv_mutex_lock(&resolver->mutex);
+
+  if (resolver->exit || !resolver->async) {
+    uv_mutex_unlock(&resolver->mutex);
+    return false;
+  }
+
+  if (resolver->pending_tail)
+    resolver->pending_tail->next = head;
+  else
+    resolver->pending_head = head;
+
+  resolver->pending_tail = tail;
+
+  uv_async_send(resolver->async);
+
+  uv_mutex_unlock(&resolver->mutex);
+
+  return true;
+}
+
+// With a thread of our own, the caller's idea of whether we're open can be
+// out of date on any other thread, so ask the thread's side instead.
+static bool
+hsk_resolver_is_open(hsk_resolver_t *resolver) {
+  if (!resolver->owned)
+    return resolver->opened;
+
+  uv_mutex_lock(&resolver->mutex);
+
+  bool open = resolver->started && !resolver->exit && resolver->async;
+
+  uv_mutex_unlock(&resolver->mutex);
+
+  return open;
+}
+
+static void
+hsk_resolver_log(hsk_resolver_t *resolver, const char *fmt, ...) {
+  if (!resolver->verbose)
+    return;
+
+  // Answers are what hnsd's root nameserver logs.
+  printf("ns: ");
+
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static hsk_resolver_job_t *
+hsk_resolver_job_create(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len,
+  const struct sockaddr *addr,
+  hsk_resolver_cb cb,
+  void *arg
+) {
+  hsk_resolver_job_t *job = malloc(sizeof(hsk_resolver_job_t));
+
+  if (!job)
+    return NULL;
+
+  job->req = hsk_dns_req_create(data, data_len, addr);
+
+  if (!job->req) {
+    free(job);
+    return NULL;
+  }
+
+  job->next = NULL;
+  job->resolver = resolver;
+  job->has_addr = addr != NULL;
+  job->cb = cb;
+  job->arg = arg;
+
+  return job;
+}
+
+static void
+hsk_resolver_job_free(hsk_resolver_job_t *job) {
+  hsk_dns_req_free(job->req);
+  free(job);
+}
+
+static void
+hsk_resolver_done(
+  hsk_resolver_job_t *job,
+  int status,
+  uint8_t *wire,
+  size_t wire_len
+) {
+  const struct sockaddr *addr = job->has_addr ? job->req->addr : NULL;
+
+  job->cb(job->arg, status, wire, wire_len, addr);
+
+  hsk_resolver_job_free(job);
+}
+
+static void
+hsk_resolver_query(hsk_resolver_job_t *job) {
+  hsk_resolver_t *resolver = job->resolver;
+  hsk_dns_req_t *req = job->req;
+
+  if (resolver->verbose)
+    hsk_dns_req_print(req, "ns: ");
+
+  uint8_t *wire = NULL;
+  size_t wire_len = 0;
+  hsk_dns_msg_t *msg = NULL;
+
+  bool reuse_sig = resolver->signer && resolver->sign_noid;
+
+  // Signed answers that don't cover the ID can
+  // be replayed without touching secp256k1.
+  if (reuse_sig
+      && hsk_cache_get_signed(&resolver->cache, req, &wire, &wire_len)) {
+    hsk_resolver_log(resolver, "sending signed cached msg (%u): %u\n",
+                     req->id, wire_len);
+
+    hsk_resolver_done(job, HSK_SUCCESS, wire, wire_len);
+
+    return;
+  }
+
+  // Hit cache first.
+  msg = hsk_cache_get(&resolver->cache, req);
+
+  if (msg) {
+    if (!hsk_resolver_finalize(resolver, &msg, req, &wire, &wire_len)) {
+      hsk_resolver_log(resolver, "could not reply\n");
+      goto fail;
+    }
+
+    if (reuse_sig) {
+      if (!hsk_signer_sign_wire(resolver->signer, wire, wire_len, &wire_len)) {
+        hsk_resolver_log(resolver, "could not sign response\n");
+        free(wire);
+        hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+        return;
+      }
+
+      hsk_cache_set_signed(&resolver->cache, req, wire, wire_len);
+
+      hsk_resolver_log(resolver, "sending cached msg (%u): %u\n",
+                       req->id, wire_len);
+
+      hsk_resolver_done(job, HSK_SUCCESS, wire, wire_len);
+
+      return;
+    }
+
+    hsk_resolver_log(resolver, "sending cached msg (%u): %u\n",
+                     req->id, wire_len);
+
+    hsk_resolver_reply(job, wire, wire_len);
+
+    return;
+  }
+
+  // Handle reverse pointers.
+  // See https://github.com/handshake-org/hsd/issues/125
+  // Resolving a name with a synth record will return an NS record
+  // with a name that encodes an IP address: _[base32]._synth.
+  // The synth name then resolves to an A/AAAA record that is derived
+  // by decoding the name itself (it does not have to be looked up).
+  bool should_cache = true;
+  if (strcmp(req->tld, "_synth") == 0 && req->labels <= 2) {
+    msg = hsk_dns_msg_alloc();
+    should_cache = false;
+
+    if (!msg)
+      goto fail;
+
+    hsk_dns_rrs_t *an = &msg->an;
+    hsk_dns_rrs_t *rrns = &msg->ns;
+    hsk_dns_rrs_t *ar = &msg->ar;
+
+    uint8_t ip[16];
+    uint16_t family;
+    char synth[HSK_DNS_MAX_NAME + 1];
+    hsk_dns_name_from(&req->qname, -2, synth);
+
+    if (req->labels == 1) {
+      hsk_resource_to_empty(req->tld, NULL, 0, rrns);
+      hsk_dnssec_sign_zsk(rrns, HSK_DNS_NSEC);
+      hsk_resource_root_to_soa(rrns);
+      hsk_dnssec_sign_zsk(rrns, HSK_DNS_SOA);
+    }
+
+    if (pointer_to_ip(synth, ip, &family)) {
+      bool match = false;
+
+      switch (req->type) {
+        case HSK_DNS_ANY:
+          match = true;
+          break;
+        case HSK_DNS_A:
+          match = family == HSK_DNS_A;
+          break;
+        case HSK_DNS_AAAA:
+          match = family == HSK_DNS_AAAA;
+          break;
+      }
+
+      if (!match) {
+        // Needs SOA.
+        // TODO: Make the reverse pointers TLDs.
+        // Empty proof:
+        if (family == HSK_DNS_A) {
+          hsk_resource_to_empty(
+            req->name,
+            hsk_type_map_a,
+            sizeof(hsk_type_map_a),
+            rrns
+          );
+        } else {
+          hsk_resource_to_empty(
+            req->name,
+            hsk_type_map_aaaa,
+            sizeof(hsk_type_map_aaaa),
+            rrns
+          );
+        }
+        hsk_dnssec_sign_zsk(rrns, HSK_DNS_NSEC);
+        hsk_resource_root_to_soa(rrns);
+        hsk_dnssec_sign_zsk(rrns, HSK_DNS_SOA);
+      } else {
+        uint16_t rrtype = family;
+
+        msg->flags |= HSK_DNS_AA;
+
+        hsk_dns_rr_t *rr = hsk_dns_rr_create(rrtype);
+
+        if (!rr) {
+          hsk_dns_msg_free(msg);
+          msg = NULL;
+          goto fail;
+        }
+
+        rr->ttl = HSK_DEFAULT_TTL;
+        hsk_dns_rr_set_name(rr, req->name);
+
+        if (family == HSK_DNS_A) {
+          hsk_dns_a_rd_t *rd = rr->rd;
+          memcpy(&rd->addr[0], &ip[0], 4);
+        } else {
+          hsk_dns_aaaa_rd_t *rd = rr->rd;
+          memcpy(&rd->addr[0], &ip[0], 16);
+        }
+
+        hsk_dns_rrs_push(an, rr);
+
+        hsk_dnssec_sign_zsk(ar, rrtype);
+      }
+    }
+
+    if (!hsk_resolver_finalize(resolver, &msg, req, &wire, &wire_len)) {
+      hsk_resolver_log(resolver, "could not reply\n");
+      goto fail;
+    }
+
+    hsk_resolver_log(resolver, "sending synthesized msg (%u): %u\n",
+                     req->id, wire_len);
+
+    hsk_resolver_reply(job, wire, wire_len);
+
+    return;
+  }
+
+  // Requesting a lookup.
+  if (req->labels > 0) {
+    // Check blacklist.
+    if (strcmp(req->tld, "bit") == 0 // Namecoin
+        || strcmp(req->tld, "eth") == 0 // ENS
+        || strcmp(req->tld, "exit") == 0 // Tor
+        || strcmp(req->tld, "gnu") == 0 // GNUnet (GNS)
+        || strcmp(req->tld, "i2p") == 0 // Invisible Internet Project
+        || strcmp(req->tld, "onion") == 0 // Tor
+        || strcmp(req->tld, "tor") == 0 // OnioNS
+        || strcmp(req->tld, "zkey") == 0) { // GNS
+      msg = hsk_resource_to_nx();
+    } else {
+      int rc = hsk_pool_resolve(
+        resolver->pool,
+        req->tld,
+        after_resolve,
+        (void *)job
+      );
+
+      if (rc != HSK_SUCCESS) {
+        hsk_resolver_log(resolver, "pool resolve error: %s\n",
+                         hsk_strerror(rc));
+        goto fail;
+      }
+
+      return;
+    }
+  } else {
+    // Querying the root zone.
+    msg = hsk_resource_root(req->type, resolver->ip);
+  }
+
+  if (!msg) {
+    hsk_resolver_log(resolver, "could not create root soa\n");
+    goto fail;
+  }
+
+  if (should_cache)
+    hsk_cache_insert(&resolver->cache, req, msg);
+
+  if (!hsk_resolver_finalize(resolver, &msg, req, &wire, &wire_len)) {
+    hsk_resolver_log(resolver, "could not reply\n");
+    goto fail;
+  }
+
+  hsk_resolver_log(resolver, "sending root soa (%u): %u\n",
+                   req->id, wire_len);
+
+  hsk_resolver_reply(job, wire, wire_len);
+
+  return;
+
+fail:
+  assert(!msg);
+
+  msg = hsk_resource_to_servfail();
+
+  if (!msg) {
+    hsk_resolver_log(resolver, "failed creating servfail\n");
+    hsk_resolver_done(job, HSK_ENOMEM, NULL, 0);
+    return;
+  }
+
+  if (!hsk_resolver_finalize(resolver, &msg, req, &wire, &wire_len)) {
+    hsk_resolver_log(resolver, "could not reply\n");
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+    return;
+  }
+
+  hsk_resolver_log(resolver, "sending servfail (%u): %u\n",
+                   req->id, wire_len);
+
+  hsk_resolver_reply(job, wire, wire_len);
+}
+
+static bool
+hsk_resolver_build(
+  hsk_resolver_t *resolver,
+  const hsk_dns_req_t *req,
+  int status,
+  const hsk_resource_t *res,
+  uint8_t **cache,
+  size_t *cache_len,
+  uint8_t **wire,
+  size_t *wire_len
+) {
+  hsk_dns_msg_t *msg = NULL;
+
+  *cache = NULL;
+  *cache_len = 0;
+  *wire = NULL;
+  *wire_len = 0;
+
+  if (status != HSK_SUCCESS) {
+    // Pool resolve error.
+    hsk_resolver_log(resolver, "resolve response error: %s\n",
+                     hsk_strerror(status));
+  } else if (!res) {
+    // Doesn't exist.
+    //
+    // We should be giving a real NSEC proof
+    // here, but I don't think it's possible
+    // with the current construction.
+    //
+    // I imagine this would only be possible
+    // if NSEC3 begins to support BLAKE2b for
+    // name hashing. Even then, it's still
+    // not possible for SPV nodes since they
+    // can't arbitrarily iterate over the tree.
+    //
+    // Instead, we give a phony proof, which
+    // makes the root zone look empty.
+    msg = hsk_resource_to_nx();
+
+    if (!msg)
+      hsk_resolver_log(resolver, "could not create nx response (%u)\n",
+                       req->id);
+    else
+      hsk_resolver_log(resolver, "sending nxdomain (%u)\n", req->id);
+  } else {
+    // Exists!
+    msg = hsk_resource_to_dns(res, req->name, req->type);
+
+    if (!msg)
+      hsk_resolver_log(resolver, "could not create dns response (%u)\n",
+                       req->id);
+    else
+      hsk_resolver_log(resolver, "sending msg (%u)\n", req->id);
+  }
+
+  if (msg) {
+    if (!hsk_dns_msg_encode(msg, cache, cache_len))
+      hsk_resolver_log(resolver, "could not encode cache\n");
+
+    if (!hsk_resolver_finalize(resolver, &msg, req, wire, wire_len)) {
+      assert(!msg && !*wire);
+      hsk_resolver_log(resolver, "could not finalize\n");
+    }
+  }
+
+  if (!*wire) {
+    // Send SERVFAIL in case of error.
+    assert(!msg);
+
+    msg = hsk_resource_to_servfail();
+
+    if (!msg) {
+      hsk_resolver_log(resolver, "could not create servfail response\n");
+      return false;
+    }
+
+    if (!hsk_resolver_finalize(resolver, &msg, req, wire, wire_len)) {
+      hsk_resolver_log(resolver, "could not create servfail\n");
+      return false;
+    }
+
+    hsk_resolver_log(resolver, "sending servfail (%u): %u\n",
+                     req->id, *wire_len);
+  }
+
+  return true;
+}
+
+static void
+hsk_resolver_cache_wire(
+  hsk_resolver_t *resolver,
+  const hsk_dns_req_t *req,
+  uint8_t *cache,
+  size_t cache_len
+) {
+  if (!cache)
+    return;
+
+  if (!hsk_cache_insert_wire(&resolver->cache, req, cache, cache_len)) {
+    hsk_resolver_log(resolver, "could not insert cache\n");
+    free(cache);
+  }
+}
+
+static void
+hsk_resolver_respond(
+  hsk_resolver_job_t *job,
+  int status,
+  const hsk_resource_t *res
+) {
+  hsk_resolver_t *resolver = job->resolver;
+  uint8_t *cache, *wire;
+  size_t cache_len, wire_len;
+
+  bool ok = hsk_resolver_build(resolver, job->req, status, res,
+                               &cache, &cache_len, &wire, &wire_len);
+
+  hsk_resolver_cache_wire(resolver, job->req, cache, cache_len);
+
+  if (ok)
+    hsk_resolver_reply(job, wire, wire_len);
+  else
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+}
+
+static bool
+hsk_resolver_finalize(
+  hsk_resolver_t *resolver,
+  hsk_dns_msg_t **msg,
+  const hsk_dns_req_t *req,
+  uint8_t **wire,
+  size_t *wire_len
+) {
+  // Leave room for SIG(0), hsk_resolver_reply() signs in place.
+  return hsk_dns_msg_prepare(msg, req, resolver->signer != NULL,
+                             wire, wire_len);
+}
+
+static void
+hsk_resolver_reply(hsk_resolver_job_t *job, uint8_t *wire, size_t wire_len) {
+  hsk_resolver_t *resolver = job->resolver;
+
+  if (!resolver->signer) {
+    hsk_resolver_done(job, HSK_SUCCESS, wire, wire_len);
+    return;
+  }
+
+  // Out of precomputed nonces: let the
+  // signing thread do the heavy lifting.
+  if (hsk_signer_should_offload(resolver->signer)) {
+    int rc = hsk_signer_submit(resolver->signer, wire, wire_len,
+                               after_sign, job);
+
+    if (rc == HSK_SUCCESS)
+      return;
+  }
+
+  if (!hsk_signer_sign_wire(resolver->signer, wire, wire_len, &wire_len)) {
+    hsk_resolver_log(resolver, "could not sign response\n");
+    free(wire);
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+    return;
+  }
+
+  hsk_resolver_done(job, HSK_SUCCESS, wire, wire_len);
+}
+
+static void
+after_sign(void *arg, bool ok, uint8_t *wire, size_t wire_len) {
+  hsk_resolver_job_t *job = (hsk_resolver_job_t *)arg;
+
+  if (!ok) {
+    hsk_resolver_log(job->resolver, "could not sign response\n");
+    free(wire);
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+    return;
+  }
+
+  hsk_resolver_done(job, HSK_SUCCESS, wire, wire_len);
+}
+
+static int
+hsk_resolver_decode(
+  hsk_resolver_t *resolver,
+  const char *name,
+  int status,
+  bool exists,
+  const uint8_t *data,
+  size_t data_len,
+  hsk_resource_t **res
+) {
+  *res = NULL;
+
+  if (status != HSK_SUCCESS)
+    return status;
+
+  if (!exists || data_len == 0) {
+    const uint8_t *item = hsk_icann_lookup(name);
+
+    if (item) {
+      const uint8_t *raw = &item[2];
+      size_t raw_len = (((size_t)item[1]) << 8) | ((size_t)item[0]);
+
+      if (!hsk_resource_decode(raw, raw_len, res)) {
+        hsk_resolver_log(resolver,
+                         "could not decode root resource for: %s\n", name);
+        *res = NULL;
+        return HSK_EFAILURE;
+      }
+    }
+  } else {
+    if (!hsk_resource_decode(data, data_len, res)) {
+      hsk_resolver_log(resolver, "could not decode resource for: %s\n", name);
+      *res = NULL;
+      return HSK_EFAILURE;
+    }
+  }
+
+  return HSK_SUCCESS;
+}
+
+static void
+after_resolve(
+  const char *name,
+  int status,
+  bool exists,
+  const uint8_t *data,
+  size_t data_len,
+  const void *arg
+) {
+  hsk_resolver_job_t *job = (hsk_resolver_job_t *)arg;
+  hsk_resolver_t *resolver = job->resolver;
+  hsk_workers_t *workers = resolver->pool->workers;
+
+  // The pool is going away with the query.
+  if (resolver->closing && status != HSK_SUCCESS) {
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+    return;
+  }
+
+  // Decode, build and sign on a worker thread.
+  if (hsk_workers_is_open(workers)) {
+    hsk_respond_data_t *rd = malloc(sizeof(hsk_respond_data_t));
+
+    if (rd && data_len > 0)
+      rd->data = malloc(data_len);
+
+    if (rd && (data_len == 0 || rd->data)) {
+      rd->job = job;
+      strcpy(rd->name, name);
+      rd->status = status;
+      rd->exists = exists;
+      rd->data_len = data_len;
+      rd->cache = NULL;
+      rd->cache_len = 0;
+      rd->wire = NULL;
+      rd->wire_len = 0;
+      rd->is_signed = false;
+
+      if (data_len > 0)
+        memcpy(rd->data, data, data_len);
+      else
+        rd->data = NULL;
+
+      int rc = hsk_workers_queue(workers, run_respond, after_respond, rd);
+
+      if (rc == HSK_SUCCESS)
+        return;
+
+      free(rd->data);
+    }
+
+    free(rd);
+  }
+
+  hsk_resource_t *res;
+
+  status = hsk_resolver_decode(resolver, name, status, exists,
+                               data, data_len, &res);
+
+  hsk_resolver_respond(job, status, res);
+
+  if (res)
+    hsk_resource_free(res);
+}
+
+static void
+run_respond(void *arg) {
+  hsk_respond_data_t *rd = (hsk_respond_data_t *)arg;
+  hsk_resolver_t *resolver = rd->job->resolver;
+  hsk_resource_t *res;
+
+  int status = hsk_resolver_decode(resolver, rd->name, rd->status, rd->exists,
+                                   rd->data, rd->data_len, &res);
+
+  bool ok = hsk_resolver_build(resolver, rd->job->req, status, res,
+                               &rd->cache, &rd->cache_len,
+                               &rd->wire, &rd->wire_len);
+
+  if (res)
+    hsk_resource_free(res);
+
+  if (!ok || !resolver->signer)
+    return;
+
+  // The signer is thread-safe.
+  if (!hsk_signer_sign_wire(resolver->signer, rd->wire,
+                            rd->wire_len, &rd->wire_len)) {
+    hsk_resolver_log(resolver, "could not sign response\n");
+    free(rd->wire);
+    rd->wire = NULL;
+    return;
+  }
+
+  rd->is_signed = true;
+}
+
+static void
+after_respond(void *arg, bool ok) {
+  hsk_respond_data_t *rd = (hsk_respond_data_t *)arg;
+  hsk_resolver_job_t *job = rd->job;
+
+  // Shutting down: do the work here instead.
+  if (!ok)
+    run_respond(rd);
+
+  hsk_resolver_cache_wire(job->resolver, job->req, rd->cache, rd->cache_len);
+
+  if (!rd->wire)
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+  else if (rd->is_signed)
+    hsk_resolver_done(job, HSK_SUCCESS, rd->wire, rd->wire_len);
+  else
+    hsk_resolver_reply(job, rd->wire, rd->wire_len);
+
+  free(rd->data);
+  free(rd);
+}
+
+/*
+ * Thread
+ */
+
+static int
+hsk_resolver_start(hsk_resolver_t *resolver) {
+  if (!resolver->signer)
+    return HSK_SUCCESS;
+
+  hsk_signer_set_offload(resolver->signer, resolver->sign_offload);
+  hsk_signer_set_cover_id(resolver->signer, !resolver->sign_noid);
+
+  if (hsk_signer_open(resolver->signer) != HSK_SUCCESS)
+    return HSK_EFAILURE;
+
+  return HSK_SUCCESS;
+}
+
+static void
+hsk_resolver_stop(hsk_resolver_t *resolver) {
+  // Flush outstanding signatures.
+  if (resolver->signer)
+    hsk_signer_close(resolver->signer);
+}
+
+static void
+run_thread(void *arg) {
+  hsk_resolver_t *resolver = (hsk_resolver_t *)arg;
+  int rc = HSK_ENOMEM;
+
+  resolver->async = malloc(sizeof(uv_async_t));
+
+  if (!resolver->async)
+    goto done;
+
+  rc = HSK_EFAILURE;
+
+  if (uv_async_init(resolver->loop, resolver->async, after_async) != 0) {
+    free(resolver->async);
+    resolver->async = NULL;
+    goto done;
+  }
+
+  resolver->async->data = (void *)resolver;
+
+  rc = hsk_pool_open(resolver->pool);
+
+  if (rc == HSK_SUCCESS) {
+    rc = hsk_resolver_start(resolver);
+
+    if (rc != HSK_SUCCESS)
+      hsk_pool_close(resolver->pool);
+  }
+
+done:
+  if (rc != HSK_SUCCESS)
+    hsk_resolver_teardown(resolver);
+
+  uv_mutex_lock(&resolver->mutex);
+  resolver->thread_rc = rc;
+  resolver->started = true;
+  uv_cond_signal(&resolver->cond);
+  uv_mutex_unlock(&resolver->mutex);
+
+  // Runs until everything is closed, which
+  // after_async() does when asked to exit.
+  uv_run(resolver->loop, UV_RUN_DEFAULT);
+}
+
+static void
+hsk_resolver_teardown(hsk_resolver_t *resolver) {
+  // Everything with a handle on our loop goes, so that the loop can stop.
+  // Peers go with the pool.
+  if (resolver->signer) {
+    hsk_signer_free(resolver->signer);
+    resolver->signer = NULL;
+  }
+
+  if (resolver->pool) {
+    hsk_pool_free(resolver->pool);
+    resolver->pool = NULL;
+  }
+
+  // Nothing can be queued once the async handle is gone, and whatever made
+  // it in before that is failed here rather than leaked.
+  uv_mutex_lock(&resolver->mutex);
+
+  hsk_resolver_job_t *job = resolver->pending_head;
+
+  resolver->pending_head = NULL;
+  resolver->pending_tail = NULL;
+
+  if (resolver->async) {
+    hsk_uv_close_free((uv_handle_t *)resolver->async);
+    resolver->async = NULL;
+  }
+
+  uv_mutex_unlock(&resolver->mutex);
+
+  hsk_resolver_job_t *next;
+
+  for (; job; job = next) {
+    next = job->next;
+    job->next = NULL;
+    hsk_resolver_done(job, HSK_EFAILURE, NULL, 0);
+  }
+}
+
+static void
+after_async(uv_async_t *async) {
+  hsk_resolver_t *resolver = (hsk_resolver_t *)async->data;
+
+  uv_mutex_lock(&resolver->mutex);
+
+  hsk_resolver_job_t *job = resolver->pending_head;
+  bool exit = resolver->exit;
+
+  resolver->pending_head = NULL;
+  resolver->pending_tail = NULL;
+
+  uv_mutex_unlock(&resolver->mutex);
+
+  hsk_resolver_job_t *next;
+
+  for (; job; job = next) {
+    next = job->next;
+    job->next = NULL;
+    hsk_resolver_query(job);
+  }
+
+  if (!exit)
+    return;
+
+  resolver->closing = true;
+
+  hsk_resolver_stop(resolver);
+  hsk_pool_close(resolver->pool);
+  hsk_resolver_teardown(resolver);
+}
+
+static int
+hsk_tld_index(const char *name) {
+  int start = 0;
+  int end = HSK_TLD_SIZE - 1;
+
+  while (start <= end) {
+    int pos = (start + end) >> 1;
+    int cmp = strcasecmp(HSK_TLD_NAMES[pos], name);
+
+    if (cmp == 0)
+      return pos;
+
+    if (cmp < 0)
+      start = pos + 1;
+    else
+      end = pos - 1;
+  }
+
+  return -1;
+}
+
+static const uint8_t *
+hsk_icann_lookup(const char *name) {
+  int index = hsk_tld_index(name);
+
+  if (index == -1)
+    return NULL;
+
+  return (const uint8_t *)HSK_TLD_DATA[index];
+}
@@ -0,0 +1,153 @@
+#ifndef _HSK_RESOLVER_H
+#define _HSK_RESOLVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "uv.h"
+
+/*
+ * Types
+ */
+
+struct hsk_pool_s;
+
+// Receives ownership of `wire`, the response to a query, with the query's ID
+// and, if a key is set, a SIG(0) record. `addr` is the address the query was
+// submitted with (or NULL). If no response could be built at all (not even
+// SERVFAIL), status says why and wire is NULL.
+typedef void (*hsk_resolver_cb)(
+  void *arg,
+  int status,
+  uint8_t *wire,
+  size_t wire_len,
+  const struct sockaddr *addr
+);
+
+// A query for hsk_resolver_resolve_batch(). The data is copied.
+typedef struct {
+  const uint8_t *data;
+  size_t data_len;
+  const struct sockaddr *addr;
+  void *arg;
+} hsk_resolver_query_t;
+
+// Answers wire format queries for the Handshake root zone the way hnsd's
+// root nameserver does: from its cache, from proofs requested through the
+// pool, or synthesized (the root zone itself, _synth and blacklisted TLDs).
+// Decoding, building and signing responses goes to the pool's worker threads
+// when it has any.
+//
+// The resolver runs in one of two ways:
+//
+// - hsk_resolver_alloc(loop, pool) runs it on the caller's loop, with a pool
+//   the caller opens and closes. Queries are submitted on the loop thread and
+//   callbacks run there.
+//
+// - hsk_resolver_alloc(NULL, NULL) gives it a loop and a pool of its own,
+//   which hsk_resolver_open() runs on a new thread. Queries can be submitted
+//   from any thread, and callbacks run on the resolver's thread.
+//
+// The struct is private to the library so that embedding it only needs this
+// header (and error.h for the status codes).
+typedef struct hsk_resolver_s hsk_resolver_t;
+
+/*
+ * Resolver
+ */
+
+hsk_resolver_t *
+hsk_resolver_alloc(const uv_loop_t *loop, const struct hsk_pool_s *pool);
+
+void
+hsk_resolver_free(hsk_resolver_t *resolver);
+
+// The address given out for the root nameserver in root zone answers.
+// Without one, they carry no glue.
+bool
+hsk_resolver_set_ip(hsk_resolver_t *resolver, const struct sockaddr *addr);
+
+// Key for SIG(0), or NULL to answer unsigned.
+bool
+hsk_resolver_set_key(hsk_resolver_t *resolver, const uint8_t *key);
+
+void
+hsk_resolver_set_sign_offload(hsk_resolver_t *resolver, bool offload);
+
+// Sign without covering the message ID and reuse signed answers for cache
+// hits. See --sig0-no-id in daemon.c for the trade-offs.
+void
+hsk_resolver_set_sign_noid(hsk_resolver_t *resolver, bool noid);
+
+// Log queries and answers to stdout, as hnsd does.
+void
+hsk_resolver_set_verbose(hsk_resolver_t *resolver, bool verbose);
+
+// How many answers to cache and for how long (in seconds). This can change
+// while open when the resolver runs on the caller's loop.
+bool
+hsk_resolver_set_cache(hsk_resolver_t *resolver, size_t limit, int64_t ttl);
+
+// Serialize the cached answers, or add ones serialized elsewhere, e.g. to
+// carry the cache over to a new process. Like hsk_resolver_set_cache(), this
+// works while open only on the caller's loop.
+bool
+hsk_resolver_save_cache(
+  hsk_resolver_t *resolver,
+  uint8_t **data,
+  size_t *data_len
+);
+
+bool
+hsk_resolver_load_cache(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len
+);
+
+// Settings for a pool of the resolver's own. These fail once it's open, or
+// if the pool belongs to the caller.
+bool
+hsk_resolver_set_seeds(hsk_resolver_t *resolver, const char *seeds);
+
+bool
+hsk_resolver_set_pool_size(hsk_resolver_t *resolver, int size);
+
+bool
+hsk_resolver_set_threads(hsk_resolver_t *resolver, int threads);
+
+int
+hsk_resolver_open(hsk_resolver_t *resolver);
+
+// Stop taking queries. With a thread of its own, the pool is closed and the
+// thread joined before this returns, and queries still waiting for a proof
+// are called back with HSK_EFAILURE and no answer. With the caller's pool,
+// they are called back the same way when that pool fails them.
+int
+hsk_resolver_close(hsk_resolver_t *resolver);
+
+// Answer one query. Returns an error, and never calls back, if the query
+// can't be parsed or the resolver isn't open.
+int
+hsk_resolver_resolve(
+  hsk_resolver_t *resolver,
+  const uint8_t *data,
+  size_t data_len,
+  const struct sockaddr *addr,
+  hsk_resolver_cb callback,
+  void *arg
+);
+
+// Answer several queries, waking the resolver's thread once for all of them.
+// Returns how many were taken. Each of the rest is called back before this
+// returns, with HSK_EENCODING if it can't be parsed or HSK_EFAILURE if the
+// resolver isn't open. With a thread of its own, a batch that loses a race
+// with hsk_resolver_close() is not taken.
+size_t
+hsk_resolver_resolve_batch(
+  hsk_resolver_t *resolver,
+  const hsk_resolver_query_t *queries,
+  size_t count,
+  hsk_resolver_cb callback
+);
+#endif
@@ -127,7 +127,6 @@ hsk_txt_record_read(
     return false;
 
   hsk_dns_txts_t *txts = &rec->txts;
-  txts->size = length;
 
   // Iterate through array
   int i;
@@ -137,8 +136,6 @@ hsk_txt_record_read(
     if(!txt)
       return false;
 
-    txts->items[i] = txt;
-
     // Size of this string
     uint8_t size = 0;
     if (!read_u8(data, data_len, &size)) {
@@ -153,6 +150,11 @@ hsk_txt_record_read(
       hsk_dns_txt_free(txt);
       return false;
     }
+
+    // Only count what was read, so a
+    // failed read frees what it should.
+    txts->items[i] = txt;
+    txts->size = i + 1;
   }
 
   return true;
@@ -335,40 +337,42 @@ hsk_record_read(
   if (r == NULL)
     return false;
 
+  bool ok = false;
+
   switch (type) {
     case HSK_DS: {
       hsk_ds_record_t *rec = (hsk_ds_record_t *)r;
-      hsk_ds_record_read(data, data_len, rec);
+      ok = hsk_ds_record_read(data, data_len, rec);
       break;
     }
     case HSK_NS: {
       hsk_ns_record_t *rec = (hsk_ns_record_t *)r;
-      hsk_ns_record_read(data, data_len, dmp, rec);
+      ok = hsk_ns_record_read(data, data_len, dmp, rec);
       break;
     }
     case HSK_GLUE4: {
       hsk_glue4_record_t *rec = (hsk_glue4_record_t *)r;
-      hsk_glue4_record_read(data, data_len, dmp, rec);
+      ok = hsk_glue4_record_read(data, data_len, dmp, rec);
       break;
     }
     case HSK_GLUE6: {
       hsk_glue6_record_t *rec = (hsk_glue6_record_t *)r;
-      hsk_glue6_record_read(data, data_len, dmp, rec);
+      ok = hsk_glue6_record_read(data, data_len, dmp, rec);
       break;
     }
     case HSK_SYNTH4: {
       hsk_synth4_record_t *rec = (hsk_synth4_record_t *)r;
-      hsk_synth4_record_read(data, data_len, rec);
+      ok = hsk_synth4_record_read(data, data_len, rec);
       break;
     }
     case HSK_SYNTH6: {
       hsk_synth6_record_t *rec = (hsk_synth6_record_t *)r;
-      hsk_synth6_record_read(data, data_len, rec);
+      ok = hsk_synth6_record_read(data, data_len, rec);
       break;
     }
     case HSK_TEXT: {
       hsk_txt_record_t *rec = (hsk_txt_record_t *)r;
-      hsk_txt_record_read(data, data_len, rec);
+      ok = hsk_txt_record_read(data, data_len, rec);
       break;
     }
     default: {
@@ -378,6 +382,11 @@ hsk_record_read(
     }
   }
 
+  if (!ok) {
+    hsk_record_free(r);
+    return false;
+  }
+
   *res = r;
 
   return true;
@@ -421,22 +430,25 @@ hsk_resource_decode(
   res->ttl = HSK_DEFAULT_TTL;
 
   // The rest of the data is records, read until empty.
-  int i = 0;
   while (data_len > 0) {
+    // No room for more.
+    if (res->record_count == 255)
+      goto fail;
+
     // Get record type.
     uint8_t type;
     read_u8(&dat, &data_len, &type);
 
     // Read the body of the record.
-    if (!hsk_record_read(&dat, &data_len, type, &dmp, &res->records[i]))
+    hsk_record_t **rec = &res->records[res->record_count];
+
+    if (!hsk_record_read(&dat, &data_len, type, &dmp, rec))
       goto fail;
 
     // Increment total amount of records in this resource.
-    i++;
+    res->record_count += 1;
   }
 
-  res->record_count = i;
-
   *resource = res;
 
   return true;
@@ -631,12 +643,25 @@ hsk_resource_to_ds(
   return true;
 }
 
+static bool
+hsk_resource_in_zone(const hsk_dns_name_t *zone, const char *name) {
+  hsk_dns_name_t child;
+
+  if (!hsk_dns_name_set(&child, name))
+    return false;
+
+  return hsk_dns_name_is_subdomain(zone, &child);
+}
+
 static bool
 hsk_resource_to_glue(
   const hsk_resource_t *res,
   const char *tld,
   hsk_dns_rrs_t *an
 ) {
+  // Parse the zone once rather than for every record.
+  hsk_dns_name_t zone;
+  bool has_zone = hsk_dns_name_set(&zone, tld);
   int i;
 
   for (i = 0; i < res->record_count; i++) {
@@ -644,7 +669,7 @@ hsk_resource_to_glue(
 
     switch (c->type) {
       case HSK_GLUE4: {
-        if (!hsk_dns_is_subdomain(tld, c->name))
+        if (!has_zone || !hsk_resource_in_zone(&zone, c->name))
           break;
 
         hsk_dns_rr_t *rr = hsk_dns_rr_create(HSK_DNS_A);
@@ -683,7 +708,7 @@ hsk_resource_to_glue(
         break;
       }
       case HSK_GLUE6: {
-        if (!hsk_dns_is_subdomain(tld, c->name))
+        if (!has_zone || !hsk_resource_in_zone(&zone, c->name))
           break;
 
         hsk_dns_rr_t *rr = hsk_dns_rr_create(HSK_DNS_AAAA);
@@ -942,13 +967,19 @@ hsk_dns_msg_t *
 hsk_resource_to_dns(const hsk_resource_t *rs, const char *name, uint16_t type) {
   assert(hsk_dns_name_is_fqdn(name));
 
-  int labels = hsk_dns_label_count(name);
+  hsk_dns_name_t qname;
+
+  if (!hsk_dns_name_set(&qname, name))
+    return NULL;
+
+  int labels = qname.count;
 
   if (labels == 0)
     return NULL;
 
-  char tld[HSK_DNS_MAX_LABEL + 1];
-  hsk_dns_label_from(name, -1, tld);
+  // Keep the case the question was asked in.
+  char tld[HSK_DNS_MAX_LABEL + 2];
+  strcpy(tld, &name[qname.labels[labels - 1]]);
 
   hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
 
@@ -1044,12 +1075,12 @@ hsk_resource_root(uint16_t type, const hsk_addr_t *addr) {
       hsk_resource_root_to_ns(an);
       hsk_dnssec_sign_zsk(an, HSK_DNS_NS);
 
-      if (hsk_addr_is_ip4(addr)) {
+      if (addr && hsk_addr_is_ip4(addr)) {
         hsk_resource_root_to_a(ar, addr);
         hsk_dnssec_sign_zsk(ar, HSK_DNS_A);
       }
 
-      if (hsk_addr_is_ip6(addr)) {
+      if (addr && hsk_addr_is_ip6(addr)) {
         hsk_resource_root_to_aaaa(ar, addr);
         hsk_dnssec_sign_zsk(ar, HSK_DNS_AAAA);
       }
@@ -1062,12 +1093,12 @@ hsk_resource_root(uint16_t type, const hsk_addr_t *addr) {
       hsk_resource_root_to_ns(ns);
       hsk_dnssec_sign_zsk(ns, HSK_DNS_NS);
 
-      if (hsk_addr_is_ip4(addr)) {
+      if (addr && hsk_addr_is_ip4(addr)) {
         hsk_resource_root_to_a(ar, addr);
         hsk_dnssec_sign_zsk(ar, HSK_DNS_A);
       }
 
-      if (hsk_addr_is_ip6(addr)) {
+      if (addr && hsk_addr_is_ip6(addr)) {
         hsk_resource_root_to_aaaa(ar, addr);
         hsk_dnssec_sign_zsk(ar, HSK_DNS_AAAA);
       }
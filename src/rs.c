@@ -253,19 +253,40 @@ hsk_rs_open(hsk_rs_t *ns, const struct sockaddr *addr) {
   if (!ns || !addr)
     return HSK_EBADARGS;
 
-  if (!hsk_rs_inject_options(ns))
-    return HSK_EFAILURE;
+  uv_udp_t *socket = malloc(sizeof(uv_udp_t));
 
-  ns->socket = malloc(sizeof(uv_udp_t));
-  if (!ns->socket)
+  if (!socket)
     return HSK_ENOMEM;
 
-  if (uv_udp_init(ns->loop, ns->socket) != 0)
+  if (uv_udp_init(ns->loop, socket) != 0) {
+    free(socket);
     return HSK_EFAILURE;
+  }
 
+  if (uv_udp_bind(socket, addr, 0) != 0) {
+    hsk_uv_close_free((uv_handle_t *)socket);
+    return HSK_EFAILURE;
+  }
+
+  return hsk_rs_open_socket(ns, socket);
+}
+
+int
+hsk_rs_open_socket(hsk_rs_t *ns, uv_udp_t *socket) {
+  if (!ns || !socket || socket->loop != ns->loop)
+    return HSK_EBADARGS;
+
+  ns->socket = socket;
   ns->socket->data = (void *)ns;
 
-  if (uv_udp_bind(ns->socket, addr, 0) != 0)
+  if (!hsk_rs_inject_options(ns))
+    return HSK_EFAILURE;
+
+  struct sockaddr_storage ss;
+  struct sockaddr *addr = (struct sockaddr *)&ss;
+  int namelen = sizeof(ss);
+
+  if (uv_udp_getsockname(ns->socket, addr, &namelen) != 0)
     return HSK_EFAILURE;
 
   int value = sizeof(ns->read_buffer);
@@ -276,11 +297,9 @@ hsk_rs_open(hsk_rs_t *ns, const struct sockaddr *addr) {
   if (uv_recv_buffer_size((uv_handle_t *)ns->socket, &value) != 0)
     return HSK_EFAILURE;
 
-  if (uv_udp_recv_start(ns->socket, alloc_buffer, after_recv) != 0)
+  if (hsk_rs_resume(ns) != HSK_SUCCESS)
     return HSK_EFAILURE;
 
-  ns->receiving = true;
-
   ns->rs_worker = hsk_rs_worker_alloc(ns->loop, (void *)ns, after_worker_stop);
   if (!ns->rs_worker)
     return HSK_EFAILURE;
@@ -296,6 +315,38 @@ hsk_rs_open(hsk_rs_t *ns, const struct sockaddr *addr) {
   return HSK_SUCCESS;
 }
 
+int
+hsk_rs_pause(hsk_rs_t *ns) {
+  if (!ns)
+    return HSK_EBADARGS;
+
+  if (!ns->receiving)
+    return HSK_SUCCESS;
+
+  if (uv_udp_recv_stop(ns->socket) != 0)
+    return HSK_EFAILURE;
+
+  ns->receiving = false;
+
+  return HSK_SUCCESS;
+}
+
+int
+hsk_rs_resume(hsk_rs_t *ns) {
+  if (!ns || !ns->socket)
+    return HSK_EBADARGS;
+
+  if (ns->receiving)
+    return HSK_SUCCESS;
+
+  if (uv_udp_recv_start(ns->socket, alloc_buffer, after_recv) != 0)
+    return HSK_EFAILURE;
+
+  ns->receiving = true;
+
+  return HSK_SUCCESS;
+}
+
 int
 hsk_rs_close(hsk_rs_t *ns, void *stop_data, void (*stop_callback)(void *)) {
   if (!ns)
@@ -443,8 +494,22 @@ hsk_rs_respond(
   uint8_t *data = result->answer_packet;
   size_t data_len = result->answer_len;
 
+  hsk_dns_view_t view;
+
+  if (!hsk_dns_view_init(&view, data, data_len)) {
+    hsk_rs_log(ns, "failed parsing answer\n");
+    goto fail;
+  }
+
+  // Non-answer sections are stripped below when
+  // there is an answer, so don't decode them.
+  int sections = HSK_DNS_SECTIONS_ALL;
+
+  if (view.counts[HSK_DNS_SECTION_AN] > 0)
+    sections = (1 << HSK_DNS_SECTION_QD) | (1 << HSK_DNS_SECTION_AN);
+
   // Deserialize to do some preprocessing.
-  if (!hsk_dns_msg_decode(data, data_len, &msg)) {
+  if (!hsk_dns_view_msg(&view, sections, &msg)) {
     hsk_rs_log(ns, "failed parsing answer\n");
     goto fail;
   }
@@ -52,6 +52,17 @@ hsk_rs_set_key(hsk_rs_t *ns, const uint8_t *key);
 int
 hsk_rs_open(hsk_rs_t *ns, const struct sockaddr *addr);
 
+// Open with a bound socket on ns->loop, which the ns takes ownership of.
+int
+hsk_rs_open_socket(hsk_rs_t *ns, uv_udp_t *socket);
+
+// Stop and start reading queries. Pending answers still go out while paused.
+int
+hsk_rs_pause(hsk_rs_t *ns);
+
+int
+hsk_rs_resume(hsk_rs_t *ns);
+
 // Close the recursive name server.  This may complete asynchronously;
 // stop_callback is called when the name server can be destroyed.
 int
@@ -10,20 +10,36 @@
 #include "scalar.h"
 #include "group.h"
 
+#ifndef HSK_ECMULT_GEN_PREC_BITS
+#define HSK_ECMULT_GEN_PREC_BITS 4
+#endif
+
+#if HSK_ECMULT_GEN_PREC_BITS != 2 && HSK_ECMULT_GEN_PREC_BITS != 4 && HSK_ECMULT_GEN_PREC_BITS != 8
+#  error "Set HSK_ECMULT_GEN_PREC_BITS to 2, 4 or 8."
+#endif
+
+#if defined(HSK_USE_ECMULT_STATIC_PRECOMPUTATION) && HSK_ECMULT_GEN_PREC_BITS != 4
+#  error "The static ecmult gen table is only available for HSK_ECMULT_GEN_PREC_BITS=4."
+#endif
+
+#define ECMULT_GEN_PREC_B HSK_ECMULT_GEN_PREC_BITS
+#define ECMULT_GEN_PREC_G (1 << ECMULT_GEN_PREC_B)
+#define ECMULT_GEN_PREC_N (256 / ECMULT_GEN_PREC_B)
+
 typedef struct {
     /* For accelerating the computation of a*G:
      * To harden against timing attacks, use the following mechanism:
-     * * Break up the multiplicand into groups of 4 bits, called n_0, n_1, n_2, ..., n_63.
-     * * Compute sum(n_i * 16^i * G + U_i, i=0..63), where:
-     *   * U_i = U * 2^i (for i=0..62)
-     *   * U_i = U * (1-2^63) (for i=63)
-     *   where U is a point with no known corresponding scalar. Note that sum(U_i, i=0..63) = 0.
-     * For each i, and each of the 16 possible values of n_i, (n_i * 16^i * G + U_i) is
-     * precomputed (call it prec(i, n_i)). The formula now becomes sum(prec(i, n_i), i=0..63).
+     * * Break up the multiplicand into groups of PREC_B bits, called n_0, n_1, n_2, ..., n_(PREC_N-1).
+     * * Compute sum(n_i * (PREC_G)^i * G + U_i, i=0 ... PREC_N-1), where:
+     *   * U_i = U * 2^i, for i=0 ... PREC_N-2
+     *   * U_i = U * (1-2^(PREC_N-1)), for i=PREC_N-1
+     *   where U is a point with no known corresponding scalar. Note that sum(U_i, i=0 ... PREC_N-1) = 0.
+     * For each i, and each of the PREC_G possible values of n_i, (n_i * (PREC_G)^i * G + U_i) is
+     * precomputed (call it prec(i, n_i)). The formula now becomes sum(prec(i, n_i), i=0 ... PREC_N-1).
      * None of the resulting prec group elements have a known scalar, and neither do any of
      * the intermediate sums while computing a*G.
      */
-    hsk_secp256k1_ge_storage (*prec)[64][16]; /* prec[j][i] = 16^j * i * G + U_i */
+    hsk_secp256k1_ge_storage (*prec)[ECMULT_GEN_PREC_N][ECMULT_GEN_PREC_G]; /* prec[j][i] = (PREC_G)^j * i * G + U_i */
     hsk_secp256k1_scalar blind;
     hsk_secp256k1_gej initial;
 } hsk_secp256k1_ecmult_gen_context;
@@ -20,7 +20,7 @@ static void hsk_secp256k1_ecmult_gen_context_init(hsk_secp256k1_ecmult_gen_conte
 
 static void hsk_secp256k1_ecmult_gen_context_build(hsk_secp256k1_ecmult_gen_context *ctx, const hsk_secp256k1_callback* cb) {
 #ifndef HSK_USE_ECMULT_STATIC_PRECOMPUTATION
-    hsk_secp256k1_ge prec[1024];
+    hsk_secp256k1_ge *prec;
     hsk_secp256k1_gej gj;
     hsk_secp256k1_gej nums_gej;
     int i, j;
@@ -30,7 +30,9 @@ static void hsk_secp256k1_ecmult_gen_context_build(hsk_secp256k1_ecmult_gen_cont
         return;
     }
 #ifndef HSK_USE_ECMULT_STATIC_PRECOMPUTATION
-    ctx->prec = (hsk_secp256k1_ge_storage (*)[64][16])checked_malloc(cb, sizeof(*ctx->prec));
+    ctx->prec = (hsk_secp256k1_ge_storage (*)[ECMULT_GEN_PREC_N][ECMULT_GEN_PREC_G])checked_malloc(cb, sizeof(*ctx->prec));
+    /* Up to 8192 entries with 8-bit precision: keep them off the stack. */
+    prec = (hsk_secp256k1_ge *)checked_malloc(cb, sizeof(hsk_secp256k1_ge) * ECMULT_GEN_PREC_N * ECMULT_GEN_PREC_G);
 
     /* get the generator */
     hsk_secp256k1_gej_set_ge(&gj, &hsk_secp256k1_ge_const_g);
@@ -54,39 +56,42 @@ static void hsk_secp256k1_ecmult_gen_context_build(hsk_secp256k1_ecmult_gen_cont
 
     /* compute prec. */
     {
-        hsk_secp256k1_gej precj[1024]; /* Jacobian versions of prec. */
+        hsk_secp256k1_gej *precj; /* Jacobian versions of prec. */
         hsk_secp256k1_gej gbase;
         hsk_secp256k1_gej numsbase;
-        gbase = gj; /* 16^j * G */
+        precj = (hsk_secp256k1_gej *)checked_malloc(cb, sizeof(hsk_secp256k1_gej) * ECMULT_GEN_PREC_N * ECMULT_GEN_PREC_G);
+        gbase = gj; /* PREC_G^j * G */
         numsbase = nums_gej; /* 2^j * nums. */
-        for (j = 0; j < 64; j++) {
-            /* Set precj[j*16 .. j*16+15] to (numsbase, numsbase + gbase, ..., numsbase + 15*gbase). */
-            precj[j*16] = numsbase;
-            for (i = 1; i < 16; i++) {
-                hsk_secp256k1_gej_add_var(&precj[j*16 + i], &precj[j*16 + i - 1], &gbase, NULL);
+        for (j = 0; j < ECMULT_GEN_PREC_N; j++) {
+            /* Set precj[j*PREC_G .. j*PREC_G+(PREC_G-1)] to (numsbase, numsbase + gbase, ..., numsbase + (PREC_G-1)*gbase). */
+            precj[j*ECMULT_GEN_PREC_G] = numsbase;
+            for (i = 1; i < ECMULT_GEN_PREC_G; i++) {
+                hsk_secp256k1_gej_add_var(&precj[j*ECMULT_GEN_PREC_G + i], &precj[j*ECMULT_GEN_PREC_G + i - 1], &gbase, NULL);
             }
-            /* Multiply gbase by 16. */
-            for (i = 0; i < 4; i++) {
+            /* Multiply gbase by PREC_G. */
+            for (i = 0; i < ECMULT_GEN_PREC_B; i++) {
                 hsk_secp256k1_gej_double_var(&gbase, &gbase, NULL);
             }
             /* Multiply numbase by 2. */
             hsk_secp256k1_gej_double_var(&numsbase, &numsbase, NULL);
-            if (j == 62) {
+            if (j == ECMULT_GEN_PREC_N - 2) {
                 /* In the last iteration, numsbase is (1 - 2^j) * nums instead. */
                 hsk_secp256k1_gej_neg(&numsbase, &numsbase);
                 hsk_secp256k1_gej_add_var(&numsbase, &numsbase, &nums_gej, NULL);
             }
         }
-        hsk_secp256k1_ge_set_all_gej_var(prec, precj, 1024, cb);
+        hsk_secp256k1_ge_set_all_gej_var(prec, precj, ECMULT_GEN_PREC_N * ECMULT_GEN_PREC_G, cb);
+        free(precj);
     }
-    for (j = 0; j < 64; j++) {
-        for (i = 0; i < 16; i++) {
-            hsk_secp256k1_ge_to_storage(&(*ctx->prec)[j][i], &prec[j*16 + i]);
+    for (j = 0; j < ECMULT_GEN_PREC_N; j++) {
+        for (i = 0; i < ECMULT_GEN_PREC_G; i++) {
+            hsk_secp256k1_ge_to_storage(&(*ctx->prec)[j][i], &prec[j*ECMULT_GEN_PREC_G + i]);
         }
     }
+    free(prec);
 #else
     (void)cb;
-    ctx->prec = (hsk_secp256k1_ge_storage (*)[64][16])hsk_secp256k1_ecmult_static_context;
+    ctx->prec = (hsk_secp256k1_ge_storage (*)[ECMULT_GEN_PREC_N][ECMULT_GEN_PREC_G])hsk_secp256k1_ecmult_static_context;
 #endif
     hsk_secp256k1_ecmult_gen_blind(ctx, NULL);
 }
@@ -101,7 +106,7 @@ static void hsk_secp256k1_ecmult_gen_context_clone(hsk_secp256k1_ecmult_gen_cont
         dst->prec = NULL;
     } else {
 #ifndef HSK_USE_ECMULT_STATIC_PRECOMPUTATION
-        dst->prec = (hsk_secp256k1_ge_storage (*)[64][16])checked_malloc(cb, sizeof(*dst->prec));
+        dst->prec = (hsk_secp256k1_ge_storage (*)[ECMULT_GEN_PREC_N][ECMULT_GEN_PREC_G])checked_malloc(cb, sizeof(*dst->prec));
         memcpy(dst->prec, src->prec, sizeof(*dst->prec));
 #else
         (void)cb;
@@ -132,9 +137,9 @@ static void hsk_secp256k1_ecmult_gen(const hsk_secp256k1_ecmult_gen_context *ctx
     /* Blind scalar/point multiplication by computing (n-b)G + bG instead of nG. */
     hsk_secp256k1_scalar_add(&gnb, gn, &ctx->blind);
     add.infinity = 0;
-    for (j = 0; j < 64; j++) {
-        bits = hsk_secp256k1_scalar_get_bits(&gnb, j * 4, 4);
-        for (i = 0; i < 16; i++) {
+    for (j = 0; j < ECMULT_GEN_PREC_N; j++) {
+        bits = hsk_secp256k1_scalar_get_bits(&gnb, j * ECMULT_GEN_PREC_B, ECMULT_GEN_PREC_B);
+        for (i = 0; i < ECMULT_GEN_PREC_G; i++) {
             /** This uses a conditional move to avoid any secret data in array indexes.
              *   _Any_ use of secret indexes has been demonstrated to result in timing
              *   sidechannels, even when the cache-line access patterns are uniform.
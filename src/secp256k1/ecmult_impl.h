@@ -33,7 +33,9 @@
 #define WINDOW_A 5
 /** larger numbers may result in slightly better performance, at the cost of
     exponentially larger precomputed tables. */
-#ifdef HSK_USE_ENDOMORPHISM
+#if defined(HSK_ECMULT_WINDOW_SIZE)
+#define WINDOW_G HSK_ECMULT_WINDOW_SIZE
+#elif defined(HSK_USE_ENDOMORPHISM)
 /** Two tables for window size 15: 1.375 MiB. */
 #define WINDOW_G 15
 #else
@@ -42,6 +44,10 @@
 #endif
 #endif
 
+#if WINDOW_G < 2 || WINDOW_G > 24
+#  error "Set HSK_ECMULT_WINDOW_SIZE to an integer in range [2..24]."
+#endif
+
 #ifdef HSK_USE_ENDOMORPHISM
     #define WNAF_BITS 128
 #else
@@ -15,7 +15,7 @@
 #include "num.h"
 #include "field.h"
 
-#if defined(HSK_USE_ASM_X86_64)
+#if defined(HSK_USE_FIELD_5X52_ASM)
 #include "field_5x52_asm_impl.h"
 #else
 #include "field_5x52_int128_impl.h"
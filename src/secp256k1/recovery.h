@@ -87,6 +87,49 @@ HSK_SECP256K1_API int hsk_secp256k1_ecdsa_sign_recoverable(
     const void *ndata
 ) HSK_SECP256K1_ARG_NONNULL(1) HSK_SECP256K1_ARG_NONNULL(2) HSK_SECP256K1_ARG_NONNULL(3) HSK_SECP256K1_ARG_NONNULL(4);
 
+/** Opaque data structure that holds a precomputed signing nonce.
+ *
+ *  Holds r = (k*G).x mod n, k^-1 mod n and the recovery id of k*G, so that a
+ *  signature can later be produced with two scalar multiplications and no
+ *  point multiplication. A nonce must never be used for more than one
+ *  signature; hsk_secp256k1_ecdsa_sign_recoverable_nonce clears it.
+ */
+typedef struct {
+    unsigned char data[65];
+} hsk_secp256k1_ecdsa_nonce;
+
+/** Precompute a signing nonce.
+ *
+ *  Returns: 1: nonce created
+ *           0: nonce32 is zero, overflows, or yields r = 0 (pick another).
+ *  Args:    ctx:     pointer to a context object, initialized for signing (cannot be NULL)
+ *  Out:     nonce:   pointer to the precomputed nonce (cannot be NULL)
+ *  In:      nonce32: 32 bytes of secret, uniformly random data (cannot be NULL)
+ */
+HSK_SECP256K1_API HSK_SECP256K1_WARN_UNUSED_RESULT int hsk_secp256k1_ecdsa_nonce_create(
+    const hsk_secp256k1_context* ctx,
+    hsk_secp256k1_ecdsa_nonce *nonce,
+    const unsigned char *nonce32
+) HSK_SECP256K1_ARG_NONNULL(1) HSK_SECP256K1_ARG_NONNULL(2) HSK_SECP256K1_ARG_NONNULL(3);
+
+/** Create a recoverable ECDSA signature with a precomputed nonce.
+ *
+ *  Returns: 1: signature created
+ *           0: the private key was invalid, or the nonce produced s = 0.
+ *  Args:    ctx:    pointer to a context object (cannot be NULL)
+ *  Out:     sig:    pointer to an array where the signature will be placed (cannot be NULL)
+ *  In:      msg32:  the 32-byte message hash being signed (cannot be NULL)
+ *           seckey: pointer to a 32-byte secret key (cannot be NULL)
+ *  In/Out:  nonce:  pointer to a precomputed nonce, cleared on return (cannot be NULL)
+ */
+HSK_SECP256K1_API int hsk_secp256k1_ecdsa_sign_recoverable_nonce(
+    const hsk_secp256k1_context* ctx,
+    hsk_secp256k1_ecdsa_recoverable_signature *sig,
+    const unsigned char *msg32,
+    const unsigned char *seckey,
+    hsk_secp256k1_ecdsa_nonce *nonce
+) HSK_SECP256K1_ARG_NONNULL(1) HSK_SECP256K1_ARG_NONNULL(2) HSK_SECP256K1_ARG_NONNULL(3) HSK_SECP256K1_ARG_NONNULL(4) HSK_SECP256K1_ARG_NONNULL(5);
+
 /** Recover an ECDSA public key from a signature.
  *
  *  Returns: 1: public key successfully recovered (which guarantees a correct signature).
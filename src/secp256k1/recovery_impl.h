@@ -167,6 +167,91 @@ int hsk_secp256k1_ecdsa_sign_recoverable(const hsk_secp256k1_context* ctx, hsk_s
     return ret;
 }
 
+int hsk_secp256k1_ecdsa_nonce_create(const hsk_secp256k1_context* ctx, hsk_secp256k1_ecdsa_nonce *nonce, const unsigned char *nonce32) {
+    unsigned char b[32];
+    hsk_secp256k1_gej rp;
+    hsk_secp256k1_ge r;
+    hsk_secp256k1_scalar k, sigr, kinv;
+    int overflow = 0;
+    int ret = 0;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(hsk_secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx));
+    ARG_CHECK(nonce != NULL);
+    ARG_CHECK(nonce32 != NULL);
+
+    memset(nonce, 0, sizeof(*nonce));
+
+    hsk_secp256k1_scalar_set_b32(&k, nonce32, &overflow);
+    if (!overflow && !hsk_secp256k1_scalar_is_zero(&k)) {
+        hsk_secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &rp, &k);
+        hsk_secp256k1_ge_set_gej(&r, &rp);
+        hsk_secp256k1_fe_normalize(&r.x);
+        hsk_secp256k1_fe_normalize(&r.y);
+        hsk_secp256k1_fe_get_b32(b, &r.x);
+        hsk_secp256k1_scalar_set_b32(&sigr, b, &overflow);
+        /* Same as hsk_secp256k1_ecdsa_sig_sign: r >= n is cryptographically
+         * unreachable, but reject it (and r = 0) rather than track it. */
+        if (!overflow && !hsk_secp256k1_scalar_is_zero(&sigr)) {
+            hsk_secp256k1_scalar_inverse(&kinv, &k);
+            hsk_secp256k1_scalar_get_b32(&nonce->data[0], &sigr);
+            hsk_secp256k1_scalar_get_b32(&nonce->data[32], &kinv);
+            nonce->data[64] = hsk_secp256k1_fe_is_odd(&r.y) ? 1 : 0;
+            ret = 1;
+        }
+        hsk_secp256k1_gej_clear(&rp);
+        hsk_secp256k1_ge_clear(&r);
+        hsk_secp256k1_scalar_clear(&kinv);
+        memset(b, 0, 32);
+    }
+    hsk_secp256k1_scalar_clear(&k);
+    return ret;
+}
+
+int hsk_secp256k1_ecdsa_sign_recoverable_nonce(const hsk_secp256k1_context* ctx, hsk_secp256k1_ecdsa_recoverable_signature *signature, const unsigned char *msg32, const unsigned char *seckey, hsk_secp256k1_ecdsa_nonce *nonce) {
+    hsk_secp256k1_scalar r, s, n;
+    hsk_secp256k1_scalar sec, msg, kinv;
+    int recid;
+    int ret = 0;
+    int overflow = 0;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(signature != NULL);
+    ARG_CHECK(seckey != NULL);
+    ARG_CHECK(nonce != NULL);
+
+    hsk_secp256k1_scalar_set_b32(&sec, seckey, &overflow);
+    if (!overflow && !hsk_secp256k1_scalar_is_zero(&sec)) {
+        hsk_secp256k1_scalar_set_b32(&r, &nonce->data[0], NULL);
+        hsk_secp256k1_scalar_set_b32(&kinv, &nonce->data[32], NULL);
+        recid = nonce->data[64];
+        if (!hsk_secp256k1_scalar_is_zero(&r) && !hsk_secp256k1_scalar_is_zero(&kinv)) {
+            hsk_secp256k1_scalar_set_b32(&msg, msg32, NULL);
+            hsk_secp256k1_scalar_mul(&n, &r, &sec);
+            hsk_secp256k1_scalar_add(&n, &n, &msg);
+            hsk_secp256k1_scalar_mul(&s, &kinv, &n);
+            hsk_secp256k1_scalar_clear(&n);
+            hsk_secp256k1_scalar_clear(&msg);
+            if (!hsk_secp256k1_scalar_is_zero(&s)) {
+                if (hsk_secp256k1_scalar_is_high(&s)) {
+                    hsk_secp256k1_scalar_negate(&s, &s);
+                    recid ^= 1;
+                }
+                ret = 1;
+            }
+        }
+        hsk_secp256k1_scalar_clear(&kinv);
+    }
+    hsk_secp256k1_scalar_clear(&sec);
+    /* Never let a nonce be used twice. */
+    memset(nonce, 0, sizeof(*nonce));
+    if (ret) {
+        hsk_secp256k1_ecdsa_recoverable_signature_save(signature, &r, &s, recid);
+    } else {
+        memset(signature, 0, sizeof(*signature));
+    }
+    return ret;
+}
+
 int hsk_secp256k1_ecdsa_recover(const hsk_secp256k1_context* ctx, hsk_secp256k1_pubkey *pubkey, const hsk_secp256k1_ecdsa_recoverable_signature *signature, const unsigned char *msg32) {
     hsk_secp256k1_ge q;
     hsk_secp256k1_scalar r, s;
@@ -18,9 +18,36 @@
 
 #include "config.h"
 
+#include <stdbool.h>
 #include <string.h>
 
 #include "sha256.h"
+#include "uv.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HSK_SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Older GCCs only expose the SHA2 intrinsics when the
+// whole unit is built for them.
+#if defined(__aarch64__) && defined(__GNUC__)                    \
+  && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO) \
+      || defined(__clang__) || __GNUC__ >= 10)
+#define HSK_SHA256_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+typedef void (*hsk_sha256_transform_t)(
+  unsigned int *hash,
+  const unsigned char *data,
+  size_t blocks
+);
 
 static inline uint32_t
 bswap_32(uint32_t x) {
@@ -169,13 +196,278 @@ hsk_sha256_process_block(unsigned hash[8], unsigned block[16]) {
   hash[4] += E, hash[5] += F, hash[6] += G, hash[7] += H;
 }
 
+static void
+hsk_sha256_transform_generic(
+  unsigned int *hash,
+  const unsigned char *data,
+  size_t blocks
+) {
+  unsigned int block[16];
+
+  for (; blocks > 0; blocks--, data += hsk_sha256_block_size) {
+    if (IS_ALIGNED_32(data)) {
+      // the most common case is processing of an
+      // already aligned message without copying it
+      hsk_sha256_process_block(hash, (unsigned int *)data);
+    } else {
+      memcpy(block, data, hsk_sha256_block_size);
+      hsk_sha256_process_block(hash, block);
+    }
+  }
+}
+
+/*
+ * SHA-NI
+ */
+
+#ifdef HSK_SHA256_SHANI
+// Four rounds. w0 holds the current message words, w1 the next ones and
+// w3 the previous ones; the schedule for later rounds is updated in place.
+#define SHANI_ROUNDS(g, w0, w1, w2, w3) do {                             \
+  __m128i x = _mm_add_epi32(w0,                                          \
+    _mm_loadu_si128((const __m128i *)&k256[4 * (g)]));                   \
+  s1 = _mm_sha256rnds2_epu32(s1, s0, x);                                 \
+  if ((g) >= 3 && (g) < 15) {                                            \
+    w1 = _mm_add_epi32(w1, _mm_alignr_epi8(w0, w3, 4));                  \
+    w1 = _mm_sha256msg2_epu32(w1, w0);                                   \
+  }                                                                      \
+  x = _mm_shuffle_epi32(x, 0x0e);                                        \
+  s0 = _mm_sha256rnds2_epu32(s0, s1, x);                                 \
+  if ((g) >= 1 && (g) < 13)                                              \
+    w3 = _mm_sha256msg1_epu32(w3, w0);                                   \
+} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+hsk_sha256_transform_shani(
+  unsigned int *hash,
+  const unsigned char *data,
+  size_t blocks
+) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull,
+                                      0x0405060700010203ull);
+  __m128i s0, s1, t, abef, cdgh, m0, m1, m2, m3;
+
+  // The instructions want the state as ABEF/CDGH.
+  t = _mm_loadu_si128((const __m128i *)&hash[0]);
+  s1 = _mm_loadu_si128((const __m128i *)&hash[4]);
+
+  t = _mm_shuffle_epi32(t, 0xb1);
+  s1 = _mm_shuffle_epi32(s1, 0x1b);
+  s0 = _mm_alignr_epi8(t, s1, 8);
+  s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+  for (; blocks > 0; blocks--, data += hsk_sha256_block_size) {
+    abef = s0;
+    cdgh = s1;
+
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+    SHANI_ROUNDS(0, m0, m1, m2, m3);
+    SHANI_ROUNDS(1, m1, m2, m3, m0);
+    SHANI_ROUNDS(2, m2, m3, m0, m1);
+    SHANI_ROUNDS(3, m3, m0, m1, m2);
+    SHANI_ROUNDS(4, m0, m1, m2, m3);
+    SHANI_ROUNDS(5, m1, m2, m3, m0);
+    SHANI_ROUNDS(6, m2, m3, m0, m1);
+    SHANI_ROUNDS(7, m3, m0, m1, m2);
+    SHANI_ROUNDS(8, m0, m1, m2, m3);
+    SHANI_ROUNDS(9, m1, m2, m3, m0);
+    SHANI_ROUNDS(10, m2, m3, m0, m1);
+    SHANI_ROUNDS(11, m3, m0, m1, m2);
+    SHANI_ROUNDS(12, m0, m1, m2, m3);
+    SHANI_ROUNDS(13, m1, m2, m3, m0);
+    SHANI_ROUNDS(14, m2, m3, m0, m1);
+    SHANI_ROUNDS(15, m3, m0, m1, m2);
+
+    s0 = _mm_add_epi32(s0, abef);
+    s1 = _mm_add_epi32(s1, cdgh);
+  }
+
+  // Back to ABCD/EFGH.
+  t = _mm_shuffle_epi32(s0, 0x1b);
+  s1 = _mm_shuffle_epi32(s1, 0xb1);
+  s0 = _mm_blend_epi16(t, s1, 0xf0);
+  s1 = _mm_alignr_epi8(s1, t, 8);
+
+  _mm_storeu_si128((__m128i *)&hash[0], s0);
+  _mm_storeu_si128((__m128i *)&hash[4], s1);
+}
+
+static bool
+hsk_sha256_has_shani(void) {
+  unsigned int a, b, c, d;
+
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return false;
+
+  // SSSE3 and SSE4.1
+  if (!(c & (1 << 9)) || !(c & (1 << 19)))
+    return false;
+
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    return false;
+
+  return (b & (1 << 29)) != 0;
+}
+#endif
+
+/*
+ * ARMv8
+ */
+
+#ifdef HSK_SHA256_ARMV8
+#if defined(__clang__)
+#define HSK_TARGET_SHA2 __attribute__((target("crypto")))
+#else
+#define HSK_TARGET_SHA2 __attribute__((target("+crypto")))
+#endif
+
+// Four rounds. w0 holds the current message words; the schedule for
+// later rounds is updated in place.
+#define ARMV8_ROUNDS(g, w0, w1, w2, w3) do {       \
+  uint32x4_t x = vaddq_u32(w0, vld1q_u32(&k256[4 * (g)])); \
+  uint32x4_t t = s0;                               \
+  if ((g) < 12)                                    \
+    w0 = vsha256su0q_u32(w0, w1);                  \
+  s0 = vsha256hq_u32(s0, s1, x);                   \
+  s1 = vsha256h2q_u32(s1, t, x);                   \
+  if ((g) < 12)                                    \
+    w0 = vsha256su1q_u32(w0, w2, w3);              \
+} while (0)
+
+HSK_TARGET_SHA2
+static void
+hsk_sha256_transform_armv8(
+  unsigned int *hash,
+  const unsigned char *data,
+  size_t blocks
+) {
+  uint32x4_t s0 = vld1q_u32(&hash[0]);
+  uint32x4_t s1 = vld1q_u32(&hash[4]);
+
+  for (; blocks > 0; blocks--, data += hsk_sha256_block_size) {
+    uint32x4_t abcd = s0;
+    uint32x4_t efgh = s1;
+
+    uint32x4_t m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+    uint32x4_t m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+    uint32x4_t m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+    uint32x4_t m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+    ARMV8_ROUNDS(0, m0, m1, m2, m3);
+    ARMV8_ROUNDS(1, m1, m2, m3, m0);
+    ARMV8_ROUNDS(2, m2, m3, m0, m1);
+    ARMV8_ROUNDS(3, m3, m0, m1, m2);
+    ARMV8_ROUNDS(4, m0, m1, m2, m3);
+    ARMV8_ROUNDS(5, m1, m2, m3, m0);
+    ARMV8_ROUNDS(6, m2, m3, m0, m1);
+    ARMV8_ROUNDS(7, m3, m0, m1, m2);
+    ARMV8_ROUNDS(8, m0, m1, m2, m3);
+    ARMV8_ROUNDS(9, m1, m2, m3, m0);
+    ARMV8_ROUNDS(10, m2, m3, m0, m1);
+    ARMV8_ROUNDS(11, m3, m0, m1, m2);
+    ARMV8_ROUNDS(12, m0, m1, m2, m3);
+    ARMV8_ROUNDS(13, m1, m2, m3, m0);
+    ARMV8_ROUNDS(14, m2, m3, m0, m1);
+    ARMV8_ROUNDS(15, m3, m0, m1, m2);
+
+    s0 = vaddq_u32(s0, abcd);
+    s1 = vaddq_u32(s1, efgh);
+  }
+
+  vst1q_u32(&hash[0], s0);
+  vst1q_u32(&hash[4], s1);
+}
+
+static bool
+hsk_sha256_has_armv8(void) {
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+  return true;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif defined(__APPLE__)
+  return true;
+#else
+  return false;
+#endif
+}
+#endif
+
+/*
+ * Backend
+ */
+
+// Picked once, before the first hash, and only changed by tests after that.
+static hsk_sha256_transform_t hsk_sha256_transform = NULL;
+static const char *hsk_sha256_transform_name = "generic";
+static uv_once_t hsk_sha256_once = UV_ONCE_INIT;
+
+static void
+hsk_sha256_pick(bool hardware) {
+  hsk_sha256_transform_t transform = hsk_sha256_transform_generic;
+  const char *name = "generic";
+
+  if (hardware) {
+#if defined(HSK_SHA256_SHANI)
+    if (hsk_sha256_has_shani()) {
+      transform = hsk_sha256_transform_shani;
+      name = "sha-ni";
+    }
+#elif defined(HSK_SHA256_ARMV8)
+    if (hsk_sha256_has_armv8()) {
+      transform = hsk_sha256_transform_armv8;
+      name = "armv8";
+    }
+#endif
+  }
+
+  hsk_sha256_transform_name = name;
+  hsk_sha256_transform = transform;
+}
+
+static void
+hsk_sha256_select(void) {
+  hsk_sha256_pick(true);
+}
+
+static inline void
+hsk_sha256_compress(
+  unsigned int *hash,
+  const unsigned char *data,
+  size_t blocks
+) {
+  uv_once(&hsk_sha256_once, hsk_sha256_select);
+  hsk_sha256_transform(hash, data, blocks);
+}
+
+const char *
+hsk_sha256_backend(void) {
+  uv_once(&hsk_sha256_once, hsk_sha256_select);
+  return hsk_sha256_transform_name;
+}
+
+bool
+hsk_sha256_use_hardware(bool enable) {
+  uv_once(&hsk_sha256_once, hsk_sha256_select);
+  hsk_sha256_pick(enable);
+  return hsk_sha256_transform != hsk_sha256_transform_generic;
+}
+
+/*
+ * Streaming
+ */
+
 void
 hsk_sha256_update(hsk_sha256_ctx *ctx, const unsigned char *msg, size_t size) {
   size_t index = (size_t)ctx->length & 63;
   ctx->length += size;
 
   // fill partial block
-  if (index) {
+  if (index && size) {
     size_t left = hsk_sha256_block_size - index;
     memcpy((char *)ctx->message + index, msg, (size < left ? size : left));
 
@@ -183,27 +475,18 @@ hsk_sha256_update(hsk_sha256_ctx *ctx, const unsigned char *msg, size_t size) {
       return;
 
     // process partial block
-    hsk_sha256_process_block(ctx->hash, (unsigned *)ctx->message);
+    hsk_sha256_compress(ctx->hash, (unsigned char *)ctx->message, 1);
     msg += left;
     size -= left;
   }
 
-  while (size >= hsk_sha256_block_size) {
-    unsigned int *aligned_message_block;
+  if (size >= hsk_sha256_block_size) {
+    size_t blocks = size / hsk_sha256_block_size;
 
-    if (IS_ALIGNED_32(msg)) {
-      // the most common case is processing of an
-      // already aligned message without copying it
-      aligned_message_block = (unsigned int *)msg;
-    } else {
-      memcpy(ctx->message, msg, hsk_sha256_block_size);
-      aligned_message_block = (unsigned int *)ctx->message;
-    }
-
-    hsk_sha256_process_block(ctx->hash, aligned_message_block);
+    hsk_sha256_compress(ctx->hash, msg, blocks);
 
-    msg += hsk_sha256_block_size;
-    size -= hsk_sha256_block_size;
+    msg += blocks * hsk_sha256_block_size;
+    size -= blocks * hsk_sha256_block_size;
   }
 
   // save leftovers
@@ -228,7 +511,7 @@ hsk_sha256_final(hsk_sha256_ctx *ctx, unsigned char *result) {
     while (index < 16)
       ctx->message[index++] = 0;
 
-    hsk_sha256_process_block(ctx->hash, ctx->message);
+    hsk_sha256_compress(ctx->hash, (unsigned char *)ctx->message, 1);
     index = 0;
   }
 
@@ -237,8 +520,210 @@ hsk_sha256_final(hsk_sha256_ctx *ctx, unsigned char *result) {
 
   ctx->message[14] = be2me_32((unsigned int)(ctx->length >> 29));
   ctx->message[15] = be2me_32((unsigned int)(ctx->length << 3));
-  hsk_sha256_process_block(ctx->hash, ctx->message);
+  hsk_sha256_compress(ctx->hash, (unsigned char *)ctx->message, 1);
 
   if (result)
     be32_copy(result, 0, ctx->hash, ctx->digest_length);
 }
+
+/*
+ * Multiple messages
+ */
+
+// Block `i` of the padded message.
+static const unsigned char *
+hsk_sha256_get_block(
+  const unsigned char *msg,
+  size_t size,
+  size_t i,
+  size_t blocks,
+  unsigned char *tmp
+) {
+  size_t off = i * hsk_sha256_block_size;
+
+  if (off + hsk_sha256_block_size <= size)
+    return msg + off;
+
+  memset(tmp, 0, hsk_sha256_block_size);
+
+  if (off < size)
+    memcpy(tmp, msg + off, size - off);
+
+  if (off <= size)
+    tmp[size - off] = 0x80;
+
+  if (i == blocks - 1) {
+    uint64_t bits = (uint64_t)size << 3;
+    int j;
+
+    for (j = 0; j < 8; j++)
+      tmp[63 - j] = (unsigned char)(bits >> (j * 8));
+  }
+
+  return tmp;
+}
+
+static size_t
+hsk_sha256_blocks(size_t size) {
+  return (size + 9 + hsk_sha256_block_size - 1) / hsk_sha256_block_size;
+}
+
+static void
+hsk_sha256_write_hash(unsigned char *out, const unsigned int *hash) {
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    out[i * 4 + 0] = (unsigned char)(hash[i] >> 24);
+    out[i * 4 + 1] = (unsigned char)(hash[i] >> 16);
+    out[i * 4 + 2] = (unsigned char)(hash[i] >> 8);
+    out[i * 4 + 3] = (unsigned char)hash[i];
+  }
+}
+
+#if defined(__GNUC__)
+typedef uint32_t hsk_sha256_u32x4 __attribute__((vector_size(16)));
+
+#define ROTRV(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CHV(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJV(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SIGMA0V(x) (ROTRV((x), 2) ^ ROTRV((x), 13) ^ ROTRV((x), 22))
+#define SIGMA1V(x) (ROTRV((x), 6) ^ ROTRV((x), 11) ^ ROTRV((x), 25))
+#define sigma0V(x) (ROTRV((x), 7) ^ ROTRV((x), 18) ^ ((x) >> 3))
+#define sigma1V(x) (ROTRV((x), 17) ^ ROTRV((x), 19) ^ ((x) >> 10))
+
+// One block for each of four messages, a message per lane.
+static void
+hsk_sha256_compress_x4(hsk_sha256_u32x4 *hash, const unsigned char *in[4]) {
+  hsk_sha256_u32x4 w[16];
+  hsk_sha256_u32x4 a, b, c, d, e, f, g, h;
+  int i, j;
+
+  for (i = 0; i < 16; i++) {
+    for (j = 0; j < 4; j++) {
+      const unsigned char *p = in[j] + i * 4;
+      w[i][j] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+              | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    }
+  }
+
+  a = hash[0], b = hash[1], c = hash[2], d = hash[3];
+  e = hash[4], f = hash[5], g = hash[6], h = hash[7];
+
+  for (i = 0; i < 64; i++) {
+    hsk_sha256_u32x4 x;
+
+    if (i < 16) {
+      x = w[i];
+    } else {
+      x = sigma1V(w[(i - 2) & 15]) + w[(i - 7) & 15]
+        + sigma0V(w[(i - 15) & 15]) + w[i & 15];
+      w[i & 15] = x;
+    }
+
+    hsk_sha256_u32x4 t1 = h + SIGMA1V(e) + CHV(e, f, g) + k256[i] + x;
+    hsk_sha256_u32x4 t2 = SIGMA0V(a) + MAJV(a, b, c);
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  hash[0] += a, hash[1] += b, hash[2] += c, hash[3] += d;
+  hash[4] += e, hash[5] += f, hash[6] += g, hash[7] += h;
+}
+
+static void
+hsk_sha256_multi_x4(
+  unsigned char *const *out,
+  const unsigned char *const *msg,
+  const size_t *size,
+  size_t count
+) {
+  static const unsigned char zero[hsk_sha256_block_size];
+  unsigned char tmp[4][hsk_sha256_block_size];
+  size_t blocks[4];
+  size_t max = 0;
+  hsk_sha256_u32x4 hash[8];
+  hsk_sha256_ctx init;
+  size_t i, j;
+
+  hsk_sha256_init(&init);
+
+  for (i = 0; i < 8; i++) {
+    uint32_t v = init.hash[i];
+    hash[i] = (hsk_sha256_u32x4){ v, v, v, v };
+  }
+
+  for (j = 0; j < 4; j++) {
+    blocks[j] = j < count ? hsk_sha256_blocks(size[j]) : 0;
+
+    if (blocks[j] > max)
+      max = blocks[j];
+  }
+
+  // Lanes that run out early hash zeroes until the longest is
+  // done; their result has been taken by then.
+  for (i = 0; i < max; i++) {
+    const unsigned char *in[4];
+
+    for (j = 0; j < 4; j++) {
+      if (i < blocks[j])
+        in[j] = hsk_sha256_get_block(msg[j], size[j], i, blocks[j], tmp[j]);
+      else
+        in[j] = zero;
+    }
+
+    hsk_sha256_compress_x4(hash, in);
+
+    for (j = 0; j < 4; j++) {
+      if (i + 1 == blocks[j]) {
+        unsigned int lane[8];
+        int k;
+
+        for (k = 0; k < 8; k++)
+          lane[k] = hash[k][j];
+
+        hsk_sha256_write_hash(out[j], lane);
+      }
+    }
+  }
+}
+#endif
+
+void
+hsk_sha256_multi(
+  unsigned char *const *out,
+  const unsigned char *const *msg,
+  const size_t *size,
+  size_t count
+) {
+  size_t i = 0;
+
+  if (!hsk_sha256_transform)
+    hsk_sha256_select();
+
+#if defined(__GNUC__)
+  if (hsk_sha256_transform == hsk_sha256_transform_generic) {
+    for (; i + 4 <= count; i += 4)
+      hsk_sha256_multi_x4(&out[i], &msg[i], &size[i], 4);
+
+    if (i < count)
+      hsk_sha256_multi_x4(&out[i], &msg[i], &size[i], count - i);
+
+    return;
+  }
+#endif
+
+  for (; i < count; i++) {
+    hsk_sha256_ctx ctx;
+    hsk_sha256_init(&ctx);
+    hsk_sha256_update(&ctx, msg[i], size[i]);
+    hsk_sha256_final(&ctx, out[i]);
+  }
+}
@@ -19,6 +19,7 @@
 #ifndef _HSK_SHA_256_H
 #define _HSK_SHA_256_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -41,4 +42,25 @@ hsk_sha256_update(hsk_sha256_ctx *ctx, const unsigned char *msg, size_t size);
 void
 hsk_sha256_final(hsk_sha256_ctx *ctx, unsigned char *result);
 
+// Hash `count` independent messages. With a hardware backend they are
+// hashed one after another; otherwise four at a time in vector lanes.
+void
+hsk_sha256_multi(
+  unsigned char *const *out,
+  const unsigned char *const *msg,
+  const size_t *size,
+  size_t count
+);
+
+// Name of the compression function in use: "sha-ni", "armv8" or
+// "generic". The hardware ones are picked at runtime when the CPU has them.
+const char *
+hsk_sha256_backend(void);
+
+// Allow or disallow the hardware backends (allowed by default). Returns
+// whether one is now in use. For tests and benchmarks: it must not race
+// with hashing on another thread.
+bool
+hsk_sha256_use_hardware(bool enable);
+
 #endif
@@ -118,8 +118,13 @@ hsk_sig0_get_sig(
   return true;
 }
 
-bool
-hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
+static bool
+hsk_sig0_sighash_(
+  const uint8_t *wire,
+  size_t wire_len,
+  bool cover_id,
+  uint8_t *hash
+) {
   if (!hsk_sig0_has_sig(wire, wire_len))
     return false;
 
@@ -131,6 +136,9 @@ hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
   uint8_t count[2];
   set_u16be(&count[0], arcount - 1);
 
+  // Zeroed ID.
+  uint8_t id[2] = {0, 0};
+
   hsk_blake2b_ctx ctx;
   assert(hsk_blake2b_init(&ctx, 32) == 0);
 
@@ -138,7 +146,8 @@ hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
   hsk_blake2b_update(&ctx, &rd[0], 19);
 
   // Message header with decremented arcount.
-  hsk_blake2b_update(&ctx, &wire[0], 10);
+  hsk_blake2b_update(&ctx, cover_id ? &wire[0] : &id[0], 2);
+  hsk_blake2b_update(&ctx, &wire[2], 8);
   hsk_blake2b_update(&ctx, &count[0], 2);
 
   // Message body, stopping just before SIG record.
@@ -150,40 +159,32 @@ hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
 }
 
 bool
-hsk_sig0_sign(
-  const hsk_ec_t *ec,
-  const uint8_t *key,
-  const uint8_t *wire,
-  size_t wire_len,
-  uint8_t **out,
-  size_t *out_len
-) {
-  if (wire_len < 12)
-    return false;
+hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
+  return hsk_sig0_sighash_(wire, wire_len, true, hash);
+}
+
+bool
+hsk_sig0_sighash_noid(const uint8_t *wire, size_t wire_len, uint8_t *hash) {
+  return hsk_sig0_sighash_(wire, wire_len, false, hash);
+}
+
+size_t
+hsk_sig0_reserve(uint8_t *wire, size_t wire_len) {
+  assert(wire && wire_len >= 12);
 
   uint16_t arcount = get_u16be(&wire[10]);
   arcount += 1;
 
-  size_t o_len = wire_len + HSK_SIG0_RR_SIZE;
-
   // Overwrite sigs. Do not append.
   if (hsk_sig0_has_sig(wire, wire_len)) {
-    o_len -= HSK_SIG0_RR_SIZE;
     wire_len -= HSK_SIG0_RR_SIZE;
     arcount -= 1;
   }
 
-  uint8_t *o = malloc(o_len);
-
-  if (!o)
-    return false;
-
-  memcpy(o, wire, wire_len);
-
   // arcount + 1
-  set_u16be(&o[10], arcount);
+  set_u16be(&wire[10], arcount);
 
-  uint8_t *rr = &o[wire_len];
+  uint8_t *rr = &wire[wire_len];
   uint8_t *rd = &rr[11];
 
   // name = .
@@ -230,17 +231,59 @@ hsk_sig0_sign(
   // signature
   memset(&rd[19], 0, 64);
 
+  return wire_len + HSK_SIG0_RR_SIZE;
+}
+
+bool
+hsk_sig0_sign_inplace(
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  uint8_t *wire,
+  size_t wire_len,
+  size_t *out_len
+) {
+  if (wire_len < 12)
+    return false;
+
+  size_t o_len = hsk_sig0_reserve(wire, wire_len);
+
   uint8_t hash[32];
 
-  if (!hsk_sig0_sighash(o, o_len, hash)) {
-    free(o);
+  if (!hsk_sig0_sighash(wire, o_len, hash))
     return false;
-  }
 
-  uint8_t *sig = &rd[19];
+  uint8_t *sig = &wire[o_len - 64];
   int rec;
 
-  if (!hsk_ec_sign_msg(ec, key, hash, sig, &rec)) {
+  if (!hsk_ec_sign_msg(ec, key, hash, sig, &rec))
+    return false;
+
+  *out_len = o_len;
+
+  return true;
+}
+
+bool
+hsk_sig0_sign(
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  const uint8_t *wire,
+  size_t wire_len,
+  uint8_t **out,
+  size_t *out_len
+) {
+  if (wire_len < 12)
+    return false;
+
+  size_t o_len = 0;
+  uint8_t *o = malloc(wire_len + HSK_SIG0_RR_SIZE);
+
+  if (!o)
+    return false;
+
+  memcpy(o, wire, wire_len);
+
+  if (!hsk_sig0_sign_inplace(ec, key, o, wire_len, &o_len)) {
     free(o);
     return false;
   }
@@ -269,3 +312,22 @@ hsk_sig0_verify(
 
   return hsk_ec_verify_msg(ec, pubkey, hash, sig);
 }
+
+bool
+hsk_sig0_verify_noid(
+  const hsk_ec_t *ec,
+  const uint8_t *pubkey,
+  const uint8_t *wire,
+  size_t wire_len
+) {
+  uint8_t sig[64];
+  uint16_t tag;
+
+  if (!hsk_sig0_get_sig(wire, wire_len, sig, &tag))
+    return false;
+
+  uint8_t hash[32];
+  assert(hsk_sig0_sighash_noid(wire, wire_len, hash));
+
+  return hsk_ec_verify_msg(ec, pubkey, hash, sig);
+}
@@ -29,6 +29,29 @@ hsk_sig0_get_sig(
 bool
 hsk_sig0_sighash(const uint8_t *wire, size_t wire_len, uint8_t *hash);
 
+// Same as hsk_sig0_sighash(), but hashes the message ID as zero. Signatures
+// over this hash stay valid when the ID is rewritten, which lets a signed
+// answer be reused for other queries. See --sig0-no-id in daemon.c.
+bool
+hsk_sig0_sighash_noid(const uint8_t *wire, size_t wire_len, uint8_t *hash);
+
+// Write an unsigned SIG(0) record (zeroed signature) to the end of `wire`,
+// replacing an existing one. The buffer must have HSK_SIG0_RR_SIZE bytes of
+// spare capacity past wire_len. Returns the new message length.
+size_t
+hsk_sig0_reserve(uint8_t *wire, size_t wire_len);
+
+// Like hsk_sig0_sign(), but signs into the spare tail of `wire` instead of
+// allocating a copy.
+bool
+hsk_sig0_sign_inplace(
+  const hsk_ec_t *ec,
+  const uint8_t *key,
+  uint8_t *wire,
+  size_t wire_len,
+  size_t *out_len
+);
+
 bool
 hsk_sig0_sign(
   const hsk_ec_t *ec,
@@ -46,4 +69,12 @@ hsk_sig0_verify(
   const uint8_t *wire,
   size_t wire_len
 );
+
+bool
+hsk_sig0_verify_noid(
+  const hsk_ec_t *ec,
+  const uint8_t *pubkey,
+  const uint8_t *wire,
+  size_t wire_len
+);
 #endif
@@ -27,6 +27,10 @@ hsk_signals_init(hsk_signals_t *signals, uv_loop_t *loop, void *data,
 
   signals->cb_data = data;
   signals->cb_func = callback;
+  signals->sigint = NULL;
+  signals->sigterm = NULL;
+  signals->reload_func = NULL;
+  signals->sighup = NULL;
 
   signals->sigint = alloc_signal(signals, loop, SIGINT);
   if (!signals->sigint)
@@ -46,10 +50,12 @@ fail:
 
 void
 hsk_signals_uninit(hsk_signals_t *signals) {
+  free_signal(signals->sighup);
+  signals->sighup = NULL;
   free_signal(signals->sigterm);
   signals->sigterm = NULL;
   free_signal(signals->sigint);
-  signals->sigterm = NULL;
+  signals->sigint = NULL;
 }
 
 hsk_signals_t *
@@ -74,6 +80,24 @@ hsk_signals_free(hsk_signals_t *signals) {
   }
 }
 
+int
+hsk_signals_set_reload(hsk_signals_t *signals, void (*callback)(void *)) {
+  if (!signals || !callback || !signals->sigint)
+    return HSK_EBADARGS;
+
+  signals->reload_func = callback;
+
+  if (signals->sighup)
+    return HSK_SUCCESS;
+
+  signals->sighup = alloc_signal(signals, signals->sigint->loop, SIGHUP);
+
+  if (!signals->sighup)
+    return HSK_EFAILURE;
+
+  return HSK_SUCCESS;
+}
+
 static uv_signal_t *
 alloc_signal(hsk_signals_t *signals, uv_loop_t *loop, int signum) {
   // Allocate the signal
@@ -120,5 +144,11 @@ signal_handler(uv_signal_t *signal, int signum) {
 
   printf("signal: %d\n", signum);
 
+  if (signum == SIGHUP) {
+    if (signals->reload_func)
+      signals->reload_func(signals->cb_data);
+    return;
+  }
+
   signals->cb_func(signals->cb_data);
 }
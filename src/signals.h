@@ -15,6 +15,8 @@ typedef struct {
   void (*cb_func)(void *);
   uv_signal_t *sigint;
   uv_signal_t *sigterm;
+  void (*reload_func)(void *);
+  uv_signal_t *sighup;
 } hsk_signals_t;
 
 /*
@@ -37,4 +39,9 @@ hsk_signals_alloc(uv_loop_t *loop, void *data, void (*callback)());
 void
 hsk_signals_free(hsk_signals_t *signals);
 
+// Also call `callback` (with the same data) on SIGHUP.  This one should reload
+// the configuration rather than shut down.
+int
+hsk_signals_set_reload(hsk_signals_t *signals, void (*callback)(void *));
+
 #endif
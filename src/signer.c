@@ -0,0 +1,416 @@
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ec.h"
+#include "error.h"
+#include "sig0.h"
+#include "signer.h"
+#include "uv.h"
+#include "workers.h"
+
+/*
+ * Prototypes
+ */
+
+static void
+hsk_signer_refill(hsk_signer_t *signer);
+
+static void
+run_fill(void *arg);
+
+static void
+after_fill(void *arg, bool ok);
+
+static void
+run_sign(void *arg);
+
+static void
+after_sign(void *arg, bool ok);
+
+/*
+ * Signer
+ */
+
+int
+hsk_signer_init(hsk_signer_t *signer, const uv_loop_t *loop, const uint8_t *key) {
+  if (!signer || !loop || !key)
+    return HSK_EBADARGS;
+
+  signer->ec = NULL;
+  memcpy(signer->key, key, 32);
+  signer->offload = false;
+  signer->cover_id = true;
+  signer->nonce_count = 0;
+  signer->filling = false;
+  signer->waiting = 0;
+  signer->pooled = 0;
+  signer->fallback = 0;
+  signer->offloaded = 0;
+
+  signer->ec = hsk_ec_alloc();
+
+  if (!signer->ec)
+    return HSK_ENOMEM;
+
+  if (!hsk_ec_verify_privkey(signer->ec, key)) {
+    hsk_ec_free(signer->ec);
+    return HSK_EBADARGS;
+  }
+
+  if (uv_mutex_init(&signer->mutex) != 0) {
+    hsk_ec_free(signer->ec);
+    return HSK_EFAILURE;
+  }
+
+  int rc = hsk_workers_init(&signer->workers, loop);
+
+  if (rc != HSK_SUCCESS) {
+    uv_mutex_destroy(&signer->mutex);
+    hsk_ec_free(signer->ec);
+    return rc;
+  }
+
+  return HSK_SUCCESS;
+}
+
+void
+hsk_signer_uninit(hsk_signer_t *signer) {
+  if (!signer)
+    return;
+
+  // Can't destroy while the thread is running.
+  assert(!hsk_workers_is_open(&signer->workers));
+
+  hsk_workers_uninit(&signer->workers);
+
+  uv_mutex_destroy(&signer->mutex);
+
+  hsk_ec_free(signer->ec);
+  signer->ec = NULL;
+
+  memset(signer->key, 0x00, sizeof(signer->key));
+  memset(signer->nonces, 0x00, sizeof(signer->nonces));
+  signer->nonce_count = 0;
+}
+
+hsk_signer_t *
+hsk_signer_alloc(const uv_loop_t *loop, const uint8_t *key) {
+  hsk_signer_t *signer = malloc(sizeof(hsk_signer_t));
+
+  if (!signer)
+    return NULL;
+
+  if (hsk_signer_init(signer, loop, key) != HSK_SUCCESS) {
+    free(signer);
+    return NULL;
+  }
+
+  return signer;
+}
+
+void
+hsk_signer_free(hsk_signer_t *signer) {
+  if (!signer)
+    return;
+
+  hsk_signer_uninit(signer);
+  free(signer);
+}
+
+int
+hsk_signer_open(hsk_signer_t *signer) {
+  assert(signer);
+
+  if (hsk_workers_is_open(&signer->workers))
+    return HSK_SUCCESS;
+
+  int rc = hsk_workers_open(&signer->workers, 1);
+
+  if (rc != HSK_SUCCESS)
+    return rc;
+
+  hsk_signer_refill(signer);
+
+  return HSK_SUCCESS;
+}
+
+void
+hsk_signer_close(hsk_signer_t *signer) {
+  assert(signer);
+  hsk_workers_close(&signer->workers);
+}
+
+void
+hsk_signer_set_offload(hsk_signer_t *signer, bool offload) {
+  assert(signer);
+  signer->offload = offload;
+}
+
+void
+hsk_signer_set_cover_id(hsk_signer_t *signer, bool cover_id) {
+  assert(signer);
+  signer->cover_id = cover_id;
+}
+
+void
+hsk_signer_fill(hsk_signer_t *signer) {
+  assert(signer);
+
+  for (;;) {
+    hsk_ec_nonce_t nonce;
+
+    uv_mutex_lock(&signer->mutex);
+    bool full = signer->nonce_count == HSK_SIGNER_NONCES;
+    uv_mutex_unlock(&signer->mutex);
+
+    if (full)
+      break;
+
+    if (!hsk_ec_create_nonce(signer->ec, &nonce))
+      break;
+
+    uv_mutex_lock(&signer->mutex);
+    if (signer->nonce_count < HSK_SIGNER_NONCES)
+      signer->nonces[signer->nonce_count++] = nonce;
+    uv_mutex_unlock(&signer->mutex);
+
+    memset(&nonce, 0x00, sizeof(nonce));
+  }
+}
+
+bool
+hsk_signer_sign(hsk_signer_t *signer, const uint8_t *hash, uint8_t *sig) {
+  assert(signer && hash && sig);
+
+  hsk_ec_nonce_t nonce;
+  bool has_nonce = false;
+
+  uv_mutex_lock(&signer->mutex);
+
+  if (signer->nonce_count > 0) {
+    signer->nonce_count -= 1;
+    nonce = signer->nonces[signer->nonce_count];
+    memset(&signer->nonces[signer->nonce_count], 0x00, sizeof(nonce));
+    has_nonce = true;
+    signer->pooled += 1;
+  } else {
+    signer->fallback += 1;
+  }
+
+  bool low = signer->nonce_count < HSK_SIGNER_LOW_WATER;
+
+  uv_mutex_unlock(&signer->mutex);
+
+  if (low)
+    hsk_signer_refill(signer);
+
+  int rec;
+
+  if (has_nonce)
+    return hsk_ec_sign_msg_nonce(signer->ec, signer->key, hash, &nonce, sig, &rec);
+
+  return hsk_ec_sign_msg(signer->ec, signer->key, hash, sig, &rec);
+}
+
+bool
+hsk_signer_sign_wire(
+  hsk_signer_t *signer,
+  uint8_t *wire,
+  size_t wire_len,
+  size_t *out_len
+) {
+  assert(signer && wire && out_len);
+
+  if (wire_len < 12)
+    return false;
+
+  size_t o_len = hsk_sig0_reserve(wire, wire_len);
+
+  uint8_t hash[32];
+
+  bool ok = signer->cover_id
+    ? hsk_sig0_sighash(wire, o_len, hash)
+    : hsk_sig0_sighash_noid(wire, o_len, hash);
+
+  if (!ok)
+    return false;
+
+  if (!hsk_signer_sign(signer, hash, &wire[o_len - 64]))
+    return false;
+
+  *out_len = o_len;
+
+  return true;
+}
+
+bool
+hsk_signer_should_offload(hsk_signer_t *signer) {
+  assert(signer);
+
+  if (!signer->offload || !hsk_workers_is_open(&signer->workers))
+    return false;
+
+  uv_mutex_lock(&signer->mutex);
+  bool empty = signer->nonce_count == 0;
+  uv_mutex_unlock(&signer->mutex);
+
+  return empty;
+}
+
+int
+hsk_signer_submit(
+  hsk_signer_t *signer,
+  uint8_t *wire,
+  size_t wire_len,
+  hsk_signer_cb cb,
+  void *arg
+) {
+  assert(signer && wire && cb);
+
+  if (!hsk_workers_is_open(&signer->workers))
+    return HSK_EFAILURE;
+
+  hsk_signer_job_t *job = malloc(sizeof(hsk_signer_job_t));
+
+  if (!job)
+    return HSK_ENOMEM;
+
+  job->signer = signer;
+  job->wire = wire;
+  job->wire_len = wire_len;
+  job->ok = false;
+  job->cb = cb;
+  job->arg = arg;
+
+  // Counted first, so that a top-up in progress stops for it.
+  uv_mutex_lock(&signer->mutex);
+  signer->waiting += 1;
+  uv_mutex_unlock(&signer->mutex);
+
+  int rc = hsk_workers_queue(&signer->workers, run_sign, after_sign, job);
+
+  uv_mutex_lock(&signer->mutex);
+
+  if (rc == HSK_SUCCESS)
+    signer->offloaded += 1;
+  else
+    signer->waiting -= 1;
+
+  uv_mutex_unlock(&signer->mutex);
+
+  if (rc != HSK_SUCCESS)
+    free(job);
+
+  return rc;
+}
+
+// Queue a top-up unless one is already queued. Called from any thread.
+static void
+hsk_signer_refill(hsk_signer_t *signer) {
+  uv_mutex_lock(&signer->mutex);
+
+  bool queue = !signer->filling
+               && signer->nonce_count < HSK_SIGNER_LOW_WATER;
+
+  if (queue)
+    signer->filling = true;
+
+  uv_mutex_unlock(&signer->mutex);
+
+  if (!queue)
+    return;
+
+  // Not open, or closing.
+  if (hsk_workers_queue(&signer->workers, run_fill, after_fill,
+                        (void *)signer) != HSK_SUCCESS) {
+    uv_mutex_lock(&signer->mutex);
+    signer->filling = false;
+    uv_mutex_unlock(&signer->mutex);
+  }
+}
+
+/*
+ * Signing thread
+ */
+
+static void
+run_fill(void *arg) {
+  hsk_signer_t *signer = (hsk_signer_t *)arg;
+
+  uv_mutex_lock(&signer->mutex);
+
+  // Signing jobs take priority over topping up the pool. They come next,
+  // and the first one to find the pool low queues the rest of the top-up.
+  while (signer->nonce_count < HSK_SIGNER_NONCES && signer->waiting == 0) {
+    hsk_ec_nonce_t nonce;
+
+    uv_mutex_unlock(&signer->mutex);
+
+    bool ok = hsk_ec_create_nonce(signer->ec, &nonce);
+
+    uv_mutex_lock(&signer->mutex);
+
+    // Out of entropy. Try again on the next top-up.
+    if (!ok)
+      break;
+
+    if (signer->nonce_count < HSK_SIGNER_NONCES)
+      signer->nonces[signer->nonce_count++] = nonce;
+
+    memset(&nonce, 0x00, sizeof(nonce));
+  }
+
+  signer->filling = false;
+
+  uv_mutex_unlock(&signer->mutex);
+}
+
+static void
+after_fill(void *arg, bool ok) {
+  hsk_signer_t *signer = (hsk_signer_t *)arg;
+
+  // Closed before it ran.
+  if (!ok) {
+    uv_mutex_lock(&signer->mutex);
+    signer->filling = false;
+    uv_mutex_unlock(&signer->mutex);
+  }
+}
+
+static void
+run_sign(void *arg) {
+  hsk_signer_job_t *job = (hsk_signer_job_t *)arg;
+  hsk_signer_t *signer = job->signer;
+
+  uv_mutex_lock(&signer->mutex);
+  signer->waiting -= 1;
+  uv_mutex_unlock(&signer->mutex);
+
+  job->ok = hsk_signer_sign_wire(
+    signer,
+    job->wire,
+    job->wire_len,
+    &job->wire_len
+  );
+}
+
+static void
+after_sign(void *arg, bool ok) {
+  hsk_signer_job_t *job = (hsk_signer_job_t *)arg;
+  hsk_signer_t *signer = job->signer;
+
+  // Closed before it ran.
+  if (!ok) {
+    uv_mutex_lock(&signer->mutex);
+    signer->waiting -= 1;
+    uv_mutex_unlock(&signer->mutex);
+  }
+
+  job->cb(job->arg, ok && job->ok, job->wire, job->wire_len);
+  free(job);
+}
@@ -0,0 +1,147 @@
+#ifndef _HSK_SIGNER_H
+#define _HSK_SIGNER_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ec.h"
+#include "uv.h"
+#include "workers.h"
+
+/*
+ * Defs
+ */
+
+// Precomputed nonces kept ready for signing.
+#define HSK_SIGNER_NONCES 128
+
+// Have the signing thread top up the pool once it drops below this.
+#define HSK_SIGNER_LOW_WATER (HSK_SIGNER_NONCES / 2)
+
+/*
+ * Types
+ */
+
+// Receives ownership of `wire`. On success, wire_len includes the SIG(0)
+// record.
+typedef void (*hsk_signer_cb)(
+  void *arg,
+  bool ok,
+  uint8_t *wire,
+  size_t wire_len
+);
+
+typedef struct hsk_signer_job_s {
+  struct hsk_signer_s *signer;
+  uint8_t *wire;
+  size_t wire_len;
+  bool ok;
+  hsk_signer_cb cb;
+  void *arg;
+} hsk_signer_job_t;
+
+// SIG(0) signing pipeline.
+//
+// Recoverable ECDSA is dominated by the k*G point multiplication and the
+// inversion of k, neither of which depends on the message. The signer keeps a
+// bounded pool of precomputed (r, k^-1) pairs that a background thread tops
+// up, so signing on the event loop is reduced to a hash and two scalar
+// multiplications.
+//
+// Nonces are drawn from the system CSPRNG rather than RFC 6979, as they have
+// to exist before the message does. Each nonce is wiped as it's used.
+//
+// With offloading enabled, messages that would otherwise need a full signing
+// operation on the event loop (because the pool is empty) are handed to the
+// signing thread instead, and the result is delivered back to the loop.
+//
+// The signing thread is a pool of workers (see workers.h) with a single
+// thread, so that topping up the nonces and offloaded jobs run in order.
+typedef struct hsk_signer_s {
+  hsk_ec_t *ec;
+  uint8_t key[32];
+  bool offload;
+  bool cover_id;
+  hsk_workers_t workers;
+  // Everything below is protected by the mutex.
+  uv_mutex_t mutex;
+  hsk_ec_nonce_t nonces[HSK_SIGNER_NONCES];
+  size_t nonce_count;
+  // A top-up is queued or running.
+  bool filling;
+  // Offloaded jobs not yet run. A top-up stops for them.
+  size_t waiting;
+  // Stats
+  uint64_t pooled;
+  uint64_t fallback;
+  uint64_t offloaded;
+} hsk_signer_t;
+
+/*
+ * Signer
+ */
+
+int
+hsk_signer_init(hsk_signer_t *signer, const uv_loop_t *loop, const uint8_t *key);
+
+void
+hsk_signer_uninit(hsk_signer_t *signer);
+
+hsk_signer_t *
+hsk_signer_alloc(const uv_loop_t *loop, const uint8_t *key);
+
+void
+hsk_signer_free(hsk_signer_t *signer);
+
+// Start the nonce/signing thread.
+int
+hsk_signer_open(hsk_signer_t *signer);
+
+// Stop the thread. Queued jobs fail and their callbacks run synchronously.
+void
+hsk_signer_close(hsk_signer_t *signer);
+
+void
+hsk_signer_set_offload(hsk_signer_t *signer, bool offload);
+
+// Whether SIG(0) covers the message ID (the default). See
+// hsk_sig0_sighash_noid().
+void
+hsk_signer_set_cover_id(hsk_signer_t *signer, bool cover_id);
+
+// Fill the nonce pool on the calling thread.
+void
+hsk_signer_fill(hsk_signer_t *signer);
+
+// Sign a 32 byte hash. Uses a precomputed nonce when one is ready and falls
+// back to a regular RFC 6979 signature otherwise. Thread-safe.
+bool
+hsk_signer_sign(hsk_signer_t *signer, const uint8_t *hash, uint8_t *sig);
+
+// Sign a message prepared with hsk_dns_msg_prepare() in place.
+bool
+hsk_signer_sign_wire(
+  hsk_signer_t *signer,
+  uint8_t *wire,
+  size_t wire_len,
+  size_t *out_len
+);
+
+// Whether a message should go through hsk_signer_submit() rather than be
+// signed inline: offloading is on and no precomputed nonce is ready.
+bool
+hsk_signer_should_offload(hsk_signer_t *signer);
+
+// Queue a prepared message for the signing thread. The callback runs on the
+// event loop.
+int
+hsk_signer_submit(
+  hsk_signer_t *signer,
+  uint8_t *wire,
+  size_t wire_len,
+  hsk_signer_cb cb,
+  void *arg
+);
+#endif
@@ -237,3 +237,26 @@ hsk_uv_close_free(uv_handle_t *handle) {
   if (handle)
     uv_close(handle, after_close_free);
 }
+
+uv_udp_t *
+hsk_uv_udp_open(const uv_loop_t *loop, uv_os_sock_t sock) {
+  if (!loop)
+    return NULL;
+
+  uv_udp_t *socket = malloc(sizeof(uv_udp_t));
+
+  if (!socket)
+    return NULL;
+
+  if (uv_udp_init((uv_loop_t *)loop, socket) != 0) {
+    free(socket);
+    return NULL;
+  }
+
+  if (uv_udp_open(socket, sock) != 0) {
+    hsk_uv_close_free((uv_handle_t *)socket);
+    return NULL;
+  }
+
+  return socket;
+}
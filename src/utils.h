@@ -60,4 +60,10 @@ hsk_to_lower(char *name);
 void
 hsk_uv_close_free(uv_handle_t *handle);
 
+// Wrap an already bound UDP socket (passed in by socket activation or by a
+// previous process) in a handle on the loop. Returns NULL on failure, with
+// the socket left open.
+uv_udp_t *
+hsk_uv_udp_open(const uv_loop_t *loop, uv_os_sock_t sock);
+
 #endif
@@ -0,0 +1,313 @@
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "utils.h"
+#include "uv.h"
+#include "workers.h"
+
+/*
+ * Prototypes
+ */
+
+static void
+run_worker(void *arg);
+
+static void
+after_work_async(uv_async_t *async);
+
+static hsk_work_t *
+hsk_workers_pop_done(hsk_workers_t *workers);
+
+/*
+ * Workers
+ */
+
+int
+hsk_workers_init(hsk_workers_t *workers, const uv_loop_t *loop) {
+  if (!workers || !loop)
+    return HSK_EBADARGS;
+
+  workers->pending_head = NULL;
+  workers->pending_tail = NULL;
+  workers->done_head = NULL;
+  workers->done_tail = NULL;
+  workers->async = NULL;
+  workers->thread_count = 0;
+  workers->exit = true;
+  workers->queued = 0;
+  workers->completed = 0;
+
+  if (uv_mutex_init(&workers->mutex) != 0)
+    return HSK_EFAILURE;
+
+  if (uv_cond_init(&workers->cond) != 0) {
+    uv_mutex_destroy(&workers->mutex);
+    return HSK_EFAILURE;
+  }
+
+  workers->async = malloc(sizeof(uv_async_t));
+
+  if (!workers->async)
+    goto fail;
+
+  if (uv_async_init((uv_loop_t *)loop, workers->async, after_work_async) != 0) {
+    free(workers->async);
+    workers->async = NULL;
+    goto fail;
+  }
+
+  workers->async->data = (void *)workers;
+
+  return HSK_SUCCESS;
+
+fail:
+  uv_cond_destroy(&workers->cond);
+  uv_mutex_destroy(&workers->mutex);
+  return HSK_ENOMEM;
+}
+
+void
+hsk_workers_uninit(hsk_workers_t *workers) {
+  if (!workers)
+    return;
+
+  // Can't destroy while the threads are running.
+  assert(workers->thread_count == 0);
+  assert(!workers->pending_head && !workers->done_head);
+
+  if (workers->async) {
+    workers->async->data = NULL;
+    hsk_uv_close_free((uv_handle_t *)workers->async);
+    workers->async = NULL;
+  }
+
+  uv_cond_destroy(&workers->cond);
+  uv_mutex_destroy(&workers->mutex);
+}
+
+hsk_workers_t *
+hsk_workers_alloc(const uv_loop_t *loop) {
+  hsk_workers_t *workers = malloc(sizeof(hsk_workers_t));
+
+  if (!workers)
+    return NULL;
+
+  if (hsk_workers_init(workers, loop) != HSK_SUCCESS) {
+    free(workers);
+    return NULL;
+  }
+
+  return workers;
+}
+
+void
+hsk_workers_free(hsk_workers_t *workers) {
+  if (!workers)
+    return;
+
+  hsk_workers_uninit(workers);
+  free(workers);
+}
+
+int
+hsk_workers_open(hsk_workers_t *workers, int count) {
+  assert(workers);
+
+  if (count <= 0 || count > HSK_WORKERS_MAX)
+    return HSK_EBADARGS;
+
+  if (workers->thread_count > 0)
+    return HSK_SUCCESS;
+
+  uv_mutex_lock(&workers->mutex);
+  workers->exit = false;
+  uv_mutex_unlock(&workers->mutex);
+
+  int i;
+  for (i = 0; i < count; i++) {
+    if (uv_thread_create(&workers->threads[i], run_worker, (void *)workers) != 0)
+      break;
+
+    workers->thread_count += 1;
+  }
+
+  if (workers->thread_count != count) {
+    hsk_workers_close(workers);
+    return HSK_EFAILURE;
+  }
+
+  return HSK_SUCCESS;
+}
+
+void
+hsk_workers_close(hsk_workers_t *workers) {
+  assert(workers);
+
+  // Nothing more can be queued from here on.
+  uv_mutex_lock(&workers->mutex);
+  workers->exit = true;
+  uv_cond_broadcast(&workers->cond);
+  uv_mutex_unlock(&workers->mutex);
+
+  if (workers->thread_count > 0) {
+    int i;
+    for (i = 0; i < workers->thread_count; i++)
+      uv_thread_join(&workers->threads[i]);
+
+    workers->thread_count = 0;
+  }
+
+  // Deliver anything that finished but hasn't been
+  // picked up by the async yet, then fail the rest.
+  hsk_work_t *work;
+
+  while ((work = hsk_workers_pop_done(workers))) {
+    work->after(work->arg, true);
+    free(work);
+  }
+
+  uv_mutex_lock(&workers->mutex);
+  work = workers->pending_head;
+  workers->pending_head = NULL;
+  workers->pending_tail = NULL;
+  uv_mutex_unlock(&workers->mutex);
+
+  while (work) {
+    hsk_work_t *next = work->next;
+    work->after(work->arg, false);
+    free(work);
+    work = next;
+  }
+}
+
+bool
+hsk_workers_is_open(const hsk_workers_t *workers) {
+  return workers && workers->thread_count > 0;
+}
+
+int
+hsk_workers_queue(
+  hsk_workers_t *workers,
+  hsk_work_cb work_cb,
+  hsk_after_work_cb after_cb,
+  void *arg
+) {
+  assert(workers && work_cb && after_cb);
+
+  uv_mutex_lock(&workers->mutex);
+
+  if (workers->exit) {
+    uv_mutex_unlock(&workers->mutex);
+    return HSK_EFAILURE;
+  }
+
+  hsk_work_t *work = malloc(sizeof(hsk_work_t));
+
+  if (!work) {
+    uv_mutex_unlock(&workers->mutex);
+    return HSK_ENOMEM;
+  }
+
+  work->next = NULL;
+  work->work = work_cb;
+  work->after = after_cb;
+  work->arg = arg;
+
+  if (workers->pending_tail)
+    workers->pending_tail->next = work;
+  else
+    workers->pending_head = work;
+
+  workers->pending_tail = work;
+  workers->queued += 1;
+
+  uv_cond_signal(&workers->cond);
+  uv_mutex_unlock(&workers->mutex);
+
+  return HSK_SUCCESS;
+}
+
+static hsk_work_t *
+hsk_workers_pop_done(hsk_workers_t *workers) {
+  uv_mutex_lock(&workers->mutex);
+
+  hsk_work_t *work = workers->done_head;
+
+  if (work) {
+    workers->done_head = work->next;
+    if (!workers->done_head)
+      workers->done_tail = NULL;
+    work->next = NULL;
+  }
+
+  uv_mutex_unlock(&workers->mutex);
+
+  return work;
+}
+
+/*
+ * Worker threads
+ */
+
+static void
+run_worker(void *arg) {
+  hsk_workers_t *workers = (hsk_workers_t *)arg;
+
+  uv_mutex_lock(&workers->mutex);
+
+  while (!workers->exit) {
+    hsk_work_t *work = workers->pending_head;
+
+    if (!work) {
+      uv_cond_wait(&workers->cond, &workers->mutex);
+      continue;
+    }
+
+    workers->pending_head = work->next;
+    if (!workers->pending_head)
+      workers->pending_tail = NULL;
+    work->next = NULL;
+
+    uv_mutex_unlock(&workers->mutex);
+
+    work->work(work->arg);
+
+    uv_mutex_lock(&workers->mutex);
+
+    if (workers->done_tail)
+      workers->done_tail->next = work;
+    else
+      workers->done_head = work;
+
+    workers->done_tail = work;
+    workers->completed += 1;
+
+    // Safe to use from this thread: the async is
+    // not closed until the threads have been joined.
+    uv_async_send(workers->async);
+  }
+
+  uv_mutex_unlock(&workers->mutex);
+}
+
+static void
+after_work_async(uv_async_t *async) {
+  hsk_workers_t *workers = (hsk_workers_t *)async->data;
+
+  // Closed while an event was in flight.
+  if (!workers)
+    return;
+
+  // libuv coalesces calls to uv_async_send().
+  hsk_work_t *work;
+
+  while ((work = hsk_workers_pop_done(workers))) {
+    work->after(work->arg, true);
+    free(work);
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef _HSK_WORKERS_H
+#define _HSK_WORKERS_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "uv.h"
+
+/*
+ * Defs
+ */
+
+#define HSK_WORKERS_MAX 16
+
+/*
+ * Types
+ */
+
+// Runs on a worker thread.
+typedef void (*hsk_work_cb)(void *arg);
+
+// Runs on the event loop once the work is done. `ok` is false if the pool
+// was closed before the work got to run.
+typedef void (*hsk_after_work_cb)(void *arg, bool ok);
+
+typedef struct hsk_work_s {
+  struct hsk_work_s *next;
+  hsk_work_cb work;
+  hsk_after_work_cb after;
+  void *arg;
+} hsk_work_t;
+
+// A small pool of threads for CPU-bound work that shouldn't hold up the
+// event loop (proof verification, response building, signing). Work is run
+// on whichever thread picks it up first, and completions are handed back to
+// the loop through a uv_async_t in the order they finish.
+//
+// This is not libuv's threadpool (uv_queue_work), which is shared with file
+// system operations and getaddrinfo and sized once per process through
+// UV_THREADPOOL_SIZE. Proofs are verified here for every answer, so they get
+// threads of their own, sized by --threads, that a slow resolve or disk
+// can't hold up.
+typedef struct {
+  // Everything below is protected by the mutex.
+  uv_mutex_t mutex;
+  // Signaled when work is queued or on exit.
+  uv_cond_t cond;
+  // Work waiting for a thread.
+  hsk_work_t *pending_head;
+  hsk_work_t *pending_tail;
+  // Work waiting to be delivered on the event loop.
+  hsk_work_t *done_head;
+  hsk_work_t *done_tail;
+  uv_async_t *async;
+  uv_thread_t threads[HSK_WORKERS_MAX];
+  int thread_count;
+  bool exit;
+  // Stats
+  uint64_t queued;
+  uint64_t completed;
+} hsk_workers_t;
+
+/*
+ * Workers
+ */
+
+int
+hsk_workers_init(hsk_workers_t *workers, const uv_loop_t *loop);
+
+void
+hsk_workers_uninit(hsk_workers_t *workers);
+
+hsk_workers_t *
+hsk_workers_alloc(const uv_loop_t *loop);
+
+void
+hsk_workers_free(hsk_workers_t *workers);
+
+// Start `count` threads (at most HSK_WORKERS_MAX).
+int
+hsk_workers_open(hsk_workers_t *workers, int count);
+
+// Stop the threads. Finished work is delivered and queued work fails, with
+// the callbacks running synchronously.
+void
+hsk_workers_close(hsk_workers_t *workers);
+
+bool
+hsk_workers_is_open(const hsk_workers_t *workers);
+
+// Can be called from any thread, the work's own included. Fails once the
+// pool is closing.
+int
+hsk_workers_queue(
+  hsk_workers_t *workers,
+  hsk_work_cb work,
+  hsk_after_work_cb after,
+  void *arg
+);
+#endif
@@ -0,0 +1,13 @@
+// The 32-bit poly1305-donna variant under its own names, so bench_hnsd can
+// compare it with the others whichever one libhsk was built with.
+
+#define HSK_POLY1305_32BIT
+
+#define hsk_poly1305_init hsk_poly1305_32_init
+#define hsk_poly1305_update hsk_poly1305_32_update
+#define hsk_poly1305_finish hsk_poly1305_32_finish
+#define hsk_poly1305_auth hsk_poly1305_32_auth
+#define hsk_poly1305_verify hsk_poly1305_32_verify
+#define hsk_poly1305_power_on_self_test hsk_poly1305_32_power_on_self_test
+
+#include "poly1305.c"
@@ -0,0 +1,16 @@
+// The 64-bit poly1305-donna variant under its own names, so bench_hnsd can
+// compare it with the others whichever one libhsk was built with.
+
+// Needs a 128 bit integer type.
+#if defined(__SIZEOF_INT128__)
+#define HSK_POLY1305_64BIT
+
+#define hsk_poly1305_init hsk_poly1305_64_init
+#define hsk_poly1305_update hsk_poly1305_64_update
+#define hsk_poly1305_finish hsk_poly1305_64_finish
+#define hsk_poly1305_auth hsk_poly1305_64_auth
+#define hsk_poly1305_verify hsk_poly1305_64_verify
+#define hsk_poly1305_power_on_self_test hsk_poly1305_64_power_on_self_test
+
+#include "poly1305.c"
+#endif
@@ -0,0 +1,1568 @@
+#include "config.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "addr.h"
+#include "aead.h"
+#include "bio.h"
+#include "blake2b.h"
+#include "brontide.h"
+#include "chacha20.h"
+#include "chain.h"
+#include "dns.h"
+#include "ec.h"
+#include "ecc.h"
+#include "error.h"
+#include "hash.h"
+#include "header.h"
+#include "msg.h"
+#include "poly1305.h"
+#include "proof.h"
+#include "resource.h"
+#include "sha256.h"
+#include "sig0.h"
+#include "signer.h"
+#include "timedata.h"
+#include "uv.h"
+
+/*
+ * Harness
+ */
+
+#define HSK_BENCH_MAX_RESULTS 256
+#define HSK_BENCH_MAX_INFO 16
+
+typedef struct {
+  const char *name;
+  uint64_t start;
+  uint64_t allocs;
+} hsk_bench_t;
+
+typedef struct {
+  char name[64];
+  uint64_t ops;
+  uint64_t elapsed;
+  // Bytes processed per op (zero if not a throughput benchmark).
+  size_t size;
+  // Allocations per op (negative if not counted).
+  double allocs;
+} hsk_bench_result_t;
+
+typedef struct {
+  char key[32];
+  char value[64];
+} hsk_bench_info_t;
+
+// With --json the results are written to stdout as a single JSON document
+// once everything has run, and the usual table goes to stderr instead.
+static bool bench_json = false;
+static FILE *bench_out = NULL;
+static hsk_bench_result_t bench_results[HSK_BENCH_MAX_RESULTS];
+static int bench_result_count = 0;
+static hsk_bench_info_t bench_infos[HSK_BENCH_MAX_INFO];
+static int bench_info_count = 0;
+
+#ifdef HSK_BENCH_ALLOCS
+// The linker sends every malloc, calloc and realloc here (see Makefile.am).
+static uint64_t bench_allocs = 0;
+
+void *
+__real_malloc(size_t size);
+
+void *
+__real_calloc(size_t nmemb, size_t size);
+
+void *
+__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size) {
+  bench_allocs += 1;
+  return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size) {
+  bench_allocs += 1;
+  return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size) {
+  bench_allocs += 1;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+static uint64_t
+bench_alloc_count(void) {
+#ifdef HSK_BENCH_ALLOCS
+  return bench_allocs;
+#else
+  return 0;
+#endif
+}
+
+static void
+bench_log(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(bench_out, fmt, args);
+  va_end(args);
+}
+
+// Build or runtime configuration that affects the numbers.
+static void
+bench_info(const char *key, const char *fmt, ...) {
+  char value[64];
+  va_list args;
+
+  va_start(args, fmt);
+  vsnprintf(value, sizeof(value), fmt, args);
+  va_end(args);
+
+  bench_log("%s: %s\n", key, value);
+
+  for (int i = 0; i < bench_info_count; i++) {
+    if (strcmp(bench_infos[i].key, key) == 0)
+      return;
+  }
+
+  if (bench_info_count == HSK_BENCH_MAX_INFO)
+    return;
+
+  hsk_bench_info_t *info = &bench_infos[bench_info_count++];
+  snprintf(info->key, sizeof(info->key), "%s", key);
+  snprintf(info->value, sizeof(info->value), "%s", value);
+}
+
+static hsk_bench_result_t *
+bench_record(const char *name, uint64_t ops, uint64_t elapsed, size_t size) {
+  double sec = (double)elapsed / 1e9;
+
+  bench_log("%-40s %12.0f ops/sec %10.3f us/op\n",
+            name,
+            (double)ops / sec,
+            ((double)elapsed / 1e3) / (double)ops);
+
+  if (size > 0) {
+    bench_log("%-40s %12.1f MB/s\n", "",
+              ((double)size * ops) / ((double)elapsed / 1e3));
+  }
+
+  if (bench_result_count == HSK_BENCH_MAX_RESULTS)
+    return NULL;
+
+  hsk_bench_result_t *res = &bench_results[bench_result_count++];
+  snprintf(res->name, sizeof(res->name), "%s", name);
+  res->ops = ops;
+  res->elapsed = elapsed;
+  res->size = size;
+  res->allocs = -1;
+
+  return res;
+}
+
+// Allocations made by the ops of a result, where they can be counted.
+static void
+bench_record_allocs(hsk_bench_result_t *res, uint64_t allocs, uint64_t ops) {
+#ifdef HSK_BENCH_ALLOCS
+  double per = (double)allocs / (double)ops;
+
+  bench_log("%-40s %12.2f allocs/op\n", "", per);
+
+  if (res)
+    res->allocs = per;
+#endif
+}
+
+static void
+bench_start(hsk_bench_t *bench, const char *name) {
+  bench->name = name;
+  bench->allocs = bench_alloc_count();
+  bench->start = uv_hrtime();
+}
+
+static void
+bench_end(hsk_bench_t *bench, uint64_t ops) {
+  bench_record(bench->name, ops, uv_hrtime() - bench->start, 0);
+}
+
+static void
+bench_end_bytes(hsk_bench_t *bench, uint64_t ops, size_t size) {
+  bench_record(bench->name, ops, uv_hrtime() - bench->start, size);
+}
+
+static void
+bench_end_allocs(hsk_bench_t *bench, uint64_t ops) {
+  uint64_t elapsed = uv_hrtime() - bench->start;
+  uint64_t allocs = bench_alloc_count() - bench->allocs;
+
+  bench_record_allocs(bench_record(bench->name, ops, elapsed, 0), allocs, ops);
+}
+
+static void
+bench_json_string(const char *str) {
+  putchar('"');
+
+  for (const char *s = str; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      putchar('\\');
+    putchar(*s);
+  }
+
+  putchar('"');
+}
+
+static void
+bench_json_write(void) {
+  printf("{\n");
+  printf("  \"version\": ");
+  bench_json_string(PACKAGE_VERSION);
+  printf(",\n");
+
+  printf("  \"info\": {");
+
+  for (int i = 0; i < bench_info_count; i++) {
+    printf(i == 0 ? "\n    " : ",\n    ");
+    bench_json_string(bench_infos[i].key);
+    printf(": ");
+    bench_json_string(bench_infos[i].value);
+  }
+
+  printf("\n  },\n");
+  printf("  \"results\": [");
+
+  for (int i = 0; i < bench_result_count; i++) {
+    hsk_bench_result_t *res = &bench_results[i];
+    double ns = (double)res->elapsed / (double)res->ops;
+
+    printf(i == 0 ? "\n    {" : ",\n    {");
+    printf("\"name\": ");
+    bench_json_string(res->name);
+    printf(", \"ops\": %llu", (unsigned long long)res->ops);
+    printf(", \"ns_per_op\": %.3f", ns);
+    printf(", \"ops_per_sec\": %.1f", 1e9 / ns);
+
+    if (res->size > 0)
+      printf(", \"mb_per_sec\": %.1f", ((double)res->size * 1e3) / ns);
+
+    if (res->allocs >= 0)
+      printf(", \"allocs_per_op\": %.2f", res->allocs);
+
+    printf("}");
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/*
+ * SIG(0)
+ */
+
+static const uint8_t bench_key[32] = {
+  0x8d, 0x3a, 0x8f, 0x5e, 0x3a, 0x92, 0x5b, 0x0c,
+  0x71, 0x1f, 0x4e, 0x1c, 0x6e, 0xd4, 0x09, 0x5f,
+  0x2b, 0x3d, 0x11, 0x9a, 0x04, 0xbf, 0x7a, 0x60,
+  0x13, 0x55, 0xe2, 0x8c, 0x2e, 0x47, 0x91, 0x0a
+};
+
+static void
+bench_sig0(void) {
+  const int n = 2000;
+  hsk_bench_t bench;
+
+  hsk_ec_t *ec = hsk_ec_alloc();
+  assert(ec);
+
+  uint8_t pub[33];
+  assert(hsk_ec_create_pubkey(ec, bench_key, pub));
+
+  // A typical response: the root NS referral.
+  hsk_addr_t ip;
+  assert(hsk_addr_from_string(&ip, "127.0.0.1", 0));
+
+  hsk_dns_msg_t *msg = hsk_resource_root(HSK_DNS_NS, &ip);
+  assert(msg);
+
+  uint8_t *data;
+  size_t data_len;
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+  hsk_dns_msg_free(msg);
+
+  uint8_t *wire = malloc(data_len + HSK_SIG0_RR_SIZE);
+  assert(wire);
+
+  size_t wire_len;
+
+  // Baseline: copy + RFC 6979 signature.
+  bench_start(&bench, "sig0: sign (malloc, rfc6979)");
+  for (int i = 0; i < n; i++) {
+    uint8_t *out;
+    size_t out_len;
+    assert(hsk_sig0_sign(ec, bench_key, data, data_len, &out, &out_len));
+    free(out);
+  }
+  bench_end(&bench, n);
+
+  // In place, RFC 6979.
+  memcpy(wire, data, data_len);
+  bench_start(&bench, "sig0: sign (in place, rfc6979)");
+  for (int i = 0; i < n; i++)
+    assert(hsk_sig0_sign_inplace(ec, bench_key, wire, data_len, &wire_len));
+  bench_end(&bench, n);
+
+  assert(hsk_sig0_verify(ec, pub, wire, wire_len));
+
+  // Nonce precomputation (the work the signing thread does).
+  bench_start(&bench, "sig0: nonce precompute");
+  for (int i = 0; i < n; i++) {
+    hsk_ec_nonce_t nonce;
+    assert(hsk_ec_create_nonce(ec, &nonce));
+  }
+  bench_end(&bench, n);
+
+  // In place, pooled nonces. Refill outside the timer.
+  uv_loop_t *loop = uv_default_loop();
+  hsk_signer_t *signer = hsk_signer_alloc(loop, bench_key);
+  assert(signer);
+
+  uint64_t elapsed = 0;
+  int done = 0;
+
+  while (done < n) {
+    hsk_signer_fill(signer);
+
+    uint64_t start = uv_hrtime();
+
+    for (int i = 0; i < HSK_SIGNER_NONCES && done < n; i++, done++) {
+      memcpy(wire, data, data_len);
+      assert(hsk_signer_sign_wire(signer, wire, data_len, &wire_len));
+    }
+
+    elapsed += uv_hrtime() - start;
+  }
+
+  assert(hsk_sig0_verify(ec, pub, wire, wire_len));
+  assert(signer->fallback == 0);
+
+  bench_record("sig0: sign (in place, pooled nonce)", n, elapsed, 0);
+
+  // Sustained, with the signing thread topping up the pool.
+  assert(hsk_signer_open(signer) == 0);
+  hsk_signer_fill(signer);
+
+  signer->pooled = 0;
+  signer->fallback = 0;
+
+  bench_start(&bench, "sig0: sign (in place, signing thread)");
+  for (int i = 0; i < n; i++) {
+    memcpy(wire, data, data_len);
+    assert(hsk_signer_sign_wire(signer, wire, data_len, &wire_len));
+  }
+  bench_end(&bench, n);
+
+  bench_log("  pooled=%llu fallback=%llu\n",
+            (unsigned long long)signer->pooled,
+            (unsigned long long)signer->fallback);
+
+  hsk_signer_close(signer);
+  hsk_signer_free(signer);
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  free(wire);
+  free(data);
+  hsk_ec_free(ec);
+}
+
+/*
+ * Urkel Proofs
+ */
+
+static uint32_t bench_seed = 0x12345678;
+
+static uint32_t
+bench_rand(void) {
+  // xorshift32
+  bench_seed ^= bench_seed << 13;
+  bench_seed ^= bench_seed >> 17;
+  bench_seed ^= bench_seed << 5;
+  return bench_seed;
+}
+
+static void
+bench_rand_bytes(uint8_t *out, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    out[i] = (uint8_t)bench_rand();
+}
+
+static bool
+bench_bit(const uint8_t *key, int i) {
+  return (key[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static void
+bench_hash_node(
+  const uint8_t *prefix,
+  uint16_t prefix_size,
+  const uint8_t *left,
+  const uint8_t *right,
+  uint8_t *out
+) {
+  hsk_blake2b_ctx ctx;
+  assert(hsk_blake2b_init(&ctx, 32) == 0);
+
+  if (prefix_size == 0) {
+    hsk_blake2b_update(&ctx, "\x01", 1);
+  } else {
+    uint8_t size[2] = { prefix_size & 0xff, prefix_size >> 8 };
+    hsk_blake2b_update(&ctx, "\x02", 1);
+    hsk_blake2b_update(&ctx, size, 2);
+    hsk_blake2b_update(&ctx, prefix, (prefix_size + 7) / 8);
+  }
+
+  hsk_blake2b_update(&ctx, left, 32);
+  hsk_blake2b_update(&ctx, right, 32);
+  assert(hsk_blake2b_final(&ctx, out, 32) == 0);
+}
+
+// Build an existence proof shaped like one from mainnet: a couple dozen
+// nodes, a few of them with short prefixes, and a namestate value. The root
+// is computed with the streaming BLAKE2b, independently of the verifier.
+static void
+bench_make_proof(hsk_proof_t *proof, uint8_t *key, uint8_t *root) {
+  const int count = 24;
+
+  hsk_proof_init(proof);
+  bench_rand_bytes(key, 32);
+
+  proof->type = HSK_PROOF_EXISTS;
+  proof->nodes = calloc(count, sizeof(hsk_proof_node_t));
+  assert(proof->nodes);
+  proof->node_count = count;
+
+  int bit = 0;
+
+  for (int i = 0; i < count; i++) {
+    hsk_proof_node_t *node = &proof->nodes[i];
+    uint16_t size = (bench_rand() % 8) == 0 ? 1 + bench_rand() % 4 : 0;
+
+    for (int j = 0; j < size; j++) {
+      if (bench_bit(key, bit + j))
+        node->prefix[j >> 3] |= 1 << (7 - (j & 7));
+    }
+
+    node->prefix_size = size;
+    bench_rand_bytes(node->node, 32);
+
+    bit += size + 1;
+  }
+
+  proof->depth = bit;
+
+  // name_size, name, res_size, res
+  uint8_t name[] = "handshake";
+  size_t name_len = sizeof(name) - 1;
+  uint16_t res_size = 96;
+
+  proof->value_size = 1 + name_len + 2 + res_size + 40;
+  proof->value = malloc(proof->value_size);
+  assert(proof->value);
+
+  bench_rand_bytes(proof->value, proof->value_size);
+  proof->value[0] = name_len;
+  memcpy(&proof->value[1], name, name_len);
+  proof->value[1 + name_len] = res_size & 0xff;
+  proof->value[2 + name_len] = res_size >> 8;
+
+  uint8_t hash[32];
+  uint8_t next[32];
+
+  assert(hsk_blake2b(hash, 32, proof->value, proof->value_size, NULL, 0) == 0);
+
+  hsk_blake2b_ctx ctx;
+  assert(hsk_blake2b_init(&ctx, 32) == 0);
+  hsk_blake2b_update(&ctx, "\x00", 1);
+  hsk_blake2b_update(&ctx, key, 32);
+  hsk_blake2b_update(&ctx, hash, 32);
+  assert(hsk_blake2b_final(&ctx, next, 32) == 0);
+
+  for (int i = count - 1; i >= 0; i--) {
+    hsk_proof_node_t *node = &proof->nodes[i];
+
+    bit -= 1;
+
+    if (bench_bit(key, bit))
+      bench_hash_node(node->prefix, node->prefix_size, node->node, next, next);
+    else
+      bench_hash_node(node->prefix, node->prefix_size, next, node->node, next);
+
+    bit -= node->prefix_size;
+  }
+
+  assert(bit == 0);
+
+  memcpy(root, next, 32);
+}
+
+static void
+bench_proof(void) {
+  const int count = 256;
+  const int rounds = 20;
+  hsk_bench_t bench;
+
+  // Node hashing.
+  const int n = 1000000;
+  uint8_t node[65];
+  uint8_t out[32];
+
+  bench_rand_bytes(node, sizeof(node));
+
+  bench_start(&bench, "blake2b-256: 65 bytes (streaming)");
+  for (int i = 0; i < n; i++)
+    hsk_blake2b(out, 32, node, sizeof(node), NULL, 0);
+  bench_end(&bench, n);
+
+  bench_start(&bench, "blake2b-256: 65 bytes (single block)");
+  for (int i = 0; i < n; i++)
+    hsk_blake2b_256_block(out, node, sizeof(node));
+  bench_end(&bench, n);
+
+  {
+    uint8_t outs[4][32];
+    uint8_t *o[4] = { outs[0], outs[1], outs[2], outs[3] };
+    const uint8_t *in[4] = { node, node, node, node };
+    const size_t len[4] = { 65, 65, 65, 65 };
+
+    bench_start(&bench, "blake2b-256: 65 bytes (4-lane)");
+    for (int i = 0; i < n; i += 4)
+      hsk_blake2b_256_block_x4(o, in, len);
+    bench_end(&bench, n);
+  }
+
+  // Proof verification.
+  hsk_proof_t *proofs = malloc(count * sizeof(hsk_proof_t));
+  uint8_t (*keys)[32] = malloc(count * 32);
+  uint8_t (*roots)[32] = malloc(count * 32);
+  hsk_proof_job_t *jobs = malloc(count * sizeof(hsk_proof_job_t));
+
+  assert(proofs && keys && roots && jobs);
+
+  for (int i = 0; i < count; i++)
+    bench_make_proof(&proofs[i], keys[i], roots[i]);
+
+  bench_start(&bench, "proof: verify");
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < count; i++) {
+      bool exists;
+      uint8_t *data;
+      size_t data_len;
+
+      int rc = hsk_proof_verify(roots[i], keys[i], &proofs[i],
+                                &exists, &data, &data_len);
+
+      assert(rc == HSK_EPROOFOK && exists);
+      free(data);
+    }
+  }
+  bench_end(&bench, count * rounds);
+
+  bench_start(&bench, "proof: verify (batch)");
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < count; i++) {
+      jobs[i].root = roots[i];
+      jobs[i].key = keys[i];
+      jobs[i].proof = &proofs[i];
+    }
+
+    hsk_proof_verify_batch(jobs, count);
+
+    for (int i = 0; i < count; i++) {
+      assert(jobs[i].result == HSK_EPROOFOK && jobs[i].exists);
+      free(jobs[i].data);
+    }
+  }
+  bench_end(&bench, count * rounds);
+
+  for (int i = 0; i < count; i++)
+    hsk_proof_uninit(&proofs[i]);
+
+  free(proofs);
+  free(keys);
+  free(roots);
+  free(jobs);
+}
+
+/*
+ * secp256k1
+ */
+
+static void
+bench_ec(void) {
+  const int n = 2000;
+  hsk_bench_t bench;
+
+  bench_info("secp256k1", "gen precision=%d window=%d field=%s",
+             HSK_ECMULT_GEN_PREC_BITS,
+             HSK_ECMULT_WINDOW_SIZE,
+#if defined(HSK_USE_FIELD_5X52_ASM)
+             "5x52 (x86_64 asm)"
+#elif defined(HSK_USE_FIELD_5X52)
+             "5x52 (int128)"
+#else
+             "10x26"
+#endif
+  );
+
+  bench_start(&bench, "ec: context create");
+  for (int i = 0; i < 20; i++)
+    hsk_ec_free(hsk_ec_alloc());
+  bench_end(&bench, 20);
+
+  hsk_ec_t *ec = hsk_ec_alloc();
+  assert(ec);
+
+  uint8_t key[32];
+  uint8_t pub[33];
+  uint8_t other[33];
+  uint8_t msg[32];
+  uint8_t sig[64];
+  uint8_t secret[32];
+  int rec;
+
+  memcpy(key, bench_key, 32);
+  memset(msg, 0xaa, 32);
+
+  bench_start(&bench, "ec: pubkey create");
+  for (int i = 0; i < n; i++) {
+    assert(hsk_ec_create_pubkey(ec, key, pub));
+    key[0] ^= pub[1];
+  }
+  bench_end(&bench, n);
+
+  memcpy(key, bench_key, 32);
+  assert(hsk_ec_create_pubkey(ec, key, pub));
+
+  bench_start(&bench, "ec: sign");
+  for (int i = 0; i < n; i++) {
+    assert(hsk_ec_sign_msg(ec, key, msg, sig, &rec));
+    msg[0] ^= sig[0];
+  }
+  bench_end(&bench, n);
+
+  assert(hsk_ec_sign_msg(ec, key, msg, sig, &rec));
+
+  bench_start(&bench, "ec: verify");
+  for (int i = 0; i < n; i++)
+    assert(hsk_ec_verify_msg(ec, pub, msg, sig));
+  bench_end(&bench, n);
+
+  bench_start(&bench, "ec: recover");
+  for (int i = 0; i < n; i++)
+    assert(hsk_ec_recover(ec, msg, sig, rec, other));
+  bench_end(&bench, n);
+
+  assert(memcmp(other, pub, 33) == 0);
+
+  bench_start(&bench, "ec: ecdh");
+  for (int i = 0; i < n; i++)
+    assert(hsk_ec_ecdh(ec, pub, key, secret));
+  bench_end(&bench, n);
+
+  hsk_ec_free(ec);
+
+  // P-256, for the DNSSEC zone signatures.
+  uint8_t p256_pub[HSK_ECC_BYTES + 1];
+
+  assert(hsk_ecc_make_pubkey_compressed(bench_key, p256_pub));
+
+  bench_start(&bench, "p256: sign");
+  for (int i = 0; i < n; i++) {
+    assert(hsk_ecc_sign(bench_key, msg, sig));
+    msg[0] ^= sig[0];
+  }
+  bench_end(&bench, n);
+
+  assert(hsk_ecc_sign(bench_key, msg, sig));
+
+  bench_start(&bench, "p256: verify");
+  for (int i = 0; i < n; i++)
+    assert(hsk_ecc_verify(p256_pub, msg, sig));
+  bench_end(&bench, n);
+}
+
+/*
+ * Brontide
+ */
+
+static void
+bench_frame(hsk_cs_t *cs, const char *name, size_t size, int n) {
+  hsk_bench_t bench;
+  uint8_t *data = malloc(size);
+  uint8_t *out = malloc(hsk_brontide_frame_size(size));
+  uint8_t len[4] = { 0 };
+
+  assert(data && out);
+  memset(data, 0x11, size);
+
+  // Same work as hsk_brontide_seal(): two messages per frame.
+  bench_start(&bench, name);
+  for (int i = 0; i < n; i++) {
+    hsk_cs_encrypt(cs, NULL, len, &out[0], 4);
+    memcpy(&out[4], cs->tag, 16);
+    hsk_cs_encrypt(cs, NULL, data, &out[20], size);
+    memcpy(&out[20 + size], cs->tag, 16);
+  }
+  bench_end(&bench, n);
+
+  free(data);
+  free(out);
+}
+
+static void
+bench_brontide(void) {
+  const int n = 200000;
+  hsk_bench_t bench;
+  hsk_aead_t aead;
+  hsk_aead_key_t key;
+  uint8_t iv[12] = { 0 };
+  uint8_t tag[16];
+
+  hsk_aead_init(&aead);
+  hsk_aead_key_init(&key, bench_key);
+
+  bench_start(&bench, "aead: setup (raw key)");
+  for (int i = 0; i < n; i++) {
+    iv[4] = i;
+    hsk_aead_setup(&aead, bench_key, iv);
+    hsk_aead_final(&aead, tag);
+  }
+  bench_end(&bench, n);
+
+  bench_start(&bench, "aead: setup (expanded key)");
+  for (int i = 0; i < n; i++) {
+    iv[4] = i;
+    hsk_aead_setup_key(&aead, &key, iv);
+    hsk_aead_final(&aead, tag);
+  }
+  bench_end(&bench, n);
+
+  hsk_cs_t cs;
+  hsk_cs_init(&cs);
+  hsk_cs_init_saltkey(&cs, bench_key, bench_key);
+
+  bench_frame(&cs, "brontide: frame 64 bytes", 64, n);
+  bench_frame(&cs, "brontide: frame 1 KB", 1024, n / 4);
+  bench_frame(&cs, "brontide: frame 64 KB", 65536, n / 200);
+
+  bench_start(&bench, "brontide: rotate key");
+  for (int i = 0; i < n / 10; i++)
+    hsk_cs_rotate_key(&cs);
+  bench_end(&bench, n / 10);
+}
+
+/*
+ * Hashes
+ */
+
+static void
+bench_size_name(char *name, size_t len, const char *prefix, size_t size) {
+  if (size >= 1024)
+    snprintf(name, len, "%s: %zu KB", prefix, size / 1024);
+  else
+    snprintf(name, len, "%s: %zu bytes", prefix, size);
+}
+
+typedef void (*bench_hash_fn)(const uint8_t *data, size_t len, uint8_t *hash);
+
+static void
+bench_hash_size(const char *prefix, bench_hash_fn fn, size_t size, int n) {
+  hsk_bench_t bench;
+  uint8_t *data = malloc(size);
+  uint8_t hash[64];
+  char name[64];
+
+  assert(data);
+  memset(data, 0x42, size);
+
+  bench_size_name(name, sizeof(name), prefix, size);
+
+  bench_start(&bench, name);
+  for (int i = 0; i < n; i++) {
+    fn(data, size, hash);
+    data[0] ^= hash[0];
+  }
+  bench_end_bytes(&bench, n, size);
+
+  free(data);
+}
+
+static void
+bench_hmac(const uint8_t *data, size_t len, uint8_t *hash) {
+  hsk_hash_sha256_hmac(data, len, bench_key, 32, hash);
+}
+
+static void
+bench_hash(void) {
+  hsk_bench_t bench;
+
+  bench_hash_size("blake2b-256", hsk_hash_blake256, 64, 500000);
+  bench_hash_size("blake2b-256", hsk_hash_blake256, 1024, 100000);
+  bench_hash_size("blake2b-256", hsk_hash_blake256, 16384, 5000);
+  bench_hash_size("blake2b-512", hsk_hash_blake512, 1024, 100000);
+
+  bench_hash_size("sha3-256", hsk_hash_sha3, 64, 500000);
+  bench_hash_size("sha3-256", hsk_hash_sha3, 1024, 50000);
+  bench_hash_size("sha3-256", hsk_hash_sha3, 16384, 5000);
+
+  bench_hash_size("hmac-sha256", bench_hmac, 64, 200000);
+  bench_hash_size("hmac-sha256", bench_hmac, 1024, 50000);
+
+  const int n = 100000;
+  uint8_t h1[32];
+  uint8_t h2[32];
+
+  memcpy(h1, bench_key, 32);
+
+  bench_start(&bench, "hkdf-sha256: expand 2x32");
+  for (int i = 0; i < n; i++)
+    hsk_hash_hkdf(h1, 32, bench_key, 32, (uint8_t *)"hns", 3, h1, h2);
+  bench_end(&bench, n);
+}
+
+/*
+ * SHA-256
+ */
+
+static void
+bench_sha256(void) {
+  // Roughly the size of an RRset being signed or verified.
+  const int count = 256;
+  const size_t rrset = 200;
+  hsk_bench_t bench;
+  uint8_t *data = malloc(count * rrset);
+  uint8_t *hashes = malloc(count * 32);
+  uint8_t *out[256];
+  const uint8_t *msg[256];
+  size_t size[256];
+  char prefix[32];
+  char name[64];
+
+  assert(data && hashes);
+
+  for (int i = 0; i < count * rrset; i++)
+    data[i] = (uint8_t)bench_rand();
+
+  for (int i = 0; i < count; i++) {
+    out[i] = &hashes[i * 32];
+    msg[i] = &data[i * rrset];
+    size[i] = rrset - (i & 15);
+  }
+
+  for (int hw = 1; hw >= 0; hw--) {
+    if (!hsk_sha256_use_hardware(hw == 1) && hw == 1)
+      continue;
+
+    const char *backend = hsk_sha256_backend();
+
+    if (hw == 1)
+      bench_info("sha256", "%s", backend);
+
+    snprintf(prefix, sizeof(prefix), "sha256 (%s)", backend);
+
+    bench_hash_size(prefix, hsk_hash_sha256, 64, 500000);
+    bench_hash_size(prefix, hsk_hash_sha256, 1024, 100000);
+    bench_hash_size(prefix, hsk_hash_sha256, 16384, 5000);
+
+    snprintf(name, sizeof(name), "%s: 256 rrsets, one by one", prefix);
+    bench_start(&bench, name);
+    for (int j = 0; j < 200; j++) {
+      for (int i = 0; i < count; i++)
+        hsk_hash_sha256(msg[i], size[i], out[i]);
+    }
+    bench_end(&bench, 200 * count);
+
+    snprintf(name, sizeof(name), "%s: 256 rrsets, multi", prefix);
+    bench_start(&bench, name);
+    for (int j = 0; j < 200; j++)
+      hsk_sha256_multi(out, msg, size, count);
+    bench_end(&bench, 200 * count);
+  }
+
+  hsk_sha256_use_hardware(true);
+
+  free(data);
+  free(hashes);
+}
+
+/*
+ * ChaCha20 / Poly1305
+ */
+
+// Every poly1305-donna variant, built under its own prefix by
+// test/bench-poly1305-*.c.
+#define BENCH_POLY1305(bits)                         \
+  void                                               \
+  hsk_poly1305_##bits##_auth(                        \
+    unsigned char mac[16],                           \
+    const unsigned char *m,                          \
+    size_t bytes,                                    \
+    const unsigned char key[32]                      \
+  );                                                 \
+                                                     \
+  int                                                \
+  hsk_poly1305_##bits##_power_on_self_test(void);
+
+BENCH_POLY1305(8)
+BENCH_POLY1305(16)
+BENCH_POLY1305(32)
+#if defined(__SIZEOF_INT128__)
+BENCH_POLY1305(64)
+#endif
+
+typedef void (*bench_mac_fn)(
+  unsigned char mac[16],
+  const unsigned char *m,
+  size_t bytes,
+  const unsigned char key[32]
+);
+
+static void
+bench_chacha20_size(size_t size, int n) {
+  hsk_bench_t bench;
+  hsk_chacha20_ctx ctx;
+  uint8_t nonce[12] = { 0 };
+  uint8_t *data = malloc(size);
+  char name[64];
+
+  assert(data);
+  memset(data, 0x42, size);
+
+  hsk_chacha20_setup(&ctx, bench_key, 32, nonce, sizeof(nonce));
+
+  bench_size_name(name, sizeof(name), "chacha20", size);
+
+  bench_start(&bench, name);
+  for (int i = 0; i < n; i++)
+    hsk_chacha20_encrypt(&ctx, data, data, size);
+  bench_end_bytes(&bench, n, size);
+
+  free(data);
+}
+
+static void
+bench_poly1305_size(const char *prefix, bench_mac_fn fn, size_t size, int n) {
+  hsk_bench_t bench;
+  uint8_t *data = malloc(size);
+  uint8_t mac[16];
+  char name[64];
+
+  assert(data);
+  memset(data, 0x42, size);
+
+  bench_size_name(name, sizeof(name), prefix, size);
+
+  bench_start(&bench, name);
+  for (int i = 0; i < n; i++) {
+    fn(mac, data, size, bench_key);
+    data[0] ^= mac[0];
+  }
+  bench_end_bytes(&bench, n, size);
+
+  free(data);
+}
+
+static void
+bench_aead_size(size_t size, int n) {
+  hsk_bench_t bench;
+  hsk_aead_t aead;
+  hsk_aead_key_t key;
+  uint8_t iv[12] = { 0 };
+  uint8_t *data = malloc(size);
+  uint8_t tag[16];
+  char name[64];
+
+  assert(data);
+  memset(data, 0x42, size);
+
+  hsk_aead_init(&aead);
+  hsk_aead_key_init(&key, bench_key);
+
+  bench_size_name(name, sizeof(name), "aead: seal", size);
+
+  bench_start(&bench, name);
+  for (int i = 0; i < n; i++) {
+    iv[4] = i;
+    hsk_aead_setup_key(&aead, &key, iv);
+    hsk_aead_encrypt(&aead, data, data, size);
+    hsk_aead_final(&aead, tag);
+  }
+  bench_end_bytes(&bench, n, size);
+
+  free(data);
+}
+
+static void
+bench_cipher(void) {
+  static const struct {
+    const char *name;
+    bench_mac_fn auth;
+    int (*self_test)(void);
+  } variants[] = {
+    { "poly1305 (8-bit)", hsk_poly1305_8_auth,
+      hsk_poly1305_8_power_on_self_test },
+    { "poly1305 (16-bit)", hsk_poly1305_16_auth,
+      hsk_poly1305_16_power_on_self_test },
+    { "poly1305 (32-bit)", hsk_poly1305_32_auth,
+      hsk_poly1305_32_power_on_self_test },
+#if defined(__SIZEOF_INT128__)
+    { "poly1305 (64-bit)", hsk_poly1305_64_auth,
+      hsk_poly1305_64_power_on_self_test },
+#endif
+  };
+
+  bench_chacha20_size(64, 500000);
+  bench_chacha20_size(1024, 100000);
+  bench_chacha20_size(16384, 10000);
+
+  // Mirrors the detection in poly1305.c.
+  bench_info("poly1305",
+#if defined(HSK_POLY1305_8BIT)
+             "8-bit"
+#elif defined(HSK_POLY1305_16BIT)
+             "16-bit"
+#elif defined(HSK_POLY1305_32BIT)
+             "32-bit"
+#elif defined(HSK_POLY1305_64BIT) \
+  || (defined(__SIZEOF_INT128__) && defined(__LP64__))
+             "64-bit"
+#else
+             "32-bit"
+#endif
+  );
+
+  assert(hsk_poly1305_power_on_self_test());
+
+  bench_poly1305_size("poly1305", hsk_poly1305_auth, 64, 500000);
+  bench_poly1305_size("poly1305", hsk_poly1305_auth, 1024, 100000);
+  bench_poly1305_size("poly1305", hsk_poly1305_auth, 16384, 10000);
+
+  for (int i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+    assert(variants[i].self_test());
+    bench_poly1305_size(variants[i].name, variants[i].auth, 64, 200000);
+    bench_poly1305_size(variants[i].name, variants[i].auth, 1024, 20000);
+  }
+
+  bench_aead_size(64, 200000);
+  bench_aead_size(1024, 100000);
+  bench_aead_size(16384, 10000);
+}
+
+/*
+ * Headers
+ */
+
+static void
+bench_header(void) {
+  const int n = 100000;
+  hsk_bench_t bench;
+  hsk_header_t hdr;
+  uint8_t data[512];
+
+  hsk_header_init(&hdr);
+
+  hdr.nonce = bench_rand();
+  hdr.time = 1580745078;
+  hdr.version = 0;
+  hdr.bits = 0x1c00a4a0;
+  bench_rand_bytes(hdr.prev_block, 32);
+  bench_rand_bytes(hdr.name_root, 32);
+  bench_rand_bytes(hdr.extra_nonce, 24);
+  bench_rand_bytes(hdr.reserved_root, 32);
+  bench_rand_bytes(hdr.witness_root, 32);
+  bench_rand_bytes(hdr.merkle_root, 32);
+  bench_rand_bytes(hdr.mask, 32);
+
+  assert(hsk_header_size(&hdr) <= sizeof(data));
+
+  bench_start(&bench, "header: encode");
+  for (int i = 0; i < n; i++) {
+    hdr.nonce = i;
+    hsk_header_encode(&hdr, data);
+  }
+  bench_end(&bench, n);
+
+  bench_start(&bench, "header: decode");
+  for (int i = 0; i < n; i++)
+    assert(hsk_header_decode(data, hsk_header_size(&hdr), &hdr));
+  bench_end(&bench, n);
+
+  bench_start(&bench, "header: hash (uncached)");
+  for (int i = 0; i < n; i++) {
+    hdr.nonce = i;
+    hdr.cache = false;
+    hsk_header_cache(&hdr);
+  }
+  bench_end(&bench, n);
+
+  bench_start(&bench, "header: verify pow");
+  for (int i = 0; i < n; i++) {
+    hdr.nonce = i;
+    hdr.cache = false;
+    hsk_header_verify_pow(&hdr);
+  }
+  bench_end(&bench, n);
+
+  // A full headers message, decoded the way the pool used to (a header
+  // allocated at a time) and the way it does now (into one buffer).
+  const int m = 50;
+  hsk_header_t *hdrs = calloc(HSK_MAX_HEADERS, sizeof(hsk_header_t));
+  hsk_headers_msg_t *msg = (hsk_headers_msg_t *)hsk_msg_alloc(HSK_MSG_HEADERS);
+
+  assert(hdrs && msg);
+
+  for (int i = 0; i < HSK_MAX_HEADERS; i++) {
+    hdrs[i] = hdr;
+    hdrs[i].nonce = i;
+    hdrs[i].next = i + 1 < HSK_MAX_HEADERS ? &hdrs[i + 1] : NULL;
+  }
+
+  msg->header_count = HSK_MAX_HEADERS;
+  msg->headers = &hdrs[0];
+
+  int wire_len = hsk_msg_size((hsk_msg_t *)msg);
+  uint8_t *wire = malloc(wire_len);
+
+  assert(wire);
+  hsk_msg_encode((hsk_msg_t *)msg, wire);
+
+  msg->headers = NULL;
+  hsk_msg_free((hsk_msg_t *)msg);
+
+  bench_start(&bench, "header: decode message (allocated)");
+  for (int i = 0; i < m; i++) {
+    hsk_msg_t *dec = hsk_msg_alloc(HSK_MSG_HEADERS);
+    assert(dec && hsk_msg_decode(wire, wire_len, dec));
+    hsk_msg_free(dec);
+  }
+  bench_end_allocs(&bench, m);
+
+  bench_start(&bench, "header: decode message (buffer)");
+  for (int i = 0; i < m; i++) {
+    hsk_msg_t *dec = hsk_msg_alloc(HSK_MSG_HEADERS);
+    assert(dec);
+    ((hsk_headers_msg_t *)dec)->buf = hdrs;
+    assert(hsk_msg_decode(wire, wire_len, dec));
+    hsk_msg_free(dec);
+  }
+  bench_end_allocs(&bench, m);
+
+  free(wire);
+  free(hdrs);
+}
+
+/*
+ * DNS
+ */
+
+static hsk_dns_rr_t *
+bench_rr(hsk_dns_rrs_t *rrs, uint16_t type, const char *name) {
+  hsk_dns_rr_t *rr = hsk_dns_rr_create(type);
+  assert(rr);
+  assert(hsk_dns_rr_set_name(rr, name));
+  rr->ttl = 21600;
+  hsk_dns_rrs_push(rrs, rr);
+  return rr;
+}
+
+static void
+bench_dns(void) {
+  const int n = 20000;
+  hsk_bench_t bench;
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+  char name[HSK_DNS_MAX_NAME + 1];
+  int i;
+
+  assert(msg);
+
+  // A referral for a TLD with a large delegation:
+  // 20 NS records, 2 DS records and 28 glue records.
+  msg->id = 0x1234;
+  msg->flags = HSK_DNS_QR;
+  msg->edns.enabled = true;
+  msg->edns.size = 4096;
+
+  bench_rr(&msg->qd, HSK_DNS_A, "www.example-tld.");
+
+  for (i = 0; i < 20; i++) {
+    hsk_dns_rr_t *rr = bench_rr(&msg->ns, HSK_DNS_NS, "example-tld.");
+    hsk_dns_ns_rd_t *rd = rr->rd;
+    sprintf(rd->ns, "ns%d.example-tld.", i);
+  }
+
+  for (i = 0; i < 2; i++) {
+    hsk_dns_rr_t *rr = bench_rr(&msg->ns, HSK_DNS_DS, "example-tld.");
+    hsk_dns_ds_rd_t *rd = rr->rd;
+    rd->key_tag = 0x4000 + i;
+    rd->algorithm = 13;
+    rd->digest_type = 2;
+    rd->digest_len = 32;
+    rd->digest = malloc(32);
+    assert(rd->digest);
+    bench_rand_bytes(rd->digest, 32);
+  }
+
+  for (i = 0; i < 20; i++) {
+    sprintf(name, "ns%d.example-tld.", i);
+    hsk_dns_rr_t *rr = bench_rr(&msg->ar, HSK_DNS_A, name);
+    hsk_dns_a_rd_t *rd = rr->rd;
+    bench_rand_bytes(rd->addr, 4);
+  }
+
+  for (i = 0; i < 8; i++) {
+    sprintf(name, "ns%d.example-tld.", i);
+    hsk_dns_rr_t *rr = bench_rr(&msg->ar, HSK_DNS_AAAA, name);
+    hsk_dns_aaaa_rd_t *rd = rr->rd;
+    bench_rand_bytes(rd->addr, 16);
+  }
+
+  uint8_t *data;
+  size_t data_len;
+
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+
+  bench_info("dns", "referral=%zu bytes", data_len);
+
+  bench_start(&bench, "dns: decode referral (50 rrs)");
+  for (i = 0; i < n; i++) {
+    hsk_dns_msg_t *res;
+    assert(hsk_dns_msg_decode(data, data_len, &res));
+    hsk_dns_msg_free(res);
+  }
+  bench_end(&bench, n);
+
+  // Header, counts, types and TTLs only.
+  bench_start(&bench, "dns: view referral (50 rrs)");
+  for (i = 0; i < n; i++) {
+    hsk_dns_view_t view;
+    hsk_dns_iter_t it;
+    hsk_dns_view_rr_t rr;
+    uint32_t ttl = 0;
+
+    assert(hsk_dns_view_init(&view, data, data_len));
+
+    for (int s = HSK_DNS_SECTION_AN; s <= HSK_DNS_SECTION_AR; s++) {
+      hsk_dns_view_iter(&view, s, &it);
+      while (hsk_dns_iter_next(&it, &rr))
+        ttl += rr.ttl;
+    }
+
+    assert(ttl == 50 * 21600);
+  }
+  bench_end(&bench, n);
+
+  free(data);
+
+  bench_start(&bench, "dns: encode referral (50 rrs)");
+  for (i = 0; i < n; i++) {
+    assert(hsk_dns_msg_encode(msg, &data, &data_len));
+    free(data);
+  }
+  bench_end(&bench, n);
+
+  hsk_dns_msg_free(msg);
+}
+
+/*
+ * Chain
+ */
+
+// A dataset saved by mock_hnsd (--save) to sync from, given with --headers.
+// Only its main chain is used, and it has to be for this network.
+static const char *bench_headers = NULL;
+
+static bool
+bench_load_headers(const char *file, hsk_header_t **out, size_t *out_count) {
+  FILE *fp = fopen(file, "rb");
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", file);
+    return false;
+  }
+
+  uint8_t *buf = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+
+  for (;;) {
+    if (len == cap) {
+      cap = cap ? cap * 2 : 1 << 20;
+
+      uint8_t *b = realloc(buf, cap);
+
+      if (!b) {
+        free(buf);
+        fclose(fp);
+        return false;
+      }
+
+      buf = b;
+    }
+
+    size_t n = fread(buf + len, 1, cap - len, fp);
+
+    if (n == 0)
+      break;
+
+    len += n;
+  }
+
+  fclose(fp);
+
+  uint8_t *p = buf;
+  uint8_t magic[8];
+  uint32_t network, count;
+  hsk_header_t *headers = NULL;
+
+  if (!read_bytes(&p, &len, magic, 8)
+      || memcmp(magic, "HSKMOCK1", 8) != 0
+      || !read_u32(&p, &len, &network)
+      || network != HSK_MAGIC
+      || !read_u32(&p, &len, &count)
+      || count == 0
+      || count > len / 200) {
+    goto fail;
+  }
+
+  headers = calloc(count, sizeof(hsk_header_t));
+
+  if (!headers)
+    goto fail;
+
+  for (uint32_t i = 0; i < count; i++) {
+    hsk_header_init(&headers[i]);
+
+    if (!hsk_header_read(&p, &len, &headers[i]))
+      goto fail;
+  }
+
+  free(buf);
+
+  *out = headers;
+  *out_count = count;
+
+  return true;
+
+fail:
+  fprintf(stderr, "%s is not a mock_hnsd dataset for %s\n",
+          file, HSK_NETWORK_NAME);
+  free(headers);
+  free(buf);
+  return false;
+}
+
+// The chain logs every header it adds; keep that out of the numbers.
+static int
+bench_quiet(void) {
+  fflush(stdout);
+#ifndef _WIN32
+  int fd = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+
+  if (fd != -1 && null != -1)
+    dup2(null, STDOUT_FILENO);
+
+  if (null != -1)
+    close(null);
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+static void
+bench_loud(int fd) {
+  fflush(stdout);
+#ifndef _WIN32
+  if (fd != -1) {
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+  }
+#endif
+}
+
+static void
+bench_chain(void) {
+  hsk_bench_t bench;
+  hsk_header_t *headers;
+  size_t count;
+
+  if (!bench_headers) {
+    bench_log("chain: skipped (needs --headers <file>)\n");
+    return;
+  }
+
+  if (!bench_load_headers(bench_headers, &headers, &count))
+    exit(1);
+
+  bench_info("headers", "%zu", count - 1);
+
+  hsk_timedata_t td;
+  hsk_chain_t chain;
+
+  int fd = bench_quiet();
+
+  hsk_timedata_init(&td);
+  assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+  assert(memcmp(hsk_header_cache(&headers[0]),
+                hsk_header_cache(chain.genesis), 32) == 0);
+
+  // Roughly what initial sync costs once the headers are off the wire.
+  bench_start(&bench, "chain: add header");
+  for (size_t i = 1; i < count; i++)
+    assert(hsk_chain_add(&chain, &headers[i]) == HSK_SUCCESS);
+  uint64_t elapsed = uv_hrtime() - bench.start;
+  uint64_t allocs = bench_alloc_count() - bench.allocs;
+
+  bench_loud(fd);
+  bench_record_allocs(bench_record(bench.name, count - 1, elapsed, 0),
+                      allocs, count - 1);
+
+  const int n = 1000000;
+  uint32_t height = (uint32_t)chain.height;
+
+  bench_start(&bench, "chain: get ancestor");
+  for (int i = 0; i < n; i++) {
+    uint32_t h = bench_rand() % (height + 1);
+    assert(hsk_chain_get_ancestor(&chain, chain.tip, h)->height == h);
+  }
+  bench_end(&bench, n);
+
+  hsk_chain_uninit(&chain);
+
+  // The same, in headers messages as the pool decodes them: linked in
+  // place in one array.
+  size_t nbatches = (count - 1 + HSK_MAX_HEADERS - 1) / HSK_MAX_HEADERS;
+  hsk_header_t **batches = calloc(nbatches, sizeof(hsk_header_t *));
+
+  assert(batches);
+
+  for (size_t i = 1; i < count; i++) {
+    if ((i - 1) % HSK_MAX_HEADERS == 0)
+      batches[(i - 1) / HSK_MAX_HEADERS] = &headers[i];
+    else
+      headers[i - 1].next = &headers[i];
+  }
+
+  fd = bench_quiet();
+
+  assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+
+  bench_start(&bench, "chain: add batch");
+  for (size_t i = 0; i < nbatches; i++)
+    assert(hsk_chain_add_batch(&chain, batches[i], 0, NULL) == HSK_SUCCESS);
+  elapsed = uv_hrtime() - bench.start;
+  allocs = bench_alloc_count() - bench.allocs;
+
+  bench_loud(fd);
+  bench_record_allocs(bench_record(bench.name, count - 1, elapsed, 0),
+                      allocs, count - 1);
+
+  assert((uint32_t)chain.height == height);
+
+  hsk_chain_uninit(&chain);
+  hsk_timedata_uninit(&td);
+  free(batches);
+  free(headers);
+}
+
+/*
+ * Main
+ */
+
+static bool
+bench_enabled(int argc, char **argv, const char *name) {
+  bool any = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      // Skip the option's value too.
+      if (strcmp(argv[i], "--headers") == 0)
+        i += 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], name) == 0)
+      return true;
+
+    any = true;
+  }
+
+  return !any;
+}
+
+int
+main(int argc, char **argv) {
+  bench_out = stdout;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      bench_json = true;
+      bench_out = stderr;
+    } else if (strcmp(argv[i], "--headers") == 0 && i + 1 < argc) {
+      bench_headers = argv[++i];
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--json] [--headers <file>] [section...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  bench_log("Benchmarking hnsd...\n");
+
+  if (bench_enabled(argc, argv, "sig0"))
+    bench_sig0();
+
+  if (bench_enabled(argc, argv, "proof"))
+    bench_proof();
+
+  if (bench_enabled(argc, argv, "ec"))
+    bench_ec();
+
+  if (bench_enabled(argc, argv, "brontide"))
+    bench_brontide();
+
+  if (bench_enabled(argc, argv, "sha256"))
+    bench_sha256();
+
+  if (bench_enabled(argc, argv, "hash"))
+    bench_hash();
+
+  if (bench_enabled(argc, argv, "cipher"))
+    bench_cipher();
+
+  if (bench_enabled(argc, argv, "header"))
+    bench_header();
+
+  if (bench_enabled(argc, argv, "dns"))
+    bench_dns();
+
+  if (bench_enabled(argc, argv, "chain"))
+    bench_chain();
+
+  if (bench_json)
+    bench_json_write();
+
+  return 0;
+}
@@ -0,0 +1,1541 @@
+#include "config.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "addr.h"
+#include "bio.h"
+#include "blake2b.h"
+#include "brontide.h"
+#include "constants.h"
+#include "dns.h"
+#include "ec.h"
+#include "error.h"
+#include "genesis.h"
+#include "header.h"
+#include "msg.h"
+#include "proof.h"
+#include "resource.h"
+#include "sig0.h"
+
+// Entry points for fuzzing the parsers that see network input:
+//
+//   dns       hsk_dns_msg_decode(), and the lazy view against it.
+//   truncate  hsk_dns_msg_truncate().
+//   sig0      hsk_sig0_*, and signing with precomputed nonces against it.
+//   msg       hsk_msg_decode() for every P2P command.
+//   header    hsk_header_read().
+//   proof     hsk_proof_decode(), and batched against single verification.
+//   resource  hsk_resource_decode() and the answers built from it.
+//   brontide  hsk_brontide_on_read(), during and after the handshake.
+//   name      wire names, and hsk_dns_name_t against the string helpers.
+//
+// Built with --enable-libfuzzer (and CC=clang), this is a libFuzzer binary
+// and the target comes from HSK_FUZZ_TARGET:
+//
+//   $ HSK_FUZZ_TARGET=dns ./fuzz_hnsd test/corpus/dns
+//
+// Otherwise it has a main of its own that runs a target over files,
+// directories or stdin, which is also what AFL++ wants. With -n, inputs are
+// mutated for a quick smoke run where no real fuzzer is around:
+//
+//   $ ./fuzz_hnsd dns test/corpus/dns
+//   $ ./fuzz_hnsd -n 100000 -c crash dns test/corpus/dns
+//   $ afl-fuzz -i test/corpus/dns -o out -- ./fuzz_hnsd dns @@
+//
+// Where a fast path sits next to the code it replaces, the target checks
+// that both give the same answer. New fast paths belong there too.
+
+/*
+ * Types
+ */
+
+#define FUZZ_MAX_INPUT 65536
+
+#define FUZZ_CHECK(expr) do {                                   \
+  if (!(expr)) {                                                \
+    fprintf(stderr, "%s:%d: %s: check failed: %s\n",            \
+            __FILE__, __LINE__, fuzz.target->name, #expr);      \
+    abort();                                                    \
+  }                                                             \
+} while (0)
+
+typedef void (*fuzz_cb)(const uint8_t *data, size_t data_len);
+
+typedef struct {
+  const char *name;
+  fuzz_cb run;
+} fuzz_target_t;
+
+typedef struct {
+  const fuzz_target_t *target;
+  hsk_ec_t *ec;
+  uint8_t key[32];
+  uint8_t pub[33];
+  uint8_t peer_key[32];
+  uint8_t peer_pub[33];
+} fuzz_t;
+
+static fuzz_t fuzz;
+
+/*
+ * Helpers
+ */
+
+static bool
+fuzz_init(void) {
+  if (fuzz.ec)
+    return true;
+
+  fuzz.ec = hsk_ec_alloc();
+
+  if (!fuzz.ec)
+    return false;
+
+  // Fixed keys, so runs are repeatable.
+  memset(fuzz.key, 0x11, 32);
+  memset(fuzz.peer_key, 0x22, 32);
+
+  return hsk_ec_create_pubkey(fuzz.ec, fuzz.key, fuzz.pub)
+      && hsk_ec_create_pubkey(fuzz.ec, fuzz.peer_key, fuzz.peer_pub);
+}
+
+// Encode a DNS message into a fresh buffer.
+static uint8_t *
+fuzz_dns_encode(const hsk_dns_msg_t *msg, size_t *len) {
+  uint8_t *data;
+
+  FUZZ_CHECK(hsk_dns_msg_encode(msg, &data, len));
+
+  return data;
+}
+
+static void
+fuzz_lower(char *str) {
+  for (; *str; str++) {
+    if (*str >= 'A' && *str <= 'Z')
+      *str += ' ';
+  }
+}
+
+/*
+ * DNS
+ */
+
+static void
+fuzz_dns(const uint8_t *data, size_t data_len) {
+  hsk_dns_msg_t *msg = NULL;
+  bool ok = hsk_dns_msg_decode(data, data_len, &msg);
+
+  hsk_dns_view_t view;
+  bool view_ok = hsk_dns_view_init(&view, data, data_len);
+
+  if (!ok) {
+    // The view skips rdata, so it may accept what the
+    // decoder doesn't, but never the other way around.
+    if (view_ok) {
+      hsk_dns_msg_t *vmsg;
+      FUZZ_CHECK(!hsk_dns_view_msg(&view, 0x0f, &vmsg));
+    }
+    return;
+  }
+
+  FUZZ_CHECK(view_ok);
+
+  size_t len;
+  uint8_t *enc = fuzz_dns_encode(msg, &len);
+
+  // Whatever we decode re-encodes to
+  // something that decodes the same way.
+  hsk_dns_msg_t *again = NULL;
+  FUZZ_CHECK(hsk_dns_msg_decode(enc, len, &again));
+
+  size_t again_len;
+  uint8_t *again_enc = fuzz_dns_encode(again, &again_len);
+  FUZZ_CHECK(again_len == len && memcmp(again_enc, enc, len) == 0);
+
+  // The lazy view materializes the same message.
+  hsk_dns_msg_t *vmsg = NULL;
+  FUZZ_CHECK(hsk_dns_view_msg(&view, 0x0f, &vmsg));
+
+  size_t view_len;
+  uint8_t *view_enc = fuzz_dns_encode(vmsg, &view_len);
+  FUZZ_CHECK(view_len == len && memcmp(view_enc, enc, len) == 0);
+
+  // And walks the same records.
+  hsk_dns_rrs_t *sections[4] = { &msg->qd, &msg->an, &msg->ns, &msg->ar };
+  int s;
+
+  for (s = 0; s < 4; s++) {
+    hsk_dns_iter_t it;
+    hsk_dns_view_rr_t rr;
+    size_t i = 0;
+
+    hsk_dns_view_iter(&view, s, &it);
+
+    while (hsk_dns_iter_next(&it, &rr)) {
+      FUZZ_CHECK(i < sections[s]->size);
+      FUZZ_CHECK(rr.type == sections[s]->items[i]->type);
+      i += 1;
+    }
+
+    FUZZ_CHECK(i == sections[s]->size);
+  }
+
+  free(view_enc);
+  free(again_enc);
+  free(enc);
+  hsk_dns_msg_free(vmsg);
+  hsk_dns_msg_free(again);
+  hsk_dns_msg_free(msg);
+}
+
+static void
+fuzz_truncate(const uint8_t *data, size_t data_len) {
+  if (data_len < 2)
+    return;
+
+  size_t max = get_u16be(data);
+  size_t msg_len = data_len - 2;
+  uint8_t *msg = malloc(msg_len ? msg_len : 1);
+
+  assert(msg);
+  memcpy(msg, &data[2], msg_len);
+
+  size_t len;
+
+  if (hsk_dns_msg_truncate(msg, msg_len, max, &len)) {
+    FUZZ_CHECK(len <= msg_len);
+    FUZZ_CHECK(len <= max || len == msg_len);
+  }
+
+  free(msg);
+  msg = NULL;
+
+  // Cutting a message we wrote leaves one we can read. Raw input
+  // may point forward past the cut, which our compressor never does.
+  hsk_dns_msg_t *orig = NULL;
+
+  if (!hsk_dns_msg_decode(&data[2], data_len - 2, &orig))
+    return;
+
+  if (hsk_dns_msg_encode(orig, &msg, &msg_len)
+      && hsk_dns_msg_truncate(msg, msg_len, max, &len)) {
+    hsk_dns_msg_t *cut = NULL;
+    FUZZ_CHECK(hsk_dns_msg_decode(msg, len, &cut));
+    hsk_dns_msg_free(cut);
+  }
+
+  free(msg);
+  hsk_dns_msg_free(orig);
+}
+
+static void
+fuzz_sig0(const uint8_t *data, size_t data_len) {
+  uint8_t sig[64];
+  uint8_t hash[32];
+  uint16_t tag;
+
+  bool has = hsk_sig0_has_sig(data, data_len);
+
+  if (hsk_sig0_get_sig(data, data_len, sig, &tag))
+    FUZZ_CHECK(has);
+
+  FUZZ_CHECK(hsk_sig0_sighash(data, data_len, hash) == has);
+  FUZZ_CHECK(hsk_sig0_sighash_noid(data, data_len, hash) == has);
+
+  // Seeds carry signatures from fuzz.key.
+  hsk_sig0_verify(fuzz.ec, fuzz.pub, data, data_len);
+  hsk_sig0_verify_noid(fuzz.ec, fuzz.pub, data, data_len);
+
+  if (data_len < 12)
+    return;
+
+  // Sign it ourselves, with RFC 6979 and with a precomputed
+  // nonce (the signer's fast path). Both have to verify.
+  uint8_t *wire = malloc(data_len + HSK_SIG0_RR_SIZE);
+  size_t len;
+
+  assert(wire);
+  memcpy(wire, data, data_len);
+
+  FUZZ_CHECK(hsk_sig0_sign_inplace(fuzz.ec, fuzz.key, wire, data_len, &len));
+  FUZZ_CHECK(hsk_sig0_has_sig(wire, len));
+  FUZZ_CHECK(hsk_sig0_verify(fuzz.ec, fuzz.pub, wire, len));
+
+  hsk_ec_nonce_t nonce;
+  int rec;
+
+  FUZZ_CHECK(hsk_sig0_sighash(wire, len, hash));
+  FUZZ_CHECK(hsk_ec_create_nonce(fuzz.ec, &nonce));
+  FUZZ_CHECK(hsk_ec_sign_msg_nonce(fuzz.ec, fuzz.key, hash, &nonce,
+                                   &wire[len - 64], &rec));
+  FUZZ_CHECK(hsk_sig0_verify(fuzz.ec, fuzz.pub, wire, len));
+
+  free(wire);
+}
+
+/*
+ * P2P
+ */
+
+static void
+fuzz_msg(const uint8_t *data, size_t data_len) {
+  if (data_len < 1)
+    return;
+
+  hsk_msg_t *msg = hsk_msg_alloc(data[0]);
+
+  if (!msg)
+    return;
+
+  if (!hsk_msg_decode(&data[1], data_len - 1, msg)) {
+    hsk_msg_free(msg);
+    return;
+  }
+
+  int size = hsk_msg_size(msg);
+  uint8_t *enc = malloc(size ? size : 1);
+
+  assert(enc);
+  FUZZ_CHECK(hsk_msg_encode(msg, enc) == size);
+
+  hsk_msg_t *again = hsk_msg_alloc(data[0]);
+
+  assert(again);
+  FUZZ_CHECK(hsk_msg_decode(enc, size, again));
+  FUZZ_CHECK(hsk_msg_size(again) == size);
+
+  uint8_t *again_enc = malloc(size ? size : 1);
+
+  assert(again_enc);
+  hsk_msg_encode(again, again_enc);
+  FUZZ_CHECK(memcmp(again_enc, enc, size) == 0);
+
+  free(again_enc);
+  free(enc);
+  hsk_msg_free(again);
+  hsk_msg_free(msg);
+}
+
+static void
+fuzz_header(const uint8_t *data, size_t data_len) {
+  hsk_header_t hdr;
+  uint8_t *d = (uint8_t *)data;
+  size_t len = data_len;
+
+  hsk_header_init(&hdr);
+
+  if (!hsk_header_read(&d, &len, &hdr))
+    return;
+
+  // Headers are fixed size, so they
+  // write back exactly as they were.
+  size_t size = data_len - len;
+  uint8_t enc[512];
+
+  FUZZ_CHECK(hsk_header_size(&hdr) == size && size <= sizeof(enc));
+  FUZZ_CHECK(hsk_header_encode(&hdr, enc) == size);
+  FUZZ_CHECK(memcmp(enc, data, size) == 0);
+
+  hsk_header_cache(&hdr);
+  hsk_header_verify_pow(&hdr);
+}
+
+/*
+ * Proofs
+ */
+
+// Input is the root and key (32 bytes each), then the proof.
+static void
+fuzz_proof(const uint8_t *data, size_t data_len) {
+  if (data_len < 64)
+    return;
+
+  const uint8_t *root = &data[0];
+  const uint8_t *key = &data[32];
+  hsk_proof_t proof;
+
+  hsk_proof_init(&proof);
+
+  if (!hsk_proof_decode(&data[64], data_len - 64, &proof)) {
+    hsk_proof_uninit(&proof);
+    return;
+  }
+
+  // Round trip through the writer.
+  int size = hsk_proof_size(&proof);
+  uint8_t *enc = malloc(size);
+  uint8_t *p = enc;
+
+  assert(enc);
+  FUZZ_CHECK(hsk_proof_write(&proof, &p) == size);
+
+  hsk_proof_t again;
+  hsk_proof_init(&again);
+  FUZZ_CHECK(hsk_proof_decode(enc, size, &again));
+  FUZZ_CHECK(hsk_proof_size(&again) == size);
+
+  uint8_t *again_enc = malloc(size);
+  p = again_enc;
+
+  assert(again_enc);
+  hsk_proof_write(&again, &p);
+  FUZZ_CHECK(memcmp(again_enc, enc, size) == 0);
+
+  // Batched verification agrees with the plain one,
+  // whichever lane the proof ends up in.
+  bool exists;
+  uint8_t *value = NULL;
+  size_t value_len = 0;
+  int rc = hsk_proof_verify(root, key, &proof, &exists, &value, &value_len);
+
+  hsk_proof_job_t jobs[5];
+  int i;
+
+  for (i = 0; i < 5; i++) {
+    jobs[i].root = root;
+    jobs[i].key = key;
+    jobs[i].proof = (i & 1) ? &again : &proof;
+  }
+
+  hsk_proof_verify_batch(jobs, 5);
+
+  for (i = 0; i < 5; i++) {
+    FUZZ_CHECK(jobs[i].result == rc);
+
+    if (rc == HSK_EPROOFOK) {
+      FUZZ_CHECK(jobs[i].exists == exists);
+      FUZZ_CHECK(jobs[i].data_len == value_len);
+      FUZZ_CHECK(value_len == 0
+                 || memcmp(jobs[i].data, value, value_len) == 0);
+    }
+
+    free(jobs[i].data);
+  }
+
+  free(value);
+  free(again_enc);
+  free(enc);
+  hsk_proof_uninit(&again);
+  hsk_proof_uninit(&proof);
+}
+
+static void
+fuzz_resource(const uint8_t *data, size_t data_len) {
+  hsk_resource_t *res = NULL;
+
+  if (!hsk_resource_decode(data, data_len, &res))
+    return;
+
+  static const char *names[2] = { "fuzz.", "www.Fuzz." };
+  static const uint16_t types[6] = {
+    HSK_DNS_NS,
+    HSK_DNS_DS,
+    HSK_DNS_TXT,
+    HSK_DNS_A,
+    HSK_DNS_AAAA,
+    HSK_DNS_ANY
+  };
+
+  int i, j;
+
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 6; j++) {
+      hsk_dns_msg_t *msg = hsk_resource_to_dns(res, names[i], types[j]);
+
+      if (!msg)
+        continue;
+
+      // What we answer with has to be readable.
+      size_t len;
+      uint8_t *enc = fuzz_dns_encode(msg, &len);
+      hsk_dns_msg_t *again = NULL;
+
+      FUZZ_CHECK(hsk_dns_msg_decode(enc, len, &again));
+
+      hsk_dns_msg_free(again);
+      free(enc);
+      hsk_dns_msg_free(msg);
+    }
+  }
+
+  hsk_resource_free(res);
+}
+
+/*
+ * Brontide
+ */
+
+typedef struct fuzz_end_s {
+  hsk_brontide_t b;
+  struct fuzz_end_s *other;
+  uint8_t inbox[FUZZ_MAX_INPUT * 2];
+  size_t inbox_len;
+  bool connected;
+  // Messages we expect to read, back to back.
+  const uint8_t *expect;
+  size_t expect_len;
+} fuzz_end_t;
+
+static fuzz_end_t fuzz_ends[2];
+
+static void
+fuzz_end_connect(const void *arg) {
+  ((fuzz_end_t *)arg)->connected = true;
+}
+
+static int
+fuzz_end_write(const void *arg, const uint8_t *data, size_t len, bool is_heap) {
+  fuzz_end_t *other = ((fuzz_end_t *)arg)->other;
+
+  if (other->inbox_len + len <= sizeof(other->inbox)) {
+    memcpy(&other->inbox[other->inbox_len], data, len);
+    other->inbox_len += len;
+  }
+
+  if (is_heap)
+    free((void *)data);
+
+  return HSK_SUCCESS;
+}
+
+static void
+fuzz_end_read(const void *arg, const uint8_t *data, size_t len) {
+  fuzz_end_t *end = (fuzz_end_t *)arg;
+
+  // Anything that gets past the MAC is something we sealed.
+  FUZZ_CHECK(len <= end->expect_len);
+  FUZZ_CHECK(memcmp(data, end->expect, len) == 0);
+
+  end->expect += len;
+  end->expect_len -= len;
+}
+
+static void
+fuzz_end_init(fuzz_end_t *end, fuzz_end_t *other) {
+  hsk_brontide_init(&end->b, fuzz.ec);
+  end->other = other;
+  end->inbox_len = 0;
+  end->connected = false;
+  end->expect = NULL;
+  end->expect_len = 0;
+  end->b.connect_cb = fuzz_end_connect;
+  end->b.connect_arg = (void *)end;
+  end->b.write_cb = fuzz_end_write;
+  end->b.write_arg = (void *)end;
+  end->b.read_cb = fuzz_end_read;
+  end->b.read_arg = (void *)end;
+}
+
+static bool
+fuzz_end_pump(fuzz_end_t *a, fuzz_end_t *b) {
+  fuzz_end_t *ends[2] = { a, b };
+  uint8_t buf[256];
+
+  while (a->inbox_len || b->inbox_len) {
+    int i;
+
+    for (i = 0; i < 2; i++) {
+      size_t len = ends[i]->inbox_len;
+
+      if (len == 0)
+        continue;
+
+      assert(len <= sizeof(buf));
+      memcpy(buf, ends[i]->inbox, len);
+      ends[i]->inbox_len = 0;
+
+      if (hsk_brontide_on_read(&ends[i]->b, buf, len) != HSK_SUCCESS)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// Feed `data` to `end` in pieces of `chunk` bytes, stopping at the first
+// error as the pool would.
+static void
+fuzz_end_feed(fuzz_end_t *end, const uint8_t *data, size_t len, size_t chunk) {
+  while (len > 0) {
+    size_t n = len < chunk ? len : chunk;
+
+    if (hsk_brontide_on_read(&end->b, data, n) != HSK_SUCCESS)
+      return;
+
+    data += n;
+    len -= n;
+  }
+}
+
+// The first byte picks a mode, the second a read size:
+//
+//   0  raw bytes to a responder waiting for act one.
+//   1  raw bytes to a responder after the handshake.
+//   2  the rest as length-prefixed messages, sealed by the initiator.
+static void
+fuzz_brontide(const uint8_t *data, size_t data_len) {
+  if (data_len < 2)
+    return;
+
+  int mode = data[0] % 3;
+  size_t chunk = (size_t)data[1] + 1;
+  fuzz_end_t *i = &fuzz_ends[0];
+  fuzz_end_t *r = &fuzz_ends[1];
+
+  data += 2;
+  data_len -= 2;
+
+  fuzz_end_init(i, r);
+  fuzz_end_init(r, i);
+
+  FUZZ_CHECK(hsk_brontide_accept(&r->b, fuzz.key) == HSK_SUCCESS);
+
+  if (mode == 0) {
+    fuzz_end_feed(r, data, data_len, chunk);
+    goto done;
+  }
+
+  FUZZ_CHECK(hsk_brontide_connect(&i->b, fuzz.peer_key, fuzz.pub)
+             == HSK_SUCCESS);
+  FUZZ_CHECK(hsk_brontide_on_connect(&i->b) == HSK_SUCCESS);
+  FUZZ_CHECK(fuzz_end_pump(i, r));
+  FUZZ_CHECK(i->connected && r->connected);
+
+  if (mode == 1) {
+    fuzz_end_feed(r, data, data_len, chunk);
+    goto done;
+  }
+
+  // Empty messages don't make it to the read callback.
+  const uint8_t *d = data;
+  size_t left = data_len;
+  size_t size = 0;
+
+  while (left > 0) {
+    size_t len = d[0] < left - 1 ? d[0] : left - 1;
+
+    if (len > 0)
+      size += hsk_brontide_frame_size(len);
+
+    d += 1 + len;
+    left -= 1 + len;
+  }
+
+  uint8_t *sealed = malloc(size + 1);
+  uint8_t *plain = malloc(data_len + 1);
+  size_t sealed_len = 0;
+  size_t plain_len = 0;
+
+  assert(sealed && plain);
+
+  while (data_len > 0) {
+    size_t len = data[0] < data_len - 1 ? data[0] : data_len - 1;
+
+    data += 1;
+    data_len -= 1;
+
+    if (len > 0) {
+      hsk_brontide_seal(&i->b, data, len, &sealed[sealed_len]);
+      sealed_len += hsk_brontide_frame_size(len);
+      memcpy(&plain[plain_len], data, len);
+      plain_len += len;
+    }
+
+    data += len;
+    data_len -= len;
+  }
+
+  assert(sealed_len == size);
+
+  r->expect = plain;
+  r->expect_len = plain_len;
+
+  fuzz_end_feed(r, sealed, sealed_len, chunk);
+
+  // Every frame was well formed, so all of it arrives.
+  FUZZ_CHECK(r->expect_len == 0);
+
+  free(plain);
+  free(sealed);
+
+done:
+  hsk_brontide_uninit(&i->b);
+  hsk_brontide_uninit(&r->b);
+}
+
+/*
+ * Names
+ */
+
+// Compare an indexed name against the string helpers it replaces.
+static void
+fuzz_name_check(const hsk_dns_name_t *name, const char *str) {
+  char a[HSK_DNS_MAX_NAME + 2];
+  char b[HSK_DNS_MAX_NAME + 2];
+  int index;
+
+  FUZZ_CHECK(name->count == hsk_dns_label_count(str));
+  FUZZ_CHECK(name->dirty == hsk_dns_name_dirty(str));
+
+  for (index = -name->count - 1; index <= name->count; index++) {
+    int alen = hsk_dns_name_label(name, index, a);
+    int blen = hsk_dns_label_get(str, index, b);
+
+    fuzz_lower(b);
+
+    FUZZ_CHECK(alen == blen && strcmp(a, b) == 0);
+
+    alen = hsk_dns_name_from(name, index, a);
+    blen = hsk_dns_label_from(str, index, b);
+
+    fuzz_lower(b);
+
+    FUZZ_CHECK(alen == blen && strcmp(a, b) == 0);
+  }
+}
+
+// Input is one or two wire names, the second read as a
+// message of its own so it can point back into the first.
+static void
+fuzz_name(const uint8_t *data, size_t data_len) {
+  char str[2][HSK_DNS_MAX_NAME + 2];
+  hsk_dns_name_t names[2];
+  hsk_dns_dmp_t dmp;
+  uint8_t *d = (uint8_t *)data;
+  size_t len = data_len;
+  int count = 0;
+
+  dmp.msg = (uint8_t *)data;
+  dmp.msg_len = data_len;
+
+  while (count < 2 && len > 0) {
+    int size = hsk_dns_name_read_size(d, len, &dmp);
+
+    if (!hsk_dns_name_read(&d, &len, &dmp, str[count]))
+      break;
+
+    FUZZ_CHECK(size == (int)strlen(str[count]));
+
+    // Anything we read back from the wire is
+    // a name hsk_dns_name_write() would take.
+    if (!hsk_dns_name_set(&names[count], str[count]))
+      break;
+
+    fuzz_name_check(&names[count], str[count]);
+
+    // Suffixes are the wire format from that label on.
+    const uint8_t *suffix;
+    size_t suffix_size;
+    uint8_t packed[HSK_DNS_MAX_NAME + 2];
+    char from[HSK_DNS_MAX_NAME + 2];
+
+    suffix = hsk_dns_name_suffix(&names[count], 0, &suffix_size);
+    hsk_dns_name_from(&names[count], 0, from);
+
+    if (names[count].count > 0) {
+      int packed_size = hsk_dns_name_pack(from, packed);
+      FUZZ_CHECK(packed_size == (int)suffix_size);
+      FUZZ_CHECK(memcmp(packed, suffix, suffix_size) == 0);
+    }
+
+    count += 1;
+  }
+
+  if (count < 2)
+    return;
+
+  bool equal = hsk_dns_name_equal(&names[0], &names[1]);
+
+  FUZZ_CHECK(equal == (strcasecmp(str[0], str[1]) == 0));
+  FUZZ_CHECK(equal == (hsk_dns_name_cmp(str[0], str[1]) == 0));
+
+  FUZZ_CHECK(hsk_dns_name_is_subdomain(&names[0], &names[1])
+             == (hsk_dns_is_subdomain(str[0], str[1]) && !equal));
+}
+
+/*
+ * Targets
+ */
+
+static const fuzz_target_t fuzz_targets[] = {
+  { "dns", fuzz_dns },
+  { "truncate", fuzz_truncate },
+  { "sig0", fuzz_sig0 },
+  { "msg", fuzz_msg },
+  { "header", fuzz_header },
+  { "proof", fuzz_proof },
+  { "resource", fuzz_resource },
+  { "brontide", fuzz_brontide },
+  { "name", fuzz_name },
+  { NULL, NULL }
+};
+
+static const fuzz_target_t *
+fuzz_find(const char *name) {
+  const fuzz_target_t *t;
+
+  if (!name)
+    return NULL;
+
+  for (t = fuzz_targets; t->name; t++) {
+    if (strcmp(t->name, name) == 0)
+      return t;
+  }
+
+  return NULL;
+}
+
+static void
+fuzz_run(const uint8_t *data, size_t data_len) {
+  // Copy, so reads past the end are caught by the sanitizers.
+  uint8_t *copy = malloc(data_len ? data_len : 1);
+
+  assert(copy);
+  memcpy(copy, data, data_len);
+
+  fuzz.target->run(copy, data_len);
+
+  free(copy);
+}
+
+#ifdef HSK_LIBFUZZER
+
+int
+LLVMFuzzerInitialize(int *argc, char ***argv) {
+  fuzz.target = fuzz_find(getenv("HSK_FUZZ_TARGET"));
+
+  if (!fuzz.target) {
+    fprintf(stderr, "set HSK_FUZZ_TARGET to one of:");
+
+    const fuzz_target_t *t;
+    for (t = fuzz_targets; t->name; t++)
+      fprintf(stderr, " %s", t->name);
+
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+
+  if (!fuzz_init())
+    exit(1);
+
+  return 0;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size <= FUZZ_MAX_INPUT)
+    fuzz_run(data, size);
+  return 0;
+}
+
+#else
+
+/*
+ * Mutation
+ */
+
+static uint64_t fuzz_rng = 0x9e3779b97f4a7c15ull;
+
+static uint32_t
+fuzz_rand(uint32_t max) {
+  // xorshift64*
+  fuzz_rng ^= fuzz_rng >> 12;
+  fuzz_rng ^= fuzz_rng << 25;
+  fuzz_rng ^= fuzz_rng >> 27;
+  return max ? (uint32_t)((fuzz_rng * 0x2545f4914f6cdd1dull) >> 32) % max : 0;
+}
+
+// A few rounds of the usual havoc: bit flips, interesting values,
+// insertions, deletions and copies within the input.
+static size_t
+fuzz_mutate(uint8_t *data, size_t len, size_t max) {
+  static const uint8_t values[] = {
+    0x00, 0x01, 0x3f, 0x40, 0x7f, 0x80, 0xc0, 0xfe, 0xff
+  };
+
+  int rounds = 1 + fuzz_rand(4);
+
+  while (rounds--) {
+    size_t pos = fuzz_rand((uint32_t)(len ? len : 1));
+
+    switch (fuzz_rand(6)) {
+      case 0: {
+        if (len > 0)
+          data[pos] ^= 1 << fuzz_rand(8);
+        break;
+      }
+      case 1: {
+        if (len > 0)
+          data[pos] = values[fuzz_rand(sizeof(values))];
+        break;
+      }
+      case 2: {
+        if (len > 0)
+          data[pos] = (uint8_t)fuzz_rand(256);
+        break;
+      }
+      case 3: {
+        size_t n = 1 + fuzz_rand(8);
+
+        if (len + n > max)
+          break;
+
+        memmove(&data[pos + n], &data[pos], len - pos);
+
+        size_t i;
+        for (i = 0; i < n; i++)
+          data[pos + i] = (uint8_t)fuzz_rand(256);
+
+        len += n;
+        break;
+      }
+      case 4: {
+        size_t n = 1 + fuzz_rand(8);
+
+        if (pos + n > len)
+          n = len - pos;
+
+        memmove(&data[pos], &data[pos + n], len - pos - n);
+        len -= n;
+        break;
+      }
+      case 5: {
+        if (len < 2)
+          break;
+
+        size_t from = fuzz_rand((uint32_t)len);
+        size_t n = 1 + fuzz_rand(16);
+
+        if (from + n > len)
+          n = len - from;
+
+        if (pos + n > len)
+          n = len - pos;
+
+        memmove(&data[pos], &data[from], n);
+        break;
+      }
+    }
+  }
+
+  return len;
+}
+
+/*
+ * Inputs
+ */
+
+typedef struct {
+  uint8_t **items;
+  size_t *sizes;
+  size_t count;
+  size_t alloc;
+} fuzz_corpus_t;
+
+static bool
+fuzz_corpus_push(fuzz_corpus_t *corpus, uint8_t *data, size_t len) {
+  if (corpus->count == corpus->alloc) {
+    size_t alloc = corpus->alloc ? corpus->alloc * 2 : 64;
+    uint8_t **items = realloc(corpus->items, alloc * sizeof(uint8_t *));
+    size_t *sizes = realloc(corpus->sizes, alloc * sizeof(size_t));
+
+    if (items)
+      corpus->items = items;
+
+    if (sizes)
+      corpus->sizes = sizes;
+
+    if (!items || !sizes)
+      return false;
+
+    corpus->alloc = alloc;
+  }
+
+  corpus->items[corpus->count] = data;
+  corpus->sizes[corpus->count] = len;
+  corpus->count += 1;
+
+  return true;
+}
+
+static bool
+fuzz_read_file(FILE *fp, fuzz_corpus_t *corpus) {
+  uint8_t *data = malloc(FUZZ_MAX_INPUT);
+
+  if (!data)
+    return false;
+
+  size_t len = fread(data, 1, FUZZ_MAX_INPUT, fp);
+
+  if (ferror(fp)) {
+    free(data);
+    return false;
+  }
+
+  return fuzz_corpus_push(corpus, data, len);
+}
+
+static bool
+fuzz_read_path(const char *path, fuzz_corpus_t *corpus) {
+  if (strcmp(path, "-") == 0)
+    return fuzz_read_file(stdin, corpus);
+
+  struct stat st;
+
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(path);
+
+    if (!dir) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+    }
+
+    struct dirent *ent;
+    bool ok = true;
+
+    while (ok && (ent = readdir(dir))) {
+      char file[4096];
+
+      if (ent->d_name[0] == '.')
+        continue;
+
+      snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+
+      ok = fuzz_read_path(file, corpus);
+    }
+
+    closedir(dir);
+
+    return ok;
+  }
+
+  FILE *fp = fopen(path, "rb");
+
+  if (!fp) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  bool ok = fuzz_read_file(fp, corpus);
+
+  fclose(fp);
+
+  return ok;
+}
+
+/*
+ * Seeds
+ */
+
+static bool
+fuzz_write_seed(const char *dir, const char *target, int index,
+                const uint8_t *data, size_t len) {
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, target);
+
+  if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s/seed-%02d", dir, target, index);
+
+  FILE *fp = fopen(path, "wb");
+
+  if (!fp) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  bool ok = fwrite(data, 1, len, fp) == len;
+
+  return fclose(fp) == 0 && ok;
+}
+
+// A resource with one of each record type, a name
+// pointing back into the resource included.
+static const uint8_t fuzz_resource_seed[] = ""
+  "\x00"                                      // version
+  "\x00\x12\x34\x08\x02\x04\xde\xad\xbe\xef"   // DS
+  "\x01\x03ns1\x07" "example\x00"             // NS
+  "\x02\x03ns2\xc0\x10\x0a\x00\x00\x01"       // GLUE4
+  "\x03\x03ns3\xc0\x10"                       // GLUE6
+  "\x20\x01\x0d\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01"
+  "\x04\x0a\x00\x00\x02"                      // SYNTH4
+  "\x05\x20\x01\x0d\xb8\x00\x00\x00\x00"      // SYNTH6
+  "\x00\x00\x00\x00\x00\x00\x00\x02"
+  "\x06\x02\x05hello\x05world";               // TEXT
+
+static bool
+fuzz_write_seeds(const char *dir) {
+  bool ok = true;
+  int n;
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+    return false;
+  }
+
+  // Resources, and the answers built from them.
+  hsk_resource_t *res = NULL;
+  size_t res_len = sizeof(fuzz_resource_seed) - 1;
+
+  if (!hsk_resource_decode(fuzz_resource_seed, res_len, &res)) {
+    fprintf(stderr, "bad resource seed\n");
+    return false;
+  }
+
+  ok &= fuzz_write_seed(dir, "resource", 0, fuzz_resource_seed, res_len);
+
+  static const char *qnames[3] = { "example.", "www.example.", "Example." };
+  static const uint16_t qtypes[3] = { HSK_DNS_NS, HSK_DNS_A, HSK_DNS_TXT };
+  uint8_t *wire;
+  size_t wire_len;
+
+  for (n = 0; n < 3; n++) {
+    hsk_dns_msg_t *msg = hsk_resource_to_dns(res, qnames[n], qtypes[n]);
+
+    if (!msg)
+      continue;
+
+    msg->id = 0x1234 + n;
+    msg->flags |= HSK_DNS_QR | HSK_DNS_AA;
+    msg->edns.enabled = true;
+    msg->edns.size = HSK_DNS_MAX_EDNS;
+
+    hsk_dns_rr_t *qs = hsk_dns_rr_create(qtypes[n]);
+
+    if (qs && hsk_dns_rr_set_name(qs, qnames[n]))
+      hsk_dns_rrs_push(&msg->qd, qs);
+
+    if (!hsk_dns_msg_encode(msg, &wire, &wire_len)) {
+      hsk_dns_msg_free(msg);
+      return false;
+    }
+
+    hsk_dns_msg_free(msg);
+
+    ok &= fuzz_write_seed(dir, "dns", n, wire, wire_len);
+
+    // Truncation seeds start with the size limit.
+    uint8_t *trunc = malloc(wire_len + 2);
+    uint8_t *p = trunc;
+
+    assert(trunc);
+    write_u16be(&p, n == 0 ? HSK_DNS_MAX_UDP : 100);
+    write_bytes(&p, wire, wire_len);
+
+    ok &= fuzz_write_seed(dir, "truncate", n, trunc, wire_len + 2);
+
+    free(trunc);
+
+    uint8_t *signed_wire;
+    size_t signed_len;
+
+    if (hsk_sig0_sign(fuzz.ec, fuzz.key, wire, wire_len,
+                      &signed_wire, &signed_len)) {
+      ok &= fuzz_write_seed(dir, "sig0", n, signed_wire, signed_len);
+      ok &= fuzz_write_seed(dir, "dns", n + 3, signed_wire, signed_len);
+      free(signed_wire);
+    }
+
+    free(wire);
+  }
+
+  hsk_resource_free(res);
+
+  // A query, as it comes in.
+  hsk_dns_msg_t *query = hsk_dns_msg_alloc();
+  hsk_dns_rr_t *qs = hsk_dns_rr_create(HSK_DNS_A);
+
+  assert(query && qs);
+  hsk_dns_rr_set_name(qs, "www.example.");
+  hsk_dns_rrs_push(&query->qd, qs);
+  query->id = 0xbeef;
+  query->flags = HSK_DNS_RD;
+  query->edns.enabled = true;
+  query->edns.size = 1232;
+  query->edns.flags = HSK_DNS_DO;
+
+  if (hsk_dns_msg_encode(query, &wire, &wire_len)) {
+    ok &= fuzz_write_seed(dir, "dns", 6, wire, wire_len);
+    ok &= fuzz_write_seed(dir, "sig0", 3, wire, wire_len);
+
+    // Names, with the second pointing into the first.
+    uint8_t names[64];
+    size_t len = wire_len - 12 - 4 - 11;
+
+    if (len + 2 <= sizeof(names)) {
+      memcpy(names, &wire[12], len);
+      names[len] = 0xc0;
+      names[len + 1] = 4;
+      ok &= fuzz_write_seed(dir, "name", 0, names, len + 2);
+    }
+
+    free(wire);
+  }
+
+  hsk_dns_msg_free(query);
+
+  // Headers, alone and in messages.
+  hsk_header_t genesis;
+  hsk_header_init(&genesis);
+
+  if (!hsk_header_decode(HSK_GENESIS, sizeof(HSK_GENESIS) - 1, &genesis))
+    return false;
+
+  hsk_header_cache(&genesis);
+
+  ok &= fuzz_write_seed(dir, "header", 0, HSK_GENESIS,
+                        sizeof(HSK_GENESIS) - 1);
+
+  // Proofs: a leaf that is the whole tree, and a dead
+  // end one node down. Both verify against their roots.
+  uint8_t proof_buf[512];
+  // A namestate: name "a", then a two byte resource.
+  uint8_t value[6] = { 1, 'a', 2, 0, 0, 0 };
+  uint8_t key[32];
+  uint8_t root[32];
+  hsk_proof_node_t node;
+  hsk_proof_t proof;
+  uint8_t *p;
+
+  memset(key, 0x80, 32);
+
+  {
+    uint8_t vhash[32];
+    uint8_t leaf[65];
+
+    hsk_blake2b(vhash, 32, value, sizeof(value), NULL, 0);
+    leaf[0] = 0x00;
+    memcpy(&leaf[1], key, 32);
+    memcpy(&leaf[33], vhash, 32);
+    hsk_blake2b(root, 32, leaf, 65, NULL, 0);
+  }
+
+  hsk_proof_init(&proof);
+  proof.type = HSK_PROOF_EXISTS;
+  proof.value = value;
+  proof.value_size = sizeof(value);
+
+  p = proof_buf;
+  write_bytes(&p, root, 32);
+  write_bytes(&p, key, 32);
+  hsk_proof_write(&proof, &p);
+
+  ok &= fuzz_write_seed(dir, "proof", 0, proof_buf, p - proof_buf);
+
+  memset(&node, 0x00, sizeof(node));
+  memset(node.node, 0x44, 32);
+
+  {
+    uint8_t inner[65];
+
+    // Key bit 0 is set, so we're on the right.
+    inner[0] = 0x01;
+    memcpy(&inner[1], node.node, 32);
+    memset(&inner[33], 0x00, 32);
+    hsk_blake2b(root, 32, inner, 65, NULL, 0);
+  }
+
+  hsk_proof_init(&proof);
+  proof.type = HSK_PROOF_DEADEND;
+  proof.depth = 1;
+  proof.nodes = &node;
+  proof.node_count = 1;
+
+  p = proof_buf;
+  write_bytes(&p, root, 32);
+  write_bytes(&p, key, 32);
+  hsk_proof_write(&proof, &p);
+
+  ok &= fuzz_write_seed(dir, "proof", 1, proof_buf, p - proof_buf);
+
+  // One of each P2P message, behind its command byte.
+  uint8_t msg_buf[1024];
+  int cmds[11] = {
+    HSK_MSG_VERSION,
+    HSK_MSG_VERACK,
+    HSK_MSG_PING,
+    HSK_MSG_PONG,
+    HSK_MSG_GETADDR,
+    HSK_MSG_ADDR,
+    HSK_MSG_GETHEADERS,
+    HSK_MSG_HEADERS,
+    HSK_MSG_SENDHEADERS,
+    HSK_MSG_GETPROOF,
+    HSK_MSG_PROOF
+  };
+
+  for (n = 0; n < 11; n++) {
+    hsk_msg_t *msg = hsk_msg_alloc(cmds[n]);
+
+    assert(msg);
+
+    switch (msg->cmd) {
+      case HSK_MSG_VERSION: {
+        hsk_version_msg_t *m = (hsk_version_msg_t *)msg;
+        m->version = HSK_PROTO_VERSION;
+        m->services = HSK_SERVICES;
+        m->time = 1580000000;
+        m->nonce = 0x0102030405060708ull;
+        strcpy(m->agent, HSK_USER_AGENT);
+        m->height = 1000;
+        break;
+      }
+      case HSK_MSG_PING:
+      case HSK_MSG_PONG: {
+        ((hsk_ping_msg_t *)msg)->nonce = 0x0102030405060708ull;
+        break;
+      }
+      case HSK_MSG_ADDR: {
+        hsk_addr_msg_t *m = (hsk_addr_msg_t *)msg;
+        m->addr_count = 1;
+        hsk_addr_from_string(&m->addrs[0].addr, "127.0.0.1", HSK_PORT);
+        break;
+      }
+      case HSK_MSG_GETHEADERS: {
+        hsk_getheaders_msg_t *m = (hsk_getheaders_msg_t *)msg;
+        m->hash_count = 1;
+        memcpy(m->hashes[0], genesis.hash, 32);
+        break;
+      }
+      case HSK_MSG_HEADERS: {
+        hsk_headers_msg_t *m = (hsk_headers_msg_t *)msg;
+        m->header_count = 1;
+        m->headers = hsk_header_clone(&genesis);
+        assert(m->headers);
+        break;
+      }
+      case HSK_MSG_GETPROOF:
+      case HSK_MSG_PROOF: {
+        hsk_getproof_msg_t *m = (hsk_getproof_msg_t *)msg;
+        memcpy(m->root, root, 32);
+        memcpy(m->key, key, 32);
+        break;
+      }
+    }
+
+    msg_buf[0] = msg->cmd;
+
+    int size = hsk_msg_encode(msg, &msg_buf[1]);
+
+    ok &= fuzz_write_seed(dir, "msg", n, msg_buf, size + 1);
+
+    hsk_msg_free(msg);
+  }
+
+  // Brontide: an act one, and the same
+  // messages, raw and to be sealed.
+  uint8_t bront[256];
+  fuzz_end_t *i = &fuzz_ends[0];
+  fuzz_end_t *r = &fuzz_ends[1];
+
+  fuzz_end_init(i, r);
+  fuzz_end_init(r, i);
+
+  if (hsk_brontide_connect(&i->b, fuzz.peer_key, fuzz.pub) == HSK_SUCCESS
+      && hsk_brontide_on_connect(&i->b) == HSK_SUCCESS) {
+    bront[0] = 0;
+    bront[1] = 255;
+    memcpy(&bront[2], r->inbox, r->inbox_len);
+    ok &= fuzz_write_seed(dir, "brontide", 0, bront, r->inbox_len + 2);
+  }
+
+  hsk_brontide_uninit(&i->b);
+  hsk_brontide_uninit(&r->b);
+
+  bront[0] = 2;
+  bront[1] = 7;
+  bront[2] = 9;
+  memcpy(&bront[3], "\x01verack!!", 9);
+  bront[12] = 1;
+  bront[13] = HSK_MSG_GETADDR;
+  ok &= fuzz_write_seed(dir, "brontide", 1, bront, 14);
+
+  bront[0] = 1;
+  bront[1] = 17;
+  memset(&bront[2], 0x00, 18 + 16);
+  ok &= fuzz_write_seed(dir, "brontide", 2, bront, 2 + 18 + 16);
+
+  return ok;
+}
+
+/*
+ * Main
+ */
+
+static void
+help(int r) {
+  const fuzz_target_t *t;
+
+  fprintf(stderr,
+    "\n"
+    "Usage: fuzz_hnsd [options] <target> [file|dir|-]...\n"
+    "\n"
+    "  -n, --runs <count>\n"
+    "    Also run this many mutations of the inputs.\n"
+    "\n"
+    "  -s, --seed <number>\n"
+    "    Seed for the mutations.\n"
+    "\n"
+    "  -c, --crash <file>\n"
+    "    Write every mutation to <file> before running it, so that\n"
+    "    it holds the input that crashed.\n"
+    "\n"
+    "  -w, --write-seeds <dir>\n"
+    "    Write a seed corpus for every target to <dir> and exit.\n"
+    "\n"
+    "  -h, --help\n"
+    "    This help message.\n"
+    "\n"
+    "Targets:");
+
+  for (t = fuzz_targets; t->name; t++)
+    fprintf(stderr, " %s", t->name);
+
+  fprintf(stderr, "\n\n");
+
+  exit(r);
+}
+
+int
+main(int argc, char **argv) {
+  const char *seeds = NULL;
+  const char *crash = NULL;
+  unsigned long runs = 0;
+
+  static const struct option long_options[] = {
+    { "runs", required_argument, NULL, 'n' },
+    { "seed", required_argument, NULL, 's' },
+    { "crash", required_argument, NULL, 'c' },
+    { "write-seeds", required_argument, NULL, 'w' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:s:c:w:h", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'n': {
+        runs = strtoul(optarg, NULL, 10);
+        break;
+      }
+      case 's': {
+        fuzz_rng = strtoull(optarg, NULL, 10) | 1;
+        break;
+      }
+      case 'c': {
+        crash = optarg;
+        break;
+      }
+      case 'w': {
+        seeds = optarg;
+        break;
+      }
+      case 'h': {
+        help(0);
+        break;
+      }
+      default: {
+        help(1);
+        break;
+      }
+    }
+  }
+
+  if (!fuzz_init()) {
+    fprintf(stderr, "could not create ec context\n");
+    return 1;
+  }
+
+  if (seeds) {
+    fuzz.target = &fuzz_targets[0];
+    return fuzz_write_seeds(seeds) ? 0 : 1;
+  }
+
+  if (optind >= argc)
+    help(1);
+
+  fuzz.target = fuzz_find(argv[optind++]);
+
+  if (!fuzz.target)
+    help(1);
+
+  fuzz_corpus_t corpus = { NULL, NULL, 0, 0 };
+  bool ok = true;
+
+  if (optind == argc)
+    ok = fuzz_read_path("-", &corpus);
+
+  for (; ok && optind < argc; optind++)
+    ok = fuzz_read_path(argv[optind], &corpus);
+
+  if (!ok)
+    return 1;
+
+  size_t i;
+
+  for (i = 0; i < corpus.count; i++)
+    fuzz_run(corpus.items[i], corpus.sizes[i]);
+
+  if (runs > 0 && corpus.count > 0) {
+    uint8_t *buf = malloc(FUZZ_MAX_INPUT);
+    unsigned long n;
+
+    assert(buf);
+
+    for (n = 0; n < runs; n++) {
+      size_t pick = fuzz_rand((uint32_t)corpus.count);
+      size_t len = corpus.sizes[pick];
+
+      memcpy(buf, corpus.items[pick], len);
+
+      len = fuzz_mutate(buf, len, FUZZ_MAX_INPUT);
+
+      if (crash) {
+        FILE *fp = fopen(crash, "wb");
+
+        if (fp) {
+          fwrite(buf, 1, len, fp);
+          fclose(fp);
+        }
+      }
+
+      fuzz_run(buf, len);
+    }
+
+    free(buf);
+  }
+
+  fprintf(stderr, "%s: %zu inputs, %lu mutations\n",
+          fuzz.target->name, corpus.count, runs);
+
+  for (i = 0; i < corpus.count; i++)
+    free(corpus.items[i]);
+
+  free(corpus.items);
+  free(corpus.sizes);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#!/bin/sh
+
+# Runs hnsd's graceful restart (--handoff) end to end: the UDP sockets go
+# from one hnsd process to another over SCM_RIGHTS while load_hnsd keeps
+# querying them. Needs a regtest build (./configure --with-network=regtest)
+# of hnsd, mock_hnsd and load_hnsd in the current directory.
+#
+#   $ ./test/handoff-test.sh [out-dir]
+#
+# First a new process that can never get ready (it has no peer) takes the
+# sockets and is killed; the old one has to keep serving. Then one that can
+# get ready takes over, and the old one has to exit. out-dir gets the logs.
+# hnsd's log is only flushed when it exits, so it is checked afterwards.
+
+set -e
+
+out=${1:-handoff-results}
+
+peer=127.0.0.1:24038
+ns=127.0.0.1:25449
+rs=127.0.0.1:25450
+path=$out/handoff.sock
+
+mkdir -p "$out"
+rm -f "$path"
+
+pids=
+
+fail() {
+  echo "handoff: $*" >&2
+  kill $pids 2> /dev/null || true
+  exit 1
+}
+
+# Wait for a condition.
+wait_for() {
+  tries=0
+
+  until eval "$1"; do
+    tries=$((tries + 1))
+
+    if [ $tries -gt 60 ]; then
+      fail "timed out waiting for: $1"
+    fi
+
+    sleep 0.5
+  done
+}
+
+logged() {
+  grep -q "$2" "$out/$1.log" || fail "no \"$2\" in $out/$1.log"
+}
+
+# The root nameserver answers (nearly) everything.
+serving() {
+  ./load_hnsd -n "$ns" -q 100 -d 2 "$out/queries.txt" \
+    > "$out/$1-load.txt" 2>&1
+  awk '$1 == "ns" { ok = $3 > 0 && $3 * 100 >= $2 * 99 } END { exit !ok }' \
+    "$out/$1-load.txt"
+}
+
+./mock_hnsd -g 1000 -N 200 -Q "$out/queries.txt" -p "$peer" \
+  > /dev/null 2> "$out/mock.log" &
+mock=$!
+pids=$mock
+
+sleep 1
+
+./hnsd -p 1 -s "$peer" -n "$ns" -r "$rs" -g "$path" > "$out/old.log" 2>&1 &
+old=$!
+pids="$pids $old"
+
+wait_for '[ -S "$path" ]'
+wait_for 'grep -q synced "$out/mock.log"'
+
+serving old || fail "old process is not serving"
+
+# Nothing listens on port 1, so this one never gets ready.
+./hnsd -p 1 -s 127.0.0.1:1 -n "$ns" -r "$rs" -g "$path" \
+  > "$out/dead.log" 2>&1 &
+dead=$!
+pids="$pids $dead"
+
+# Taking the sockets happens before it even opens the pool.
+sleep 2
+
+kill -9 $dead
+wait $dead || true
+
+kill -0 $old 2> /dev/null || fail "old process exited"
+serving dead || fail "old process stopped serving after the new one died"
+
+./hnsd -p 1 -s "$peer" -n "$ns" -r "$rs" -g "$path" > "$out/new.log" 2>&1 &
+new=$!
+pids="$pids $new"
+
+# Once the new one is ready, the old one drains for a few seconds and exits.
+wait_for '! kill -0 $old 2> /dev/null'
+wait $old || fail "old process failed"
+
+serving new || fail "new process is not serving"
+
+kill $new $mock
+wait $new || true
+wait $mock || true
+
+logged old "new process went away, still serving"
+logged old "new process is serving, draining"
+logged new "handoff: took over"
+
+echo "handoff: ok"
@@ -1,7 +1,21 @@
 #include <assert.h>
+#include "activation.c"
 #include "base32.h"
+#include "blake2b.h"
+#include "brontide.h"
+#include "cache.h"
+#include "chain.c"
+#include "conf.h"
+#include "msg.h"
+#include "pool.h"
+#include "proof.h"
+#include "resolver.h"
 #include "resource.h"
 #include "resource.c"
+#include "sha256.h"
+#include "sig0.h"
+#include "signer.h"
+#include "workers.h"
 
 void
 print_array(uint8_t *arr, size_t size){
@@ -60,11 +74,1994 @@ test_pointer_to_ip() {
   assert(family6 == HSK_DNS_AAAA);
 }
 
+static void
+test_after_sign(void *arg, bool ok, uint8_t *wire, size_t wire_len) {
+  int *done = (int *)arg;
+
+  assert(ok);
+  assert(hsk_sig0_has_sig(wire, wire_len));
+
+  free(wire);
+
+  *done += 1;
+}
+
+void
+test_sig0_signer() {
+  const uint8_t key[32] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+    0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20
+  };
+
+  hsk_ec_t *ec = hsk_ec_alloc();
+  assert(ec);
+
+  uint8_t pub[33];
+  assert(hsk_ec_create_pubkey(ec, key, pub));
+
+  hsk_dns_msg_t *msg = hsk_resource_to_nx();
+  assert(msg);
+
+  uint8_t *data;
+  size_t data_len;
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+  hsk_dns_msg_free(msg);
+
+  uint8_t wire[512];
+  size_t wire_len;
+  assert(data_len + HSK_SIG0_RR_SIZE <= sizeof(wire));
+
+  // Precomputed nonce.
+  uv_loop_t *loop = uv_default_loop();
+  hsk_signer_t *signer = hsk_signer_alloc(loop, key);
+  assert(signer);
+
+  hsk_signer_fill(signer);
+  assert(signer->nonce_count == HSK_SIGNER_NONCES);
+
+  memcpy(wire, data, data_len);
+  assert(hsk_signer_sign_wire(signer, wire, data_len, &wire_len));
+  assert(wire_len == data_len + HSK_SIG0_RR_SIZE);
+  assert(signer->pooled == 1);
+  assert(hsk_sig0_verify(ec, pub, wire, wire_len));
+
+  // Re-signing replaces the existing record.
+  assert(hsk_signer_sign_wire(signer, wire, wire_len, &wire_len));
+  assert(wire_len == data_len + HSK_SIG0_RR_SIZE);
+  assert(hsk_sig0_verify(ec, pub, wire, wire_len));
+
+  // RFC 6979 fallback once the pool is empty.
+  signer->nonce_count = 0;
+  memcpy(wire, data, data_len);
+  assert(hsk_signer_sign_wire(signer, wire, data_len, &wire_len));
+  assert(signer->fallback == 1);
+  assert(hsk_sig0_verify(ec, pub, wire, wire_len));
+
+  // Without the ID, a signed answer survives a new ID.
+  hsk_signer_set_cover_id(signer, false);
+  memcpy(wire, data, data_len);
+  wire[0] = 0x12;
+  wire[1] = 0x34;
+  assert(hsk_signer_sign_wire(signer, wire, data_len, &wire_len));
+  assert(!hsk_sig0_verify(ec, pub, wire, wire_len));
+  assert(hsk_sig0_verify_noid(ec, pub, wire, wire_len));
+  wire[0] ^= 0xff;
+  wire[1] ^= 0xff;
+  assert(hsk_sig0_verify_noid(ec, pub, wire, wire_len));
+
+  // Offloaded to the signing thread.
+  int done = 0;
+
+  assert(hsk_signer_open(signer) == HSK_SUCCESS);
+
+  for (int i = 0; i < 8; i++) {
+    uint8_t *copy = malloc(data_len + HSK_SIG0_RR_SIZE);
+    assert(copy);
+    memcpy(copy, data, data_len);
+    assert(hsk_signer_submit(signer, copy, data_len,
+                             test_after_sign, &done) == HSK_SUCCESS);
+  }
+
+  while (done < 8)
+    uv_run(loop, UV_RUN_ONCE);
+
+  hsk_signer_close(signer);
+
+  assert(hsk_signer_submit(signer, wire, data_len,
+                           test_after_sign, &done) == HSK_EFAILURE);
+
+  hsk_signer_free(signer);
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  free(data);
+  hsk_ec_free(ec);
+}
+
+void
+test_blake2b_block() {
+  uint8_t msg[128];
+  uint8_t expect[32];
+  uint8_t outs[4][32];
+  uint8_t *out[4] = { outs[0], outs[1], outs[2], outs[3] };
+
+  for (int i = 0; i < 128; i++)
+    msg[i] = i * 7 + 1;
+
+  for (size_t len = 0; len <= 128; len++) {
+    assert(hsk_blake2b(expect, 32, msg, len, NULL, 0) == 0);
+
+    hsk_blake2b_256_block(outs[0], msg, len);
+    assert(memcmp(outs[0], expect, 32) == 0);
+
+    const uint8_t *in[4] = { msg, msg + 1, msg, msg };
+    const size_t lens[4] = { len, len > 0 ? len - 1 : 0, 0, len };
+
+    hsk_blake2b_256_block_x4(out, in, lens);
+
+    for (int j = 0; j < 4; j++) {
+      assert(hsk_blake2b(expect, 32, in[j], lens[j], NULL, 0) == 0);
+      assert(memcmp(outs[j], expect, 32) == 0);
+    }
+  }
+}
+
+void
+test_proof_batch() {
+  // A dead end proof down an all-zero key, one
+  // node per bit. Siblings always sit on the right.
+  uint8_t key[32] = {0};
+  uint8_t root[32] = {0};
+  hsk_proof_node_t nodes[5];
+  hsk_proof_t proof;
+
+  hsk_proof_init(&proof);
+  proof.type = HSK_PROOF_DEADEND;
+  proof.depth = 5;
+  proof.nodes = nodes;
+  proof.node_count = 5;
+
+  memset(nodes, 0x00, sizeof(nodes));
+
+  for (int i = 4; i >= 0; i--) {
+    uint8_t data[65];
+
+    memset(nodes[i].node, i + 1, 32);
+
+    data[0] = 0x01;
+    memcpy(&data[1], root, 32);
+    memcpy(&data[33], nodes[i].node, 32);
+
+    assert(hsk_blake2b(root, 32, data, 65, NULL, 0) == 0);
+  }
+
+  uint8_t bad[32];
+  memcpy(bad, root, 32);
+  bad[0] ^= 1;
+
+  uint8_t other[32] = {0};
+  other[0] = 0x80;
+
+  hsk_proof_job_t jobs[7];
+
+  for (int i = 0; i < 7; i++) {
+    jobs[i].root = root;
+    jobs[i].key = key;
+    jobs[i].proof = &proof;
+  }
+
+  jobs[2].root = bad;
+  jobs[4].key = other;
+  jobs[5].proof = NULL;
+
+  hsk_proof_verify_batch(jobs, 7);
+
+  for (int i = 0; i < 7; i++) {
+    bool exists;
+    uint8_t *data;
+    size_t data_len;
+    int rc = HSK_EBADARGS;
+
+    if (jobs[i].proof) {
+      rc = hsk_proof_verify(jobs[i].root, jobs[i].key, jobs[i].proof,
+                            &exists, &data, &data_len);
+    }
+
+    assert(jobs[i].result == rc);
+  }
+
+  assert(jobs[0].result == HSK_EPROOFOK && !jobs[0].exists);
+  assert(jobs[2].result == HSK_EHASHMISMATCH);
+  assert(jobs[4].result == HSK_EHASHMISMATCH);
+}
+
+void
+test_proof_write() {
+  // One plain node, one short and one long
+  // (two byte bitlen) prefix, ending in a short.
+  hsk_proof_node_t nodes[3];
+  uint8_t prefix[2] = {0xa5, 0x80};
+  uint8_t left[32], right[32];
+  hsk_proof_t proof;
+
+  memset(nodes, 0x00, sizeof(nodes));
+  memset(left, 0x11, 32);
+  memset(right, 0x22, 32);
+
+  nodes[1].prefix_size = 9;
+  nodes[1].prefix[0] = 0xff;
+  nodes[1].prefix[1] = 0x80;
+  nodes[2].prefix_size = 200;
+  memset(nodes[2].prefix, 0x5a, 25);
+
+  for (int i = 0; i < 3; i++)
+    memset(nodes[i].node, i + 1, 32);
+
+  hsk_proof_init(&proof);
+  proof.type = HSK_PROOF_SHORT;
+  proof.depth = 212;
+  proof.nodes = nodes;
+  proof.node_count = 3;
+  proof.prefix = prefix;
+  proof.prefix_size = 9;
+  proof.left = left;
+  proof.right = right;
+
+  int size = hsk_proof_size(&proof);
+  uint8_t data[512];
+  uint8_t *p = data;
+
+  // 2 + 2 + 1 + 32 + (1 + 2 + 32) + (2 + 25 + 32) + (1 + 2 + 64)
+  assert(size == 198);
+  assert(hsk_proof_write(&proof, &p) == size);
+  assert(p - data == size);
+
+  hsk_proof_t out;
+  hsk_proof_init(&out);
+
+  assert(hsk_proof_decode(data, size, &out));
+  assert(out.type == HSK_PROOF_SHORT);
+  assert(out.depth == 212);
+  assert(out.node_count == 3);
+
+  for (int i = 0; i < 3; i++) {
+    assert(out.nodes[i].prefix_size == nodes[i].prefix_size);
+    assert(memcmp(out.nodes[i].prefix, nodes[i].prefix, 32) == 0);
+    assert(memcmp(out.nodes[i].node, nodes[i].node, 32) == 0);
+  }
+
+  assert(out.prefix_size == 9);
+  assert(memcmp(out.prefix, prefix, 2) == 0);
+  assert(memcmp(out.left, left, 32) == 0);
+  assert(memcmp(out.right, right, 32) == 0);
+
+  hsk_proof_uninit(&out);
+
+  // Leaf values carry their own length.
+  uint8_t value[3] = {1, 2, 3};
+
+  hsk_proof_init(&proof);
+  proof.type = HSK_PROOF_EXISTS;
+  proof.depth = 1;
+  proof.nodes = nodes;
+  proof.node_count = 1;
+  proof.value = value;
+  proof.value_size = 3;
+
+  p = data;
+  size = hsk_proof_write(&proof, &p);
+  assert(size == 2 + 2 + 1 + 32 + 2 + 3);
+
+  hsk_proof_init(&out);
+  assert(hsk_proof_decode(data, size, &out));
+  assert(out.type == HSK_PROOF_EXISTS);
+  assert(out.value_size == 3 && memcmp(out.value, value, 3) == 0);
+  hsk_proof_uninit(&out);
+}
+
+static void
+test_work(void *arg) {
+  int *item = (int *)arg;
+  item[1] = item[0] * 2;
+}
+
+static void
+test_after_work(void *arg, bool ok) {
+  int *item = (int *)arg;
+  assert(ok);
+  assert(item[1] == item[0] * 2);
+  item[2] = 1;
+}
+
+void
+test_workers() {
+  int items[64][3];
+
+  uv_loop_t *loop = uv_default_loop();
+  hsk_workers_t *workers = hsk_workers_alloc(loop);
+  assert(workers);
+
+  assert(hsk_workers_queue(workers, test_work, test_after_work, items[0])
+         == HSK_EFAILURE);
+
+  assert(hsk_workers_open(workers, 3) == HSK_SUCCESS);
+  assert(hsk_workers_is_open(workers));
+
+  for (int i = 0; i < 64; i++) {
+    items[i][0] = i;
+    items[i][1] = -1;
+    items[i][2] = 0;
+    assert(hsk_workers_queue(workers, test_work, test_after_work, items[i])
+           == HSK_SUCCESS);
+  }
+
+  // Completions come back through the async.
+  for (int i = 0; i < 64; i++) {
+    while (!items[i][2])
+      uv_run(loop, UV_RUN_ONCE);
+  }
+
+  hsk_workers_close(workers);
+
+  hsk_workers_free(workers);
+  uv_run(loop, UV_RUN_DEFAULT);
+}
+
+static uint8_t *
+test_query(uint16_t id, const char *name, uint16_t type, size_t *len) {
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+  hsk_dns_qs_t *qs = hsk_dns_qs_alloc();
+  uint8_t *wire;
+
+  assert(msg && qs);
+
+  msg->id = id;
+  hsk_dns_qs_set(qs, name, type);
+  hsk_dns_rrs_push(&msg->qd, qs);
+
+  assert(hsk_dns_msg_encode(msg, &wire, len));
+
+  hsk_dns_msg_free(msg);
+
+  return wire;
+}
+
+static void
+test_after_resolve(
+  void *arg,
+  int status,
+  uint8_t *wire,
+  size_t wire_len,
+  const struct sockaddr *addr
+) {
+  int *expect = (int *)arg;
+  hsk_dns_msg_t *msg = NULL;
+
+  // Not taken.
+  if (expect[1] < 0) {
+    assert(status == HSK_EENCODING && !wire);
+    expect[3] += 1;
+    return;
+  }
+
+  assert(status == HSK_SUCCESS && wire);
+  assert(addr == NULL);
+  assert(hsk_sig0_has_sig(wire, wire_len) == (expect[2] != 0));
+  assert(hsk_dns_msg_decode(wire, wire_len, &msg));
+  assert(msg->id == expect[0]);
+  assert(msg->code == expect[1]);
+
+  hsk_dns_msg_free(msg);
+  free(wire);
+
+  expect[3] += 1;
+}
+
+static void
+test_after_fail(
+  void *arg,
+  int status,
+  uint8_t *wire,
+  size_t wire_len,
+  const struct sockaddr *addr
+) {
+  int *failed = (int *)arg;
+
+  assert(status == HSK_EFAILURE && !wire);
+
+  *failed += 1;
+}
+
+void
+test_resolver() {
+  // The root zone, blacklisted TLDs and synth names
+  // are answered without asking the pool.
+  static const char *names[3] = { ".", "onion.", "_5l6tm80._synth." };
+  static const uint16_t types[3] = { HSK_DNS_NS, HSK_DNS_A, HSK_DNS_A };
+  static const int codes[3] = {
+    HSK_DNS_NOERROR,
+    HSK_DNS_NXDOMAIN,
+    HSK_DNS_NOERROR
+  };
+
+  uint8_t key[32];
+  memset(key, 0x01, sizeof(key));
+
+  uv_loop_t *loop = uv_default_loop();
+  hsk_pool_t *pool = hsk_pool_alloc(loop);
+  assert(pool);
+
+  for (int sign = 0; sign < 2; sign++) {
+    hsk_resolver_t *resolver = hsk_resolver_alloc(loop, pool);
+    hsk_resolver_query_t queries[4];
+    int expect[4][4];
+    int i;
+
+    assert(resolver);
+
+    if (sign)
+      assert(hsk_resolver_set_key(resolver, key));
+
+    for (i = 0; i < 3; i++) {
+      expect[i][0] = 0x100 + i;
+      expect[i][1] = codes[i];
+      expect[i][2] = sign;
+      expect[i][3] = 0;
+
+      queries[i].data = test_query(0x100 + i, names[i], types[i],
+                                   &queries[i].data_len);
+      queries[i].addr = NULL;
+      queries[i].arg = expect[i];
+    }
+
+    // Not a query.
+    queries[3].data = (const uint8_t *)"garbage";
+    queries[3].data_len = 7;
+    queries[3].addr = NULL;
+    queries[3].arg = expect[3];
+    expect[3][1] = -1;
+    expect[3][3] = 0;
+
+    assert(hsk_resolver_resolve(resolver, queries[0].data,
+                                queries[0].data_len, NULL,
+                                test_after_resolve, expect[0])
+           == HSK_EFAILURE);
+
+    assert(hsk_resolver_open(resolver) == HSK_SUCCESS);
+
+    assert(hsk_resolver_resolve_batch(resolver, queries, 4,
+                                      test_after_resolve) == 3);
+
+    // Called back right away.
+    assert(expect[3][3] == 1);
+
+    // Root zone answers come from the cache the second time.
+    assert(hsk_resolver_resolve(resolver, queries[0].data,
+                                queries[0].data_len, NULL,
+                                test_after_resolve, expect[0])
+           == HSK_SUCCESS);
+
+    while (expect[0][3] < 2 || expect[1][3] < 1 || expect[2][3] < 1)
+      uv_run(loop, UV_RUN_ONCE);
+
+    assert(expect[3][3] == 1);
+
+    assert(hsk_resolver_close(resolver) == HSK_SUCCESS);
+    hsk_resolver_free(resolver);
+
+    for (i = 0; i < 3; i++)
+      free((uint8_t *)queries[i].data);
+  }
+
+  // A query still waiting for a proof is failed, even after the
+  // resolver is closed, once the pool gives up on it.
+  hsk_resolver_t *resolver = hsk_resolver_alloc(loop, pool);
+  int failed = 0;
+  size_t len;
+  uint8_t *query = test_query(0x100, "hnsd-test.", HSK_DNS_A, &len);
+
+  assert(resolver);
+
+  // With no peers, the request waits in the pool.
+  pool->chain.synced = true;
+
+  assert(hsk_resolver_open(resolver) == HSK_SUCCESS);
+  assert(hsk_resolver_resolve(resolver, query, len, NULL,
+                              test_after_fail, &failed)
+         == HSK_SUCCESS);
+
+  assert(hsk_resolver_close(resolver) == HSK_SUCCESS);
+  assert(failed == 0);
+
+  hsk_pool_free(pool);
+  assert(failed == 1);
+
+  hsk_resolver_free(resolver);
+  free(query);
+
+  uv_run(loop, UV_RUN_DEFAULT);
+}
+
+typedef struct {
+  hsk_resolver_t *resolver;
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  uint8_t *query;
+  size_t query_len;
+  size_t sent;
+  size_t answered;
+} test_resolver_thread_t;
+
+static void
+test_thread_after_resolve(
+  void *arg,
+  int status,
+  uint8_t *wire,
+  size_t wire_len,
+  const struct sockaddr *addr
+) {
+  test_resolver_thread_t *t = (test_resolver_thread_t *)arg;
+
+  assert(status == HSK_SUCCESS ? wire != NULL : wire == NULL);
+
+  free(wire);
+
+  uv_mutex_lock(&t->mutex);
+  t->answered += 1;
+  uv_cond_signal(&t->cond);
+  uv_mutex_unlock(&t->mutex);
+}
+
+// Keeps submitting until the resolver is closed under it.
+static void
+test_resolver_submit(void *arg) {
+  test_resolver_thread_t *t = (test_resolver_thread_t *)arg;
+  hsk_resolver_query_t queries[8];
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    queries[i].data = t->query;
+    queries[i].data_len = t->query_len;
+    queries[i].addr = NULL;
+    queries[i].arg = (void *)t;
+  }
+
+  for (;;) {
+    size_t n = hsk_resolver_resolve_batch(t->resolver, queries, 8,
+                                          test_thread_after_resolve);
+
+    assert(n == 0 || n == 8);
+
+    uv_mutex_lock(&t->mutex);
+    t->sent += 8;
+    uv_mutex_unlock(&t->mutex);
+
+    if (n == 0)
+      break;
+  }
+}
+
+void
+test_resolver_thread() {
+  test_resolver_thread_t t;
+  uv_thread_t thread;
+
+  t.resolver = hsk_resolver_alloc(NULL, NULL);
+  t.query = test_query(0x100, ".", HSK_DNS_NS, &t.query_len);
+  t.sent = 0;
+  t.answered = 0;
+
+  assert(t.resolver);
+  assert(uv_mutex_init(&t.mutex) == 0);
+  assert(uv_cond_init(&t.cond) == 0);
+  assert(hsk_resolver_set_threads(t.resolver, 0));
+
+  assert(hsk_resolver_resolve(t.resolver, t.query, t.query_len, NULL,
+                              test_thread_after_resolve, &t)
+         == HSK_EFAILURE);
+
+  assert(hsk_resolver_open(t.resolver) == HSK_SUCCESS);
+  assert(uv_thread_create(&thread, test_resolver_submit, &t) == 0);
+
+  // Close while the other thread is still submitting.
+  uv_mutex_lock(&t.mutex);
+
+  while (t.answered < 1000)
+    uv_cond_wait(&t.cond, &t.mutex);
+
+  uv_mutex_unlock(&t.mutex);
+
+  assert(hsk_resolver_close(t.resolver) == HSK_SUCCESS);
+  uv_thread_join(&thread);
+
+  // Root zone answers need no proof, so everything has been called
+  // back: answered if it was taken, failed if it wasn't.
+  assert(t.answered == t.sent);
+
+  assert(hsk_resolver_resolve(t.resolver, t.query, t.query_len, NULL,
+                              test_thread_after_resolve, &t)
+         == HSK_EFAILURE);
+
+  hsk_resolver_free(t.resolver);
+  uv_cond_destroy(&t.cond);
+  uv_mutex_destroy(&t.mutex);
+  free(t.query);
+}
+
+void
+test_aead_key() {
+  uint8_t key[32];
+  uint8_t iv[12];
+  uint8_t ad[32];
+  uint8_t msg[1500];
+  uint8_t out1[1500];
+  uint8_t out2[1500];
+  uint8_t tag1[16];
+  uint8_t tag2[16];
+
+  for (int i = 0; i < 32; i++)
+    key[i] = ad[i] = i;
+
+  for (int i = 0; i < 12; i++)
+    iv[i] = 0xa0 + i;
+
+  for (int i = 0; i < sizeof(msg); i++)
+    msg[i] = i * 7;
+
+  // Odd lengths take every path through the keystream.
+  size_t lens[] = { 0, 4, 63, 64, 65, 513, 1500 };
+
+  for (int j = 0; j < 7; j++) {
+    size_t len = lens[j];
+    hsk_aead_t a1, a2;
+    hsk_aead_key_t k;
+
+    hsk_aead_init(&a1);
+    hsk_aead_setup(&a1, key, iv);
+    hsk_aead_aad(&a1, ad, 32);
+    hsk_aead_encrypt(&a1, msg, out1, len);
+    hsk_aead_final(&a1, tag1);
+
+    hsk_aead_init(&a2);
+    hsk_aead_key_init(&k, key);
+    hsk_aead_setup_key(&a2, &k, iv);
+    hsk_aead_aad(&a2, ad, 32);
+    hsk_aead_encrypt(&a2, msg, out2, 1);
+    hsk_aead_encrypt(&a2, msg + 1, out2 + 1, len > 0 ? len - 1 : 0);
+    hsk_aead_final(&a2, tag2);
+
+    if (len == 0)
+      continue;
+
+    assert(memcmp(out1, out2, len) == 0);
+    assert(memcmp(tag1, tag2, 16) == 0);
+
+    hsk_aead_setup_key(&a2, &k, iv);
+    hsk_aead_aad(&a2, ad, 32);
+    hsk_aead_decrypt(&a2, out2, out2, len);
+    hsk_aead_final(&a2, tag2);
+
+    assert(memcmp(out2, msg, len) == 0);
+    assert(hsk_aead_verify(tag1, tag2));
+  }
+
+  // Key rotation matches the generic HKDF.
+  hsk_cs_t cs;
+  uint8_t salt[32];
+  uint8_t h1[32];
+  uint8_t h2[32];
+
+  memset(salt, 0x5c, 32);
+
+  hsk_cs_init(&cs);
+  hsk_cs_init_saltkey(&cs, salt, key);
+  hsk_cs_rotate_key(&cs);
+  hsk_hash_hkdf(key, 32, salt, 32, NULL, 0, h1, h2);
+
+  assert(memcmp(cs.salt, h1, 32) == 0);
+  assert(memcmp(cs.secret_key, h2, 32) == 0);
+  assert(cs.nonce == 0);
+}
+
+void
+test_dns_name() {
+  hsk_dns_name_t name, zone;
+  char str[HSK_DNS_MAX_NAME + 1];
+  size_t size;
+
+  assert(hsk_dns_name_set(&name, "Www.Example.HNS."));
+  assert(name.count == 3);
+  assert(!name.dirty);
+  assert(memcmp(name.data, "\x03www\x07" "example\x03hns", 17) == 0);
+
+  // Offsets line up with the dotted string.
+  assert(strcmp(&"Www.Example.HNS."[name.labels[1]], "Example.HNS.") == 0);
+
+  assert(hsk_dns_name_label(&name, -1, str) == 3);
+  assert(strcmp(str, "hns") == 0);
+  assert(hsk_dns_name_label(&name, 0, str) == 3);
+  assert(strcmp(str, "www") == 0);
+  assert(hsk_dns_name_label(&name, 3, str) == 0);
+  assert(hsk_dns_name_from(&name, -2, str) == 12);
+  assert(strcmp(str, "example.hns.") == 0);
+
+  const uint8_t *suffix = hsk_dns_name_suffix(&name, -1, &size);
+  assert(size == 5 && memcmp(suffix, "\x03hns", 5) == 0);
+
+  assert(hsk_dns_name_set(&zone, "example.hns."));
+  assert(hsk_dns_name_is_subdomain(&zone, &name));
+  assert(!hsk_dns_name_is_subdomain(&name, &zone));
+  assert(!hsk_dns_name_is_subdomain(&zone, &zone));
+  assert(hsk_dns_is_subdomain("EXAMPLE.hns.", "ns1.example.HNS."));
+  assert(!hsk_dns_is_subdomain("ample.hns.", "ns1.example.hns."));
+
+  assert(hsk_dns_name_set(&zone, "WWW.example.hns."));
+  assert(hsk_dns_name_equal(&zone, &name));
+  assert(zone.hash == name.hash);
+
+  assert(hsk_dns_name_set(&name, "."));
+  assert(name.count == 0 && name.size == 1);
+
+  assert(hsk_dns_name_set(&name, "a b.hns."));
+  assert(name.dirty);
+
+  assert(!hsk_dns_name_set(&name, "example.hns"));
+  assert(!hsk_dns_name_set(&name, "example..hns."));
+}
+
+static hsk_dns_rr_t *
+test_ns_rr(const char *name, const char *ns, uint32_t ttl) {
+  hsk_dns_rr_t *rr = hsk_dns_rr_create(HSK_DNS_NS);
+  assert(rr);
+  strcpy(rr->name, name);
+  rr->class = HSK_DNS_IN;
+  rr->ttl = ttl;
+  strcpy(((hsk_dns_ns_rd_t *)rr->rd)->ns, ns);
+  return rr;
+}
+
+static hsk_dns_rr_t *
+test_a_rr(const char *name, uint8_t last) {
+  hsk_dns_rr_t *rr = hsk_dns_rr_create(HSK_DNS_A);
+  assert(rr);
+  strcpy(rr->name, name);
+  rr->class = HSK_DNS_IN;
+  rr->ttl = 300;
+  uint8_t *addr = ((hsk_dns_a_rd_t *)rr->rd)->addr;
+  addr[0] = 10;
+  addr[3] = last;
+  return rr;
+}
+
+// The RFC 4034 digest, built the long way from
+// records that are already canonical and sorted.
+static void
+test_sighash_expect(hsk_dns_rrs_t *canon, hsk_dns_rr_t *sig, uint8_t *hash) {
+  uint8_t *data;
+  size_t size;
+  hsk_sha256_ctx ctx;
+
+  hsk_sha256_init(&ctx);
+
+  assert(hsk_dns_rrsig_tbs(sig->rd, &data, &size));
+  hsk_sha256_update(&ctx, data, size);
+  free(data);
+
+  for (int i = 0; i < canon->size; i++) {
+    assert(hsk_dns_rr_encode(canon->items[i], &data, &size));
+    hsk_sha256_update(&ctx, data, size);
+    free(data);
+  }
+
+  hsk_sha256_final(&ctx, hash);
+}
+
+void
+test_dns_sighash() {
+  hsk_dns_rrs_t rrset, canon;
+  hsk_dns_rr_t *sig = hsk_dns_rr_create(HSK_DNS_RRSIG);
+  hsk_dns_rrsig_rd_t *rrsig = sig->rd;
+  uint8_t hash[32], expect[32];
+
+  rrsig->type_covered = HSK_DNS_NS;
+  rrsig->algorithm = 13;
+  rrsig->labels = 1;
+  rrsig->orig_ttl = 3600;
+  rrsig->expiration = 1700000000;
+  rrsig->inception = 1600000000;
+  rrsig->key_tag = 12345;
+  strcpy(rrsig->signer_name, "Example.");
+
+  // Mixed case, out of order, with a duplicate.
+  hsk_dns_rrs_init(&rrset);
+  hsk_dns_rrs_push(&rrset, test_ns_rr("eXample.", "NS2.Example.", 60));
+  hsk_dns_rrs_push(&rrset, test_ns_rr("eXample.", "ns1.example.", 60));
+  hsk_dns_rrs_push(&rrset, test_ns_rr("eXample.", "NS1.EXAMPLE.", 60));
+
+  hsk_dns_rrs_init(&canon);
+  hsk_dns_rrs_push(&canon, test_ns_rr("example.", "ns1.example.", 3600));
+  hsk_dns_rrs_push(&canon, test_ns_rr("example.", "ns2.example.", 3600));
+
+  assert(hsk_dns_sighash(&rrset, sig, hash));
+  test_sighash_expect(&canon, sig, expect);
+  assert(memcmp(hash, expect, 32) == 0);
+
+  // Nothing it was given is modified.
+  assert(strcmp(rrset.items[0]->name, "eXample.") == 0);
+  assert(strcmp(rrsig->signer_name, "Example.") == 0);
+
+  hsk_dns_rrs_uninit(&rrset);
+  hsk_dns_rrs_uninit(&canon);
+
+  // Too big for the stack arena.
+  rrsig->type_covered = HSK_DNS_A;
+  rrsig->orig_ttl = 300;
+
+  hsk_dns_rrs_init(&rrset);
+  hsk_dns_rrs_init(&canon);
+
+  for (int i = 100; i > 0; i--)
+    hsk_dns_rrs_push(&rrset, test_a_rr("a.example.", i % 90));
+
+  for (int i = 0; i < 90; i++)
+    hsk_dns_rrs_push(&canon, test_a_rr("a.example.", i));
+
+  assert(hsk_dns_sighash(&rrset, sig, hash));
+  test_sighash_expect(&canon, sig, expect);
+  assert(memcmp(hash, expect, 32) == 0);
+
+  hsk_dns_rrs_uninit(&rrset);
+  hsk_dns_rrs_uninit(&canon);
+  hsk_dns_rr_free(sig);
+}
+
+void
+test_dns_compress() {
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+  assert(msg);
+
+  hsk_dns_rr_t *qs = hsk_dns_rr_create(HSK_DNS_A);
+  assert(qs && hsk_dns_rr_set_name(qs, "www.example.hns."));
+  hsk_dns_rrs_push(&msg->qd, qs);
+
+  hsk_dns_rr_t *cname = hsk_dns_rr_create(HSK_DNS_CNAME);
+  assert(cname && hsk_dns_rr_set_name(cname, "www.example.hns."));
+  strcpy(((hsk_dns_cname_rd_t *)cname->rd)->target, "ns1.example.hns.");
+  hsk_dns_rrs_push(&msg->an, cname);
+
+  hsk_dns_rr_t *ns = test_ns_rr("example.hns.", "ns1.example.hns.", 3600);
+  hsk_dns_rrs_push(&msg->ns, ns);
+
+  // Matches are case-sensitive, so only "example.hns." is shared.
+  hsk_dns_rr_t *a = hsk_dns_rr_create(HSK_DNS_A);
+  assert(a && hsk_dns_rr_set_name(a, "Www.example.hns."));
+  hsk_dns_rrs_push(&msg->ar, a);
+
+  uint8_t *data;
+  size_t data_len;
+
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+  assert(data_len == 85);
+
+  // Answer name points at the question name.
+  assert(data[33] == 0xc0 && data[34] == 12);
+  // NS rdata points at the CNAME target.
+  assert(data[63] == 0xc0 && data[64] == 45);
+  assert(memcmp(&data[65], "\x03Www\xc0\x10", 6) == 0);
+
+  hsk_dns_msg_t *res;
+  assert(hsk_dns_msg_decode(data, data_len, &res));
+  assert(strcmp(res->an.items[0]->name, "www.example.hns.") == 0);
+  assert(strcmp(((hsk_dns_ns_rd_t *)res->ns.items[0]->rd)->ns,
+                "ns1.example.hns.") == 0);
+  assert(strcmp(res->ar.items[0]->name, "Www.example.hns.") == 0);
+
+  hsk_dns_msg_free(res);
+  hsk_dns_msg_free(msg);
+  free(data);
+}
+
+// More distinct suffixes than the table keeps still compress.
+void
+test_dns_compress_many() {
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+  char name[HSK_DNS_MAX_NAME + 1];
+  int i;
+
+  assert(msg);
+
+  for (i = 0; i < 400; i++) {
+    hsk_dns_rr_t *rr = hsk_dns_rr_create(HSK_DNS_A);
+    sprintf(name, "x.n%d.many.", i % 200);
+    assert(rr && hsk_dns_rr_set_name(rr, name));
+    hsk_dns_rrs_push(i < 200 ? &msg->an : &msg->ar, rr);
+  }
+
+  uint8_t *data;
+  size_t data_len;
+
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+
+  // 401 suffixes the first time round, then a pointer and 14 bytes of
+  // A record per repeat. Only the first name spells out "many.".
+  size_t first = 12 + 4;
+
+  for (i = 0; i < 200; i++) {
+    sprintf(name, "%d", i);
+    first += 2 + 1 + 1 + strlen(name) + 2 + 14;
+  }
+
+  assert(data_len == first + 200 * (2 + 14));
+
+  hsk_dns_msg_t *res;
+  assert(hsk_dns_msg_decode(data, data_len, &res));
+  assert(res->ar.size == 200);
+  assert(strcmp(res->ar.items[199]->name, "x.n199.many.") == 0);
+
+  hsk_dns_msg_free(res);
+  hsk_dns_msg_free(msg);
+  free(data);
+}
+
+void
+test_dns_view() {
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+  assert(msg);
+
+  msg->id = 0xabcd;
+  msg->flags = HSK_DNS_QR | HSK_DNS_AA;
+  msg->edns.enabled = true;
+  msg->edns.size = 1232;
+  msg->edns.flags = HSK_DNS_DO;
+
+  hsk_dns_rr_t *qs = hsk_dns_rr_create(HSK_DNS_A);
+  assert(qs && hsk_dns_rr_set_name(qs, "www.example.hns."));
+  hsk_dns_rrs_push(&msg->qd, qs);
+
+  hsk_dns_rrs_push(&msg->an, test_a_rr("www.example.hns.", 1));
+  hsk_dns_rrs_push(&msg->an, test_a_rr("www.example.hns.", 2));
+  hsk_dns_rrs_push(&msg->ns,
+                   test_ns_rr("example.hns.", "ns1.example.hns.", 60));
+  hsk_dns_rrs_push(&msg->ar, test_a_rr("ns1.example.hns.", 3));
+
+  uint8_t *data;
+  size_t data_len;
+
+  assert(hsk_dns_msg_encode(msg, &data, &data_len));
+  hsk_dns_msg_free(msg);
+
+  hsk_dns_view_t view;
+  hsk_dns_iter_t it;
+  hsk_dns_view_rr_t rr;
+  char name[HSK_DNS_MAX_NAME + 1];
+
+  assert(hsk_dns_view_init(&view, data, data_len));
+  assert(view.id == 0xabcd);
+  assert(view.flags & HSK_DNS_AA);
+  assert(view.counts[HSK_DNS_SECTION_QD] == 1);
+  assert(view.counts[HSK_DNS_SECTION_AN] == 2);
+  assert(view.counts[HSK_DNS_SECTION_NS] == 1);
+  // OPT is not counted.
+  assert(view.counts[HSK_DNS_SECTION_AR] == 1);
+  assert(view.edns.enabled && view.edns.size == 1232);
+  assert(view.edns.flags == HSK_DNS_DO);
+  assert(view.offsets[4] == data_len);
+
+  hsk_dns_view_iter(&view, HSK_DNS_SECTION_AN, &it);
+
+  int count = 0;
+  while (hsk_dns_iter_next(&it, &rr)) {
+    hsk_dns_a_rd_t *rd;
+
+    assert(rr.type == HSK_DNS_A && rr.rd_len == 4);
+    assert(hsk_dns_view_name(&view, rr.off, name));
+    assert(strcmp(name, "www.example.hns.") == 0);
+    assert(hsk_dns_view_rd(&view, &rr, (void **)&rd));
+    assert(rd->addr[3] == ++count);
+    hsk_dns_rd_free(rd, rr.type);
+  }
+  assert(count == 2);
+
+  hsk_dns_view_iter(&view, HSK_DNS_SECTION_AR, &it);
+  assert(hsk_dns_iter_next(&it, &rr) && rr.type == HSK_DNS_A);
+  assert(!hsk_dns_iter_next(&it, &rr));
+
+  // Only the answers.
+  assert(hsk_dns_view_msg(&view, 1 << HSK_DNS_SECTION_AN, &msg));
+  assert(msg->id == 0xabcd && msg->edns.enabled);
+  assert(msg->qd.size == 0 && msg->an.size == 2);
+  assert(msg->ns.size == 0 && msg->ar.size == 0);
+  hsk_dns_msg_free(msg);
+
+  // Short messages end early, as with hsk_dns_msg_read().
+  assert(hsk_dns_view_init(&view, data, 12));
+  assert(view.counts[HSK_DNS_SECTION_QD] == 0);
+  assert(!hsk_dns_view_init(&view, data, 20));
+
+  free(data);
+}
+
+static void
+test_sha256_kat() {
+  static const char *vectors[][2] = {
+    {
+      "",
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+    },
+    {
+      "abc",
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+    },
+    {
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+    },
+    {
+      "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+      "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+      "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"
+    }
+  };
+
+  uint8_t hash[32];
+
+  for (int i = 0; i < 4; i++) {
+    const char *msg = vectors[i][0];
+    hsk_hash_sha256((const uint8_t *)msg, strlen(msg), hash);
+    assert(strcmp(hsk_hex_encode32(hash), vectors[i][1]) == 0);
+  }
+
+  // A million 'a's, fed in uneven pieces.
+  uint8_t chunk[1000];
+  hsk_sha256_ctx ctx;
+
+  memset(chunk, 'a', sizeof(chunk));
+  hsk_sha256_init(&ctx);
+
+  for (int i = 0; i < 1000; i++) {
+    hsk_sha256_update(&ctx, chunk, 333);
+    hsk_sha256_update(&ctx, chunk + 333, 667);
+  }
+
+  hsk_sha256_final(&ctx, hash);
+
+  assert(strcmp(hsk_hex_encode32(hash),
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0);
+}
+
+void
+test_sha256() {
+  uint8_t buf[301];
+  uint8_t expect[300][32];
+  uint8_t hashes[300][32];
+  uint8_t *out[300];
+  const uint8_t *msg[300];
+  size_t size[300];
+
+  for (int i = 0; i < sizeof(buf); i++)
+    buf[i] = i * 31 + 7;
+
+  // Run everything on the portable code, then again on
+  // the hardware backend if this machine has one.
+  for (int hw = 0; hw < 2; hw++) {
+    bool has_hw = hsk_sha256_use_hardware(hw == 1);
+
+    if (hw == 1 && !has_hw)
+      break;
+
+    test_sha256_kat();
+
+    for (int i = 0; i < 300; i++) {
+      // Unaligned input, every padding case.
+      if (hw == 0)
+        hsk_hash_sha256(buf + 1, i, expect[i]);
+
+      hsk_hash_sha256(buf + 1, i, hashes[i]);
+      assert(memcmp(hashes[i], expect[i], 32) == 0);
+
+      out[i] = hashes[i];
+      msg[i] = buf + 1;
+      size[i] = i;
+    }
+
+    // Odd count, so the last group has idle lanes.
+    memset(hashes, 0, sizeof(hashes));
+    hsk_sha256_multi(out, msg, size, 299);
+
+    for (int i = 0; i < 299; i++)
+      assert(memcmp(hashes[i], expect[i], 32) == 0);
+  }
+
+  hsk_sha256_use_hardware(true);
+}
+
+typedef struct test_end_s {
+  hsk_brontide_t b;
+  struct test_end_s *other;
+  uint8_t inbox[4096];
+  size_t inbox_len;
+  bool connected;
+  char got[32];
+  hsk_brontide_ticket_t *ticket;
+} test_end_t;
+
+static void
+test_end_connect(const void *arg) {
+  ((test_end_t *)arg)->connected = true;
+}
+
+static int
+test_end_write(const void *arg, const uint8_t *data, size_t len, bool is_heap) {
+  test_end_t *end = (test_end_t *)arg;
+  test_end_t *other = end->other;
+
+  assert(other->inbox_len + len <= sizeof(other->inbox));
+  memcpy(&other->inbox[other->inbox_len], data, len);
+  other->inbox_len += len;
+
+  if (is_heap)
+    free((void *)data);
+
+  return HSK_SUCCESS;
+}
+
+static void
+test_end_read(const void *arg, const uint8_t *data, size_t len) {
+  test_end_t *end = (test_end_t *)arg;
+  assert(len < sizeof(end->got));
+  memcpy(end->got, data, len);
+  end->got[len] = 0;
+}
+
+static bool
+test_end_ticket(const void *arg, const uint8_t *id, hsk_brontide_ticket_t *t) {
+  test_end_t *end = (test_end_t *)arg;
+
+  if (!end->ticket || memcmp(end->ticket->id, id, 32) != 0)
+    return false;
+
+  memcpy(t, end->ticket, sizeof(hsk_brontide_ticket_t));
+  end->ticket = NULL;
+
+  return true;
+}
+
+static void
+test_end_init(test_end_t *end, test_end_t *other, const hsk_ec_t *ec) {
+  memset(end, 0, sizeof(test_end_t));
+  hsk_brontide_init(&end->b, ec);
+  end->other = other;
+  end->b.connect_cb = test_end_connect;
+  end->b.connect_arg = (void *)end;
+  end->b.write_cb = test_end_write;
+  end->b.write_arg = (void *)end;
+  end->b.read_cb = test_end_read;
+  end->b.read_arg = (void *)end;
+  end->b.ticket_cb = test_end_ticket;
+  end->b.ticket_arg = (void *)end;
+}
+
+static int
+test_end_pump(test_end_t *a, test_end_t *b) {
+  while (a->inbox_len || b->inbox_len) {
+    test_end_t *ends[2] = { a, b };
+
+    for (int i = 0; i < 2; i++) {
+      uint8_t buf[4096];
+      size_t len = ends[i]->inbox_len;
+
+      memcpy(buf, ends[i]->inbox, len);
+      ends[i]->inbox_len = 0;
+
+      if (len == 0)
+        continue;
+
+      int r = hsk_brontide_on_read(&ends[i]->b, buf, len);
+
+      if (r != HSK_SUCCESS)
+        return r;
+    }
+  }
+
+  return HSK_SUCCESS;
+}
+
+static void
+test_end_send(test_end_t *end, const char *str) {
+  size_t len = strlen(str);
+  uint8_t *data = malloc(len);
+  assert(data);
+  memcpy(data, str, len);
+  assert(hsk_brontide_write(&end->b, data, len) == HSK_SUCCESS);
+}
+
+void
+test_brontide_resume() {
+  hsk_ec_t *ec = hsk_ec_alloc();
+  assert(ec);
+
+  uint8_t ikey[32];
+  uint8_t rkey[32];
+  uint8_t rpub[33];
+
+  assert(hsk_ec_create_privkey(ec, ikey));
+  assert(hsk_ec_create_privkey(ec, rkey));
+  assert(hsk_ec_create_pubkey(ec, rkey, rpub));
+
+  test_end_t i, r;
+  hsk_brontide_ticket_t it, rt;
+
+  // Full handshake.
+  test_end_init(&i, &r, ec);
+  test_end_init(&r, &i, ec);
+
+  assert(hsk_brontide_connect(&i.b, ikey, rpub) == HSK_SUCCESS);
+  assert(hsk_brontide_accept(&r.b, rkey) == HSK_SUCCESS);
+  assert(hsk_brontide_on_connect(&i.b) == HSK_SUCCESS);
+  assert(test_end_pump(&i, &r) == HSK_SUCCESS);
+  assert(i.connected && r.connected);
+  assert(!hsk_brontide_is_resumed(&i.b));
+
+  test_end_send(&i, "version");
+  assert(test_end_pump(&i, &r) == HSK_SUCCESS);
+  assert(strcmp(r.got, "version") == 0);
+
+  // Both ends derive the same ticket.
+  assert(hsk_brontide_get_ticket(&i.b, &it));
+  assert(hsk_brontide_get_ticket(&r.b, &rt));
+  assert(memcmp(it.id, rt.id, 32) == 0);
+  assert(memcmp(it.secret, rt.secret, 32) == 0);
+  assert(memcmp(it.remote_static, rpub, 33) == 0);
+
+  hsk_brontide_uninit(&i.b);
+  hsk_brontide_uninit(&r.b);
+
+  // Resume: the initiator can write before hearing back.
+  test_end_init(&i, &r, ec);
+  test_end_init(&r, &i, ec);
+  r.ticket = &rt;
+
+  assert(hsk_brontide_connect(&i.b, ikey, rpub) == HSK_SUCCESS);
+  hsk_brontide_set_ticket(&i.b, &it);
+  assert(hsk_brontide_accept(&r.b, rkey) == HSK_SUCCESS);
+  assert(hsk_brontide_on_connect(&i.b) == HSK_SUCCESS);
+  assert(i.connected && hsk_brontide_is_resumed(&i.b));
+
+  test_end_send(&i, "version");
+  assert(test_end_pump(&i, &r) == HSK_SUCCESS);
+  assert(r.connected && hsk_brontide_is_resumed(&r.b));
+  assert(strcmp(r.got, "version") == 0);
+
+  test_end_send(&r, "verack");
+  assert(test_end_pump(&i, &r) == HSK_SUCCESS);
+  assert(strcmp(i.got, "verack") == 0);
+
+  // The resumed session hands out a fresh ticket.
+  hsk_brontide_ticket_t next;
+  assert(hsk_brontide_get_ticket(&i.b, &next));
+  assert(memcmp(next.id, it.id, 32) != 0);
+
+  hsk_brontide_uninit(&i.b);
+  hsk_brontide_uninit(&r.b);
+
+  // Tickets are single use: a responder that no longer has it falls back
+  // to act one, which fails.
+  test_end_init(&i, &r, ec);
+  test_end_init(&r, &i, ec);
+
+  assert(hsk_brontide_connect(&i.b, ikey, rpub) == HSK_SUCCESS);
+  hsk_brontide_set_ticket(&i.b, &it);
+  assert(hsk_brontide_accept(&r.b, rkey) == HSK_SUCCESS);
+  assert(hsk_brontide_on_connect(&i.b) == HSK_SUCCESS);
+  assert(test_end_pump(&i, &r) == HSK_EACTONE);
+  assert(!r.connected);
+
+  hsk_brontide_uninit(&i.b);
+  hsk_brontide_uninit(&r.b);
+
+  hsk_ec_free(ec);
+}
+
+void
+test_cache_encode() {
+  hsk_cache_t a, b;
+  hsk_cache_init(&a);
+  hsk_cache_init(&b);
+
+  uint8_t *wire = malloc(3);
+  assert(wire);
+  memcpy(wire, "abc", 3);
+
+  assert(hsk_cache_insert_data(&a, "foo.", HSK_DNS_A, wire, 3));
+
+  uint8_t *data;
+  size_t data_len;
+  assert(hsk_cache_encode(&a, &data, &data_len));
+
+  assert(hsk_cache_decode(&b, data, data_len));
+  assert(!hsk_cache_decode(&b, data, data_len - 1));
+
+  uint8_t *got;
+  size_t got_len;
+  assert(hsk_cache_get_data(&b, "foo.", HSK_DNS_A, &got, &got_len));
+  assert(got_len == 3 && memcmp(got, "abc", 3) == 0);
+  assert(!hsk_cache_get_data(&b, "foo.", HSK_DNS_AAAA, &got, &got_len));
+
+  free(data);
+  hsk_cache_uninit(&a);
+  hsk_cache_uninit(&b);
+}
+
+#ifndef _WIN32
+static void
+test_listen_env(const char *pid, const char *fds, const char *names) {
+  char self[32];
+
+  if (!pid) {
+    sprintf(self, "%ld", (long)getpid());
+    pid = self;
+  }
+
+  assert(setenv("LISTEN_PID", pid, 1) == 0);
+  assert(setenv("LISTEN_FDS", fds, 1) == 0);
+
+  if (names)
+    assert(setenv("LISTEN_FDNAMES", names, 1) == 0);
+  else
+    assert(unsetenv("LISTEN_FDNAMES") == 0);
+}
+
+void
+test_activation() {
+  int ns_fd, rs_fd;
+  char other[32];
+
+  assert(hsk_activation_name("ns:rs", 0, "ns"));
+  assert(hsk_activation_name("ns:rs", 1, "rs"));
+  assert(hsk_activation_name("::ns", 2, "ns"));
+  assert(!hsk_activation_name("ns:rs", 2, "rs"));
+  assert(!hsk_activation_name("nsx:rs", 0, "ns"));
+  assert(!hsk_activation_name("n:rs", 0, "ns"));
+  assert(!hsk_activation_name("", 0, "ns"));
+  assert(!hsk_activation_name(NULL, 0, "ns"));
+
+  // Meant for someone else: left alone for them.
+  sprintf(other, "%ld", (long)getpid() + 1);
+  test_listen_env(other, "2", NULL);
+  assert(hsk_activation_listen_fds(&ns_fd, &rs_fd) == HSK_SUCCESS);
+  assert(ns_fd == -1 && rs_fd == -1);
+  assert(getenv("LISTEN_FDS") != NULL);
+
+  // Names win over order, and the variables are gone afterwards.
+  test_listen_env(NULL, "3", "other:rs:ns");
+  assert(hsk_activation_listen_fds(&ns_fd, &rs_fd) == HSK_SUCCESS);
+  assert(ns_fd == 5 && rs_fd == 4);
+  assert(!getenv("LISTEN_PID") && !getenv("LISTEN_FDS"));
+  assert(!getenv("LISTEN_FDNAMES"));
+
+  test_listen_env(NULL, "2", "other:ns");
+  assert(hsk_activation_listen_fds(&ns_fd, &rs_fd) == HSK_SUCCESS);
+  assert(ns_fd == 4 && rs_fd == -1);
+
+  // Unnamed ones go in order.
+  test_listen_env(NULL, "2", NULL);
+  assert(hsk_activation_listen_fds(&ns_fd, &rs_fd) == HSK_SUCCESS);
+  assert(ns_fd == 3 && rs_fd == 4);
+
+  test_listen_env(NULL, "two", NULL);
+  assert(hsk_activation_listen_fds(&ns_fd, &rs_fd) == HSK_EFAILURE);
+  assert(ns_fd == -1 && rs_fd == -1);
+  assert(!getenv("LISTEN_FDS"));
+
+  // Only bound UDP sockets will do.
+  struct sockaddr_storage ss;
+  struct sockaddr *sa = (struct sockaddr *)&ss;
+  struct sockaddr_in sin;
+  socklen_t len = sizeof(sin);
+  int fds[2];
+
+  assert(pipe(fds) == 0);
+  assert(hsk_activation_check(fds[0], sa) == HSK_EFAILURE);
+  close(fds[0]);
+  close(fds[1]);
+
+  int tcp = socket(AF_INET, SOCK_STREAM, 0);
+  assert(tcp != -1);
+  assert(hsk_activation_check(tcp, sa) == HSK_EFAILURE);
+  close(tcp);
+
+  int udp = socket(AF_INET, SOCK_DGRAM, 0);
+  assert(udp != -1);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  assert(bind(udp, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+  assert(getsockname(udp, (struct sockaddr *)&sin, &len) == 0);
+
+  assert(hsk_activation_check(udp, sa) == HSK_SUCCESS);
+  assert(sa->sa_family == AF_INET);
+  assert(((struct sockaddr_in *)sa)->sin_port == sin.sin_port);
+  assert(fcntl(udp, F_GETFD) & FD_CLOEXEC);
+
+  close(udp);
+}
+#endif
+
+void
+test_conf() {
+  hsk_conf_t conf;
+  hsk_conf_init(&conf);
+
+  assert(conf.pool_size == HSK_POOL_SIZE);
+  assert(conf.timeouts.proof == 5);
+
+  const char *text =
+    "# tuning\n"
+    "pool-size = 16\n"
+    "  threads 4  # comment\n"
+    "\n"
+    "proof-timeout=10\r\n"
+    "rate-limit = 0";
+
+  assert(hsk_conf_parse(&conf, text, strlen(text)) == HSK_SUCCESS);
+  assert(conf.pool_size == 16);
+  assert(conf.threads == 4);
+  assert(conf.timeouts.proof == 10);
+  assert(conf.cache_size == HSK_CACHE_LIMIT);
+
+  // Errors leave everything as it was.
+  const char *bad[] = {
+    "pool-size = 8\nunknown = 1\n",
+    "pool-size = 0\n",
+    "pool-size = -1\n",
+    "pool-size = 8x\n",
+    "pool-size =\n",
+    "cache-ttl = 99999999999999999999\n"
+  };
+
+  for (int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    assert(hsk_conf_parse(&conf, bad[i], strlen(bad[i])) == HSK_EENCODING);
+
+  assert(conf.pool_size == 16);
+
+  // Only settings that can change while running are reloaded.
+  hsk_conf_t next = conf;
+  next.threads = 8;
+  next.cache_size = 100;
+
+  assert(hsk_conf_reload(&conf, &next) == 1);
+  assert(conf.threads == 4);
+  assert(conf.cache_size == 100);
+  assert(hsk_conf_reload(&conf, &next) == 0);
+}
+
+void
+test_headers_buf() {
+  static hsk_header_t buf[HSK_MAX_HEADERS];
+  hsk_header_t hdrs[3];
+  hsk_msg_t *msg = hsk_msg_alloc(HSK_MSG_HEADERS);
+  hsk_headers_msg_t *m = (hsk_headers_msg_t *)msg;
+
+  assert(msg);
+
+  for (int i = 0; i < 3; i++) {
+    hsk_header_init(&hdrs[i]);
+    hdrs[i].nonce = i;
+    hdrs[i].time = 1580745078 + i;
+    memset(hdrs[i].prev_block, i, 32);
+    hdrs[i].next = i < 2 ? &hdrs[i + 1] : NULL;
+  }
+
+  m->header_count = 3;
+  m->headers = &hdrs[0];
+
+  int len = hsk_msg_size(msg);
+  uint8_t wire[len];
+
+  assert(hsk_msg_encode(msg, wire) == len);
+
+  m->headers = NULL;
+  hsk_msg_free(msg);
+
+  // Read into the buffer, in order, without allocating.
+  msg = hsk_msg_alloc(HSK_MSG_HEADERS);
+  m = (hsk_headers_msg_t *)msg;
+  assert(msg);
+  m->buf = buf;
+
+  assert(hsk_msg_decode(wire, len, msg));
+  assert(m->header_count == 3);
+
+  hsk_header_t *hdr = m->headers;
+
+  for (int i = 0; i < 3; i++) {
+    assert(hdr == &buf[i]);
+    assert(memcmp(hsk_header_cache(hdr), hsk_header_cache(&hdrs[i]), 32) == 0);
+    hdr = hdr->next;
+  }
+
+  assert(!hdr);
+
+  // A short message fails. The buffer may hold whatever
+  // was read before that, but the message has no headers.
+  assert(!hsk_msg_decode(wire, len - 1, msg));
+  assert(!m->headers && m->header_count == 0);
+
+  hsk_msg_free(msg);
+}
+
+/*
+ * Chain
+ */
+
+// Headers here are not mined: hsk_chain_insert leaves proof of work to
+// its callers, so the chain's own code is tested on any network.
+static void
+test_chain_next(
+  const hsk_chain_t *chain,
+  hsk_header_t *hdr,
+  const hsk_header_t *prev,
+  uint32_t spacing,
+  uint8_t salt
+) {
+  hsk_header_init(hdr);
+  memcpy(hdr->prev_block, hsk_header_cache((hsk_header_t *)prev), 32);
+  hdr->extra_nonce[0] = salt;
+  hdr->time = prev->time + spacing;
+  hdr->bits = hsk_chain_get_target(chain, hdr->time, prev);
+  hsk_header_cache(hdr);
+}
+
+// What hsk_chain_add_from does once the proof of work checks out.
+static int
+test_chain_put(hsk_chain_t *chain, const hsk_header_t *h, uint64_t source) {
+  hsk_header_t *hdr = hsk_header_clone(h);
+  assert(hdr);
+
+  hsk_header_t *prev = hsk_chain_get(chain, hdr->prev_block);
+  int rc;
+
+  if (!prev) {
+    rc = hsk_chain_store_orphan(chain, hdr, source);
+
+    if (rc != HSK_SUCCESS) {
+      free(hdr);
+      return rc;
+    }
+
+    return HSK_EORPHAN;
+  }
+
+  rc = hsk_chain_insert(chain, hdr, prev, false);
+
+  if (rc != HSK_SUCCESS) {
+    free(hdr);
+    return rc;
+  }
+
+  hsk_chain_resolve_orphans(chain, hdr, false);
+
+  return HSK_SUCCESS;
+}
+
+static void
+test_chain_no_orphans(const hsk_chain_t *chain) {
+  assert(chain->orphans.size == 0);
+  assert(chain->prevs.size == 0);
+  assert(chain->sources.size == 0);
+  assert(!chain->oldest && !chain->newest);
+}
+
+void
+test_chain_orphans() {
+  hsk_timedata_t td;
+  hsk_chain_t chain;
+  hsk_chain_orphan_t *head;
+
+  assert(hsk_timedata_init(&td) == HSK_SUCCESS);
+  assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+
+  // p -> s1 -> d
+  //   -> s2 -> c -> e
+  // with s0, a sibling of s1 and s2, evicted before p shows up.
+  hsk_header_t p, s[3], c, d, e;
+
+  test_chain_next(&chain, &p, chain.tip, 600, 0);
+
+  for (int i = 0; i < 3; i++)
+    test_chain_next(&chain, &s[i], &p, 600, i);
+
+  test_chain_next(&chain, &d, &s[1], 600, 0);
+  test_chain_next(&chain, &c, &s[2], 600, 0);
+  test_chain_next(&chain, &e, &c, 600, 0);
+
+  for (int i = 0; i < 3; i++)
+    assert(test_chain_put(&chain, &s[i], 1) == HSK_EORPHAN);
+
+  assert(chain.orphans.size == 3);
+  assert(chain.prevs.size == 1);
+  assert(hsk_chain_source_count(&chain, 1) == 3);
+
+  // The oldest is the head of the siblings, and the map's key points into
+  // its header, so the next sibling has to take over the key.
+  chain.orphan_limit = 3;
+  assert(test_chain_put(&chain, &e, 2) == HSK_EORPHAN);
+  chain.orphan_limit = HSK_CHAIN_ORPHANS;
+
+  assert(!hsk_chain_has_orphan(&chain, s[0].hash));
+  assert(chain.orphans.size == 3);
+  assert(chain.prevs.size == 2);
+  assert(hsk_chain_source_count(&chain, 1) == 2);
+  assert(hsk_chain_source_count(&chain, 2) == 1);
+
+  head = hsk_map_get(&chain.prevs, p.hash);
+  assert(head);
+  assert(hsk_map_key(&chain.prevs, hsk_map_lookup(&chain.prevs, p.hash))
+         == (void *)head->hdr->prev_block);
+  assert(memcmp(head->hdr->hash, s[2].hash, 32) == 0);
+  assert(memcmp(head->sibling->hdr->hash, s[1].hash, 32) == 0);
+  assert(!head->sibling->sibling);
+
+  assert(test_chain_put(&chain, &d, 2) == HSK_EORPHAN);
+  assert(test_chain_put(&chain, &c, 1) == HSK_EORPHAN);
+  assert(test_chain_put(&chain, &p, 0) == HSK_SUCCESS);
+
+  assert(!hsk_chain_has(&chain, s[0].hash));
+  assert(hsk_chain_has(&chain, s[1].hash));
+  assert(hsk_chain_has(&chain, s[2].hash));
+  assert(hsk_chain_has(&chain, c.hash));
+  assert(hsk_chain_has(&chain, d.hash));
+  assert(memcmp(chain.tip->hash, e.hash, 32) == 0);
+  assert(chain.height == 4);
+  test_chain_no_orphans(&chain);
+
+  // q -> x0 -> w -> z
+  //   -> x1 (bad bits) -> y
+  //   -> x2
+  hsk_header_t q, x[3], y, w, z;
+
+  test_chain_next(&chain, &q, chain.tip, 600, 0);
+
+  for (int i = 0; i < 3; i++)
+    test_chain_next(&chain, &x[i], &q, 600, i);
+
+  x[1].bits ^= 1;
+  x[1].cache = false;
+  hsk_header_cache(&x[1]);
+
+  test_chain_next(&chain, &y, &x[1], 600, 0);
+  test_chain_next(&chain, &w, &x[0], 600, 0);
+  test_chain_next(&chain, &z, &w, 600, 0);
+
+  // One peer can't fill the pool, another one still can.
+  chain.peer_orphan_limit = 2;
+
+  assert(test_chain_put(&chain, &x[0], 3) == HSK_EORPHAN);
+  assert(test_chain_put(&chain, &x[1], 3) == HSK_EORPHAN);
+  assert(test_chain_put(&chain, &x[2], 3) == HSK_EFAILURE);
+  assert(!hsk_chain_has_orphan(&chain, x[2].hash));
+  assert(hsk_chain_source_count(&chain, 3) == 2);
+
+  assert(test_chain_put(&chain, &x[2], 4) == HSK_EORPHAN);
+  assert(test_chain_put(&chain, &y, 4) == HSK_EORPHAN);
+  assert(hsk_chain_source_count(&chain, 4) == 2);
+
+  chain.peer_orphan_limit = HSK_CHAIN_PEER_ORPHANS;
+
+  // x1 fails to insert, and y is left waiting on it.
+  assert(test_chain_put(&chain, &q, 0) == HSK_SUCCESS);
+
+  assert(hsk_chain_has(&chain, x[0].hash));
+  assert(!hsk_chain_has(&chain, x[1].hash));
+  assert(hsk_chain_has(&chain, x[2].hash));
+  assert(hsk_chain_has_orphan(&chain, y.hash));
+  assert(chain.orphans.size == 1);
+  assert(chain.prevs.size == 1);
+  assert(hsk_chain_source_count(&chain, 3) == 0);
+  assert(hsk_chain_source_count(&chain, 4) == 1);
+
+  // Until it expires.
+  chain.oldest->time -= HSK_CHAIN_ORPHAN_AGE + 1;
+
+  assert(test_chain_put(&chain, &z, 5) == HSK_EORPHAN);
+
+  assert(!hsk_chain_has_orphan(&chain, y.hash));
+  assert(chain.orphans.size == 1);
+  assert(chain.prevs.size == 1);
+  assert(hsk_chain_source_count(&chain, 4) == 0);
+  assert(hsk_chain_source_count(&chain, 5) == 1);
+
+  assert(test_chain_put(&chain, &w, 0) == HSK_SUCCESS);
+
+  assert(memcmp(chain.tip->hash, z.hash, 32) == 0);
+  test_chain_no_orphans(&chain);
+
+  hsk_chain_uninit(&chain);
+  hsk_timedata_uninit(&td);
+}
+
+// Every ancestor of every header, against a walk through `prev`.
+static void
+test_chain_check_ancestors(
+  const hsk_chain_t *chain,
+  hsk_header_t **hdrs,
+  int count
+) {
+  for (int i = 0; i < count; i++) {
+    hsk_header_t *hdr = hdrs[i];
+    hsk_header_t *a = hdr;
+
+    for (;;) {
+      assert(hsk_chain_get_ancestor(chain, hdr, a->height) == a);
+
+      if (!a->prev)
+        break;
+
+      a = a->prev;
+    }
+
+    assert(a == chain->genesis);
+  }
+}
+
+void
+test_chain_ancestor() {
+  static hsk_header_t *hdrs[512];
+  hsk_timedata_t td;
+  hsk_chain_t chain;
+  hsk_header_t next;
+  int count = 0;
+  int i;
+
+  assert(hsk_timedata_init(&td) == HSK_SUCCESS);
+  assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+
+  hdrs[count++] = chain.genesis;
+
+  // Long enough that the window wraps, with room for a fork above it.
+  uint32_t fork = HSK_CHAIN_WINDOW + 60;
+  uint32_t height = fork + 100;
+
+  for (i = 1; i <= height; i++) {
+    test_chain_next(&chain, &next, chain.tip, HSK_TARGET_SPACING, 0);
+    assert(test_chain_put(&chain, &next, 0) == HSK_SUCCESS);
+    hdrs[count++] = chain.tip;
+  }
+
+  assert(chain.height == height);
+  test_chain_check_ancestors(&chain, hdrs, count);
+
+  // A branch of fast blocks from the fork gets harder with every block
+  // where the network retargets, so it takes over below the old height.
+  // On networks that don't, it just has to get longer.
+  hsk_header_t *old_tip = chain.tip;
+  hsk_header_t *prev = hsk_chain_get_by_height(&chain, fork);
+
+  assert(prev);
+
+  while (chain.tip == old_tip) {
+    assert(count < 512);
+
+    test_chain_next(&chain, &next, prev, 1, 1);
+    assert(test_chain_put(&chain, &next, 0) == HSK_SUCCESS);
+
+    prev = hsk_chain_get(&chain, next.hash);
+    hdrs[count++] = prev;
+  }
+
+  assert(chain.tip == prev);
+
+  if (!HSK_NO_RETARGETTING) {
+    assert(chain.height < height);
+
+    // The window still has the old main chain above the new tip.
+    assert(chain.window[old_tip->height % HSK_CHAIN_WINDOW] == old_tip);
+  }
+
+  test_chain_check_ancestors(&chain, hdrs, count);
+
+  hsk_chain_uninit(&chain);
+  hsk_timedata_uninit(&td);
+}
+
+#if HSK_NETWORK == HSK_REGTEST
+// Proof of work is only cheap to find on regtest.
+static void
+test_chain_mine(
+  const hsk_chain_t *chain,
+  hsk_header_t *hdr,
+  const hsk_header_t *prev,
+  uint8_t salt,
+  bool bad_bits
+) {
+  test_chain_next(chain, hdr, prev, HSK_TARGET_SPACING, salt);
+
+  if (bad_bits)
+    hdr->bits -= 1;
+
+  for (;;) {
+    hdr->cache = false;
+
+    if (hsk_header_verify_pow(hdr) == HSK_SUCCESS)
+      break;
+
+    hdr->nonce += 1;
+  }
+
+  hsk_header_cache(hdr);
+}
+
+// How the pool added a headers message before hsk_chain_add_batch.
+static int
+test_chain_add_each(
+  hsk_chain_t *chain,
+  const hsk_header_t *headers,
+  uint64_t source,
+  int *added
+) {
+  const hsk_header_t *hdr;
+  bool orphan = false;
+
+  *added = 0;
+
+  for (hdr = headers; hdr; hdr = hdr->next) {
+    int rc = hsk_chain_add_from(chain, hdr, source);
+
+    if (rc == HSK_EORPHAN || rc == HSK_EDUPLICATEORPHAN) {
+      orphan = true;
+      continue;
+    }
+
+    if (rc != HSK_SUCCESS)
+      return rc;
+
+    *added += 1;
+  }
+
+  return orphan ? HSK_EORPHAN : HSK_SUCCESS;
+}
+
+// The same headers, one at a time and as a batch, on top of the same
+// known headers, must leave the same chain behind.
+static void
+test_chain_batch_case(
+  const hsk_header_t **known,
+  int known_count,
+  const hsk_header_t **batch,
+  int count,
+  int expect_rc,
+  int expect_added,
+  const hsk_header_t *tip,
+  int orphans
+) {
+  hsk_header_t list[8];
+
+  assert(count <= 8);
+
+  for (int i = 0; i < count; i++) {
+    list[i] = *batch[i];
+    list[i].next = i + 1 < count ? &list[i + 1] : NULL;
+  }
+
+  for (int each = 0; each < 2; each++) {
+    hsk_timedata_t td;
+    hsk_chain_t chain;
+    int added;
+    int rc;
+
+    assert(hsk_timedata_init(&td) == HSK_SUCCESS);
+    assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+
+    for (int i = 0; i < known_count; i++) {
+      rc = hsk_chain_add_from(&chain, known[i], 1);
+      assert(rc == HSK_SUCCESS || rc == HSK_EORPHAN);
+    }
+
+    if (each)
+      rc = test_chain_add_each(&chain, &list[0], 1, &added);
+    else
+      rc = hsk_chain_add_batch(&chain, &list[0], 1, &added);
+
+    assert(rc == expect_rc);
+    assert(added == expect_added);
+    assert(memcmp(chain.tip->hash, tip->hash, 32) == 0);
+    assert(chain.orphans.size == orphans);
+    assert(hsk_chain_source_count(&chain, 1) == orphans);
+
+    hsk_chain_uninit(&chain);
+    hsk_timedata_uninit(&td);
+  }
+}
+
+void
+test_chain_batch() {
+  hsk_timedata_t td;
+  hsk_chain_t chain;
+  hsk_header_t m[6], bad, n, y;
+
+  assert(hsk_timedata_init(&td) == HSK_SUCCESS);
+  assert(hsk_chain_init(&chain, &td) == HSK_SUCCESS);
+
+  test_chain_mine(&chain, &m[0], chain.genesis, 0, false);
+
+  for (int i = 1; i < 6; i++)
+    test_chain_mine(&chain, &m[i], &m[i - 1], 0, false);
+
+  test_chain_mine(&chain, &bad, &m[2], 1, true);
+  test_chain_mine(&chain, &n, &m[5], 0, false);
+  test_chain_mine(&chain, &y, &n, 0, false);
+
+  {
+    const hsk_header_t *batch[] = { &m[0], &m[1], &m[2], &m[3], &m[4], &m[5] };
+    test_chain_batch_case(NULL, 0, batch, 6, HSK_SUCCESS, 6, &m[5], 0);
+  }
+
+  // Banned for it, keeping what came before.
+  {
+    const hsk_header_t *batch[] = { &m[0], &m[1], &m[2], &bad, &m[3] };
+    test_chain_batch_case(NULL, 0, batch, 5, HSK_EBADDIFFBITS, 3, &m[2], 0);
+  }
+
+  {
+    const hsk_header_t *known[] = { &m[0], &m[1] };
+    const hsk_header_t *batch[] = { &m[2], &m[3], &m[1], &m[4] };
+    test_chain_batch_case(known, 2, batch, 4, HSK_EDUPLICATE, 2, &m[3], 0);
+  }
+
+  // m3 and m4 wait for m2 in the same batch, y for n which never comes.
+  {
+    const hsk_header_t *batch[] = {
+      &m[0], &m[1], &m[3], &m[4], &y, &m[2], &m[5]
+    };
+    test_chain_batch_case(NULL, 0, batch, 7, HSK_EORPHAN, 4, &m[5], 1);
+  }
+
+  // An orphan from before, sent again.
+  {
+    const hsk_header_t *known[] = { &m[3] };
+    const hsk_header_t *batch[] = { &m[0], &m[1], &m[3], &m[2] };
+    test_chain_batch_case(known, 1, batch, 4, HSK_EORPHAN, 3, &m[3], 0);
+  }
+
+  hsk_chain_uninit(&chain);
+  hsk_timedata_uninit(&td);
+}
+#endif
+
 int
 main() {
   printf("Testing hnsd...\n");
   test_base32();
   test_pointer_to_ip();
+  test_sig0_signer();
+  test_blake2b_block();
+  test_proof_batch();
+  test_proof_write();
+  test_workers();
+  test_resolver();
+  test_resolver_thread();
+  test_cache_encode();
+  test_conf();
+#ifndef _WIN32
+  test_activation();
+#endif
+  test_aead_key();
+  test_sha256();
+  test_dns_sighash();
+  test_dns_name();
+  test_dns_compress();
+  test_dns_compress_many();
+  test_dns_view();
+  test_brontide_resume();
+  test_headers_buf();
+  test_chain_orphans();
+  test_chain_ancestor();
+#if HSK_NETWORK == HSK_REGTEST
+  test_chain_batch();
+#endif
 
   printf("ok\n");
 
@@ -0,0 +1,1012 @@
+#include "config.h"
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "addr.h"
+#include "constants.h"
+#include "dns.h"
+#include "uv.h"
+
+// Replays a query log against a running hnsd at a fixed rate and reports
+// throughput, loss and latency percentiles for each port.
+//
+//   $ ./load_hnsd -q 5000 -d 30 queries.txt
+//   $ ./load_hnsd -t both --json capture.pcap > load.json
+//
+// Query logs are either pcap captures (queries are taken from the UDP
+// payloads) or text with one `name [type]` per line. The log is replayed in
+// order, from the start again once it runs out.
+//
+// hnsd only listens on UDP, so that is all we send.
+
+/*
+ * Types
+ */
+
+#define LOAD_TICK_MS 1
+#define LOAD_MAX_BURST 10000
+
+enum {
+  LOAD_NOERROR,
+  LOAD_NXDOMAIN,
+  LOAD_SERVFAIL,
+  LOAD_REFUSED,
+  LOAD_OTHER,
+  LOAD_RCODES
+};
+
+static const char *load_rcode_names[LOAD_RCODES] = {
+  "noerror",
+  "nxdomain",
+  "servfail",
+  "refused",
+  "other"
+};
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} load_query_t;
+
+typedef struct {
+  const char *name;
+  struct sockaddr_storage addr;
+  uv_udp_t socket;
+  uint64_t sent;
+  uint64_t received;
+  uint64_t lost;
+  uint64_t send_errors;
+  uint64_t rcodes[LOAD_RCODES];
+  uint32_t *latency;
+  size_t latency_len;
+  size_t latency_cap;
+} load_target_t;
+
+// One per DNS message ID.
+typedef struct {
+  uint64_t time;
+  load_target_t *target;
+} load_slot_t;
+
+typedef struct {
+  // Options.
+  double qps;
+  double duration;
+  uint64_t limit;
+  uint64_t timeout;
+  bool dnssec;
+  bool json;
+  // Input.
+  load_query_t *queries;
+  size_t query_count;
+  size_t query_cap;
+  // Targets.
+  load_target_t targets[2];
+  int target_count;
+  // State.
+  uv_loop_t *loop;
+  uv_timer_t timer;
+  load_slot_t slots[65536];
+  uint16_t next_id;
+  size_t cursor;
+  uint64_t sent;
+  uint64_t start;
+  uint64_t stop;
+  uint64_t unmatched;
+  bool draining;
+} load_t;
+
+static load_t load;
+
+/*
+ * Query Logs
+ */
+
+static const struct {
+  const char *name;
+  uint16_t type;
+} load_types[] = {
+  { "A", HSK_DNS_A },
+  { "NS", HSK_DNS_NS },
+  { "CNAME", HSK_DNS_CNAME },
+  { "SOA", HSK_DNS_SOA },
+  { "PTR", HSK_DNS_PTR },
+  { "MX", HSK_DNS_MX },
+  { "TXT", HSK_DNS_TXT },
+  { "AAAA", HSK_DNS_AAAA },
+  { "SRV", HSK_DNS_SRV },
+  { "DS", HSK_DNS_DS },
+  { "RRSIG", HSK_DNS_RRSIG },
+  { "NSEC", HSK_DNS_NSEC },
+  { "DNSKEY", HSK_DNS_DNSKEY },
+  { "TLSA", HSK_DNS_TLSA },
+  { "ANY", HSK_DNS_ANY }
+};
+
+static bool
+load_parse_type(const char *str, uint16_t *type) {
+  size_t i;
+
+  for (i = 0; i < sizeof(load_types) / sizeof(load_types[0]); i++) {
+    if (strcasecmp(str, load_types[i].name) == 0) {
+      *type = load_types[i].type;
+      return true;
+    }
+  }
+
+  if (strncasecmp(str, "TYPE", 4) == 0)
+    str += 4;
+
+  char *end;
+  unsigned long n = strtoul(str, &end, 10);
+
+  if (*str == '\0' || *end != '\0' || n > 0xffff)
+    return false;
+
+  *type = (uint16_t)n;
+
+  return true;
+}
+
+static bool
+load_push(const uint8_t *data, size_t len) {
+  // load_send() copies queries into a buffer of this size.
+  if (len > HSK_DNS_MAX_TCP)
+    return false;
+
+  if (load.query_count == load.query_cap) {
+    size_t cap = load.query_cap ? load.query_cap * 2 : 1024;
+    load_query_t *queries = realloc(load.queries, cap * sizeof(load_query_t));
+
+    if (!queries)
+      return false;
+
+    load.queries = queries;
+    load.query_cap = cap;
+  }
+
+  uint8_t *copy = malloc(len);
+
+  if (!copy)
+    return false;
+
+  memcpy(copy, data, len);
+
+  load.queries[load.query_count].data = copy;
+  load.queries[load.query_count].len = len;
+  load.query_count += 1;
+
+  return true;
+}
+
+static bool
+load_push_question(const char *name, uint16_t type) {
+  hsk_dns_msg_t *msg = hsk_dns_msg_alloc();
+
+  if (!msg)
+    return false;
+
+  msg->flags = HSK_DNS_RD;
+  msg->edns.enabled = true;
+  msg->edns.size = HSK_DNS_MAX_EDNS;
+
+  if (load.dnssec)
+    msg->edns.flags = HSK_DNS_DO;
+
+  hsk_dns_qs_t *qs = hsk_dns_qs_alloc();
+
+  if (!qs) {
+    hsk_dns_msg_free(msg);
+    return false;
+  }
+
+  strcpy(qs->name, name);
+  qs->type = type;
+  qs->class = HSK_DNS_IN;
+
+  hsk_dns_rrs_push(&msg->qd, qs);
+
+  uint8_t *data;
+  size_t len;
+  bool ok = hsk_dns_msg_encode(msg, &data, &len);
+
+  hsk_dns_msg_free(msg);
+
+  if (!ok)
+    return false;
+
+  ok = load_push(data, len);
+
+  free(data);
+
+  return ok;
+}
+
+static bool
+load_read_text(char *text) {
+  char *line = text;
+  int lineno = 0;
+
+  while (line && *line) {
+    char *next = strchr(line, '\n');
+
+    if (next)
+      *next++ = '\0';
+
+    lineno += 1;
+
+    char *comment = strchr(line, '#');
+
+    if (comment)
+      *comment = '\0';
+
+    char *save;
+    char *name = strtok_r(line, " \t\r", &save);
+    char *type_str = strtok_r(NULL, " \t\r", &save);
+    uint16_t type = HSK_DNS_A;
+
+    line = next;
+
+    if (!name)
+      continue;
+
+    if (type_str && !load_parse_type(type_str, &type)) {
+      fprintf(stderr, "line %d: unknown type: %s\n", lineno, type_str);
+      return false;
+    }
+
+    char fqdn[HSK_DNS_MAX_NAME + 2];
+    size_t len = strlen(name);
+
+    if (len == 0 || len > HSK_DNS_MAX_NAME) {
+      fprintf(stderr, "line %d: bad name: %s\n", lineno, name);
+      return false;
+    }
+
+    strcpy(fqdn, name);
+
+    if (fqdn[len - 1] != '.')
+      strcpy(&fqdn[len], ".");
+
+    if (!hsk_dns_name_verify(fqdn)) {
+      fprintf(stderr, "line %d: bad name: %s\n", lineno, name);
+      return false;
+    }
+
+    if (!load_push_question(fqdn, type))
+      return false;
+  }
+
+  return true;
+}
+
+static uint32_t
+load_pcap_u32(const uint8_t *data, bool swap) {
+  uint32_t n = (uint32_t)data[0]
+             | ((uint32_t)data[1] << 8)
+             | ((uint32_t)data[2] << 16)
+             | ((uint32_t)data[3] << 24);
+
+  if (swap)
+    n = ((n & 0xff) << 24)
+      | ((n & 0xff00) << 8)
+      | ((n >> 8) & 0xff00)
+      | (n >> 24);
+
+  return n;
+}
+
+static uint16_t
+load_u16be(const uint8_t *data) {
+  return ((uint16_t)data[0] << 8) | data[1];
+}
+
+// Take the query out of a captured frame, if there is one.
+static bool
+load_read_frame(uint32_t link, const uint8_t *data, size_t len) {
+  uint16_t ether = 0;
+
+  switch (link) {
+    case 0: // BSD loopback
+      if (len < 4)
+        return true;
+      ether = (data[0] == 2 || data[3] == 2) ? 0x0800 : 0x86dd;
+      data += 4;
+      len -= 4;
+      break;
+    case 1: // Ethernet
+      if (len < 14)
+        return true;
+      ether = load_u16be(&data[12]);
+      data += 14;
+      len -= 14;
+      if (ether == 0x8100) {
+        if (len < 4)
+          return true;
+        ether = load_u16be(&data[2]);
+        data += 4;
+        len -= 4;
+      }
+      break;
+    case 12:
+    case 101: // Raw IP
+      if (len < 1)
+        return true;
+      ether = (data[0] >> 4) == 4 ? 0x0800 : 0x86dd;
+      break;
+    case 113: // Linux cooked
+      if (len < 16)
+        return true;
+      ether = load_u16be(&data[14]);
+      data += 16;
+      len -= 16;
+      break;
+    case 276: // Linux cooked v2
+      if (len < 20)
+        return true;
+      ether = load_u16be(&data[0]);
+      data += 20;
+      len -= 20;
+      break;
+    default:
+      return false;
+  }
+
+  if (ether == 0x0800) {
+    if (len < 20 || (data[0] >> 4) != 4)
+      return true;
+
+    size_t ihl = (data[0] & 0x0f) * 4;
+
+    // UDP, and not a fragment.
+    if (data[9] != 17 || (load_u16be(&data[6]) & 0x3fff) != 0)
+      return true;
+
+    if (ihl < 20 || len < ihl)
+      return true;
+
+    data += ihl;
+    len -= ihl;
+  } else if (ether == 0x86dd) {
+    if (len < 40 || data[6] != 17)
+      return true;
+
+    data += 40;
+    len -= 40;
+  } else {
+    return true;
+  }
+
+  if (len < 8)
+    return true;
+
+  // Ignore whatever the capture has past the datagram.
+  size_t udp_len = load_u16be(&data[4]);
+
+  if (udp_len < 8 || udp_len > len)
+    return true;
+
+  data += 8;
+  len = udp_len - 8;
+
+  hsk_dns_view_t view;
+
+  if (!hsk_dns_view_init(&view, data, len))
+    return true;
+
+  if ((view.flags & HSK_DNS_QR)
+      || view.opcode != HSK_DNS_QUERY
+      || view.counts[HSK_DNS_SECTION_QD] != 1) {
+    return true;
+  }
+
+  return load_push(data, view.offsets[4]);
+}
+
+static bool
+load_read_pcap(const uint8_t *data, size_t len) {
+  if (len < 24)
+    return false;
+
+  uint32_t magic = load_pcap_u32(data, false);
+  bool swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  uint32_t link = load_pcap_u32(&data[20], swap) & 0x0fffffff;
+
+  data += 24;
+  len -= 24;
+
+  while (len >= 16) {
+    uint32_t caplen = load_pcap_u32(&data[8], swap);
+
+    data += 16;
+    len -= 16;
+
+    if (caplen > len)
+      break;
+
+    if (!load_read_frame(link, data, caplen)) {
+      fprintf(stderr, "unsupported link type: %u\n", link);
+      return false;
+    }
+
+    data += caplen;
+    len -= caplen;
+  }
+
+  return true;
+}
+
+static bool
+load_read(const char *file) {
+  FILE *fp = fopen(file, "rb");
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", file);
+    return false;
+  }
+
+  uint8_t *data = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+
+  for (;;) {
+    if (len == cap) {
+      cap = cap ? cap * 2 : 65536;
+      uint8_t *buf = realloc(data, cap + 1);
+
+      if (!buf) {
+        free(data);
+        fclose(fp);
+        return false;
+      }
+
+      data = buf;
+    }
+
+    size_t n = fread(&data[len], 1, cap - len, fp);
+
+    if (n == 0)
+      break;
+
+    len += n;
+  }
+
+  fclose(fp);
+
+  bool ok;
+  uint32_t magic = len >= 4 ? load_pcap_u32(data, false) : 0;
+
+  switch (magic) {
+    case 0xa1b2c3d4:
+    case 0xd4c3b2a1:
+    case 0xa1b23c4d:
+    case 0x4d3cb2a1:
+      ok = load_read_pcap(data, len);
+      break;
+    default:
+      data[len] = '\0';
+      ok = load_read_text((char *)data);
+      break;
+  }
+
+  free(data);
+
+  return ok;
+}
+
+/*
+ * Sending
+ */
+
+static void
+load_record(load_target_t *target, uint32_t us) {
+  if (target->latency_len == target->latency_cap) {
+    size_t cap = target->latency_cap ? target->latency_cap * 2 : 65536;
+    uint32_t *lat = realloc(target->latency, cap * sizeof(uint32_t));
+
+    // Out of memory. Drop the sample, but keep counting.
+    if (!lat)
+      return;
+
+    target->latency = lat;
+    target->latency_cap = cap;
+  }
+
+  target->latency[target->latency_len++] = us;
+}
+
+static void
+load_send(load_target_t *target, uint64_t now) {
+  load_query_t *q = &load.queries[load.cursor];
+  uint8_t buf[HSK_DNS_MAX_TCP];
+  uint16_t id = load.next_id++;
+  load_slot_t *slot = &load.slots[id];
+
+  load.cursor = (load.cursor + 1) % load.query_count;
+  load.sent += 1;
+
+  // More than 65536 in flight: the
+  // old one has long since timed out.
+  if (slot->target) {
+    slot->target->lost += 1;
+    slot->target = NULL;
+  }
+
+  memcpy(buf, q->data, q->len);
+  buf[0] = id >> 8;
+  buf[1] = id & 0xff;
+
+  uv_buf_t b = uv_buf_init((char *)buf, q->len);
+
+  target->sent += 1;
+
+  int rc = uv_udp_try_send(
+    &target->socket,
+    &b,
+    1,
+    (struct sockaddr *)&target->addr
+  );
+
+  if (rc < 0) {
+    target->send_errors += 1;
+    target->lost += 1;
+    return;
+  }
+
+  slot->time = now;
+  slot->target = target;
+}
+
+static void
+load_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+  static char slab[HSK_DNS_MAX_TCP];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+static void
+load_recv(
+  uv_udp_t *socket,
+  ssize_t nread,
+  const uv_buf_t *buf,
+  const struct sockaddr *addr,
+  unsigned flags
+) {
+  load_target_t *target = socket->data;
+  const uint8_t *data = (const uint8_t *)buf->base;
+
+  if (nread < 12)
+    return;
+
+  uint64_t now = uv_hrtime();
+  uint16_t id = load_u16be(&data[0]);
+  load_slot_t *slot = &load.slots[id];
+
+  if (slot->target != target || !(data[2] & 0x80)) {
+    load.unmatched += 1;
+    return;
+  }
+
+  slot->target = NULL;
+
+  uint64_t elapsed = now - slot->time;
+
+  if (elapsed > load.timeout) {
+    target->lost += 1;
+    return;
+  }
+
+  uint8_t code = data[3] & 0x0f;
+  int rcode;
+
+  switch (code) {
+    case HSK_DNS_NOERROR:
+      rcode = LOAD_NOERROR;
+      break;
+    case HSK_DNS_NXDOMAIN:
+      rcode = LOAD_NXDOMAIN;
+      break;
+    case HSK_DNS_SERVFAIL:
+      rcode = LOAD_SERVFAIL;
+      break;
+    case HSK_DNS_REFUSED:
+      rcode = LOAD_REFUSED;
+      break;
+    default:
+      rcode = LOAD_OTHER;
+      break;
+  }
+
+  target->received += 1;
+  target->rcodes[rcode] += 1;
+
+  load_record(target, (uint32_t)(elapsed / 1000));
+}
+
+static void
+load_close(uv_handle_t *handle) {}
+
+static void
+load_finish(void) {
+  uv_timer_stop(&load.timer);
+  uv_close((uv_handle_t *)&load.timer, load_close);
+
+  for (int i = 0; i < load.target_count; i++) {
+    uv_udp_recv_stop(&load.targets[i].socket);
+    uv_close((uv_handle_t *)&load.targets[i].socket, load_close);
+  }
+
+  // Whatever is still in flight has timed out.
+  for (size_t i = 0; i < 65536; i++) {
+    if (load.slots[i].target) {
+      load.slots[i].target->lost += 1;
+      load.slots[i].target = NULL;
+    }
+  }
+}
+
+static void
+load_tick(uv_timer_t *timer) {
+  uint64_t now = uv_hrtime();
+
+  if (load.draining) {
+    if (now - load.stop >= load.timeout)
+      load_finish();
+    return;
+  }
+
+  double elapsed = (double)(now - load.start) / 1e9;
+  uint64_t due = (uint64_t)(elapsed * load.qps);
+  int burst = 0;
+
+  if (load.limit && due > load.limit)
+    due = load.limit;
+
+  while (load.sent < due && burst < LOAD_MAX_BURST) {
+    load_target_t *target = &load.targets[load.sent % load.target_count];
+    load_send(target, now);
+    burst += 1;
+  }
+
+  if (elapsed >= load.duration || (load.limit && load.sent >= load.limit)) {
+    load.draining = true;
+    load.stop = now;
+  }
+}
+
+static bool
+load_open(load_target_t *target) {
+  struct sockaddr_storage bind;
+
+  memset(&bind, 0x00, sizeof(bind));
+
+  if (target->addr.ss_family == AF_INET6) {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&bind;
+    sin6->sin6_family = AF_INET6;
+  } else {
+    struct sockaddr_in *sin = (struct sockaddr_in *)&bind;
+    sin->sin_family = AF_INET;
+  }
+
+  if (uv_udp_init(load.loop, &target->socket) != 0)
+    return false;
+
+  target->socket.data = (void *)target;
+
+  if (uv_udp_bind(&target->socket, (struct sockaddr *)&bind, 0) != 0)
+    return false;
+
+  // Best effort: big bursts overflow the default buffers.
+  int size = 4 << 20;
+  uv_recv_buffer_size((uv_handle_t *)&target->socket, &size);
+  size = 4 << 20;
+  uv_send_buffer_size((uv_handle_t *)&target->socket, &size);
+
+  return uv_udp_recv_start(&target->socket, load_alloc, load_recv) == 0;
+}
+
+/*
+ * Reporting
+ */
+
+static int
+load_cmp(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double
+load_percentile(const load_target_t *target, double p) {
+  if (target->latency_len == 0)
+    return 0;
+
+  // Nearest rank.
+  double rank = p * (double)target->latency_len;
+  size_t i = (size_t)rank;
+
+  if ((double)i < rank)
+    i += 1;
+
+  if (i > 0)
+    i -= 1;
+
+  if (i >= target->latency_len)
+    i = target->latency_len - 1;
+
+  return (double)target->latency[i] / 1000.0;
+}
+
+static void
+load_report(double elapsed) {
+  static const double pcts[4] = { 0.50, 0.90, 0.99, 0.999 };
+  static const char *pct_names[4] = { "p50", "p90", "p99", "p99.9" };
+  FILE *out = load.json ? stderr : stdout;
+  int i, j;
+
+  fprintf(out, "%-4s %10s %10s %7s %10s %9s %9s %9s %9s\n",
+          "", "sent", "recv", "loss", "qps",
+          "p50 ms", "p90 ms", "p99 ms", "p99.9 ms");
+
+  for (i = 0; i < load.target_count; i++) {
+    load_target_t *t = &load.targets[i];
+    double loss = t->sent ? 100.0 * (double)t->lost / (double)t->sent : 0;
+
+    qsort(t->latency, t->latency_len, sizeof(uint32_t), load_cmp);
+
+    fprintf(out, "%-4s %10llu %10llu %6.2f%% %10.1f",
+            t->name,
+            (unsigned long long)t->sent,
+            (unsigned long long)t->received,
+            loss,
+            (double)t->received / elapsed);
+
+    for (j = 0; j < 4; j++)
+      fprintf(out, " %9.3f", load_percentile(t, pcts[j]));
+
+    fprintf(out, "\n");
+  }
+
+  if (load.unmatched > 0)
+    fprintf(out, "unmatched replies: %llu\n", (unsigned long long)load.unmatched);
+
+  if (!load.json)
+    return;
+
+  printf("{\n");
+  printf("  \"version\": 1,\n");
+  printf("  \"qps\": %.1f,\n", load.qps);
+  printf("  \"duration\": %.3f,\n", elapsed);
+  printf("  \"queries\": %zu,\n", load.query_count);
+  printf("  \"unmatched\": %llu,\n", (unsigned long long)load.unmatched);
+  printf("  \"results\": [");
+
+  for (i = 0; i < load.target_count; i++) {
+    load_target_t *t = &load.targets[i];
+
+    printf("%s\n    {\n", i > 0 ? "," : "");
+    printf("      \"target\": \"%s\",\n", t->name);
+    printf("      \"sent\": %llu,\n", (unsigned long long)t->sent);
+    printf("      \"received\": %llu,\n", (unsigned long long)t->received);
+    printf("      \"lost\": %llu,\n", (unsigned long long)t->lost);
+    printf("      \"send_errors\": %llu,\n",
+           (unsigned long long)t->send_errors);
+    printf("      \"qps\": %.1f,\n", (double)t->received / elapsed);
+    printf("      \"latency_ms\": {");
+
+    for (j = 0; j < 4; j++) {
+      printf("%s\"%s\": %.3f", j > 0 ? ", " : " ",
+             pct_names[j], load_percentile(t, pcts[j]));
+    }
+
+    printf(" },\n");
+    printf("      \"rcodes\": {");
+
+    for (j = 0; j < LOAD_RCODES; j++) {
+      printf("%s\"%s\": %llu", j > 0 ? ", " : " ",
+             load_rcode_names[j], (unsigned long long)t->rcodes[j]);
+    }
+
+    printf(" }\n    }");
+  }
+
+  printf("\n  ]\n}\n");
+}
+
+/*
+ * Main
+ */
+
+static void
+help(int r) {
+  fprintf(stderr,
+    "\n"
+    "load_hnsd [options] <query-log>\n"
+    "\n"
+    "  -n, --ns-host <ip[:port]>\n"
+    "    Authoritative server (default: 127.0.0.1:%d).\n"
+    "\n"
+    "  -r, --rs-host <ip[:port]>\n"
+    "    Recursive server (default: 127.0.0.1:%d).\n"
+    "\n"
+    "  -t, --target <ns|rs|both>\n"
+    "    Which server(s) to query (default: ns).\n"
+    "\n"
+    "  -q, --qps <rate>\n"
+    "    Queries per second, across all targets (default: 1000).\n"
+    "\n"
+    "  -d, --duration <seconds>\n"
+    "    How long to send for (default: 10).\n"
+    "\n"
+    "  -c, --count <n>\n"
+    "    Stop after sending n queries.\n"
+    "\n"
+    "  -T, --timeout <ms>\n"
+    "    When to count a query as lost (default: 2000).\n"
+    "\n"
+    "  -D, --dnssec\n"
+    "    Set the DO bit on queries from text logs.\n"
+    "\n"
+    "  -j, --json\n"
+    "    Print results as JSON to stdout (the table goes to stderr).\n"
+    "\n"
+    "  -h, --help\n"
+    "    This help message.\n"
+    "\n",
+    HSK_NS_PORT,
+    HSK_RS_PORT
+  );
+
+  exit(r);
+}
+
+int
+main(int argc, char **argv) {
+  const static char *optstring = "n:r:t:q:d:c:T:Djh";
+
+  const static struct option longopts[] = {
+    { "ns-host", required_argument, NULL, 'n' },
+    { "rs-host", required_argument, NULL, 'r' },
+    { "target", required_argument, NULL, 't' },
+    { "qps", required_argument, NULL, 'q' },
+    { "duration", required_argument, NULL, 'd' },
+    { "count", required_argument, NULL, 'c' },
+    { "timeout", required_argument, NULL, 'T' },
+    { "dnssec", no_argument, NULL, 'D' },
+    { "json", no_argument, NULL, 'j' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  const char *ns_host = "127.0.0.1";
+  const char *rs_host = "127.0.0.1";
+  const char *which = "ns";
+
+  load.qps = 1000;
+  load.duration = 10;
+  load.timeout = 2000;
+
+  for (;;) {
+    int o = getopt_long(argc, argv, optstring, longopts, NULL);
+
+    if (o == -1)
+      break;
+
+    switch (o) {
+      case 'n':
+        ns_host = optarg;
+        break;
+      case 'r':
+        rs_host = optarg;
+        break;
+      case 't':
+        which = optarg;
+        break;
+      case 'q':
+        load.qps = atof(optarg);
+        break;
+      case 'd':
+        load.duration = atof(optarg);
+        break;
+      case 'c':
+        load.limit = strtoull(optarg, NULL, 10);
+        break;
+      case 'T':
+        load.timeout = strtoull(optarg, NULL, 10);
+        break;
+      case 'D':
+        load.dnssec = true;
+        break;
+      case 'j':
+        load.json = true;
+        break;
+      case 'h':
+        help(0);
+        break;
+      default:
+        help(1);
+        break;
+    }
+  }
+
+  if (optind != argc - 1 || load.qps <= 0 || load.duration <= 0)
+    help(1);
+
+  load.timeout *= 1000000;
+
+  bool use_ns = strcmp(which, "ns") == 0 || strcmp(which, "both") == 0;
+  bool use_rs = strcmp(which, "rs") == 0 || strcmp(which, "both") == 0;
+
+  if (!use_ns && !use_rs)
+    help(1);
+
+  if (use_ns) {
+    load_target_t *t = &load.targets[load.target_count++];
+    t->name = "ns";
+    if (!hsk_sa_from_string((struct sockaddr *)&t->addr, ns_host, HSK_NS_PORT))
+      help(1);
+  }
+
+  if (use_rs) {
+    load_target_t *t = &load.targets[load.target_count++];
+    t->name = "rs";
+    if (!hsk_sa_from_string((struct sockaddr *)&t->addr, rs_host, HSK_RS_PORT))
+      help(1);
+  }
+
+  if (!load_read(argv[optind]))
+    return 1;
+
+  if (load.query_count == 0) {
+    fprintf(stderr, "no queries in %s\n", argv[optind]);
+    return 1;
+  }
+
+  fprintf(stderr, "Replaying %zu queries at %.0f qps...\n",
+          load.query_count, load.qps);
+
+  load.loop = uv_default_loop();
+
+  for (int i = 0; i < load.target_count; i++) {
+    if (!load_open(&load.targets[i])) {
+      fprintf(stderr, "could not open socket\n");
+      return 1;
+    }
+  }
+
+  // Start IDs somewhere other than
+  // zero, as a courtesy to caches.
+  load.next_id = (uint16_t)(uv_hrtime() & 0xffff);
+  load.start = uv_hrtime();
+
+  uv_timer_init(load.loop, &load.timer);
+  uv_timer_start(&load.timer, load_tick, 0, LOAD_TICK_MS);
+
+  uv_run(load.loop, UV_RUN_DEFAULT);
+
+  double elapsed = (double)(load.stop - load.start) / 1e9;
+
+  if (elapsed <= 0)
+    elapsed = 1e-9;
+
+  load_report(elapsed);
+
+  for (size_t i = 0; i < load.query_count; i++)
+    free(load.queries[i].data);
+
+  free(load.queries);
+
+  for (int i = 0; i < load.target_count; i++)
+    free(load.targets[i].latency);
+
+  uv_loop_close(load.loop);
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#!/bin/sh
+
+# Runs hnsd against mock_hnsd for each scenario and collects the results.
+# Needs a regtest build (./configure --with-network=regtest) of hnsd,
+# mock_hnsd and load_hnsd in the current directory.
+#
+#   $ ./test/mock-scenarios.sh [out-dir] [scenario...]
+#
+# For every scenario, out-dir gets <scenario>-mock.json (headers/sec,
+# proofs/sec, root switch time), <scenario>-load.json (resolver latency),
+# <scenario>-usage.txt (hnsd's peak memory and CPU time) and the logs of
+# both sides.
+#
+# The resume scenario runs over brontide with --resume-sessions and fails
+# if hnsd did not resume its session after mock_hnsd dropped it.
+
+set -e
+
+out=${1:-mock-results}
+[ $# -gt 0 ] && shift
+scenarios=${*:-sync reorg flip orphans resume}
+
+height=${MOCK_HEIGHT:-3000}
+names=${MOCK_NAMES:-500}
+qps=${MOCK_QPS:-200}
+duration=${MOCK_DURATION:-10}
+
+peer=127.0.0.1:24038
+ns=127.0.0.1:25449
+rs=127.0.0.1:25450
+key=0101010101010101010101010101010101010101010101010101010101010101
+
+mkdir -p "$out"
+
+./mock_hnsd -g "$height" -N "$names" \
+  -w "$out/chain.mock" -Q "$out/queries.txt" 2> /dev/null
+
+for scenario in $scenarios; do
+  echo "$scenario:"
+
+  mock_args=
+  hnsd_args=
+  seed=$peer
+
+  if [ "$scenario" = resume ]; then
+    mock_args="-k $key"
+    hnsd_args=-e
+  fi
+
+  ./mock_hnsd -l "$out/chain.mock" -p "$peer" -S "$scenario" -e 2 $mock_args \
+    --json > "$out/$scenario-mock.json" 2> "$out/$scenario-mock.log" &
+  mock=$!
+
+  sleep 1
+
+  if [ -n "$mock_args" ]; then
+    pub=$(sed -n 's/.*identity key: //p' "$out/$scenario-mock.log")
+    seed=$pub@$peer
+  fi
+
+  ./hnsd -p 1 -s "$seed" -n "$ns" -r "$rs" $hnsd_args \
+    > "$out/$scenario-hnsd.log" 2>&1 &
+  hnsd=$!
+
+  # Queries sent before the first sync would only measure timeouts.
+  tries=0
+  until grep -q synced "$out/$scenario-mock.log"; do
+    tries=$((tries + 1))
+
+    if [ $tries -gt 60 ]; then
+      echo "hnsd did not sync" >&2
+      kill $hnsd $mock
+      exit 1
+    fi
+
+    sleep 0.5
+  done
+
+  ./load_hnsd -n "$ns" -q "$qps" -d "$duration" --json \
+    "$out/queries.txt" > "$out/$scenario-load.json"
+
+  # What the scenario cost hnsd (Linux only).
+  if [ -r /proc/$hnsd/status ]; then
+    rss=$(awk '/^VmHWM/ { print $2 }' /proc/$hnsd/status)
+    # utime and stime, after the parenthesized command name.
+    cpu=$(sed 's/.*) //' /proc/$hnsd/stat \
+      | awk -v hz="$(getconf CLK_TCK)" '{ printf "%.2f", ($12 + $13) / hz }')
+    echo "hnsd:         peak rss $rss kB, cpu $cpu s" \
+      > "$out/$scenario-usage.txt"
+  fi
+
+  kill $mock
+  wait $mock
+  kill $hnsd
+  wait $hnsd || true
+
+  cat "$out/$scenario-mock.log"
+
+  if [ -f "$out/$scenario-usage.txt" ]; then
+    cat "$out/$scenario-usage.txt"
+  fi
+
+  if [ "$scenario" = resume ] \
+      && ! grep -q "session resumed" "$out/$scenario-hnsd.log"; then
+    echo "hnsd did not resume its session" >&2
+    exit 1
+  fi
+done
@@ -0,0 +1,2246 @@
+#include "config.h"
+
+#include <assert.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "addr.h"
+#include "base32.h"
+#include "bio.h"
+#include "blake2b.h"
+#include "brontide.h"
+#include "constants.h"
+#include "ec.h"
+#include "error.h"
+#include "genesis.h"
+#include "hash.h"
+#include "header.h"
+#include "map.h"
+#include "msg.h"
+#include "proof.h"
+#include "resource.h"
+#include "utils.h"
+#include "uv.h"
+
+// A stand-in full node for measuring hnsd's sync and proof paths against a
+// fixed chain, with no real network in the way.
+//
+//   $ ./mock_hnsd -g 10000 -N 2000 -w chain.mock -Q queries.txt
+//   $ ./mock_hnsd -l chain.mock -S reorg --latency 50 --json > reorg.json
+//   $ ./hnsd -s 127.0.0.1:14038 ...
+//
+// It speaks enough of the P2P protocol (see msg.c and pool.c) for hnsd:
+// version/verack, ping, getheaders/headers and getproof/proof, in the clear
+// or over brontide. Headers and proofs come from a dataset that is either
+// generated on the spot or loaded from a file written by an earlier run, so
+// every run serves the same bytes. Generating a chain needs the easy proof
+// of work of a regtest build.
+//
+// Once the first peer has synced, the chosen scenario plays out:
+//
+//   sync     nothing more; report headers/sec and proofs/sec.
+//   reorg    announce a longer fork whose headers commit to a new name root.
+//   flip     extend the chain past a tree interval with a new name root.
+//   orphans  keep sending headers that connect to nothing (regtest only).
+//   resume   drop every peer so it reconnects (brontide only).
+//
+// For reorg and flip, we also report how long it took for the first proof
+// request against the new root to show up. For orphans, we report how many
+// were sent; mock-scenarios.sh records what they cost hnsd. For resume, we
+// report how many of the reconnects skipped the handshake.
+//
+// Over brontide, we keep the responder's half of a resumption ticket for
+// every peer that offers HSK_SERVICE_RESUME (hnsd --resume-sessions), the
+// same way hsd does, and offer it ourselves.
+
+/*
+ * Types
+ */
+
+#define MOCK_MAGIC "HSKMOCK1"
+#define MOCK_MAX_HEADERS 2000
+#define MOCK_BUFFER_SIZE 65536
+
+// How often to send another message full of orphans, in milliseconds.
+#define MOCK_FLOOD_INTERVAL 100
+
+// Resumption tickets kept for peers, oldest dropped first.
+#define MOCK_TICKETS 64
+
+#define MOCK_HAS_BIT(m, i) (((m)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+enum {
+  MOCK_SYNC,
+  MOCK_REORG,
+  MOCK_FLIP,
+  MOCK_ORPHANS,
+  MOCK_RESUME
+};
+
+static const char *mock_scenarios[5] = {
+  "sync",
+  "reorg",
+  "flip",
+  "orphans",
+  "resume"
+};
+
+#define MOCK_SCENARIOS \
+  (sizeof(mock_scenarios) / sizeof(mock_scenarios[0]))
+
+typedef struct {
+  char name[64];
+  uint8_t key[32];
+  uint8_t *value;
+  size_t value_len;
+} mock_leaf_t;
+
+typedef struct mock_node_s {
+  uint8_t hash[32];
+  // Internal nodes.
+  uint16_t prefix_size;
+  uint8_t prefix[32];
+  struct mock_node_s *left;
+  struct mock_node_s *right;
+  // Leaves.
+  const mock_leaf_t *leaf;
+} mock_node_t;
+
+// A static radix tree with the same hashing as the one hsd
+// keeps, built once from a sorted set of leaves.
+typedef struct {
+  mock_leaf_t *leaves;
+  size_t leaf_count;
+  mock_node_t *nodes;
+  size_t node_count;
+  mock_node_t *root;
+  uint8_t root_hash[32];
+} mock_tree_t;
+
+// Headers that attach to the main chain after `parent`.
+typedef struct {
+  uint32_t parent;
+  hsk_header_t *headers;
+  size_t count;
+} mock_branch_t;
+
+typedef struct mock_write_s {
+  struct mock_write_s *next;
+  uint64_t due;
+  uint8_t *data;
+  size_t len;
+} mock_write_t;
+
+typedef struct {
+  uv_write_t req;
+  uint8_t *data;
+} mock_req_t;
+
+typedef struct mock_peer_s {
+  struct mock_peer_s *next;
+  uint64_t id;
+  char host[HSK_MAX_HOST];
+  uv_tcp_t socket;
+  uv_timer_t timer;
+  int handles;
+  bool closing;
+  bool version;
+  hsk_brontide_t *brontide;
+  // Framing.
+  bool msg_hdr;
+  uint8_t msg_cmd;
+  uint8_t *msg;
+  size_t msg_pos;
+  size_t msg_len;
+  size_t msg_cap;
+  // Shaping.
+  mock_write_t *head;
+  mock_write_t *tail;
+  uint64_t link_free;
+} mock_peer_t;
+
+typedef struct {
+  // Options.
+  int scenario;
+  uint64_t latency;
+  uint64_t bandwidth;
+  double delay;
+  double duration;
+  bool json;
+  // Dataset. The branches are the fork for
+  // the reorg and the extension for the flip.
+  hsk_header_t *main;
+  size_t main_count;
+  mock_branch_t branches[2];
+  mock_tree_t trees[2];
+  // Chain being served.
+  hsk_header_t **chain;
+  uint32_t height;
+  hsk_map_t hashes;
+  // Net.
+  uv_loop_t *loop;
+  uv_tcp_t server;
+  uv_timer_t event;
+  uv_timer_t stop;
+  uv_signal_t sigint;
+  uv_signal_t sigterm;
+  hsk_ec_t *ec;
+  bool use_brontide;
+  uint8_t key[32];
+  hsk_brontide_ticket_t tickets[MOCK_TICKETS];
+  size_t ticket_count;
+  mock_peer_t *peers;
+  uint64_t next_id;
+  bool stopping;
+  // Stats.
+  uint64_t start;
+  uint64_t headers;
+  uint64_t sync_start;
+  uint64_t sync_end;
+  uint64_t sync_headers;
+  uint64_t proofs;
+  uint64_t proof_start;
+  uint64_t proof_end;
+  uint64_t proof_types[4];
+  uint64_t unknown_roots;
+  uint64_t event_time;
+  uint64_t switch_time;
+  uint64_t bytes;
+  uint64_t orphans;
+  uint64_t dropped;
+  uint64_t reconnects;
+  uint64_t resumed;
+} mock_t;
+
+static mock_t mock;
+
+/*
+ * Tree
+ */
+
+static void
+mock_hash_value(const uint8_t *value, size_t value_len, uint8_t *out) {
+  hsk_blake2b_ctx ctx;
+  assert(hsk_blake2b_init(&ctx, 32) == 0);
+  hsk_blake2b_update(&ctx, value, value_len);
+  assert(hsk_blake2b_final(&ctx, out, 32) == 0);
+}
+
+static void
+mock_hash_leaf(const uint8_t *key, const uint8_t *hash, uint8_t *out) {
+  uint8_t block[65];
+  block[0] = 0x00;
+  memcpy(&block[1], key, 32);
+  memcpy(&block[33], hash, 32);
+  hsk_blake2b_256_block(out, block, sizeof(block));
+}
+
+static void
+mock_hash_internal(const mock_node_t *node, uint8_t *out) {
+  uint8_t block[1 + 2 + 32 + 64];
+  uint8_t *p = block;
+
+  if (node->prefix_size == 0) {
+    write_u8(&p, 0x01);
+  } else {
+    write_u8(&p, 0x02);
+    write_u16(&p, node->prefix_size);
+    write_bytes(&p, node->prefix, (node->prefix_size + 7) / 8);
+  }
+
+  write_bytes(&p, node->left->hash, 32);
+  write_bytes(&p, node->right->hash, 32);
+
+  hsk_blake2b_256_block(out, block, p - block);
+}
+
+static int
+mock_leaf_cmp(const void *a, const void *b) {
+  const mock_leaf_t *x = (const mock_leaf_t *)a;
+  const mock_leaf_t *y = (const mock_leaf_t *)b;
+  return memcmp(x->key, y->key, 32);
+}
+
+static mock_node_t *
+mock_tree_build(mock_tree_t *tree, const mock_leaf_t *leaves,
+                size_t count, int depth) {
+  assert(count > 0);
+
+  mock_node_t *node = &tree->nodes[tree->node_count++];
+
+  memset(node, 0x00, sizeof(mock_node_t));
+
+  if (count == 1) {
+    uint8_t hash[32];
+    node->leaf = &leaves[0];
+    mock_hash_value(leaves[0].value, leaves[0].value_len, hash);
+    mock_hash_leaf(leaves[0].key, hash, node->hash);
+    return node;
+  }
+
+  // Leaves are sorted, so the bits the first and last
+  // have in common are shared by everything between.
+  const uint8_t *lo = leaves[0].key;
+  const uint8_t *hi = leaves[count - 1].key;
+  int bit = depth;
+
+  while (MOCK_HAS_BIT(lo, bit) == MOCK_HAS_BIT(hi, bit)) {
+    int i = bit - depth;
+
+    if (MOCK_HAS_BIT(lo, bit))
+      node->prefix[i >> 3] |= 1 << (7 - (i & 7));
+
+    bit += 1;
+  }
+
+  node->prefix_size = bit - depth;
+
+  size_t split = 1;
+
+  while (!MOCK_HAS_BIT(leaves[split].key, bit))
+    split += 1;
+
+  node->left = mock_tree_build(tree, leaves, split, bit + 1);
+  node->right = mock_tree_build(tree, &leaves[split], count - split, bit + 1);
+
+  mock_hash_internal(node, node->hash);
+
+  return node;
+}
+
+static bool
+mock_tree_init(mock_tree_t *tree) {
+  size_t i;
+
+  for (i = 0; i < tree->leaf_count; i++)
+    hsk_hash_name(tree->leaves[i].name, tree->leaves[i].key);
+
+  qsort(tree->leaves, tree->leaf_count, sizeof(mock_leaf_t), mock_leaf_cmp);
+
+  for (i = 1; i < tree->leaf_count; i++) {
+    if (memcmp(tree->leaves[i - 1].key, tree->leaves[i].key, 32) == 0)
+      return false;
+  }
+
+  tree->node_count = 0;
+  tree->root = NULL;
+  memset(tree->root_hash, 0x00, 32);
+
+  if (tree->leaf_count == 0)
+    return true;
+
+  tree->nodes = malloc((2 * tree->leaf_count - 1) * sizeof(mock_node_t));
+
+  if (!tree->nodes)
+    return false;
+
+  tree->root = mock_tree_build(tree, tree->leaves, tree->leaf_count, 0);
+  memcpy(tree->root_hash, tree->root->hash, 32);
+
+  return true;
+}
+
+static void
+mock_tree_uninit(mock_tree_t *tree) {
+  size_t i;
+
+  for (i = 0; i < tree->leaf_count; i++)
+    free(tree->leaves[i].value);
+
+  free(tree->leaves);
+  free(tree->nodes);
+
+  memset(tree, 0x00, sizeof(mock_tree_t));
+}
+
+static bool
+mock_tree_has(const mock_node_t *node, const uint8_t *key, int depth) {
+  int i;
+
+  for (i = 0; i < node->prefix_size; i++) {
+    if (MOCK_HAS_BIT(node->prefix, i) != MOCK_HAS_BIT(key, depth + i))
+      return false;
+  }
+
+  return true;
+}
+
+static bool
+mock_tree_prove(const mock_tree_t *tree, const uint8_t *key,
+                hsk_proof_t *proof) {
+  const mock_node_t *node = tree->root;
+  int depth = 0;
+
+  if (!node) {
+    proof->type = HSK_PROOF_DEADEND;
+    proof->depth = 0;
+    return true;
+  }
+
+  proof->nodes = calloc(256, sizeof(hsk_proof_node_t));
+
+  if (!proof->nodes)
+    return false;
+
+  while (!node->leaf) {
+    if (!mock_tree_has(node, key, depth)) {
+      size_t bytes = (node->prefix_size + 7) / 8;
+
+      proof->type = HSK_PROOF_SHORT;
+      proof->depth = depth;
+      proof->prefix = malloc(bytes);
+      proof->left = malloc(32);
+      proof->right = malloc(32);
+
+      if (!proof->prefix || !proof->left || !proof->right)
+        return false;
+
+      memcpy(proof->prefix, node->prefix, bytes);
+      proof->prefix_size = node->prefix_size;
+      memcpy(proof->left, node->left->hash, 32);
+      memcpy(proof->right, node->right->hash, 32);
+
+      return true;
+    }
+
+    hsk_proof_node_t *item = &proof->nodes[proof->node_count++];
+
+    memcpy(item->prefix, node->prefix, 32);
+    item->prefix_size = node->prefix_size;
+
+    depth += node->prefix_size;
+
+    if (MOCK_HAS_BIT(key, depth)) {
+      memcpy(item->node, node->left->hash, 32);
+      node = node->right;
+    } else {
+      memcpy(item->node, node->right->hash, 32);
+      node = node->left;
+    }
+
+    depth += 1;
+  }
+
+  const mock_leaf_t *leaf = node->leaf;
+
+  proof->depth = depth;
+
+  if (memcmp(leaf->key, key, 32) == 0) {
+    proof->type = HSK_PROOF_EXISTS;
+    proof->value = malloc(leaf->value_len);
+
+    if (!proof->value)
+      return false;
+
+    memcpy(proof->value, leaf->value, leaf->value_len);
+    proof->value_size = leaf->value_len;
+  } else {
+    proof->type = HSK_PROOF_COLLISION;
+    proof->nx_key = malloc(32);
+    proof->nx_hash = malloc(32);
+
+    if (!proof->nx_key || !proof->nx_hash)
+      return false;
+
+    memcpy(proof->nx_key, leaf->key, 32);
+    mock_hash_value(leaf->value, leaf->value_len, proof->nx_hash);
+  }
+
+  return true;
+}
+
+static const mock_tree_t *
+mock_find_tree(const uint8_t *root) {
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (memcmp(mock.trees[i].root_hash, root, 32) == 0)
+      return &mock.trees[i];
+  }
+
+  return NULL;
+}
+
+/*
+ * Dataset
+ */
+
+static size_t
+mock_write_ns(uint8_t *data, const char *name) {
+  uint8_t *p = data;
+  size_t len = strlen(name);
+
+  write_u8(&p, 3);
+  write_bytes(&p, (const uint8_t *)"ns1", 3);
+  write_u8(&p, (uint8_t)len);
+  write_bytes(&p, (const uint8_t *)name, len);
+  write_u8(&p, 0);
+
+  return p - data;
+}
+
+// A namestate with just enough in it for hnsd: the name and a
+// resource delegating to an in-zone nameserver with glue.
+static bool
+mock_leaf_init(mock_leaf_t *leaf, const char *name, uint8_t epoch,
+               uint32_t index) {
+  uint8_t res[128];
+  uint8_t *p = res;
+
+  write_u8(&p, 0);
+  write_u8(&p, HSK_NS);
+  p += mock_write_ns(p, name);
+  write_u8(&p, HSK_GLUE4);
+  p += mock_write_ns(p, name);
+  write_u8(&p, 10);
+  write_u8(&p, epoch);
+  write_u8(&p, (uint8_t)(index >> 8));
+  write_u8(&p, (uint8_t)index);
+
+  size_t res_len = p - res;
+  size_t name_len = strlen(name);
+
+  assert(name_len < sizeof(leaf->name));
+
+  strcpy(leaf->name, name);
+  leaf->value_len = 1 + name_len + 2 + res_len;
+  leaf->value = malloc(leaf->value_len);
+
+  if (!leaf->value)
+    return false;
+
+  p = leaf->value;
+  write_u8(&p, (uint8_t)name_len);
+  write_bytes(&p, (const uint8_t *)name, name_len);
+  write_u16(&p, (uint16_t)res_len);
+  write_bytes(&p, res, res_len);
+
+  return true;
+}
+
+static bool
+mock_genesis(hsk_header_t *hdr) {
+  hsk_header_init(hdr);
+
+  if (!hsk_header_decode(HSK_GENESIS, sizeof(HSK_GENESIS) - 1, hdr))
+    return false;
+
+  hdr->height = 0;
+  hsk_header_cache(hdr);
+
+  return true;
+}
+
+#if HSK_NETWORK == HSK_REGTEST
+static void
+mock_mine(hsk_header_t *hdr, const hsk_header_t *prev,
+          const uint8_t *root, uint8_t salt) {
+  hsk_header_init(hdr);
+
+  memcpy(hdr->prev_block, prev->hash, 32);
+  memcpy(hdr->name_root, root, 32);
+  hdr->extra_nonce[0] = salt;
+  hdr->time = prev->time + HSK_TARGET_SPACING;
+  hdr->bits = HSK_BITS;
+  hdr->height = prev->height + 1;
+
+  for (;;) {
+    hdr->cache = false;
+
+    if (hsk_header_verify_pow(hdr) == HSK_SUCCESS)
+      break;
+
+    hdr->nonce += 1;
+  }
+
+  hsk_header_cache(hdr);
+}
+#endif
+
+static bool
+mock_generate(uint32_t height, size_t names, uint32_t depth) {
+#if HSK_NETWORK == HSK_REGTEST
+  int i;
+  size_t j;
+
+  if (depth == 0)
+    depth = HSK_TREE_INTERVAL * 2;
+
+  if (height <= depth) {
+    fprintf(stderr, "height must be above the reorg depth (%u)\n", depth);
+    return false;
+  }
+
+  for (i = 0; i < 2; i++) {
+    mock_tree_t *tree = &mock.trees[i];
+
+    tree->leaves = calloc(names, sizeof(mock_leaf_t));
+
+    if (names > 0 && !tree->leaves)
+      return false;
+
+    tree->leaf_count = names;
+
+    for (j = 0; j < names; j++) {
+      char name[64];
+      sprintf(name, "mock%zu", j);
+
+      if (!mock_leaf_init(&tree->leaves[j], name, i, j))
+        return false;
+    }
+
+    if (!mock_tree_init(tree))
+      return false;
+  }
+
+  mock.main_count = (size_t)height + 1;
+  mock.main = calloc(mock.main_count, sizeof(hsk_header_t));
+
+  if (!mock.main)
+    return false;
+
+  if (!mock_genesis(&mock.main[0]))
+    return false;
+
+  for (j = 1; j < mock.main_count; j++)
+    mock_mine(&mock.main[j], &mock.main[j - 1], mock.trees[0].root_hash, 0);
+
+  // The fork is one block longer than what it replaces and the extension
+  // is long enough to cross a tree interval, so either way hnsd ends up
+  // with a safe height that commits to the new root.
+  mock.branches[0].parent = height - depth;
+  mock.branches[0].count = depth + 1;
+  mock.branches[1].parent = height;
+  mock.branches[1].count = HSK_TREE_INTERVAL + 1;
+
+  for (i = 0; i < 2; i++) {
+    mock_branch_t *branch = &mock.branches[i];
+    const hsk_header_t *prev = &mock.main[branch->parent];
+
+    branch->headers = calloc(branch->count, sizeof(hsk_header_t));
+
+    if (!branch->headers)
+      return false;
+
+    for (j = 0; j < branch->count; j++) {
+      mock_mine(&branch->headers[j], prev, mock.trees[1].root_hash, i + 1);
+      prev = &branch->headers[j];
+    }
+  }
+
+  return true;
+#else
+  fprintf(stderr,
+    "generating a chain needs a regtest build (--with-network=regtest)\n");
+  return false;
+#endif
+}
+
+static bool
+mock_save_headers(FILE *fp, const hsk_header_t *headers, size_t count) {
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    uint8_t data[256];
+    int size = hsk_header_encode(&headers[i], data);
+
+    assert(size > 0 && size <= (int)sizeof(data));
+
+    if (fwrite(data, 1, size, fp) != (size_t)size)
+      return false;
+  }
+
+  return true;
+}
+
+static bool
+mock_save(const char *file) {
+  FILE *fp = fopen(file, "wb");
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", file);
+    return false;
+  }
+
+  uint8_t data[16];
+  uint8_t *p;
+  size_t i, j;
+  bool ok = true;
+
+  p = data;
+  write_bytes(&p, (const uint8_t *)MOCK_MAGIC, 8);
+  write_u32(&p, HSK_MAGIC);
+  write_u32(&p, (uint32_t)mock.main_count);
+  ok &= fwrite(data, 1, p - data, fp) == (size_t)(p - data);
+  ok &= mock_save_headers(fp, mock.main, mock.main_count);
+
+  for (i = 0; i < 2; i++) {
+    const mock_branch_t *branch = &mock.branches[i];
+
+    p = data;
+    write_u32(&p, branch->parent);
+    write_u32(&p, (uint32_t)branch->count);
+    ok &= fwrite(data, 1, p - data, fp) == (size_t)(p - data);
+    ok &= mock_save_headers(fp, branch->headers, branch->count);
+  }
+
+  for (i = 0; i < 2; i++) {
+    const mock_tree_t *tree = &mock.trees[i];
+
+    p = data;
+    write_u32(&p, (uint32_t)tree->leaf_count);
+    ok &= fwrite(data, 1, p - data, fp) == (size_t)(p - data);
+
+    for (j = 0; j < tree->leaf_count; j++) {
+      const mock_leaf_t *leaf = &tree->leaves[j];
+      uint8_t name_len = (uint8_t)strlen(leaf->name);
+
+      p = data;
+      write_u8(&p, name_len);
+      ok &= fwrite(data, 1, 1, fp) == 1;
+      ok &= fwrite(leaf->name, 1, name_len, fp) == name_len;
+
+      p = data;
+      write_u16(&p, (uint16_t)leaf->value_len);
+      ok &= fwrite(data, 1, 2, fp) == 2;
+      ok &= fwrite(leaf->value, 1, leaf->value_len, fp) == leaf->value_len;
+    }
+  }
+
+  if (fclose(fp) != 0)
+    ok = false;
+
+  if (!ok)
+    fprintf(stderr, "could not write %s\n", file);
+
+  return ok;
+}
+
+static bool
+mock_load_headers(uint8_t **data, size_t *len, hsk_header_t **out,
+                  size_t count, const hsk_header_t *prev) {
+  // Each header is at least 200 bytes.
+  if (count > *len / 200)
+    return false;
+
+  hsk_header_t *headers = calloc(count ? count : 1, sizeof(hsk_header_t));
+
+  if (!headers)
+    return false;
+
+  *out = headers;
+
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    hsk_header_t *hdr = &headers[i];
+
+    hsk_header_init(hdr);
+
+    if (!hsk_header_read(data, len, hdr))
+      return false;
+
+    hdr->height = prev ? prev->height + 1 : 0;
+
+    if (prev && memcmp(hdr->prev_block, prev->hash, 32) != 0)
+      return false;
+
+    hsk_header_cache(hdr);
+    prev = hdr;
+  }
+
+  return true;
+}
+
+static bool
+mock_load(const char *file) {
+  FILE *fp = fopen(file, "rb");
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", file);
+    return false;
+  }
+
+  uint8_t *buf = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+
+  for (;;) {
+    if (len == cap) {
+      cap = cap ? cap * 2 : 1 << 20;
+
+      uint8_t *b = realloc(buf, cap);
+
+      if (!b) {
+        free(buf);
+        fclose(fp);
+        return false;
+      }
+
+      buf = b;
+    }
+
+    size_t n = fread(buf + len, 1, cap - len, fp);
+
+    if (n == 0)
+      break;
+
+    len += n;
+  }
+
+  fclose(fp);
+
+  uint8_t *p = buf;
+  uint32_t magic, count;
+  uint8_t header[8];
+  size_t i, j;
+
+  if (!read_bytes(&p, &len, header, 8)
+      || memcmp(header, MOCK_MAGIC, 8) != 0
+      || !read_u32(&p, &len, &magic)) {
+    fprintf(stderr, "%s is not a mock_hnsd dataset\n", file);
+    goto fail;
+  }
+
+  if (magic != HSK_MAGIC) {
+    fprintf(stderr, "%s is for another network (this is %s)\n",
+            file, HSK_NETWORK_NAME);
+    goto fail;
+  }
+
+  if (!read_u32(&p, &len, &count) || count == 0)
+    goto corrupt;
+
+  mock.main_count = count;
+
+  if (!mock_load_headers(&p, &len, &mock.main, count, NULL))
+    goto corrupt;
+
+  for (i = 0; i < 2; i++) {
+    mock_branch_t *branch = &mock.branches[i];
+
+    if (!read_u32(&p, &len, &branch->parent) || !read_u32(&p, &len, &count))
+      goto corrupt;
+
+    if (branch->parent >= mock.main_count)
+      goto corrupt;
+
+    branch->count = count;
+
+    if (!mock_load_headers(&p, &len, &branch->headers, count,
+                           &mock.main[branch->parent])) {
+      goto corrupt;
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    mock_tree_t *tree = &mock.trees[i];
+
+    if (!read_u32(&p, &len, &count) || count > len / 3)
+      goto corrupt;
+
+    tree->leaves = calloc(count ? count : 1, sizeof(mock_leaf_t));
+
+    if (!tree->leaves)
+      goto fail;
+
+    tree->leaf_count = count;
+
+    for (j = 0; j < count; j++) {
+      mock_leaf_t *leaf = &tree->leaves[j];
+      uint8_t name_len;
+      uint16_t value_len;
+
+      if (!read_u8(&p, &len, &name_len) || name_len >= sizeof(leaf->name))
+        goto corrupt;
+
+      if (!read_bytes(&p, &len, (uint8_t *)leaf->name, name_len))
+        goto corrupt;
+
+      leaf->name[name_len] = '\0';
+
+      if (!read_u16(&p, &len, &value_len) || value_len > HSK_MAX_DATA_SIZE)
+        goto corrupt;
+
+      if (!alloc_bytes(&p, &len, &leaf->value, value_len))
+        goto corrupt;
+
+      leaf->value_len = value_len;
+    }
+
+    if (!mock_tree_init(tree))
+      goto corrupt;
+  }
+
+  free(buf);
+
+  return true;
+
+corrupt:
+  fprintf(stderr, "%s is corrupt\n", file);
+fail:
+  free(buf);
+  return false;
+}
+
+// One `name type` line per query, in the format load_hnsd reads.
+// Every fourth name does not exist, for some non-existence proofs.
+static bool
+mock_save_queries(const char *file) {
+  FILE *fp = fopen(file, "w");
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", file);
+    return false;
+  }
+
+  const mock_tree_t *tree = &mock.trees[0];
+  size_t i;
+
+  for (i = 0; i < tree->leaf_count; i++) {
+    fprintf(fp, "%s. A\n", tree->leaves[i].name);
+
+    if ((i & 3) == 3)
+      fprintf(fp, "no%s. A\n", tree->leaves[i].name);
+  }
+
+  return fclose(fp) == 0;
+}
+
+static void
+mock_dataset_free(void) {
+  int i;
+
+  free(mock.main);
+  mock.main = NULL;
+
+  for (i = 0; i < 2; i++) {
+    free(mock.branches[i].headers);
+    mock.branches[i].headers = NULL;
+    mock_tree_uninit(&mock.trees[i]);
+  }
+}
+
+/*
+ * Chain
+ */
+
+static bool
+mock_chain_init(void) {
+  size_t extra = mock.branches[0].count > mock.branches[1].count
+    ? mock.branches[0].count
+    : mock.branches[1].count;
+  size_t i, j;
+
+  mock.chain = malloc((mock.main_count + extra) * sizeof(hsk_header_t *));
+
+  if (!mock.chain)
+    return false;
+
+  for (i = 0; i < mock.main_count; i++)
+    mock.chain[i] = &mock.main[i];
+
+  mock.height = (uint32_t)(mock.main_count - 1);
+
+  hsk_map_init_hash_map(&mock.hashes, NULL);
+
+  for (i = 0; i < mock.main_count; i++) {
+    if (!hsk_map_set(&mock.hashes, mock.main[i].hash, &mock.main[i]))
+      return false;
+  }
+
+  for (i = 0; i < 2; i++) {
+    mock_branch_t *branch = &mock.branches[i];
+
+    for (j = 0; j < branch->count; j++) {
+      hsk_header_t *hdr = &branch->headers[j];
+
+      if (!hsk_map_set(&mock.hashes, hdr->hash, hdr))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+static void
+mock_chain_switch(const mock_branch_t *branch) {
+  size_t i;
+
+  for (i = 0; i < branch->count; i++)
+    mock.chain[branch->parent + 1 + i] = &branch->headers[i];
+
+  mock.height = branch->parent + (uint32_t)branch->count;
+}
+
+// The height of the best locator hash on our chain.
+static uint32_t
+mock_chain_find(const hsk_getheaders_msg_t *msg) {
+  size_t i;
+
+  for (i = 0; i < msg->hash_count; i++) {
+    hsk_header_t *hdr = hsk_map_get(&mock.hashes, msg->hashes[i]);
+
+    if (hdr && hdr->height <= mock.height && mock.chain[hdr->height] == hdr)
+      return hdr->height;
+  }
+
+  return 0;
+}
+
+/*
+ * Peers
+ */
+
+static void
+mock_peer_close(mock_peer_t *peer);
+
+static void
+mock_log(const char *fmt, ...);
+
+static void
+mock_after_write(uv_write_t *req, int status) {
+  mock_req_t *wr = (mock_req_t *)req;
+  free(wr->data);
+  free(wr);
+}
+
+static bool
+mock_peer_write(mock_peer_t *peer, uint8_t *data, size_t len) {
+  mock_req_t *wr = malloc(sizeof(mock_req_t));
+
+  if (!wr) {
+    free(data);
+    return false;
+  }
+
+  wr->data = data;
+
+  uv_buf_t buf = uv_buf_init((char *)data, (unsigned int)len);
+
+  if (uv_write(&wr->req, (uv_stream_t *)&peer->socket, &buf, 1,
+               mock_after_write) != 0) {
+    free(data);
+    free(wr);
+    return false;
+  }
+
+  mock.bytes += len;
+
+  return true;
+}
+
+static void
+mock_peer_flush(uv_timer_t *timer) {
+  mock_peer_t *peer = (mock_peer_t *)timer->data;
+  uint64_t now = uv_hrtime();
+
+  // The timer only has millisecond resolution.
+  while (peer->head && peer->head->due <= now + 500000) {
+    mock_write_t *w = peer->head;
+
+    peer->head = w->next;
+
+    if (!peer->head)
+      peer->tail = NULL;
+
+    bool ok = mock_peer_write(peer, w->data, w->len);
+
+    free(w);
+
+    if (!ok) {
+      mock_peer_close(peer);
+      return;
+    }
+  }
+
+  if (peer->head) {
+    uint64_t ms = (peer->head->due - now + 999999) / 1000000;
+    uv_timer_start(&peer->timer, mock_peer_flush, ms, 0);
+  }
+}
+
+// Messages go out in order, each after the one before it has been
+// clocked onto the link at the configured bandwidth, and arrive the
+// configured latency later.
+static bool
+mock_peer_queue(mock_peer_t *peer, uint8_t *data, size_t len) {
+  if (peer->closing) {
+    free(data);
+    return true;
+  }
+
+  if (mock.latency == 0 && mock.bandwidth == 0)
+    return mock_peer_write(peer, data, len);
+
+  uint64_t now = uv_hrtime();
+  uint64_t start = peer->link_free > now ? peer->link_free : now;
+
+  if (mock.bandwidth > 0)
+    start += (uint64_t)len * 1000000000 / mock.bandwidth;
+
+  peer->link_free = start;
+
+  mock_write_t *w = malloc(sizeof(mock_write_t));
+
+  if (!w) {
+    free(data);
+    return false;
+  }
+
+  w->next = NULL;
+  w->due = start + mock.latency;
+  w->data = data;
+  w->len = len;
+
+  if (peer->tail)
+    peer->tail->next = w;
+  else
+    peer->head = w;
+
+  peer->tail = w;
+
+  if (!uv_is_active((uv_handle_t *)&peer->timer))
+    mock_peer_flush(&peer->timer);
+
+  return true;
+}
+
+static void
+mock_brontide_connect(const void *arg) {
+  const mock_peer_t *peer = (const mock_peer_t *)arg;
+  bool resumed = hsk_brontide_is_resumed(peer->brontide);
+
+  if (mock.scenario == MOCK_RESUME && mock.event_time) {
+    mock.reconnects += 1;
+
+    if (resumed)
+      mock.resumed += 1;
+  }
+
+  if (resumed)
+    mock_log("peer %llu: session resumed\n", (unsigned long long)peer->id);
+}
+
+static int
+mock_brontide_write(
+  const void *arg,
+  const uint8_t *data,
+  size_t data_len,
+  bool is_heap
+) {
+  mock_peer_t *peer = (mock_peer_t *)arg;
+  uint8_t *buf = (uint8_t *)data;
+
+  if (!is_heap) {
+    buf = malloc(data_len);
+
+    if (!buf)
+      return HSK_ENOMEM;
+
+    memcpy(buf, data, data_len);
+  }
+
+  if (!mock_peer_queue(peer, buf, data_len))
+    return HSK_EFAILURE;
+
+  return HSK_SUCCESS;
+}
+
+static uint8_t *
+mock_frame(uint8_t cmd, size_t size, uint8_t **body) {
+  uint8_t *data = malloc(9 + size);
+
+  if (!data)
+    return NULL;
+
+  uint8_t *p = data;
+
+  write_u32(&p, HSK_MAGIC);
+  write_u8(&p, cmd);
+  write_u32(&p, (uint32_t)size);
+
+  *body = p;
+
+  return data;
+}
+
+static bool
+mock_peer_send_frame(mock_peer_t *peer, uint8_t *data, size_t len) {
+  if (peer->brontide)
+    return hsk_brontide_write(peer->brontide, data, len) == HSK_SUCCESS;
+
+  return mock_peer_queue(peer, data, len);
+}
+
+static bool
+mock_peer_send(mock_peer_t *peer, const hsk_msg_t *msg) {
+  int size = hsk_msg_size(msg);
+  uint8_t *body;
+
+  assert(size >= 0);
+
+  uint8_t *data = mock_frame(msg->cmd, size, &body);
+
+  if (!data)
+    return false;
+
+  hsk_msg_write(msg, &body);
+
+  return mock_peer_send_frame(peer, data, 9 + size);
+}
+
+static bool
+mock_peer_send_headers(mock_peer_t *peer, uint32_t start, size_t count) {
+  size_t size = write_varsize(NULL, count);
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    size += hsk_header_size(mock.chain[start + i]);
+
+  uint8_t *body;
+  uint8_t *data = mock_frame(HSK_MSG_HEADERS, size, &body);
+
+  if (!data)
+    return false;
+
+  write_varsize(&body, count);
+
+  for (i = 0; i < count; i++)
+    hsk_header_write(mock.chain[start + i], &body);
+
+  mock.headers += count;
+
+  return mock_peer_send_frame(peer, data, 9 + size);
+}
+
+// Headers that are not on our chain.
+static bool
+mock_peer_send_header_list(
+  mock_peer_t *peer,
+  const hsk_header_t *headers,
+  size_t count
+) {
+  size_t size = write_varsize(NULL, count);
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    size += hsk_header_size(&headers[i]);
+
+  uint8_t *body;
+  uint8_t *data = mock_frame(HSK_MSG_HEADERS, size, &body);
+
+  if (!data)
+    return false;
+
+  write_varsize(&body, count);
+
+  for (i = 0; i < count; i++)
+    hsk_header_write(&headers[i], &body);
+
+  return mock_peer_send_frame(peer, data, 9 + size);
+}
+
+/*
+ * Handlers
+ */
+
+static void
+mock_log(const char *fmt, ...) {
+  double elapsed = (double)(uv_hrtime() - mock.start) / 1e9;
+  va_list args;
+
+  fprintf(stderr, "[%8.3f] ", elapsed);
+
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+static void
+mock_after_event(uv_timer_t *timer);
+
+static void
+mock_save_ticket(const mock_peer_t *peer) {
+  size_t size = sizeof(hsk_brontide_ticket_t);
+
+  if (mock.ticket_count == MOCK_TICKETS) {
+    memmove(&mock.tickets[0], &mock.tickets[1], (MOCK_TICKETS - 1) * size);
+    mock.ticket_count -= 1;
+  }
+
+  if (hsk_brontide_get_ticket(peer->brontide,
+                              &mock.tickets[mock.ticket_count])) {
+    mock.ticket_count += 1;
+  }
+}
+
+// Tickets are single use here too: a resumed
+// session saves the next one with its version.
+static bool
+mock_take_ticket(
+  const void *arg,
+  const uint8_t *id,
+  hsk_brontide_ticket_t *ticket
+) {
+  size_t size = sizeof(hsk_brontide_ticket_t);
+  size_t i;
+
+  for (i = 0; i < mock.ticket_count; i++) {
+    hsk_brontide_ticket_t *entry = &mock.tickets[i];
+
+    if (memcmp(entry->id, id, 32) != 0)
+      continue;
+
+    bool ok = hsk_now() < entry->time + HSK_BRONTIDE_TICKET_LIFETIME;
+
+    if (ok)
+      memcpy(ticket, entry, size);
+
+    mock.ticket_count -= 1;
+    memmove(entry, entry + 1, (mock.ticket_count - i) * size);
+    memset(&mock.tickets[mock.ticket_count], 0, size);
+
+    return ok;
+  }
+
+  return false;
+}
+
+static bool
+mock_handle_version(mock_peer_t *peer, const hsk_version_msg_t *msg) {
+  mock_log("peer %llu: %s (height %u)\n",
+           (unsigned long long)peer->id, msg->agent, msg->height);
+
+  struct sockaddr_storage ss;
+  int len = sizeof(ss);
+
+  hsk_version_msg_t res = { .cmd = HSK_MSG_VERSION };
+  hsk_msg_init((hsk_msg_t *)&res);
+
+  res.version = HSK_PROTO_VERSION;
+  res.services = 1;
+
+  if (peer->brontide) {
+    res.services |= HSK_SERVICE_RESUME;
+
+    if (msg->services & HSK_SERVICE_RESUME)
+      mock_save_ticket(peer);
+  }
+
+  res.time = (uint64_t)hsk_now();
+  res.nonce = hsk_nonce();
+  strcpy(res.agent, "/mock_hnsd:0.0.0/");
+  res.height = mock.height;
+
+  if (uv_tcp_getpeername(&peer->socket, (struct sockaddr *)&ss, &len) == 0)
+    hsk_addr_from_sa(&res.remote.addr, (struct sockaddr *)&ss);
+
+  hsk_verack_msg_t ack = { .cmd = HSK_MSG_VERACK };
+
+  peer->version = true;
+
+  return mock_peer_send(peer, (hsk_msg_t *)&res)
+      && mock_peer_send(peer, (hsk_msg_t *)&ack);
+}
+
+static bool
+mock_handle_getheaders(mock_peer_t *peer, const hsk_getheaders_msg_t *msg) {
+  uint64_t now = uv_hrtime();
+  uint32_t start = mock_chain_find(msg);
+  size_t count = mock.height - start;
+
+  if (count > MOCK_MAX_HEADERS)
+    count = MOCK_MAX_HEADERS;
+
+  if (mock.sync_start == 0)
+    mock.sync_start = now;
+
+  if (!mock_peer_send_headers(peer, start + 1, count))
+    return false;
+
+  // The first time someone catches up with
+  // us, kick off whatever happens next.
+  if (mock.sync_end == 0 && start + count == mock.height) {
+    mock.sync_end = now;
+    mock.sync_headers = mock.headers;
+
+    mock_log("peer %llu synced to %u\n",
+             (unsigned long long)peer->id, mock.height);
+
+    if (mock.scenario != MOCK_SYNC) {
+      uv_timer_start(&mock.event, mock_after_event,
+                     (uint64_t)(mock.delay * 1000), 0);
+    }
+  }
+
+  return true;
+}
+
+static bool
+mock_handle_getproof(mock_peer_t *peer, const hsk_getproof_msg_t *msg) {
+  const mock_tree_t *tree = mock_find_tree(msg->root);
+  uint64_t now = uv_hrtime();
+
+  // The genesis tree is empty, so anything asked
+  // of it before the first sync is a dead end.
+  bool genesis = memcmp(msg->root, mock.main[0].name_root, 32) == 0;
+
+  if (!tree && !genesis) {
+    mock.unknown_roots += 1;
+    return true;
+  }
+
+  if (mock.event_time && !mock.switch_time && tree == &mock.trees[1]) {
+    mock.switch_time = now;
+    mock_log("first proof request for the new root after %.1f ms\n",
+             (double)(now - mock.event_time) / 1e6);
+  }
+
+  hsk_proof_msg_t res = { .cmd = HSK_MSG_PROOF };
+  hsk_msg_init((hsk_msg_t *)&res);
+
+  memcpy(res.root, msg->root, 32);
+  memcpy(res.key, msg->key, 32);
+
+  bool ok = true;
+
+  if (tree)
+    ok = mock_tree_prove(tree, msg->key, &res.proof);
+
+  if (ok) {
+    if (mock.proof_start == 0)
+      mock.proof_start = now;
+
+    mock.proof_end = now;
+    mock.proofs += 1;
+    mock.proof_types[res.proof.type] += 1;
+
+    ok = mock_peer_send(peer, (hsk_msg_t *)&res);
+  }
+
+  hsk_proof_uninit(&res.proof);
+
+  return ok;
+}
+
+static bool
+mock_peer_handle(mock_peer_t *peer, const hsk_msg_t *msg) {
+  switch (msg->cmd) {
+    case HSK_MSG_VERSION: {
+      return mock_handle_version(peer, (const hsk_version_msg_t *)msg);
+    }
+    case HSK_MSG_PING: {
+      const hsk_ping_msg_t *ping = (const hsk_ping_msg_t *)msg;
+      hsk_pong_msg_t pong = { .cmd = HSK_MSG_PONG, .nonce = ping->nonce };
+      return mock_peer_send(peer, (hsk_msg_t *)&pong);
+    }
+    case HSK_MSG_GETHEADERS: {
+      return mock_handle_getheaders(peer, (const hsk_getheaders_msg_t *)msg);
+    }
+    case HSK_MSG_GETPROOF: {
+      return mock_handle_getproof(peer, (const hsk_getproof_msg_t *)msg);
+    }
+    default: {
+      // verack, sendheaders, getaddr and the rest need no reply.
+      return true;
+    }
+  }
+}
+
+static bool
+mock_known_cmd(uint8_t cmd) {
+  switch (cmd) {
+    case HSK_MSG_VERSION:
+    case HSK_MSG_VERACK:
+    case HSK_MSG_PING:
+    case HSK_MSG_PONG:
+    case HSK_MSG_GETADDR:
+    case HSK_MSG_ADDR:
+    case HSK_MSG_GETHEADERS:
+    case HSK_MSG_HEADERS:
+    case HSK_MSG_SENDHEADERS:
+    case HSK_MSG_GETPROOF:
+    case HSK_MSG_PROOF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool
+mock_peer_parse(mock_peer_t *peer) {
+  uint8_t *data = peer->msg;
+  size_t len = peer->msg_len;
+
+  if (!peer->msg_hdr) {
+    uint32_t magic, size;
+    uint8_t cmd;
+
+    assert(read_u32(&data, &len, &magic));
+    assert(read_u8(&data, &len, &cmd));
+    assert(read_u32(&data, &len, &size));
+
+    if (magic != HSK_MAGIC || size > HSK_MAX_MESSAGE)
+      return false;
+
+    if (size > peer->msg_cap) {
+      uint8_t *msg = realloc(peer->msg, size);
+
+      if (!msg)
+        return false;
+
+      peer->msg = msg;
+      peer->msg_cap = size;
+    }
+
+    peer->msg_hdr = true;
+    peer->msg_cmd = cmd;
+    peer->msg_pos = 0;
+    peer->msg_len = size;
+
+    return true;
+  }
+
+  peer->msg_hdr = false;
+  peer->msg_pos = 0;
+  peer->msg_len = 9;
+
+  if (!mock_known_cmd(peer->msg_cmd))
+    return true;
+
+  hsk_msg_t *msg = hsk_msg_alloc(peer->msg_cmd);
+
+  if (!msg)
+    return false;
+
+  bool ok = hsk_msg_decode(data, len, msg) && mock_peer_handle(peer, msg);
+
+  hsk_msg_free(msg);
+
+  return ok;
+}
+
+static void
+mock_peer_on_read(mock_peer_t *peer, const uint8_t *data, size_t data_len) {
+  while (!peer->closing) {
+    if (peer->msg_pos == peer->msg_len) {
+      if (!mock_peer_parse(peer))
+        mock_peer_close(peer);
+      continue;
+    }
+
+    if (data_len == 0)
+      break;
+
+    size_t need = peer->msg_len - peer->msg_pos;
+
+    if (need > data_len)
+      need = data_len;
+
+    memcpy(peer->msg + peer->msg_pos, data, need);
+
+    peer->msg_pos += need;
+    data += need;
+    data_len -= need;
+  }
+}
+
+static void
+mock_brontide_read(const void *arg, const uint8_t *data, size_t data_len) {
+  mock_peer_on_read((mock_peer_t *)arg, data, data_len);
+}
+
+/*
+ * Server
+ */
+
+static void
+mock_peer_after_close(uv_handle_t *handle) {
+  mock_peer_t *peer = (mock_peer_t *)handle->data;
+
+  if (--peer->handles > 0)
+    return;
+
+  while (peer->head) {
+    mock_write_t *w = peer->head;
+    peer->head = w->next;
+    free(w->data);
+    free(w);
+  }
+
+  if (peer->brontide) {
+    hsk_brontide_uninit(peer->brontide);
+    free(peer->brontide);
+  }
+
+  free(peer->msg);
+  free(peer);
+}
+
+static void
+mock_peer_close(mock_peer_t *peer) {
+  if (peer->closing)
+    return;
+
+  peer->closing = true;
+
+  mock_peer_t **pp = &mock.peers;
+
+  while (*pp != peer)
+    pp = &(*pp)->next;
+
+  *pp = peer->next;
+
+  mock_log("peer %llu: closed\n", (unsigned long long)peer->id);
+
+  uv_close((uv_handle_t *)&peer->timer, mock_peer_after_close);
+  uv_close((uv_handle_t *)&peer->socket, mock_peer_after_close);
+}
+
+static void
+mock_alloc(uv_handle_t *handle, size_t size, uv_buf_t *buf) {
+  static char slab[MOCK_BUFFER_SIZE];
+  buf->base = slab;
+  buf->len = sizeof(slab);
+}
+
+static void
+mock_after_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+  mock_peer_t *peer = (mock_peer_t *)stream->data;
+
+  if (nread < 0) {
+    mock_peer_close(peer);
+    return;
+  }
+
+  if (peer->brontide) {
+    int rc = hsk_brontide_on_read(peer->brontide,
+                                  (const uint8_t *)buf->base, nread);
+
+    if (rc != HSK_SUCCESS)
+      mock_peer_close(peer);
+
+    return;
+  }
+
+  mock_peer_on_read(peer, (const uint8_t *)buf->base, nread);
+}
+
+static void
+mock_on_connection(uv_stream_t *server, int status) {
+  if (status != 0 || mock.stopping)
+    return;
+
+  mock_peer_t *peer = calloc(1, sizeof(mock_peer_t));
+
+  if (!peer)
+    return;
+
+  peer->id = mock.next_id++;
+  peer->msg_len = 9;
+  peer->msg_cap = 4096;
+  peer->msg = malloc(peer->msg_cap);
+
+  if (!peer->msg) {
+    free(peer);
+    return;
+  }
+
+  uv_tcp_init(mock.loop, &peer->socket);
+  uv_timer_init(mock.loop, &peer->timer);
+
+  peer->socket.data = (void *)peer;
+  peer->timer.data = (void *)peer;
+  peer->handles = 2;
+  peer->next = mock.peers;
+  mock.peers = peer;
+
+  if (uv_accept(server, (uv_stream_t *)&peer->socket) != 0) {
+    mock_peer_close(peer);
+    return;
+  }
+
+  uv_tcp_nodelay(&peer->socket, 1);
+
+  struct sockaddr_storage ss;
+  int len = sizeof(ss);
+
+  if (uv_tcp_getpeername(&peer->socket, (struct sockaddr *)&ss, &len) == 0)
+    hsk_sa_to_string((struct sockaddr *)&ss, peer->host, HSK_MAX_HOST, 0);
+
+  mock_log("peer %llu: connected from %s\n",
+           (unsigned long long)peer->id, peer->host);
+
+  if (mock.use_brontide) {
+    peer->brontide = malloc(sizeof(hsk_brontide_t));
+
+    if (!peer->brontide) {
+      mock_peer_close(peer);
+      return;
+    }
+
+    hsk_brontide_init(peer->brontide, mock.ec);
+    peer->brontide->connect_cb = mock_brontide_connect;
+    peer->brontide->connect_arg = (void *)peer;
+    peer->brontide->write_cb = mock_brontide_write;
+    peer->brontide->write_arg = (void *)peer;
+    peer->brontide->read_cb = mock_brontide_read;
+    peer->brontide->read_arg = (void *)peer;
+    peer->brontide->ticket_cb = mock_take_ticket;
+    peer->brontide->ticket_arg = NULL;
+
+    if (hsk_brontide_accept(peer->brontide, mock.key) != HSK_SUCCESS) {
+      mock_peer_close(peer);
+      return;
+    }
+  }
+
+  if (uv_read_start((uv_stream_t *)&peer->socket, mock_alloc,
+                    mock_after_read) != 0) {
+    mock_peer_close(peer);
+  }
+}
+
+#if HSK_NETWORK == HSK_REGTEST
+// A chain of headers off a parent no one has, different every time.
+static void
+mock_mine_orphans(hsk_header_t *headers, size_t count) {
+  static uint64_t batch = 0;
+  const hsk_header_t *tip = mock.chain[mock.height];
+  hsk_header_t parent;
+  uint8_t *p = parent.hash;
+
+  hsk_header_init(&parent);
+  memset(parent.hash, 0xff, 32);
+  write_u64(&p, ++batch);
+
+  // Old enough that none of them is too new.
+  parent.time = (uint64_t)time(NULL) - (count + 1) * HSK_TARGET_SPACING;
+  parent.height = tip->height;
+
+  const hsk_header_t *prev = &parent;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    mock_mine(&headers[i], prev, tip->name_root, 0);
+    prev = &headers[i];
+  }
+}
+#endif
+
+static void
+mock_after_flood(uv_timer_t *timer) {
+#if HSK_NETWORK == HSK_REGTEST
+  static hsk_header_t headers[MOCK_MAX_HEADERS];
+
+  mock_mine_orphans(headers, MOCK_MAX_HEADERS);
+
+  mock_peer_t *peer, *next;
+
+  for (peer = mock.peers; peer; peer = next) {
+    next = peer->next;
+
+    if (!peer->version)
+      continue;
+
+    if (!mock_peer_send_header_list(peer, headers, MOCK_MAX_HEADERS)) {
+      mock_peer_close(peer);
+      continue;
+    }
+
+    mock.orphans += MOCK_MAX_HEADERS;
+  }
+#endif
+}
+
+static void
+mock_after_event(uv_timer_t *timer) {
+  if (mock.scenario == MOCK_ORPHANS) {
+    mock.event_time = uv_hrtime();
+    mock_log("orphans: sending %d every %d ms\n",
+             MOCK_MAX_HEADERS, MOCK_FLOOD_INTERVAL);
+    uv_timer_start(&mock.event, mock_after_flood, 0, MOCK_FLOOD_INTERVAL);
+    return;
+  }
+
+  if (mock.scenario == MOCK_RESUME) {
+    mock.event_time = uv_hrtime();
+
+    mock_peer_t *peer, *next;
+
+    for (peer = mock.peers; peer; peer = next) {
+      next = peer->next;
+
+      if (!peer->version)
+        continue;
+
+      mock.dropped += 1;
+      mock_peer_close(peer);
+    }
+
+    mock_log("resume: dropped %llu peers with %zu tickets\n",
+             (unsigned long long)mock.dropped, mock.ticket_count);
+    return;
+  }
+
+  const mock_branch_t *branch = mock.scenario == MOCK_REORG
+    ? &mock.branches[0]
+    : &mock.branches[1];
+
+  mock_chain_switch(branch);
+
+  mock.event_time = uv_hrtime();
+
+  mock_log("%s: announcing %zu headers after height %u\n",
+           mock_scenarios[mock.scenario], branch->count, branch->parent);
+
+  // hnsd sent sendheaders, so it takes
+  // unsolicited headers as announcements.
+  mock_peer_t *peer, *next;
+
+  for (peer = mock.peers; peer; peer = next) {
+    next = peer->next;
+
+    if (!peer->version)
+      continue;
+
+    if (!mock_peer_send_headers(peer, branch->parent + 1, branch->count))
+      mock_peer_close(peer);
+  }
+}
+
+static void
+mock_close_handle(uv_handle_t *handle) {}
+
+static void
+mock_stop(void) {
+  if (mock.stopping)
+    return;
+
+  mock.stopping = true;
+
+  while (mock.peers)
+    mock_peer_close(mock.peers);
+
+  uv_close((uv_handle_t *)&mock.server, mock_close_handle);
+  uv_close((uv_handle_t *)&mock.event, mock_close_handle);
+  uv_close((uv_handle_t *)&mock.stop, mock_close_handle);
+  uv_close((uv_handle_t *)&mock.sigint, mock_close_handle);
+  uv_close((uv_handle_t *)&mock.sigterm, mock_close_handle);
+}
+
+static void
+mock_after_stop(uv_timer_t *timer) {
+  mock_stop();
+}
+
+static void
+mock_after_signal(uv_signal_t *signal, int signum) {
+  mock_stop();
+}
+
+/*
+ * Reporting
+ */
+
+static double
+mock_rate(uint64_t count, uint64_t start, uint64_t end) {
+  if (count == 0 || end <= start)
+    return 0;
+
+  return (double)count / ((double)(end - start) / 1e9);
+}
+
+static void
+mock_report(void) {
+  FILE *out = mock.json ? stderr : stdout;
+  double sync_secs = (double)(mock.sync_end - mock.sync_start) / 1e9;
+  double proof_secs = (double)(mock.proof_end - mock.proof_start) / 1e9;
+  double headers_rate = mock_rate(mock.sync_headers, mock.sync_start,
+                                  mock.sync_end);
+  double proofs_rate = mock_rate(mock.proofs, mock.proof_start,
+                                 mock.proof_end);
+  double switch_ms = -1;
+
+  if (mock.sync_end == 0)
+    sync_secs = 0;
+
+  if (mock.switch_time)
+    switch_ms = (double)(mock.switch_time - mock.event_time) / 1e6;
+
+  fprintf(out, "scenario:     %s\n", mock_scenarios[mock.scenario]);
+  fprintf(out, "headers:      %llu in %.3f s (%.1f/sec)%s\n",
+          (unsigned long long)mock.sync_headers, sync_secs, headers_rate,
+          mock.sync_end ? "" : ", never synced");
+  fprintf(out, "proofs:       %llu in %.3f s (%.1f/sec)\n",
+          (unsigned long long)mock.proofs, proof_secs, proofs_rate);
+  fprintf(out, "  exists %llu, collision %llu, short %llu, deadend %llu\n",
+          (unsigned long long)mock.proof_types[HSK_PROOF_EXISTS],
+          (unsigned long long)mock.proof_types[HSK_PROOF_COLLISION],
+          (unsigned long long)mock.proof_types[HSK_PROOF_SHORT],
+          (unsigned long long)mock.proof_types[HSK_PROOF_DEADEND]);
+
+  if (mock.unknown_roots > 0) {
+    fprintf(out, "unknown roots: %llu\n",
+            (unsigned long long)mock.unknown_roots);
+  }
+
+  if (mock.scenario == MOCK_REORG || mock.scenario == MOCK_FLIP) {
+    if (switch_ms >= 0)
+      fprintf(out, "switch:       %.1f ms to the new root\n", switch_ms);
+    else
+      fprintf(out, "switch:       never saw the new root\n");
+  }
+
+  if (mock.scenario == MOCK_ORPHANS) {
+    fprintf(out, "orphans:      %llu sent\n",
+            (unsigned long long)mock.orphans);
+  }
+
+  if (mock.scenario == MOCK_RESUME) {
+    fprintf(out, "resumed:      %llu of %llu reconnects (%llu dropped)\n",
+            (unsigned long long)mock.resumed,
+            (unsigned long long)mock.reconnects,
+            (unsigned long long)mock.dropped);
+  }
+
+  fprintf(out, "sent:         %llu bytes\n", (unsigned long long)mock.bytes);
+
+  if (!mock.json)
+    return;
+
+  printf("{\n");
+  printf("  \"version\": 1,\n");
+  printf("  \"network\": \"%s\",\n", HSK_NETWORK_NAME);
+  printf("  \"scenario\": \"%s\",\n", mock_scenarios[mock.scenario]);
+  printf("  \"height\": %u,\n", (unsigned int)(mock.main_count - 1));
+  printf("  \"names\": %zu,\n", mock.trees[0].leaf_count);
+  printf("  \"latency_ms\": %.3f,\n", (double)mock.latency / 1e6);
+  printf("  \"bandwidth\": %llu,\n", (unsigned long long)mock.bandwidth);
+  printf("  \"brontide\": %s,\n", mock.use_brontide ? "true" : "false");
+  printf("  \"headers\": { \"count\": %llu, \"seconds\": %.6f, "
+         "\"per_sec\": %.1f },\n",
+         (unsigned long long)mock.sync_headers, sync_secs, headers_rate);
+  printf("  \"proofs\": { \"count\": %llu, \"seconds\": %.6f, "
+         "\"per_sec\": %.1f,\n",
+         (unsigned long long)mock.proofs, proof_secs, proofs_rate);
+  printf("              \"exists\": %llu, \"collision\": %llu, "
+         "\"short\": %llu, \"deadend\": %llu },\n",
+         (unsigned long long)mock.proof_types[HSK_PROOF_EXISTS],
+         (unsigned long long)mock.proof_types[HSK_PROOF_COLLISION],
+         (unsigned long long)mock.proof_types[HSK_PROOF_SHORT],
+         (unsigned long long)mock.proof_types[HSK_PROOF_DEADEND]);
+  printf("  \"unknown_roots\": %llu,\n",
+         (unsigned long long)mock.unknown_roots);
+
+  if (switch_ms >= 0)
+    printf("  \"switch_ms\": %.3f,\n", switch_ms);
+  else
+    printf("  \"switch_ms\": null,\n");
+
+  printf("  \"orphans\": %llu,\n", (unsigned long long)mock.orphans);
+  printf("  \"reconnects\": %llu,\n", (unsigned long long)mock.reconnects);
+  printf("  \"resumed\": %llu,\n", (unsigned long long)mock.resumed);
+  printf("  \"bytes_sent\": %llu\n", (unsigned long long)mock.bytes);
+  printf("}\n");
+}
+
+/*
+ * Main
+ */
+
+static void
+help(int r) {
+  fprintf(stderr,
+    "\n"
+    "mock_hnsd [options]\n"
+    "\n"
+    "  -g, --generate <height>\n"
+    "    Generate a chain of this height (regtest builds only).\n"
+    "\n"
+    "  -N, --names <count>\n"
+    "    Names in the generated tree (default: 1000).\n"
+    "\n"
+    "  -R, --reorg-depth <blocks>\n"
+    "    Blocks replaced by the generated fork (default: %d).\n"
+    "\n"
+    "  -l, --load <file>\n"
+    "    Serve a dataset saved with --save.\n"
+    "\n"
+    "  -w, --save <file>\n"
+    "    Save the dataset and exit.\n"
+    "\n"
+    "  -Q, --query-log <file>\n"
+    "    Write the names as a query log for load_hnsd.\n"
+    "\n"
+    "  -p, --listen <ip[:port]>\n"
+    "    Address to listen on (default: 127.0.0.1:%d).\n"
+    "\n"
+    "  -k, --identity-key <hex-string>\n"
+    "    Serve over brontide with this private key.\n"
+    "\n"
+    "  -S, --scenario <sync|reorg|flip|orphans|resume>\n"
+    "    What to do once a peer has synced (default: sync).\n"
+    "\n"
+    "  -e, --delay <seconds>\n"
+    "    How long after the sync to start the scenario (default: 2).\n"
+    "\n"
+    "  -L, --latency <ms>\n"
+    "    Delay every message we send by this much.\n"
+    "\n"
+    "  -B, --bandwidth <bytes/sec>\n"
+    "    Limit how fast we send to each peer.\n"
+    "\n"
+    "  -d, --duration <seconds>\n"
+    "    Exit and report after this long (default: when interrupted).\n"
+    "\n"
+    "  -j, --json\n"
+    "    Print results as JSON to stdout (the summary goes to stderr).\n"
+    "\n"
+    "  -h, --help\n"
+    "    This help message.\n"
+    "\n",
+    HSK_TREE_INTERVAL * 2,
+    HSK_PORT
+  );
+
+  exit(r);
+}
+
+int
+main(int argc, char **argv) {
+  const static char *optstring = "g:N:R:l:w:Q:p:k:S:e:L:B:d:jh";
+
+  const static struct option longopts[] = {
+    { "generate", required_argument, NULL, 'g' },
+    { "names", required_argument, NULL, 'N' },
+    { "reorg-depth", required_argument, NULL, 'R' },
+    { "load", required_argument, NULL, 'l' },
+    { "save", required_argument, NULL, 'w' },
+    { "query-log", required_argument, NULL, 'Q' },
+    { "listen", required_argument, NULL, 'p' },
+    { "identity-key", required_argument, NULL, 'k' },
+    { "scenario", required_argument, NULL, 'S' },
+    { "delay", required_argument, NULL, 'e' },
+    { "latency", required_argument, NULL, 'L' },
+    { "bandwidth", required_argument, NULL, 'B' },
+    { "duration", required_argument, NULL, 'd' },
+    { "json", no_argument, NULL, 'j' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  uint32_t generate = 0;
+  size_t names = 1000;
+  uint32_t depth = 0;
+  const char *load_file = NULL;
+  const char *save_file = NULL;
+  const char *query_file = NULL;
+  const char *host = "127.0.0.1";
+  const char *key = NULL;
+  const char *scenario = "sync";
+  int i;
+
+  mock.delay = 2;
+
+  for (;;) {
+    int o = getopt_long(argc, argv, optstring, longopts, NULL);
+
+    if (o == -1)
+      break;
+
+    switch (o) {
+      case 'g':
+        generate = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'N':
+        names = (size_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'R':
+        depth = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        load_file = optarg;
+        break;
+      case 'w':
+        save_file = optarg;
+        break;
+      case 'Q':
+        query_file = optarg;
+        break;
+      case 'p':
+        host = optarg;
+        break;
+      case 'k':
+        key = optarg;
+        break;
+      case 'S':
+        scenario = optarg;
+        break;
+      case 'e':
+        mock.delay = atof(optarg);
+        break;
+      case 'L':
+        mock.latency = (uint64_t)(atof(optarg) * 1e6);
+        break;
+      case 'B':
+        mock.bandwidth = strtoull(optarg, NULL, 10);
+        break;
+      case 'd':
+        mock.duration = atof(optarg);
+        break;
+      case 'j':
+        mock.json = true;
+        break;
+      case 'h':
+        help(0);
+        break;
+      default:
+        help(1);
+        break;
+    }
+  }
+
+  if (optind != argc || (generate == 0) == (load_file == NULL))
+    help(1);
+
+  for (i = 0; i < MOCK_SCENARIOS; i++) {
+    if (strcmp(scenario, mock_scenarios[i]) == 0)
+      break;
+  }
+
+  if (i == MOCK_SCENARIOS || mock.delay < 0 || mock.duration < 0)
+    help(1);
+
+#if HSK_NETWORK != HSK_REGTEST
+  if (i == MOCK_ORPHANS) {
+    fprintf(stderr,
+      "the orphans scenario needs a regtest build (--with-network=regtest)\n");
+    return 1;
+  }
+#endif
+
+  if (i == MOCK_RESUME && !key) {
+    fprintf(stderr, "the resume scenario needs brontide (--identity-key)\n");
+    return 1;
+  }
+
+  mock.scenario = i;
+  mock.start = uv_hrtime();
+
+  bool ok = generate
+    ? mock_generate(generate, names, depth)
+    : mock_load(load_file);
+
+  if (!ok) {
+    mock_dataset_free();
+    return 1;
+  }
+
+  mock_log("chain: height %u, %zu names, root %s\n",
+           (unsigned int)(mock.main_count - 1),
+           mock.trees[0].leaf_count,
+           hsk_hex_encode32(mock.trees[0].root_hash));
+
+  if (query_file && !mock_save_queries(query_file)) {
+    mock_dataset_free();
+    return 1;
+  }
+
+  if (save_file) {
+    ok = mock_save(save_file);
+    mock_dataset_free();
+    return ok ? 0 : 1;
+  }
+
+  struct sockaddr_storage addr;
+
+  if (key) {
+    if (hsk_hex_decode_size(key) != 32 || !hsk_hex_decode(key, mock.key))
+      help(1);
+
+    mock.use_brontide = true;
+  }
+
+  uint16_t port = mock.use_brontide ? HSK_BRONTIDE_PORT : HSK_PORT;
+
+  if (!hsk_sa_from_string((struct sockaddr *)&addr, host, port))
+    help(1);
+
+  if (!mock_chain_init()) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  mock.ec = hsk_ec_alloc();
+
+  if (!mock.ec)
+    return 1;
+
+  if (mock.use_brontide) {
+    uint8_t pub[33];
+    char pub32[64];
+
+    if (!hsk_ec_create_pubkey(mock.ec, mock.key, pub)) {
+      fprintf(stderr, "invalid identity key\n");
+      return 1;
+    }
+
+    hsk_base32_encode(pub, sizeof(pub), pub32, false);
+
+    mock_log("identity key: %s\n", pub32);
+  }
+
+  mock.loop = uv_default_loop();
+
+  uv_tcp_init(mock.loop, &mock.server);
+  uv_timer_init(mock.loop, &mock.event);
+  uv_timer_init(mock.loop, &mock.stop);
+  uv_signal_init(mock.loop, &mock.sigint);
+  uv_signal_init(mock.loop, &mock.sigterm);
+
+  int rc = uv_tcp_bind(&mock.server, (struct sockaddr *)&addr, 0);
+
+  if (rc == 0)
+    rc = uv_listen((uv_stream_t *)&mock.server, 16, mock_on_connection);
+
+  if (rc != 0) {
+    fprintf(stderr, "could not listen on %s: %s\n", host, uv_strerror(rc));
+    return 1;
+  }
+
+  uv_signal_start(&mock.sigint, mock_after_signal, SIGINT);
+  uv_signal_start(&mock.sigterm, mock_after_signal, SIGTERM);
+
+  if (mock.duration > 0) {
+    uv_timer_start(&mock.stop, mock_after_stop,
+                   (uint64_t)(mock.duration * 1000), 0);
+  }
+
+  char name[HSK_MAX_HOST];
+
+  hsk_sa_to_string((struct sockaddr *)&addr, name, sizeof(name), port);
+
+  mock_log("listening on %s (%s)\n", name, HSK_NETWORK_NAME);
+
+  uv_run(mock.loop, UV_RUN_DEFAULT);
+
+  mock_report();
+
+  hsk_map_uninit(&mock.hashes);
+  hsk_ec_free(mock.ec);
+  free(mock.chain);
+  mock_dataset_free();
+
+  uv_loop_close(mock.loop);
+
+  return 0;
+}